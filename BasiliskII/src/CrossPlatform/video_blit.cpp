@@ -28,6 +28,45 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// SIMD blitters are selected at run-time on x86, NEON is always available on AArch64
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__i386__) || defined(__x86_64__)
+#define VIDEO_BLIT_X86 1
+#include <immintrin.h>
+#define BLIT_TARGET_SSE2 __attribute__((target("sse2")))
+#define BLIT_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+#define VIDEO_BLIT_NEON 1
+#include <arm_neon.h>
+#define BLIT_TARGET_NEON
+#endif
+#endif
+
+#if VIDEO_BLIT_X86 || VIDEO_BLIT_NEON
+typedef uint64 blit_vec128 __attribute__((vector_size(16)));
+typedef uint64 blit_vec256 __attribute__((vector_size(32)));
+
+#define FB_CONCAT_(a, b) a##b
+#define FB_CONCAT(a, b) FB_CONCAT_(a, b)
+
+// Define a blitter that converts whole vectors with FB_BLIT_4, the tail is left to FB_FUNC_NAME
+#define FB_VECTOR_BLITTER(NAME, VECTOR, TARGET)								\
+static TARGET void NAME(uint8 * dest, const uint8 * source, uint32 length)	\
+{																			\
+	for (; length >= sizeof(VECTOR); length -= sizeof(VECTOR)) {			\
+		VECTOR s, d;														\
+		memcpy(&s, source, sizeof(s));										\
+		FB_BLIT_4(d, s);													\
+		memcpy(dest, &d, sizeof(d));										\
+		source += sizeof(VECTOR);											\
+		dest += sizeof(VECTOR);												\
+	}																		\
+	if (length)																\
+		FB_FUNC_NAME(dest, source, length);									\
+}
+#endif
 
 // Format of the target visual
 static VisualFormat visualFormat;
@@ -468,6 +507,424 @@ static void Blit_Expand_8_To_32(uint8 * dest, const uint8 * p, uint32 length)
 		*q++ = ExpandMap[*p++];
 }
 
+/* -------------------------------------------------------------------------- */
+/* --- SIMD variants of the indexed mode expansions                       --- */
+/* -------------------------------------------------------------------------- */
+
+// The trailing pixels of each line are left to the portable blitters. The
+// SSE2/NEON variants expand bits into masks; the AVX2 variants also look up
+// the ExpandMap[] with gathers, with the same indices as the scalar code.
+
+#ifdef VIDEO_BLIT_X86
+
+// Set each byte to 0xff where its bit is set in a source byte replicated 8 times
+static inline BLIT_TARGET_SSE2 __m128i sse2_bit_mask_8(__m128i v)
+{
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	return _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+}
+
+// Replicate each of the 8 low bytes of x 8 times, into 4 vectors
+static inline BLIT_TARGET_SSE2 void sse2_spread_bytes_8(__m128i x, __m128i v[4])
+{
+	x = _mm_unpacklo_epi8(x, x);
+	const __m128i lo = _mm_unpacklo_epi16(x, x);
+	const __m128i hi = _mm_unpackhi_epi16(x, x);
+	v[0] = _mm_unpacklo_epi32(lo, lo);
+	v[1] = _mm_unpackhi_epi32(lo, lo);
+	v[2] = _mm_unpacklo_epi32(hi, hi);
+	v[3] = _mm_unpackhi_epi32(hi, hi);
+}
+
+#if !(REAL_ADDRESSING || DIRECT_ADDRESSING || USE_SDL_VIDEO)
+static BLIT_TARGET_SSE2 void Blit_Expand_1_To_8_Color_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m128i *q = (__m128i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		__m128i v[4];
+		sse2_spread_bytes_8(_mm_loadl_epi64((const __m128i *)p), v);
+		for (int i = 0; i < 4; i++)
+			_mm_storeu_si128(q++, _mm_andnot_si128(sse2_bit_mask_8(v[i]), _mm_set1_epi8(-1)));
+	}
+	if (length)
+		Blit_Expand_1_To_8_Color((uint8 *)q, p, length);
+}
+#endif
+
+static BLIT_TARGET_SSE2 void Blit_Expand_1_To_8_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i ones = _mm_set1_epi8(1);
+	__m128i *q = (__m128i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		__m128i v[4];
+		sse2_spread_bytes_8(_mm_loadl_epi64((const __m128i *)p), v);
+		for (int i = 0; i < 4; i++)
+			_mm_storeu_si128(q++, _mm_and_si128(sse2_bit_mask_8(v[i]), ones));
+	}
+	if (length)
+		Blit_Expand_1_To_8((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_SSE2 void Blit_Expand_2_To_8_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i mask = _mm_set1_epi8(3);
+	__m128i *q = (__m128i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const __m128i x = _mm_loadl_epi64((const __m128i *)p);
+		const __m128i a = _mm_and_si128(_mm_srli_epi16(x, 6), mask);
+		const __m128i b = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+		const __m128i c = _mm_and_si128(_mm_srli_epi16(x, 2), mask);
+		const __m128i d = _mm_and_si128(x, mask);
+		const __m128i ab = _mm_unpacklo_epi8(a, b);
+		const __m128i cd = _mm_unpacklo_epi8(c, d);
+		_mm_storeu_si128(q++, _mm_unpacklo_epi16(ab, cd));
+		_mm_storeu_si128(q++, _mm_unpackhi_epi16(ab, cd));
+	}
+	if (length)
+		Blit_Expand_2_To_8((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_SSE2 void Blit_Expand_4_To_8_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i *q = (__m128i *)dest;
+	for (; length >= 16; length -= 16, p += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)p);
+		const __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+		const __m128i lo = _mm_and_si128(x, mask);
+		_mm_storeu_si128(q++, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128(q++, _mm_unpackhi_epi8(hi, lo));
+	}
+	if (length)
+		Blit_Expand_4_To_8((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_SSE2 void Blit_Expand_1_To_16_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i bits = _mm_set_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+	__m128i *q = (__m128i *)dest;
+	for (; length > 0; length--) {
+		const __m128i v = _mm_and_si128(_mm_set1_epi16(*p++), bits);
+		_mm_storeu_si128(q++, _mm_cmpeq_epi16(v, bits));
+	}
+}
+
+static BLIT_TARGET_SSE2 void Blit_Expand_1_To_32_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i bits_hi = _mm_set_epi32(16, 32, 64, 128);
+	const __m128i bits_lo = _mm_set_epi32(1, 2, 4, 8);
+	__m128i *q = (__m128i *)dest;
+	for (; length > 0; length--) {
+		const __m128i v = _mm_set1_epi32(*p++);
+		_mm_storeu_si128(q++, _mm_cmpeq_epi32(_mm_and_si128(v, bits_hi), bits_hi));
+		_mm_storeu_si128(q++, _mm_cmpeq_epi32(_mm_and_si128(v, bits_lo), bits_lo));
+	}
+}
+
+// Look up 8 ExpandMap[] entries at once
+static inline BLIT_TARGET_AVX2 __m256i avx2_expand_map(__m256i index)
+{
+	return _mm256_i32gather_epi32((const int *)ExpandMap, index, 4);
+}
+
+// Truncate two vectors of 32-bit pixels to one vector of 16-bit pixels, in order
+static inline BLIT_TARGET_AVX2 __m256i avx2_pack_16(__m256i a, __m256i b)
+{
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	const __m256i v = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+	return _mm256_permute4x64_epi64(v, 0xd8);
+}
+
+// Compute the ExpandMap[] indices for 8 pixels of a 2-bit (k < 4) or a 4-bit (k < 2) source
+// The 8 source bytes are zero-extended into 32-bit elements of x
+static inline BLIT_TARGET_AVX2 __m256i avx2_index_2(__m256i x, int k)
+{
+	const __m256i sel = _mm256_setr_epi32(2*k, 2*k, 2*k, 2*k, 2*k+1, 2*k+1, 2*k+1, 2*k+1);
+	return _mm256_srlv_epi32(_mm256_permutevar8x32_epi32(x, sel), _mm256_setr_epi32(6, 4, 2, 0, 6, 4, 2, 0));
+}
+
+static inline BLIT_TARGET_AVX2 __m256i avx2_index_4(__m256i x, int k)
+{
+	const __m256i sel = _mm256_setr_epi32(4*k, 4*k, 4*k+1, 4*k+1, 4*k+2, 4*k+2, 4*k+3, 4*k+3);
+	return _mm256_srlv_epi32(_mm256_permutevar8x32_epi32(x, sel), _mm256_setr_epi32(4, 0, 4, 0, 4, 0, 4, 0));
+}
+
+#if !(REAL_ADDRESSING || DIRECT_ADDRESSING || USE_SDL_VIDEO)
+static BLIT_TARGET_AVX2 void Blit_Expand_1_To_8_Color_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i bits = _mm256_setr_epi8(
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+	const __m256i sel = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 4; length -= 4, p += 4) {
+		uint32 c;
+		memcpy(&c, p, sizeof(c));
+		const __m256i v = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32(c), sel), bits);
+		_mm256_storeu_si256(q++, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+	}
+	if (length)
+		Blit_Expand_1_To_8_Color((uint8 *)q, p, length);
+}
+#endif
+
+static BLIT_TARGET_AVX2 void Blit_Expand_1_To_8_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i bits = _mm256_setr_epi8(
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+	const __m256i sel = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i ones = _mm256_set1_epi8(1);
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 4; length -= 4, p += 4) {
+		uint32 c;
+		memcpy(&c, p, sizeof(c));
+		const __m256i v = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32(c), sel), bits);
+		_mm256_storeu_si256(q++, _mm256_and_si256(_mm256_cmpeq_epi8(v, bits), ones));
+	}
+	if (length)
+		Blit_Expand_1_To_8((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_2_To_8_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i mask = _mm256_set1_epi8(3);
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 16; length -= 16, p += 16) {
+		// Bytes 0-7 go to the low lane, bytes 8-15 to the high lane
+		const __m256i x = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)), 0x50);
+		const __m256i a = _mm256_and_si256(_mm256_srli_epi16(x, 6), mask);
+		const __m256i b = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+		const __m256i c = _mm256_and_si256(_mm256_srli_epi16(x, 2), mask);
+		const __m256i d = _mm256_and_si256(x, mask);
+		const __m256i ab = _mm256_unpacklo_epi8(a, b);
+		const __m256i cd = _mm256_unpacklo_epi8(c, d);
+		const __m256i lo = _mm256_unpacklo_epi16(ab, cd);
+		const __m256i hi = _mm256_unpackhi_epi16(ab, cd);
+		_mm256_storeu_si256(q++, _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(q++, _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	if (length)
+		Blit_Expand_2_To_8((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_4_To_8_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 16; length -= 16, p += 16) {
+		const __m256i x = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)), 0x50);
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+		const __m256i lo = _mm256_and_si256(x, mask);
+		_mm256_storeu_si256(q++, _mm256_unpacklo_epi8(hi, lo));
+	}
+	if (length)
+		Blit_Expand_4_To_8((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_1_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	// Each 16-bit element holds the source byte twice, only the low byte is tested
+	const __m256i bits = _mm256_setr_epi16(128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1);
+	const __m256i sel_01 = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1);
+	const __m256i sel_23 = _mm256_add_epi8(sel_01, _mm256_set1_epi8(2));
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 4; length -= 4, p += 4) {
+		uint32 c;
+		memcpy(&c, p, sizeof(c));
+		const __m256i x = _mm256_set1_epi32(c);
+		const __m256i v01 = _mm256_and_si256(_mm256_shuffle_epi8(x, sel_01), bits);
+		const __m256i v23 = _mm256_and_si256(_mm256_shuffle_epi8(x, sel_23), bits);
+		_mm256_storeu_si256(q++, _mm256_cmpeq_epi16(v01, bits));
+		_mm256_storeu_si256(q++, _mm256_cmpeq_epi16(v23, bits));
+	}
+	if (length)
+		Blit_Expand_1_To_16((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_1_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i bits = _mm256_setr_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+	__m256i *q = (__m256i *)dest;
+	for (; length > 0; length--) {
+		const __m256i v = _mm256_and_si256(_mm256_set1_epi32(*p++), bits);
+		_mm256_storeu_si256(q++, _mm256_cmpeq_epi32(v, bits));
+	}
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_2_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+		_mm256_storeu_si256(q++, avx2_pack_16(avx2_expand_map(avx2_index_2(x, 0)), avx2_expand_map(avx2_index_2(x, 1))));
+		_mm256_storeu_si256(q++, avx2_pack_16(avx2_expand_map(avx2_index_2(x, 2)), avx2_expand_map(avx2_index_2(x, 3))));
+	}
+	if (length)
+		Blit_Expand_2_To_16((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_4_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+		_mm256_storeu_si256(q++, avx2_pack_16(avx2_expand_map(avx2_index_4(x, 0)), avx2_expand_map(avx2_index_4(x, 1))));
+	}
+	if (length)
+		Blit_Expand_4_To_16((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_8_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 16; length -= 16, p += 16) {
+		const __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+		const __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p + 8)));
+		_mm256_storeu_si256(q++, avx2_pack_16(avx2_expand_map(a), avx2_expand_map(b)));
+	}
+	if (length)
+		Blit_Expand_8_To_16((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_2_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+		for (int k = 0; k < 4; k++)
+			_mm256_storeu_si256(q++, avx2_expand_map(avx2_index_2(x, k)));
+	}
+	if (length)
+		Blit_Expand_2_To_32((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_4_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+		_mm256_storeu_si256(q++, avx2_expand_map(avx2_index_4(x, 0)));
+		_mm256_storeu_si256(q++, avx2_expand_map(avx2_index_4(x, 1)));
+	}
+	if (length)
+		Blit_Expand_4_To_32((uint8 *)q, p, length);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_8_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	__m256i *q = (__m256i *)dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+		_mm256_storeu_si256(q++, avx2_expand_map(x));
+	}
+	if (length)
+		Blit_Expand_8_To_32((uint8 *)q, p, length);
+}
+
+#endif
+
+#ifdef VIDEO_BLIT_NEON
+
+// Replicate source byte pairs 8 times each, vtst then yields 0xff for set bits
+static const uint8 neon_bits_8[16] = { 128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1 };
+static const uint8 neon_spread_8[4][16] = {
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1 },
+	{ 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 },
+	{ 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5 },
+	{ 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7 }
+};
+
+#if !(REAL_ADDRESSING || DIRECT_ADDRESSING || USE_SDL_VIDEO)
+static void Blit_Expand_1_To_8_Color_NEON(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint8x16_t bits = vld1q_u8(neon_bits_8);
+	uint8 *q = dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const uint8x16_t x = vcombine_u8(vld1_u8(p), vdup_n_u8(0));
+		for (int i = 0; i < 4; i++, q += 16)
+			vst1q_u8(q, vmvnq_u8(vtstq_u8(vqtbl1q_u8(x, vld1q_u8(neon_spread_8[i])), bits)));
+	}
+	if (length)
+		Blit_Expand_1_To_8_Color(q, p, length);
+}
+#endif
+
+static void Blit_Expand_1_To_8_NEON(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint8x16_t bits = vld1q_u8(neon_bits_8);
+	const uint8x16_t ones = vdupq_n_u8(1);
+	uint8 *q = dest;
+	for (; length >= 8; length -= 8, p += 8) {
+		const uint8x16_t x = vcombine_u8(vld1_u8(p), vdup_n_u8(0));
+		for (int i = 0; i < 4; i++, q += 16)
+			vst1q_u8(q, vandq_u8(vtstq_u8(vqtbl1q_u8(x, vld1q_u8(neon_spread_8[i])), bits), ones));
+	}
+	if (length)
+		Blit_Expand_1_To_8(q, p, length);
+}
+
+static void Blit_Expand_2_To_8_NEON(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint8x16_t mask = vdupq_n_u8(3);
+	uint8 *q = dest;
+	for (; length >= 16; length -= 16, p += 16, q += 64) {
+		const uint8x16_t x = vld1q_u8(p);
+		uint8x16x4_t v;
+		v.val[0] = vshrq_n_u8(x, 6);
+		v.val[1] = vandq_u8(vshrq_n_u8(x, 4), mask);
+		v.val[2] = vandq_u8(vshrq_n_u8(x, 2), mask);
+		v.val[3] = vandq_u8(x, mask);
+		vst4q_u8(q, v);
+	}
+	if (length)
+		Blit_Expand_2_To_8(q, p, length);
+}
+
+static void Blit_Expand_4_To_8_NEON(uint8 * dest, const uint8 * p, uint32 length)
+{
+	uint8 *q = dest;
+	for (; length >= 16; length -= 16, p += 16, q += 32) {
+		const uint8x16_t x = vld1q_u8(p);
+		uint8x16x2_t v;
+		v.val[0] = vshrq_n_u8(x, 4);
+		v.val[1] = vandq_u8(x, vdupq_n_u8(0x0f));
+		vst2q_u8(q, v);
+	}
+	if (length)
+		Blit_Expand_4_To_8(q, p, length);
+}
+
+static void Blit_Expand_1_To_16_NEON(uint8 * dest, const uint8 * p, uint32 length)
+{
+	static const uint16 bit_values[8] = { 128, 64, 32, 16, 8, 4, 2, 1 };
+	const uint16x8_t bits = vld1q_u16(bit_values);
+	uint16 *q = (uint16 *)dest;
+	for (; length > 0; length--, q += 8)
+		vst1q_u16(q, vtstq_u16(vdupq_n_u16(*p++), bits));
+}
+
+static void Blit_Expand_1_To_32_NEON(uint8 * dest, const uint8 * p, uint32 length)
+{
+	static const uint32 bit_values[8] = { 128, 64, 32, 16, 8, 4, 2, 1 };
+	const uint32x4_t bits_hi = vld1q_u32(bit_values);
+	const uint32x4_t bits_lo = vld1q_u32(bit_values + 4);
+	uint32 *q = (uint32 *)dest;
+	for (; length > 0; length--, q += 8) {
+		const uint32x4_t v = vdupq_n_u32(*p++);
+		vst1q_u32(q, vtstq_u32(v, bits_hi));
+		vst1q_u32(q + 4, vtstq_u32(v, bits_lo));
+	}
+}
+
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* --- Blitters to the host frame buffer, or XImage buffer                --- */
 /* -------------------------------------------------------------------------- */
@@ -519,6 +976,104 @@ static Screen_blit_func_info Screen_blitters[] = {
 	{ 32, 0xff00, 0xff0000, 0xff000000, Blit_Copy_Raw   , Blit_Copy_Raw     }   // OK
 };
 
+// SIMD variants of the blitters, NULL if there is none for the instruction set
+#ifdef VIDEO_BLIT_X86
+#define BLIT_SSE2(func) func##_SSE2
+#define BLIT_AVX2(func) func##_AVX2
+#else
+#define BLIT_SSE2(func) NULL
+#define BLIT_AVX2(func) NULL
+#endif
+#ifdef VIDEO_BLIT_NEON
+#define BLIT_NEON(func) func##_NEON
+#else
+#define BLIT_NEON(func) NULL
+#endif
+
+#define DEFINE_SIMD_BLITTER(func, ratio)	{ #func, ratio, func, BLIT_SSE2(func), BLIT_AVX2(func), BLIT_NEON(func) }
+#define DEFINE_AVX2_BLITTER(func, ratio)	{ #func, ratio, func, NULL, BLIT_AVX2(func), NULL }
+
+struct Screen_blit_simd_info {
+	const char *		name;			// Portable blitter name
+	int					ratio;			// Destination bytes per source byte
+	Screen_blit_func	handler;		// Portable blitter
+	Screen_blit_func	handler_sse2;	// SSE2 variant
+	Screen_blit_func	handler_avx2;	// AVX2 variant
+	Screen_blit_func	handler_neon;	// NEON variant
+};
+
+static Screen_blit_simd_info Screen_simd_blitters[] = {
+#ifdef WORDS_BIGENDIAN
+	DEFINE_SIMD_BLITTER(Blit_RGB555_OBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_RGB888_OBO, 1),
+#else
+	DEFINE_SIMD_BLITTER(Blit_RGB555_NBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_RGB888_NBO, 1),
+#endif
+	DEFINE_SIMD_BLITTER(Blit_BGR555_NBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_BGR555_OBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_RGB565_NBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_RGB565_OBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_BGR888_NBO, 1),
+	DEFINE_SIMD_BLITTER(Blit_BGR888_OBO, 1),
+#if !(REAL_ADDRESSING || DIRECT_ADDRESSING || USE_SDL_VIDEO)
+	DEFINE_SIMD_BLITTER(Blit_Expand_1_To_8_Color, 8),
+#endif
+	DEFINE_SIMD_BLITTER(Blit_Expand_1_To_8, 8),
+	DEFINE_SIMD_BLITTER(Blit_Expand_2_To_8, 4),
+	DEFINE_SIMD_BLITTER(Blit_Expand_4_To_8, 2),
+	DEFINE_SIMD_BLITTER(Blit_Expand_1_To_16, 16),
+	DEFINE_AVX2_BLITTER(Blit_Expand_2_To_16, 8),
+	DEFINE_AVX2_BLITTER(Blit_Expand_4_To_16, 4),
+	DEFINE_AVX2_BLITTER(Blit_Expand_8_To_16, 2),
+	DEFINE_SIMD_BLITTER(Blit_Expand_1_To_32, 32),
+	DEFINE_AVX2_BLITTER(Blit_Expand_2_To_32, 16),
+	DEFINE_AVX2_BLITTER(Blit_Expand_4_To_32, 8),
+	DEFINE_AVX2_BLITTER(Blit_Expand_8_To_32, 4)
+};
+
+// Instruction sets available to the blitters
+enum {
+	BLIT_SIMD_NONE,
+	BLIT_SIMD_SSE2,
+	BLIT_SIMD_AVX2,
+	BLIT_SIMD_NEON
+};
+
+static int Screen_blit_simd_level(void)
+{
+#if defined(VIDEO_BLIT_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return BLIT_SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return BLIT_SIMD_SSE2;
+#elif defined(VIDEO_BLIT_NEON)
+	return BLIT_SIMD_NEON;
+#endif
+	return BLIT_SIMD_NONE;
+}
+
+// Return the best variant of a blitter for the given instruction set
+static Screen_blit_func Screen_blit_simd(Screen_blit_simd_info const & info, int level)
+{
+	switch (level) {
+	case BLIT_SIMD_AVX2:
+		if (info.handler_avx2)
+			return info.handler_avx2;
+		// fall through
+	case BLIT_SIMD_SSE2:
+		if (info.handler_sse2)
+			return info.handler_sse2;
+		break;
+	case BLIT_SIMD_NEON:
+		if (info.handler_neon)
+			return info.handler_neon;
+		break;
+	}
+	return info.handler;
+}
+
 // Initialize the framebuffer update function
 // Returns FALSE, if the function was to be reduced to a simple memcpy()
 // --> In that case, VOSF is not necessary
@@ -626,8 +1181,274 @@ bool Screen_blitter_init(VisualFormat const & visual_format, bool native_byte_or
 		Screen_blit = Blit_Copy_Raw;
 	}
 #endif
+
+	// Switch to a SIMD variant of the blitter, if any
+	const int simd_count = sizeof(Screen_simd_blitters)/sizeof(Screen_simd_blitters[0]);
+	for (int i = 0; i < simd_count; i++) {
+		if (Screen_blit == Screen_simd_blitters[i].handler) {
+			Screen_blit = Screen_blit_simd(Screen_simd_blitters[i], Screen_blit_simd_level());
+			break;
+		}
+	}
 	
 	// If the blitter simply reduces to a copy, we don't need VOSF in DGA mode
 	// --> In that case, we return FALSE
 	return (Screen_blit != Blit_Copy_Raw);
 }
+
+/* -------------------------------------------------------------------------- */
+/* --- Parallel blitting                                                  --- */
+/* -------------------------------------------------------------------------- */
+
+// Large updates are split into row bands that are converted by a small pool
+// of worker threads, the calling thread takes the first band itself
+
+const int BLIT_MAX_THREADS = 4;					// Maximum number of threads per update, including the caller
+const uint32 BLIT_MIN_BAND_BYTES = 64 * 1024;	// Minimum number of source bytes per band
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+struct blit_job {
+	Screen_blit_band_func	func;
+	void *					arg;
+	uint32					count;
+	int						n_bands;
+};
+
+static pthread_once_t blit_pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t blit_call_lock = PTHREAD_MUTEX_INITIALIZER;	// Serializes callers
+static pthread_mutex_t blit_pool_lock = PTHREAD_MUTEX_INITIALIZER;	// Protects the fields below
+static pthread_cond_t blit_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t blit_done_cond = PTHREAD_COND_INITIALIZER;
+static int blit_n_threads = 1;					// Number of workers + 1
+static uint32 blit_generation = 0;				// Incremented for each new job
+static int blit_pending = 0;					// Number of worker bands not done yet
+static blit_job blit_current;
+
+static void blit_run_band(blit_job const & job, int band)
+{
+	const uint32 first = (uint64)job.count * band / job.n_bands;
+	const uint32 last = (uint64)job.count * (band + 1) / job.n_bands;
+	if (first < last)
+		job.func(job.arg, first, last);
+}
+
+static void *blit_worker_func(void *arg)
+{
+	const int band = (int)(intptr)arg;
+	uint32 generation = 0;
+
+	pthread_mutex_lock(&blit_pool_lock);
+	for (;;) {
+		while (generation == blit_generation)
+			pthread_cond_wait(&blit_start_cond, &blit_pool_lock);
+		generation = blit_generation;
+		if (band < blit_current.n_bands) {
+			const blit_job job = blit_current;
+			pthread_mutex_unlock(&blit_pool_lock);
+			blit_run_band(job, band);
+			pthread_mutex_lock(&blit_pool_lock);
+			if (--blit_pending == 0)
+				pthread_cond_signal(&blit_done_cond);
+		}
+	}
+	return NULL;
+}
+
+static void blit_pool_init(void)
+{
+	// Only count the processors we are allowed to run on
+	int n_cpus = 1;
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t cpus;
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+		n_cpus = CPU_COUNT(&cpus);
+#elif defined(_SC_NPROCESSORS_ONLN)
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	const int n_threads = n_cpus < BLIT_MAX_THREADS ? n_cpus : BLIT_MAX_THREADS;
+	for (int i = 1; i < n_threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, blit_worker_func, (void *)(intptr)i) != 0)
+			break;
+		pthread_detach(thread);
+		blit_n_threads++;
+	}
+}
+#endif
+
+void Screen_blit_bands(Screen_blit_band_func func, void *arg, uint32 count, uint32 bytes_per_item)
+{
+#ifdef HAVE_PTHREADS
+	pthread_once(&blit_pool_once, blit_pool_init);
+
+	uint64 n_bands = (uint64)count * bytes_per_item / BLIT_MIN_BAND_BYTES;
+	if (n_bands > (uint64)blit_n_threads)
+		n_bands = blit_n_threads;
+	if (n_bands > count)
+		n_bands = count;
+	if (n_bands > 1) {
+		pthread_mutex_lock(&blit_call_lock);
+		pthread_mutex_lock(&blit_pool_lock);
+		blit_current.func = func;
+		blit_current.arg = arg;
+		blit_current.count = count;
+		blit_current.n_bands = (int)n_bands;
+		blit_pending = (int)n_bands - 1;
+		blit_generation++;
+		pthread_cond_broadcast(&blit_start_cond);
+		const blit_job job = blit_current;
+		pthread_mutex_unlock(&blit_pool_lock);
+
+		blit_run_band(job, 0);
+
+		pthread_mutex_lock(&blit_pool_lock);
+		while (blit_pending > 0)
+			pthread_cond_wait(&blit_done_cond, &blit_pool_lock);
+		pthread_mutex_unlock(&blit_pool_lock);
+		pthread_mutex_unlock(&blit_call_lock);
+		return;
+	}
+#endif
+	if (count)
+		func(arg, 0, count);
+}
+
+struct blit_rows_args {
+	uint8 *			dest;
+	int				dest_bytes_per_row;
+	const uint8 *	source;
+	int				source_bytes_per_row;
+	uint32			length;
+	uint8 *			copy;
+};
+
+static void blit_rows_band(void *arg, uint32 first, uint32 last)
+{
+	const blit_rows_args *args = (const blit_rows_args *)arg;
+	uint8 *dest = args->dest + first * args->dest_bytes_per_row;
+	const int offset = first * args->source_bytes_per_row;
+	const uint8 *source = args->source + offset;
+	uint8 *copy = args->copy ? args->copy + offset : NULL;
+	for (uint32 j = first; j < last; j++) {
+		if (copy) {
+			memcpy(copy, source, args->length);
+			copy += args->source_bytes_per_row;
+		}
+		Screen_blit(dest, source, args->length);
+		dest += args->dest_bytes_per_row;
+		source += args->source_bytes_per_row;
+	}
+}
+
+void Screen_blit_rows(uint8 * dest, int dest_bytes_per_row, const uint8 * source, int source_bytes_per_row,
+					  uint32 length, uint32 n_rows, uint8 * copy)
+{
+	blit_rows_args args;
+	args.dest = dest;
+	args.dest_bytes_per_row = dest_bytes_per_row;
+	args.source = source;
+	args.source_bytes_per_row = source_bytes_per_row;
+	args.length = length;
+	args.copy = copy;
+	Screen_blit_bands(blit_rows_band, &args, n_rows, length);
+}
+
+
+/*
+ *  Blitter benchmark, reports the throughput of each variant in
+ *  destination GB/s and checks it against the portable blitter
+ */
+
+#ifdef TEST_VIDEO_BLIT
+#include <sys/time.h>
+
+static double blit_bench_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int main(int argc, char *argv[])
+{
+	// Convert 1920x1080 true color frames, i.e. about 8 MB of output
+	const uint32 dest_size = 1920 * 1080 * 4;
+	const int n_frames = argc > 1 ? atoi(argv[1]) : 100;
+	// Source lines are misaligned on purpose, and not a multiple of any vector size
+	// Direct color blitters expect whole pixels, which are at most 4 bytes long
+	const uint32 source_offset = 4;
+	const uint32 line_length = 1924;
+
+	uint8 *source = (uint8 *)malloc(dest_size + source_offset);
+	uint8 *dest = (uint8 *)malloc(dest_size + 64);
+	uint8 *check = (uint8 *)malloc(dest_size + 64);
+	if (source == NULL || dest == NULL || check == NULL) {
+		fprintf(stderr, "Not enough memory\n");
+		return 1;
+	}
+	srand(1);
+	for (uint32 i = 0; i < dest_size + source_offset; i++)
+		source[i] = rand();
+	for (int i = 0; i < 256; i++)
+		ExpandMap[i] = (rand() << 16) ^ rand();
+
+	const char *level_names[] = { "scalar", "sse2", "avx2", "neon" };
+	const int level = Screen_blit_simd_level();
+	printf("SIMD level: %s\n", level_names[level]);
+
+	bool failed = false;
+	const int n_blitters = sizeof(Screen_simd_blitters)/sizeof(Screen_simd_blitters[0]);
+	for (int i = 0; i < n_blitters; i++) {
+		Screen_blit_simd_info const & info = Screen_simd_blitters[i];
+		const uint32 source_size = dest_size / info.ratio;
+		const uint8 *src = source + source_offset;
+
+		double scalar_rate = 0;
+		for (int l = BLIT_SIMD_NONE; l <= level; l++) {
+			Screen_blit_func blit = (l == BLIT_SIMD_NONE) ? info.handler : Screen_blit_simd(info, l);
+			if (l != BLIT_SIMD_NONE && (blit == info.handler || blit == Screen_blit_simd(info, l - 1)))
+				continue;
+
+			// Check the output of short and unaligned lines
+			memset(dest, 0, dest_size + 64);
+			memset(check, 0, dest_size + 64);
+			for (uint32 ofs = 0; ofs + line_length <= source_size; ofs += line_length) {
+				info.handler(check + ofs * info.ratio, src + ofs, line_length);
+				blit(dest + ofs * info.ratio, src + ofs, line_length);
+			}
+			for (uint32 n = 0; n < 80; n++) {
+				const uint32 length = (info.ratio == 1) ? (n & ~3) : n / info.ratio;
+				info.handler(check + n * 160, src + n * 160 / info.ratio, length);
+				blit(dest + n * 160, src + n * 160 / info.ratio, length);
+			}
+			if (memcmp(dest, check, dest_size + 64) != 0) {
+				printf("%-26s %-6s MISMATCH\n", info.name, level_names[l]);
+				failed = true;
+				continue;
+			}
+
+			const double start = blit_bench_time();
+			for (int n = 0; n < n_frames; n++)
+				blit(dest, src, source_size);
+			const double rate = (double)dest_size * n_frames / (blit_bench_time() - start) / 1e9;
+			if (l == BLIT_SIMD_NONE) {
+				scalar_rate = rate;
+				printf("%-26s %-6s %7.2f GB/s\n", info.name, level_names[l], rate);
+			}
+			else
+				printf("%-26s %-6s %7.2f GB/s  (x%.2f)\n", info.name, level_names[l], rate, rate / scalar_rate);
+		}
+	}
+
+	free(check);
+	free(dest);
+	free(source);
+	return failed ? 1 : 0;
+}
+#endif
@@ -36,6 +36,14 @@ extern void (*Screen_blit)(uint8 * dest, const uint8 * source, uint32 length);
 extern bool Screen_blitter_init(VisualFormat const & visual_format, bool native_byte_order, int mac_depth);
 extern uint32 ExpandMap[256];
 
+// Run func over items [0, count) split into bands, concurrently if the work is large enough
+typedef void (*Screen_blit_band_func)(void *arg, uint32 first, uint32 last);
+extern void Screen_blit_bands(Screen_blit_band_func func, void *arg, uint32 count, uint32 bytes_per_item);
+
+// Screen_blit() n_rows rows, concurrently, and optionally copy the source rows to copy too
+extern void Screen_blit_rows(uint8 * dest, int dest_bytes_per_row, const uint8 * source, int source_bytes_per_row,
+							 uint32 length, uint32 n_rows, uint8 * copy = NULL);
+
 // Glue for SheepShaver and BasiliskII
 #ifdef SHEEPSHAVER
 enum {
@@ -171,6 +179,15 @@ static void FB_FUNC_NAME(uint8 * dest, const uint8 * source, uint32 length)
 #undef DEREF_WORD_PTR
 }
 
+// SIMD variants apply FB_BLIT_4 to vectors of 64-bit words
+#ifdef VIDEO_BLIT_X86
+FB_VECTOR_BLITTER(FB_CONCAT(FB_FUNC_NAME, _SSE2), blit_vec128, BLIT_TARGET_SSE2)
+FB_VECTOR_BLITTER(FB_CONCAT(FB_FUNC_NAME, _AVX2), blit_vec256, BLIT_TARGET_AVX2)
+#endif
+#ifdef VIDEO_BLIT_NEON
+FB_VECTOR_BLITTER(FB_CONCAT(FB_FUNC_NAME, _NEON), blit_vec128, BLIT_TARGET_NEON)
+#endif
+
 #undef FB_FUNC_NAME
 
 #ifdef FB_BLIT_1
@@ -30,6 +30,17 @@
 #include "util_windows.h"
 #endif
 
+#if defined(__linux__) && defined(HAVE_LINUX_USERFAULTFD_H)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#ifdef __NR_userfaultfd
+#define USE_VOSF_UFFD 1
+#endif
+#endif
+
 // Import SDL-backend-specific functions
 #ifdef USE_SDL_VIDEO
 extern void update_sdl_video(SDL_Surface *screen, Sint32 x, Sint32 y, Sint32 w, Sint32 h);
@@ -83,6 +94,8 @@ extern void update_sdl_video(SDL_Surface *screen, int numrects, SDL_Rect *rects)
 
 // Prototypes
 static void vosf_do_set_dirty_area(uintptr first, uintptr last);
+static inline void vosf_protect_pages(unsigned first_page, unsigned last_page);
+static inline void vosf_protect_all(void);
 static void vosf_set_dirty_area(int x, int y, int w, int h, unsigned screen_width, unsigned screen_height, unsigned bytes_per_row);
 
 // Variables for Video on SEGV support
@@ -108,6 +121,14 @@ struct ScreenInfo {
 
 static ScreenInfo mainBuffer;
 
+// Dirty page tracking backends
+enum {
+	VOSF_TRACK_SIGSEGV,			// Write-protect the frame buffer and catch faults
+	VOSF_TRACK_UFFD_WP			// Asynchronous userfaultfd write-protection (Linux)
+};
+
+static int vosf_tracking = VOSF_TRACK_SIGSEGV;
+
 #define PFLAG_SET_VALUE			0x00
 #define PFLAG_CLEAR_VALUE		0x01
 #define PFLAG_SET_VALUE_4		0x00000000
@@ -223,6 +244,183 @@ static uint32 page_extend(uint32 size)
 }
 
 
+/*
+ *  Dirty page tracking with userfaultfd
+ *
+ *  In asynchronous write-protect mode (Linux 6.7+), the kernel resolves
+ *  write faults to the frame buffer by itself and only marks the pages
+ *  as written. A single PAGEMAP_SCAN ioctl then reports the written
+ *  pages and write-protects them again, so that no signal is delivered
+ *  at all.
+ */
+
+#ifdef USE_VOSF_UFFD
+// Definitions from Linux 6.7, system headers may be older
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY			1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED	(1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC		(1 << 15)
+#endif
+
+struct vosf_page_region {
+	uint64 start, end;
+	uint64 categories;
+};
+
+struct vosf_pm_scan_arg {
+	uint64 size, flags;
+	uint64 start, end, walk_end;
+	uint64 vec, vec_len, max_pages;
+	uint64 category_inverted, category_mask, category_anyof_mask, return_mask;
+};
+
+#define VOSF_PAGEMAP_SCAN			_IOWR('f', 16, struct vosf_pm_scan_arg)
+#define VOSF_PM_SCAN_WP_MATCHING	(1 << 0)
+#define VOSF_PM_SCAN_CHECK_WPASYNC	(1 << 1)
+#define VOSF_PAGE_IS_WRITTEN		(1 << 1)
+
+static int vosf_uffd = -1;				// userfaultfd the frame buffer is registered to
+static int vosf_pagemap_fd = -1;		// /proc/self/pagemap, for PAGEMAP_SCAN
+
+static void vosf_uffd_exit(void)
+{
+	if (vosf_pagemap_fd >= 0) {
+		close(vosf_pagemap_fd);
+		vosf_pagemap_fd = -1;
+	}
+	if (vosf_uffd >= 0) {
+		close(vosf_uffd);
+		vosf_uffd = -1;
+	}
+}
+
+static bool vosf_uffd_init(void)
+{
+	vosf_uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if (vosf_uffd < 0)
+		return false;
+
+	struct uffdio_api api;
+	memset(&api, 0, sizeof(api));
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+	if (ioctl(vosf_uffd, UFFDIO_API, &api) < 0) {
+		vosf_uffd_exit();
+		return false;
+	}
+
+	struct uffdio_register reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.range.start = mainBuffer.memStart;
+	reg.range.len = mainBuffer.memLength;
+	reg.mode = UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(vosf_uffd, UFFDIO_REGISTER, &reg) < 0) {
+		vosf_uffd_exit();
+		return false;
+	}
+
+	if ((vosf_pagemap_fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC)) < 0) {
+		vosf_uffd_exit();
+		return false;
+	}
+	return true;
+}
+
+static bool vosf_uffd_protect(uintptr start, uint32 length)
+{
+	struct uffdio_writeprotect wp;
+	wp.range.start = start;
+	wp.range.len = length;
+	wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+	return ioctl(vosf_uffd, UFFDIO_WRITEPROTECT, &wp) == 0;
+}
+
+// Mark pages written since the last scan, and write-protect them again
+static void vosf_uffd_scan(void)
+{
+	const int MAX_REGIONS = 32;
+	vosf_page_region regions[MAX_REGIONS];
+
+	uint64 start = mainBuffer.memStart;
+	const uint64 end = mainBuffer.memStart + mainBuffer.memLength;
+	while (start < end) {
+		vosf_pm_scan_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.size = sizeof(arg);
+		arg.flags = VOSF_PM_SCAN_WP_MATCHING | VOSF_PM_SCAN_CHECK_WPASYNC;
+		arg.start = start;
+		arg.end = end;
+		arg.vec = (uintptr)regions;
+		arg.vec_len = MAX_REGIONS;
+		arg.category_mask = VOSF_PAGE_IS_WRITTEN;
+		arg.return_mask = VOSF_PAGE_IS_WRITTEN;
+		const int n_regions = ioctl(vosf_pagemap_fd, VOSF_PAGEMAP_SCAN, &arg);
+		if (n_regions < 0) {
+			// Don't lose updates if the scan failed
+			PFLAG_SET_ALL;
+			return;
+		}
+		for (int i = 0; i < n_regions; i++) {
+			const unsigned first_page = (regions[i].start - mainBuffer.memStart) >> mainBuffer.pageBits;
+			const unsigned last_page = (regions[i].end - mainBuffer.memStart) >> mainBuffer.pageBits;
+			PFLAG_SET_RANGE(first_page, last_page);
+			mainBuffer.dirty = true;
+		}
+		if (arg.walk_end <= start)
+			break;
+		start = arg.walk_end;
+	}
+}
+#endif
+
+
+/*
+ *  Write-protect frame buffer pages to catch the next writes to them
+ */
+
+static inline void vosf_protect_pages(unsigned first_page, unsigned last_page)
+{
+	// Pages tracked with userfaultfd are protected again as they are scanned
+	if (vosf_tracking == VOSF_TRACK_SIGSEGV) {
+		const int32 offset  = first_page << mainBuffer.pageBits;
+		const uint32 length = (last_page - first_page) << mainBuffer.pageBits;
+		vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+	}
+}
+
+static inline void vosf_protect_all(void)
+{
+#ifdef USE_VOSF_UFFD
+	if (vosf_tracking == VOSF_TRACK_UFFD_WP) {
+		vosf_uffd_protect(mainBuffer.memStart, mainBuffer.memLength);
+		return;
+	}
+#endif
+	vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ);
+}
+
+
+/*
+ *  Check whether the frame buffer was touched since the last update
+ */
+
+static inline bool video_vosf_dirty(void)
+{
+#ifdef USE_VOSF_UFFD
+	if (vosf_tracking == VOSF_TRACK_UFFD_WP) {
+		LOCK_VOSF;
+		vosf_uffd_scan();
+		UNLOCK_VOSF;
+	}
+#endif
+	return mainBuffer.dirty;
+}
+
+
 /*
  *  Check if VOSF acceleration is profitable on this platform
  */
@@ -233,18 +431,10 @@ static uint32 page_extend(uint32 size)
 const int VOSF_PROFITABLE_TRIES_DFL = 3;		// Make 3 attempts for full screen update
 const int VOSF_PROFITABLE_THRESHOLD = 16667/2;	// 60 Hz (half of the quantum)
 
-static bool video_vosf_profitable(uint32 *duration_p = NULL, uint32 *n_page_faults_p = NULL)
+// Time n_tries full screen updates with the current tracking backend
+static bool vosf_measure_page_faults(uint32 n_tries, bool accel, uint32 *duration_p)
 {
 	uint32 duration = 0;
-	uint32 n_tries = VOSF_PROFITABLE_TRIES;
-	const uint32 n_page_faults = mainBuffer.pageCount * n_tries;
-
-#ifdef SHEEPSHAVER
-	const bool accel = PrefsFindBool("gfxaccel");
-#else
-	const bool accel = false;
-#endif
-
 	for (uint32 i = 0; i < n_tries; i++) {
 		uint64 start = GetTicks_usec();
 		for (uint32 p = 0; p < mainBuffer.pageCount; p++) {
@@ -252,15 +442,60 @@ static bool video_vosf_profitable(uint32 *duration_p = NULL, uint32 *n_page_faul
 			if (accel)
 				vosf_do_set_dirty_area((uintptr)addr, (uintptr)addr + mainBuffer.pageSize - 1);
 			else
-				addr[0] = 0; // Trigger Screen_fault_handler()
+				addr[0] = 0; // Trigger Screen_fault_handler(), or a write-protect fault
 		}
+#ifdef USE_VOSF_UFFD
+		if (vosf_tracking == VOSF_TRACK_UFFD_WP)
+			vosf_uffd_scan();
+#endif
 		duration += uint32(GetTicks_usec() - start);
 
 		PFLAG_CLEAR_ALL;
 		mainBuffer.dirty = false;
-		if (vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
+		if (vosf_tracking == VOSF_TRACK_SIGSEGV &&
+			vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
 			return false;
 	}
+	*duration_p = duration;
+	return true;
+}
+
+static bool video_vosf_profitable(uint32 *duration_p = NULL, uint32 *n_page_faults_p = NULL)
+{
+	uint32 duration = 0;
+	uint32 n_tries = VOSF_PROFITABLE_TRIES;
+	const uint32 n_page_faults = mainBuffer.pageCount * n_tries;
+
+#ifdef SHEEPSHAVER
+	const bool accel = PrefsFindBool("gfxaccel");
+#else
+	const bool accel = false;
+#endif
+
+	if (!vosf_measure_page_faults(n_tries, accel, &duration))
+		return false;
+
+#ifdef USE_VOSF_UFFD
+	// Switch to userfaultfd write-protection if it is available and cheaper
+	if (vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ | VM_PAGE_WRITE) == 0 &&
+		vosf_uffd_init()) {
+		uint32 uffd_duration = 0;
+		vosf_tracking = VOSF_TRACK_UFFD_WP;
+		if (vosf_uffd_protect(mainBuffer.memStart, mainBuffer.memLength) &&
+			vosf_measure_page_faults(n_tries, accel, &uffd_duration) &&
+			uffd_duration < duration) {
+			D(bug("Using userfaultfd for dirty page tracking (%d usec vs. %d usec)\n", uffd_duration, duration));
+			duration = uffd_duration;
+		}
+		else {
+			vosf_uffd_exit();
+			vosf_tracking = VOSF_TRACK_SIGSEGV;
+		}
+	}
+	if (vosf_tracking == VOSF_TRACK_SIGSEGV &&
+		vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
+		return false;
+#endif
 
 	if (duration_p)
 	  *duration_p = duration;
@@ -343,6 +578,10 @@ static bool video_vosf_init(MONITOR_INIT)
 
 static void video_vosf_exit(void)
 {
+#ifdef USE_VOSF_UFFD
+	vosf_uffd_exit();
+#endif
+	vosf_tracking = VOSF_TRACK_SIGSEGV;
 	if (mainBuffer.pageInfo) {
 		free(mainBuffer.pageInfo);
 		mainBuffer.pageInfo = NULL;
@@ -366,7 +605,8 @@ static void vosf_do_set_dirty_area(uintptr first, uintptr last)
 	for (int i = first_page; i <= last_page; i++) {
 		if (PFLAG_ISCLEAR(i)) {
 			PFLAG_SET(i);
-			vm_protect(addr, mainBuffer.pageSize, VM_PAGE_READ | VM_PAGE_WRITE);
+			if (vosf_tracking == VOSF_TRACK_SIGSEGV)
+				vm_protect(addr, mainBuffer.pageSize, VM_PAGE_READ | VM_PAGE_WRITE);
 		}
 		addr += mainBuffer.pageSize;
 	}
@@ -502,9 +742,7 @@ static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
 		PFLAG_CLEAR_RANGE(first_page, page);
 
 		// Make the dirty pages read-only again
-		const int32 offset  = first_page << mainBuffer.pageBits;
-		const uint32 length = (page - first_page) << mainBuffer.pageBits;
-		vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+		vosf_protect_pages(first_page, page);
 		
 		// There is at least one line to update
 		const int y1 = mainBuffer.pageInfo[first_page].top;
@@ -515,12 +753,9 @@ static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
 		VIDEO_DRV_LOCK_PIXELS;
 		const int src_bytes_per_row = VIDEO_MODE_ROW_BYTES;
 		const int dst_bytes_per_row = VIDEO_DRV_ROW_BYTES;
-		int i1 = y1 * src_bytes_per_row, i2 = y1 * dst_bytes_per_row, j;
-		for (j = y1; j <= y2; j++) {
-			Screen_blit(the_host_buffer + i2, the_buffer + i1, src_bytes_per_row);
-			i1 += src_bytes_per_row;
-			i2 += dst_bytes_per_row;
-		}
+		Screen_blit_rows(the_host_buffer + y1 * dst_bytes_per_row, dst_bytes_per_row,
+						 the_buffer + y1 * src_bytes_per_row, src_bytes_per_row,
+						 src_bytes_per_row, height);
 		VIDEO_DRV_UNLOCK_PIXELS;
 
 #ifdef USE_SDL_VIDEO
@@ -559,15 +794,11 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 	// Full screen update requested?
 	if (mainBuffer.very_dirty) {
 		PFLAG_CLEAR_ALL;
-		vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ);
+		vosf_protect_all();
 		memcpy(the_buffer_copy, the_buffer, VIDEO_MODE_ROW_BYTES * VIDEO_MODE_Y);
 		VIDEO_DRV_LOCK_PIXELS;
-		int i1 = 0, i2 = 0;
-		for (uint32_t j = 0;  j < VIDEO_MODE_Y; j++) {
-			Screen_blit(the_host_buffer + i2, the_buffer + i1, src_bytes_per_row);
-			i1 += src_bytes_per_row;
-			i2 += scr_bytes_per_row;
-		}
+		Screen_blit_rows(the_host_buffer, scr_bytes_per_row, the_buffer, src_bytes_per_row,
+						 src_bytes_per_row, VIDEO_MODE_Y);
 #ifdef USE_SDL_VIDEO
 		update_sdl_video(drv->s, 0, 0, VIDEO_MODE_X, VIDEO_MODE_Y);
 #endif
@@ -597,9 +828,7 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 		PFLAG_CLEAR_RANGE(first_page, page);
 
 		// Make the dirty pages read-only again
-		const int32 offset  = first_page << mainBuffer.pageBits;
-		const uint32 length = (page - first_page) << mainBuffer.pageBits;
-		vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+		vosf_protect_pages(first_page, page);
 
 		// Optimized for scanlines, don't process overlapping lines again
 		uint32 y1 = mainBuffer.pageInfo[first_page].top;
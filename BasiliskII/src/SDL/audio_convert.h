@@ -0,0 +1,472 @@
+/*
+ *  audio_convert.h - Audio sample format conversion and resampling
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AUDIO_CONVERT_H
+#define AUDIO_CONVERT_H
+
+#ifdef TEST_AUDIO_CONVERT
+#include "sysdeps.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SSE2 is always available on x86-64, the other hosts use the portable loops
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_CONVERT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The resampler filter uses generic vectors, which map to SSE or NEON
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define AUDIO_RESAMPLE_VECTOR 1
+typedef float audio_vec4f __attribute__((vector_size(16)));
+#endif
+
+
+/*
+ *  Conversion of MacOS sample data to native 16-bit stereo
+ */
+
+// 8-bit samples are unsigned, 16-bit samples are big-endian
+static inline int16 audio_sample_u8(uint8 x)
+{
+	return int16(int8(x ^ 0x80) * 256);
+}
+
+static inline int16 audio_sample_s16be(const uint8 *p)
+{
+	return int16((p[0] << 8) | p[1]);
+}
+
+static void audio_convert_u8_mono(int16 *dest, const uint8 *src, int frames)
+{
+#if AUDIO_CONVERT_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i sign = _mm_set1_epi8(-128);
+	for (; frames >= 16; frames -= 16, src += 16, dest += 32) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), sign);
+		__m128i lo = _mm_unpacklo_epi8(zero, v);
+		__m128i hi = _mm_unpackhi_epi8(zero, v);
+		_mm_storeu_si128((__m128i *)dest + 0, _mm_unpacklo_epi16(lo, lo));
+		_mm_storeu_si128((__m128i *)dest + 1, _mm_unpackhi_epi16(lo, lo));
+		_mm_storeu_si128((__m128i *)dest + 2, _mm_unpacklo_epi16(hi, hi));
+		_mm_storeu_si128((__m128i *)dest + 3, _mm_unpackhi_epi16(hi, hi));
+	}
+#endif
+	for (int i = 0; i < frames; i++)
+		dest[2 * i] = dest[2 * i + 1] = audio_sample_u8(src[i]);
+}
+
+static void audio_convert_u8_stereo(int16 *dest, const uint8 *src, int frames)
+{
+#if AUDIO_CONVERT_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i sign = _mm_set1_epi8(-128);
+	for (; frames >= 8; frames -= 8, src += 16, dest += 16) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), sign);
+		_mm_storeu_si128((__m128i *)dest + 0, _mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i *)dest + 1, _mm_unpackhi_epi8(zero, v));
+	}
+#endif
+	for (int i = 0; i < 2 * frames; i++)
+		dest[i] = audio_sample_u8(src[i]);
+}
+
+#if AUDIO_CONVERT_SSE2
+static inline __m128i audio_swap_16_sse2(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+static void audio_convert_s16be_mono(int16 *dest, const uint8 *src, int frames)
+{
+#if AUDIO_CONVERT_SSE2
+	for (; frames >= 8; frames -= 8, src += 16, dest += 16) {
+		__m128i v = audio_swap_16_sse2(_mm_loadu_si128((const __m128i *)src));
+		_mm_storeu_si128((__m128i *)dest + 0, _mm_unpacklo_epi16(v, v));
+		_mm_storeu_si128((__m128i *)dest + 1, _mm_unpackhi_epi16(v, v));
+	}
+#endif
+	for (int i = 0; i < frames; i++)
+		dest[2 * i] = dest[2 * i + 1] = audio_sample_s16be(src + 2 * i);
+}
+
+static void audio_convert_s16be_stereo(int16 *dest, const uint8 *src, int frames)
+{
+#if AUDIO_CONVERT_SSE2
+	for (; frames >= 8; frames -= 8, src += 32, dest += 16) {
+		_mm_storeu_si128((__m128i *)dest + 0, audio_swap_16_sse2(_mm_loadu_si128((const __m128i *)src + 0)));
+		_mm_storeu_si128((__m128i *)dest + 1, audio_swap_16_sse2(_mm_loadu_si128((const __m128i *)src + 1)));
+	}
+#endif
+	for (int i = 0; i < 2 * frames; i++)
+		dest[i] = audio_sample_s16be(src + 2 * i);
+}
+
+// Convert frames of MacOS sample data to native 16-bit stereo
+static void audio_convert_to_s16_stereo(int16 *dest, const uint8 *src, int frames, int sample_size, int channels)
+{
+	if (sample_size == 8) {
+		if (channels == 1)
+			audio_convert_u8_mono(dest, src, frames);
+		else
+			audio_convert_u8_stereo(dest, src, frames);
+	} else {
+		if (channels == 1)
+			audio_convert_s16be_mono(dest, src, frames);
+		else
+			audio_convert_s16be_stereo(dest, src, frames);
+	}
+}
+
+// Scale 16-bit samples by volume (8.8 fixed point, 0x100 = unity gain)
+static void audio_scale_volume(int16 *buf, int samples, int volume)
+{
+	if (volume >= 0x100)
+		return;
+	if (volume <= 0) {
+		memset(buf, 0, samples * sizeof(int16));
+		return;
+	}
+#if AUDIO_CONVERT_SSE2
+	const __m128i vol = _mm_set1_epi16(volume);
+	for (; samples >= 8; samples -= 8, buf += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)buf);
+		__m128i lo = _mm_mullo_epi16(v, vol);
+		__m128i hi = _mm_mulhi_epi16(v, vol);
+		__m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+		__m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+		_mm_storeu_si128((__m128i *)buf, _mm_packs_epi32(p0, p1));
+	}
+#endif
+	for (int i = 0; i < samples; i++)
+		buf[i] = int16((buf[i] * volume) >> 8);
+}
+
+
+/*
+ *  Polyphase windowed-sinc resampler for 16-bit stereo
+ */
+
+const int AUDIO_RESAMPLE_TAPS = 64;			// Filter length in input frames
+const int AUDIO_RESAMPLE_PHASES = 256;		// Number of filter phases, interpolated linearly
+const int AUDIO_RESAMPLE_CHUNK = 512;		// Maximum number of input frames fetched at once
+const int AUDIO_RESAMPLE_HIST = AUDIO_RESAMPLE_TAPS + AUDIO_RESAMPLE_CHUNK;
+
+// Function that supplies exactly "frames" input frames (padded with silence if necessary)
+typedef void (*audio_resample_source)(int16 *dest, int frames);
+
+struct audio_resampler {
+	uint64 step;							// Input frames per output frame (32.32 fixed point)
+	uint64 pos;								// Input frame of the first tap of the next output frame (32.32 fixed point)
+	int hist_len;							// Number of valid input frames in hist[]
+	float *coefs;							// (AUDIO_RESAMPLE_PHASES + 1) * AUDIO_RESAMPLE_TAPS filter coefficients
+	float *hist[2];							// Input history, one array per channel
+	int16 *in_buf;							// Interleaved input from source function
+};
+
+// Modified Bessel function of the first kind, order 0
+static double audio_bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Set up filter tables for converting in_rate to out_rate
+static bool audio_resampler_init(audio_resampler *r, int in_rate, int out_rate)
+{
+	const int taps = AUDIO_RESAMPLE_TAPS;
+	memset(r, 0, sizeof(*r));
+	r->step = (uint64(in_rate) << 32) / out_rate;
+	r->coefs = (float *)malloc((AUDIO_RESAMPLE_PHASES + 1) * taps * sizeof(float));
+	r->hist[0] = (float *)malloc(AUDIO_RESAMPLE_HIST * sizeof(float));
+	r->hist[1] = (float *)malloc(AUDIO_RESAMPLE_HIST * sizeof(float));
+	r->in_buf = (int16 *)malloc(AUDIO_RESAMPLE_CHUNK * 2 * sizeof(int16));
+	if (r->coefs == NULL || r->hist[0] == NULL || r->hist[1] == NULL || r->in_buf == NULL)
+		return false;
+
+	// Start with half a filter of silence, so the first output frame is the first input frame
+	r->hist_len = taps / 2 - 1;
+	memset(r->hist[0], 0, r->hist_len * sizeof(float));
+	memset(r->hist[1], 0, r->hist_len * sizeof(float));
+
+	// Kaiser windowed sinc, cut off below the lower Nyquist frequency
+	const double cutoff = 0.9 * (out_rate < in_rate ? double(out_rate) / in_rate : 1.0);
+	const double beta = 7.0;
+	const double i0_beta = audio_bessel_i0(beta);
+	for (int p = 0; p <= AUDIO_RESAMPLE_PHASES; p++) {
+		float *c = r->coefs + p * taps;
+		double sum = 0;
+		for (int t = 0; t < taps; t++) {
+			double d = t - (taps / 2 - 1) - double(p) / AUDIO_RESAMPLE_PHASES;
+			double x = d / (taps / 2);
+			double w = (x > -1.0 && x < 1.0) ? audio_bessel_i0(beta * sqrt(1.0 - x * x)) / i0_beta : 0.0;
+			double s = (d == 0) ? 1.0 : sin(M_PI * cutoff * d) / (M_PI * cutoff * d);
+			c[t] = float(s * w);
+			sum += c[t];
+		}
+		for (int t = 0; t < taps; t++)
+			c[t] = float(c[t] / sum);
+	}
+	return true;
+}
+
+static void audio_resampler_exit(audio_resampler *r)
+{
+	free(r->coefs);
+	free(r->hist[0]);
+	free(r->hist[1]);
+	free(r->in_buf);
+	memset(r, 0, sizeof(*r));
+}
+
+// Filter one output frame, starting at input frame i with phase frac
+static inline void audio_resample_frame(const audio_resampler *r, int i, uint32 frac, int16 *dest)
+{
+	const int taps = AUDIO_RESAMPLE_TAPS;
+	const float *c0 = r->coefs + (frac >> 24) * taps;
+	const float *c1 = c0 + taps;
+	const float *h0 = r->hist[0] + i;
+	const float *h1 = r->hist[1] + i;
+	const float f = (frac & 0xffffff) * (1.0f / 16777216.0f);
+	float left, right;
+#if AUDIO_RESAMPLE_VECTOR
+	const audio_vec4f vf = {f, f, f, f};
+	audio_vec4f acc0 = {0, 0, 0, 0}, acc1 = {0, 0, 0, 0};
+	for (int t = 0; t < taps; t += 4) {
+		audio_vec4f a, b, x, y;
+		memcpy(&a, c0 + t, sizeof(a));
+		memcpy(&b, c1 + t, sizeof(b));
+		memcpy(&x, h0 + t, sizeof(x));
+		memcpy(&y, h1 + t, sizeof(y));
+		audio_vec4f c = a + (b - a) * vf;
+		acc0 += c * x;
+		acc1 += c * y;
+	}
+	left = (acc0[0] + acc0[2]) + (acc0[1] + acc0[3]);
+	right = (acc1[0] + acc1[2]) + (acc1[1] + acc1[3]);
+#else
+	left = right = 0;
+	for (int t = 0; t < taps; t++) {
+		float c = c0[t] + (c1[t] - c0[t]) * f;
+		left += c * h0[t];
+		right += c * h1[t];
+	}
+#endif
+	left = left < -32768.0f ? -32768.0f : (left > 32767.0f ? 32767.0f : left);
+	right = right < -32768.0f ? -32768.0f : (right > 32767.0f ? 32767.0f : right);
+	dest[0] = int16(left < 0 ? left - 0.5f : left + 0.5f);
+	dest[1] = int16(right < 0 ? right - 0.5f : right + 0.5f);
+}
+
+// Produce frames output frames, fetching only as much input as they need
+static void audio_resample(audio_resampler *r, int16 *dest, int frames, audio_resample_source source)
+{
+	const int taps = AUDIO_RESAMPLE_TAPS;
+	while (frames > 0) {
+
+		// Fetch input for the remaining output frames
+		int need = int((r->pos + uint64(frames - 1) * r->step) >> 32) + taps - r->hist_len;
+		if (need > 0) {
+			int drop = int(r->pos >> 32);
+			if (drop) {
+				r->hist_len -= drop;
+				memmove(r->hist[0], r->hist[0] + drop, r->hist_len * sizeof(float));
+				memmove(r->hist[1], r->hist[1] + drop, r->hist_len * sizeof(float));
+				r->pos -= uint64(drop) << 32;
+			}
+			if (need > AUDIO_RESAMPLE_HIST - r->hist_len)
+				need = AUDIO_RESAMPLE_HIST - r->hist_len;
+			if (need > AUDIO_RESAMPLE_CHUNK)
+				need = AUDIO_RESAMPLE_CHUNK;
+			source(r->in_buf, need);
+			float *h0 = r->hist[0] + r->hist_len, *h1 = r->hist[1] + r->hist_len;
+			for (int i = 0; i < need; i++) {
+				h0[i] = r->in_buf[2 * i];
+				h1[i] = r->in_buf[2 * i + 1];
+			}
+			r->hist_len += need;
+		}
+
+		// Filter all output frames covered by the history
+		while (frames > 0 && int(r->pos >> 32) + taps <= r->hist_len) {
+			audio_resample_frame(r, int(r->pos >> 32), uint32(r->pos), dest);
+			r->pos += r->step;
+			dest += 2;
+			frames--;
+		}
+	}
+}
+
+
+#ifdef TEST_AUDIO_CONVERT
+#include <stdio.h>
+#include <sys/time.h>
+
+static double audio_bench_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Scalar reference for the conversion kernels
+static void audio_convert_reference(int16 *dest, const uint8 *src, int frames, int sample_size, int channels)
+{
+	for (int i = 0; i < frames; i++) {
+		for (int c = 0; c < 2; c++) {
+			int j = channels == 1 ? i : 2 * i + c;
+			dest[2 * i + c] = sample_size == 8 ? audio_sample_u8(src[j]) : audio_sample_s16be(src + 2 * j);
+		}
+	}
+}
+
+// Sine wave source for the resampler
+static double bench_freq, bench_phase;
+static const int bench_in_rate = 22050;
+
+static void bench_source(int16 *dest, int frames)
+{
+	for (int i = 0; i < frames; i++) {
+		dest[2 * i] = dest[2 * i + 1] = int16(16384 * sin(bench_phase));
+		bench_phase += 2 * M_PI * bench_freq / bench_in_rate;
+	}
+}
+
+// Level of the strongest component other than freq in a resampled sine [dB]
+static double bench_spurious_db(const int16 *buf, int frames, int rate, double freq)
+{
+	// Remove the fundamental by least squares, then measure what is left
+	double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+	for (int i = 0; i < frames; i++) {
+		double s = sin(2 * M_PI * freq * i / rate), c = cos(2 * M_PI * freq * i / rate);
+		ss += s * s; cc += c * c; sc += s * c;
+		ys += buf[2 * i] * s; yc += buf[2 * i] * c;
+	}
+	double det = ss * cc - sc * sc;
+	double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+	double signal = 0, noise = 0;
+	for (int i = 0; i < frames; i++) {
+		double fit = a * sin(2 * M_PI * freq * i / rate) + b * cos(2 * M_PI * freq * i / rate);
+		signal += fit * fit;
+		noise += (buf[2 * i] - fit) * (buf[2 * i] - fit);
+	}
+	return 10 * log10(noise / signal);
+}
+
+int main(int argc, char *argv[])
+{
+	const int frames = 4096;
+	const int n_loops = argc > 1 ? atoi(argv[1]) : 10000;
+	uint8 *src = (uint8 *)malloc(frames * 4 + 1);
+	int16 *dest = (int16 *)malloc(frames * 4 + 64);
+	int16 *check = (int16 *)malloc(frames * 4 + 64);
+	srand(1);
+	for (int i = 0; i < frames * 4 + 1; i++)
+		src[i] = rand();
+
+	// Conversions, from a misaligned source with a length that is no multiple of any vector size
+	bool failed = false;
+	static const char *names[] = { "8-bit mono", "8-bit stereo", "16-bit mono", "16-bit stereo" };
+	for (int k = 0; k < 4; k++) {
+		int size = k < 2 ? 8 : 16, channels = (k & 1) + 1;
+		for (int n = 0; n < 40; n++) {
+			audio_convert_reference(check, src + 1, n, size, channels);
+			audio_convert_to_s16_stereo(dest, src + 1, n, size, channels);
+			if (memcmp(dest, check, n * 4)) {
+				printf("%s: mismatch with %d frames\n", names[k], n);
+				failed = true;
+			}
+		}
+		double start = audio_bench_time();
+		for (int l = 0; l < n_loops; l++)
+			audio_convert_to_s16_stereo(dest, src + 1, frames - 3, size, channels);
+		double t = audio_bench_time() - start;
+		printf("%-14s %7.1f ns/block  %6.2f Gframes/s\n", names[k], t * 1e9 / n_loops, (frames - 3) * double(n_loops) / t * 1e-9);
+	}
+
+	// Volume, compared with the portable loop
+	for (int v = 0; v <= 0x100; v += 0x11) {
+		audio_convert_reference(dest, src + 1, frames, 16, 2);
+		memcpy(check, dest, frames * 4);
+		audio_scale_volume(dest, frames * 2 - 5, v);
+		for (int i = 0; i < frames * 2 - 5; i++) {
+			int16 x = v >= 0x100 ? check[i] : int16((check[i] * v) >> 8);
+			if (dest[i] != x) {
+				printf("volume %#x: mismatch at %d\n", v, i);
+				failed = true;
+				break;
+			}
+		}
+	}
+	double start = audio_bench_time();
+	for (int l = 0; l < n_loops; l++)
+		audio_scale_volume(dest, frames * 2, 0xc0);
+	double t = audio_bench_time() - start;
+	printf("%-14s %7.1f ns/block  %6.2f Gframes/s\n", "volume", t * 1e9 / n_loops, frames * double(n_loops) / t * 1e-9);
+
+	// Resampler: speed, and spurious components of sine waves
+	static const int out_rates[] = { 44100, 48000, 11025 };
+	for (int k = 0; k < 3; k++) {
+		const int out_rate = out_rates[k];
+		audio_resampler r;
+		if (!audio_resampler_init(&r, bench_in_rate, out_rate)) {
+			printf("Not enough memory\n");
+			return 1;
+		}
+		bench_freq = 1000;
+		start = audio_bench_time();
+		int n_blocks = n_loops / 10;
+		for (int l = 0; l < n_blocks; l++)
+			audio_resample(&r, dest, frames, bench_source);
+		t = audio_bench_time() - start;
+		printf("resample %5d -> %5d Hz  %6.1f Mframes/s output", bench_in_rate, out_rate, frames * double(n_blocks) / t * 1e-6);
+		audio_resampler_exit(&r);
+
+		double worst = -200;
+		for (double freq = 100; freq < bench_in_rate * 0.45 && freq < out_rate * 0.45; freq *= 1.5) {
+			audio_resampler_init(&r, bench_in_rate, out_rate);
+			bench_freq = freq;
+			bench_phase = 0;
+			audio_resample(&r, dest, frames, bench_source);	// Let the filter settle
+			audio_resample(&r, dest, frames, bench_source);
+			double db = bench_spurious_db(dest, frames, out_rate, freq);
+			if (db > worst)
+				worst = db;
+			audio_resampler_exit(&r);
+		}
+		printf("  worst spurious %.1f dB\n", worst);
+	}
+
+	free(src);
+	free(dest);
+	free(check);
+	return failed ? 1 : 0;
+}
+#endif
+
+#endif
@@ -23,12 +23,15 @@
 #include "my_sdl.h"
 #if !SDL_VERSION_ATLEAST(3, 0, 0)
 
+#include <atomic>
+
 #include "cpu_emulation.h"
 #include "main.h"
 #include "prefs.h"
 #include "user_strings.h"
 #include "audio.h"
 #include "audio_defs.h"
+#include "audio_convert.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -46,16 +49,42 @@ static int audio_sample_size_index = 0;
 static int audio_channel_count_index = 0;
 
 // Global variables
-static SDL_sem *audio_irq_done_sem = NULL;			// Signal from interrupt to streaming thread: data block read
-static uint8 silence_byte;							// Byte value to use to fill sound buffers with silence
-static uint8 *audio_mix_buf = NULL;
 static int main_volume = MAC_MAX_VOLUME;
 static int speaker_volume = MAC_MAX_VOLUME;
 static bool main_mute = false;
 static bool speaker_mute = false;
 
+// Ring of sample blocks, filled by AudioInterrupt() ahead of demand and
+// played by stream_func(), which never waits for the emulation thread
+const int MAX_AUDIO_BLOCKS = 16;
+
+struct audio_block {
+	int frames;										// Number of frames
+	uint64 time;									// Time the block was filled [us]
+	int16 *data;									// Native 16-bit stereo samples at the MacOS sample rate
+};
+
+static audio_block audio_ring[MAX_AUDIO_BLOCKS];
+static int16 *audio_ring_buf = NULL;				// Sample data of all blocks
+static int audio_num_blocks;						// Ring depth ("sound_blocks" pref)
+static int audio_block_pos;							// Next frame to play in block at tail, used by stream_func()
+static std::atomic<uint32> audio_ring_head(0);		// Next block to fill, written by AudioInterrupt()
+static std::atomic<uint32> audio_ring_tail(0);		// Next block to play, written by stream_func()
+static std::atomic<bool> audio_irq_pending(false);	// Flag: audio interrupt triggered, not handled yet
+
+// Streaming statistics
+static uint32 audio_blocks_played;					// Blocks taken from the ring
+static uint32 audio_underruns;						// Ring found empty while sources were active
+static uint64 audio_latency_sum;					// Sum of fill-to-play delays [us]
+static uint32 audio_latency_max;					// Maximum fill-to-play delay [us]
+
+// The device runs at its native rate if SDL can tell, MacOS sample rates are converted
+static audio_resampler resampler;
+static bool resampler_active = false;
+
 // Prototypes
 static void stream_func(void *arg, uint8 *stream, int stream_len);
+static void request_audio_blocks(void);
 static int get_audio_volume();
 
 
@@ -90,28 +119,44 @@ static bool open_sdl_audio(void)
 		audio_channel_count_index = audio_channel_counts.size() - 1;
 	}
 
+	// Sound buffer size = 4096 frames
+	const int mac_rate = audio_sample_rates[audio_sample_rate_index] >> 16;
+	audio_frames_per_block = 4096 >> PrefsFindInt32("sound_buffer");
+
+	// MacOS samples are converted to native 16-bit stereo, at the device rate
+	int host_rate = mac_rate;
+#if SDL_VERSION_ATLEAST(2,24,0)
+	SDL_AudioSpec native_spec;
+	if (SDL_GetDefaultAudioInfo(NULL, &native_spec, 0) == 0 && native_spec.freq > 0)
+		host_rate = native_spec.freq;
+#endif
+
 	SDL_AudioSpec audio_spec;
 	memset(&audio_spec, 0, sizeof(audio_spec));
-	audio_spec.freq = audio_sample_rates[audio_sample_rate_index] >> 16;
-	audio_spec.format = (audio_sample_sizes[audio_sample_size_index] == 8) ? AUDIO_U8 : AUDIO_S16MSB;
-	audio_spec.channels = audio_channel_counts[audio_channel_count_index];
-	audio_spec.samples = 4096 >> PrefsFindInt32("sound_buffer");
+	audio_spec.freq = host_rate;
+	audio_spec.format = AUDIO_S16SYS;
+	audio_spec.channels = 2;
+	// Device buffer of the same duration as a MacOS block (the field is 16-bit)
+	const uint64 device_frames = uint64(audio_frames_per_block) * host_rate / mac_rate;
+	audio_spec.samples = device_frames < 0xffff ? device_frames : 0xffff;
 	audio_spec.callback = stream_func;
 	audio_spec.userdata = NULL;
 
+	resampler_active = host_rate != mac_rate;
+	if (resampler_active && !audio_resampler_init(&resampler, mac_rate, host_rate)) {
+		audio_resampler_exit(&resampler);
+		resampler_active = false;
+		return false;
+	}
+
 	// Open the audio device, forcing the desired format
 	if (SDL_OpenAudio(&audio_spec, NULL) < 0) {
 		fprintf(stderr, "WARNING: Cannot open audio: %s\n", SDL_GetError());
+		if (resampler_active)
+			audio_resampler_exit(&resampler);
+		resampler_active = false;
 		return false;
 	}
-	
-#if SDL_VERSION_ATLEAST(2,0,0)
-	// HACK: workaround a bug in SDL pre-2.0.6 (reported via https://bugzilla.libsdl.org/show_bug.cgi?id=3710 )
-	// whereby SDL does not update audio_spec.size
-	if (audio_spec.size == 0) {
-		audio_spec.size = (SDL_AUDIO_BITSIZE(audio_spec.format) / 8) * audio_spec.channels * audio_spec.samples;
-	}
-#endif
 
 #if defined(BINCUE)
 	OpenAudio_bincue(audio_spec.freq, audio_spec.format, audio_spec.channels,
@@ -125,12 +170,27 @@ static bool open_sdl_audio(void)
 	SDL_AudioDriverName(driver_name, sizeof(driver_name) - 1);
 #endif
 	printf("Using SDL/%s audio output\n", driver_name ? driver_name : "");
-	silence_byte = audio_spec.silence;
-	SDL_PauseAudio(0);
+	D(bug("MacOS sample rate %d Hz, device sample rate %d Hz\n", mac_rate, host_rate));
+
+	// Allocate block ring
+	audio_num_blocks = PrefsFindInt32("sound_blocks");
+	if (audio_num_blocks < 1)
+		audio_num_blocks = 1;
+	else if (audio_num_blocks > MAX_AUDIO_BLOCKS - 1)
+		audio_num_blocks = MAX_AUDIO_BLOCKS - 1;
+	if (resampler_active)
+		audio_num_blocks++;		// Device buffers don't line up with blocks, one of them is always partly played
+	audio_ring_buf = (int16 *)malloc(audio_num_blocks * audio_frames_per_block * 2 * sizeof(int16));
+	for (int i = 0; i < audio_num_blocks; i++) {
+		audio_ring[i].frames = 0;
+		audio_ring[i].data = audio_ring_buf + i * audio_frames_per_block * 2;
+	}
+	audio_ring_head = audio_ring_tail = 0;
+	audio_block_pos = 0;
+	audio_irq_pending = false;
+	D(bug("audio ring: %d blocks of %d frames\n", audio_num_blocks, audio_frames_per_block));
 
-	// Sound buffer size = 4096 frames
-	audio_frames_per_block = audio_spec.samples;
-	audio_mix_buf = (uint8*)malloc(audio_spec.size);
+	SDL_PauseAudio(0);
 	return true;
 }
 
@@ -164,8 +224,6 @@ void AudioInit(void)
 	if (PrefsFindBool("nosound"))
 		return;
 
-	// Init semaphore
-	audio_irq_done_sem = SDL_CreateSemaphore(0);
 #ifdef BINCUE
 	InitBinCue();
 #endif
@@ -185,9 +243,16 @@ static void close_audio(void)
 	CloseAudio_bincue();
 #endif
 	SDL_CloseAudio();
-	free(audio_mix_buf);
-	audio_mix_buf = NULL;
+	free(audio_ring_buf);
+	audio_ring_buf = NULL;
+	if (resampler_active)
+		audio_resampler_exit(&resampler);
+	resampler_active = false;
 	audio_open = false;
+
+	D(bug("%u audio blocks played, %u underruns, latency %u us average, %u us maximum\n",
+		audio_blocks_played, audio_underruns,
+		audio_blocks_played ? uint32(audio_latency_sum / audio_blocks_played) : 0, audio_latency_max));
 }
 
 void AudioExit(void)
@@ -197,9 +262,6 @@ void AudioExit(void)
 #ifdef BINCUE
 	ExitBinCue();
 #endif
-	// Delete semaphore
-	if (audio_irq_done_sem)
-		SDL_DestroySemaphore(audio_irq_done_sem);
 }
 
 
@@ -209,6 +271,9 @@ void AudioExit(void)
 
 void audio_enter_stream()
 {
+	// Fill the ring before the first block is played
+	if (audio_open)
+		request_audio_blocks();
 }
 
 
@@ -225,77 +290,143 @@ void audio_exit_stream()
  *  Streaming function
  */
 
-static void stream_func(void *arg, uint8 *stream, int stream_len)
+// Ask the emulation thread to fill free ring blocks, unless it already has been
+static void request_audio_blocks(void)
 {
-	if (AudioStatus.num_sources) {
-		// Trigger audio interrupt to get new buffer
+	if (audio_ring_head.load() - audio_ring_tail.load() < uint32(audio_num_blocks) && !audio_irq_pending.exchange(true)) {
 		D(bug("stream: triggering irq\n"));
 		SetInterruptFlag(INTFLAG_AUDIO);
 		TriggerInterrupt();
-		D(bug("stream: waiting for ack\n"));
-		SDL_SemWait(audio_irq_done_sem);
-		D(bug("stream: ack received\n"));
-
-		// Get size of audio data
-		uint32 apple_stream_info = ReadMacInt32(audio_data + adatStreamInfo);
-		if (apple_stream_info && !main_mute && !speaker_mute) {
-			int work_size = ReadMacInt32(apple_stream_info + scd_sampleCount) * (AudioStatus.sample_size >> 3) * AudioStatus.channels;
-			D(bug("stream: work_size %d\n", work_size));
-			if (work_size > stream_len)
-				work_size = stream_len;
-			if (work_size == 0)
-				goto silence;
-
-			// Send data to audio device
-			bool dbl = AudioStatus.channels == 2 &&
-				ReadMacInt16(apple_stream_info + scd_numChannels) == 1 &&
-				ReadMacInt16(apple_stream_info + scd_sampleSize) == 8;
-			uint8 *src = Mac2HostAddr(ReadMacInt32(apple_stream_info + scd_buffer));
-			if (dbl)
-				for (int i = 0; i < work_size; i += 2)
-					audio_mix_buf[i] = audio_mix_buf[i + 1] = src[i >> 1];
-			else memcpy(audio_mix_buf, src, work_size);
-			memset((uint8 *)stream, silence_byte, stream_len);
-			SDL_MixAudio(stream, audio_mix_buf, work_size, get_audio_volume());
-
-			D(bug("stream: data written\n"));
-
-		} else
-			goto silence;
+	}
+}
+
+// Copy frames from the ring, pad with silence if the emulation fell behind
+static void read_audio_frames(int16 *dest, int frames)
+{
+	uint32 tail = audio_ring_tail.load(std::memory_order_relaxed);
+	while (frames > 0) {
+		if (tail == audio_ring_head.load(std::memory_order_acquire)) {
+			audio_underruns++;
+			D(bug("stream: underrun\n"));
+			memset(dest, 0, frames * 2 * sizeof(int16));
+			return;
+		}
+
+		audio_block *b = &audio_ring[tail % audio_num_blocks];
+		if (audio_block_pos == 0) {
+			uint32 latency = uint32(GetTicks_usec() - b->time);
+			audio_latency_sum += latency;
+			if (latency > audio_latency_max)
+				audio_latency_max = latency;
+			audio_blocks_played++;
+		}
+
+		int n = b->frames - audio_block_pos;
+		if (n > frames)
+			n = frames;
+		memcpy(dest, b->data + audio_block_pos * 2, n * 2 * sizeof(int16));
+		dest += n * 2;
+		frames -= n;
+		audio_block_pos += n;
+
+		// Block done, hand it back to AudioInterrupt()
+		if (audio_block_pos >= b->frames) {
+			audio_block_pos = 0;
+			audio_ring_tail.store(++tail, std::memory_order_release);
+		}
+	}
+}
+
+static void stream_func(void *arg, uint8 *stream, int stream_len)
+{
+	int16 *out = (int16 *)stream;
+	int frames = stream_len / (2 * sizeof(int16));
+
+	if (AudioStatus.num_sources) {
+
+		// Take samples from ring, converting them to the device rate if necessary
+		if (resampler_active)
+			audio_resample(&resampler, out, frames, read_audio_frames);
+		else
+			read_audio_frames(out, frames);
+		audio_scale_volume(out, frames * 2, (main_mute || speaker_mute) ? 0 : main_volume * speaker_volume / MAC_MAX_VOLUME);
+		D(bug("stream: %d frames played\n", frames));
+
+		// Have the emulation thread refill the ring while this block is playing
+		request_audio_blocks();
 
 	} else {
 
-		// Audio not active, play silence
-		silence: memset(stream, silence_byte, stream_len);
+		// Audio not active, drop blocks of the last stream and play silence
+		audio_ring_tail.store(audio_ring_head.load(std::memory_order_acquire), std::memory_order_release);
+		audio_block_pos = 0;
+		memset(stream, 0, stream_len);
 	}
-	
+
 #if defined(BINCUE)
 	MixAudio_bincue(stream, stream_len);
 #endif
-	
 }
 
 
 /*
- *  MacOS audio interrupt, read next data block
+ *  MacOS audio interrupt, read next data blocks into the ring
  */
 
+// Convert the data block returned by the Apple mixer to native 16-bit stereo
+static int get_audio_block(int16 *dest)
+{
+	uint32 apple_stream_info = ReadMacInt32(audio_data + adatStreamInfo);
+	if (apple_stream_info == 0)
+		return 0;
+
+	int frames = ReadMacInt32(apple_stream_info + scd_sampleCount);
+	D(bug(" %d frames\n", frames));
+	if (frames > audio_frames_per_block)
+		frames = audio_frames_per_block;
+
+	audio_convert_to_s16_stereo(dest, Mac2HostAddr(ReadMacInt32(apple_stream_info + scd_buffer)), frames,
+		ReadMacInt16(apple_stream_info + scd_sampleSize), ReadMacInt16(apple_stream_info + scd_numChannels));
+	return frames;
+}
+
 void AudioInterrupt(void)
 {
 	D(bug("AudioInterrupt\n"));
 
-	// Get data from apple mixer
-	if (AudioStatus.mixer) {
-		M68kRegisters r;
-		r.a[0] = audio_data + adatStreamInfo;
-		r.a[1] = AudioStatus.mixer;
-		Execute68k(audio_data + adatGetSourceData, &r);
-		D(bug(" GetSourceData() returns %08lx\n", r.d[0]));
-	} else
-		WriteMacInt32(audio_data + adatStreamInfo, 0);
-
-	// Signal stream function
-	SDL_SemPost(audio_irq_done_sem);
+	// Blocks freed from now on need another interrupt
+	audio_irq_pending = false;
+	if (!audio_open)
+		return;
+
+	// Fill all free blocks
+	uint32 head = audio_ring_head.load(std::memory_order_relaxed);
+	while (head - audio_ring_tail.load(std::memory_order_acquire) < uint32(audio_num_blocks)) {
+		audio_block *b = &audio_ring[head % audio_num_blocks];
+
+		// Get data from apple mixer
+		if (AudioStatus.mixer) {
+			M68kRegisters r;
+			r.a[0] = audio_data + adatStreamInfo;
+			r.a[1] = AudioStatus.mixer;
+			Execute68k(audio_data + adatGetSourceData, &r);
+			D(bug(" GetSourceData() returns %08lx\n", r.d[0]));
+			b->frames = get_audio_block(b->data);
+		} else {
+			WriteMacInt32(audio_data + adatStreamInfo, 0);
+			b->frames = 0;
+		}
+
+		// No data, play a block of silence instead
+		if (b->frames == 0) {
+			memset(b->data, 0, audio_frames_per_block * 2 * sizeof(int16));
+			b->frames = audio_frames_per_block;
+		}
+		b->time = GetTicks_usec();
+
+		// Hand block to stream function
+		audio_ring_head.store(++head, std::memory_order_release);
+	}
 	D(bug("AudioInterrupt done\n"));
 }
 
@@ -2549,14 +2549,10 @@ static void update_display_static(driver_base *drv)
 					SDL_LockSurface(drv->s);
 
 				// Blit to screen surface
-				int si = y1 * src_bytes_per_row + (x1 / pixels_per_byte);
-				int di = y1 * dst_bytes_per_row + x1;
-				for (uint32 j = y1; j <= y2; j++) {
-					memcpy(the_buffer_copy + si, the_buffer + si, wide / pixels_per_byte);
-					Screen_blit((uint8 *)drv->s->pixels + di, the_buffer + si, wide / pixels_per_byte);
-					si += src_bytes_per_row;
-					di += dst_bytes_per_row;
-				}
+				const int si = y1 * src_bytes_per_row + (x1 / pixels_per_byte);
+				const int di = y1 * dst_bytes_per_row + x1;
+				Screen_blit_rows((uint8 *)drv->s->pixels + di, dst_bytes_per_row, the_buffer + si, src_bytes_per_row,
+								 wide / pixels_per_byte, high, the_buffer_copy + si);
 
 				// Unlock surface, if required
 				if (SDL_MUSTLOCK(drv->s))
@@ -2607,12 +2603,10 @@ static void update_display_static(driver_base *drv)
 					SDL_LockSurface(drv->s);
 
 				// Blit to screen surface
-				for (uint32 j = y1; j <= y2; j++) {
-					uint32 i = j * bytes_per_row + x1 * bytes_per_pixel;
-					int dst_i = j * dst_bytes_per_row + x1 * bytes_per_pixel;
-					memcpy(the_buffer_copy + i, the_buffer + i, bytes_per_pixel * wide);
-					Screen_blit((uint8 *)drv->s->pixels + dst_i, the_buffer + i, bytes_per_pixel * wide);
-				}
+				const uint32 i = y1 * bytes_per_row + x1 * bytes_per_pixel;
+				const int dst_i = y1 * dst_bytes_per_row + x1 * bytes_per_pixel;
+				Screen_blit_rows((uint8 *)drv->s->pixels + dst_i, dst_bytes_per_row, the_buffer + i, bytes_per_row,
+								 bytes_per_pixel * wide, high, the_buffer_copy + i);
 
 				// Unlock surface, if required
 				if (SDL_MUSTLOCK(drv->s))
@@ -2627,60 +2621,92 @@ static void update_display_static(driver_base *drv)
 
 // Static display update (fixed frame rate, bounding boxes based)
 // XXX use NQD bounding boxes to help detect dirty areas?
-static void update_display_static_bbox(driver_base *drv)
-{
-	const VIDEO_MODE &mode = drv->mode;
-	bool blit = (int)VIDEO_MODE_DEPTH == VIDEO_DEPTH_16BIT;
+const uint32 BBOX_N_PIXELS = 64;
 
-	// Allocate bounding boxes for SDL_UpdateRects()
-	const uint32 N_PIXELS = 64;
-	const uint32 n_x_boxes = (VIDEO_MODE_X + N_PIXELS - 1) / N_PIXELS;
-	const uint32 n_y_boxes = (VIDEO_MODE_Y + N_PIXELS - 1) / N_PIXELS;
-	SDL_Rect *boxes = (SDL_Rect *)alloca(sizeof(SDL_Rect) * n_x_boxes * n_y_boxes);
-	uint32 nr_boxes = 0;
+struct update_bbox_args {
+	driver_base *	drv;
+	bool			blit;			// Convert pixels to the surface?
+	uint32			n_x_boxes;		// Number of boxes per row
+	bool *			dirty;			// Dirty state of each box
+};
 
-	// Lock surface, if required
-	if (SDL_MUSTLOCK(drv->s))
-		SDL_LockSurface(drv->s);
+// Update rows [first, last) of boxes, this may run concurrently on disjoint bands
+static void update_display_static_bbox_band(void *arg, uint32 first, uint32 last)
+{
+	const update_bbox_args *args = (const update_bbox_args *)arg;
+	driver_base *drv = args->drv;
+	const VIDEO_MODE &mode = drv->mode;
+	const uint32 N_PIXELS = BBOX_N_PIXELS;
 
-	// Update the surface from Mac screen
 	const uint32 bytes_per_row = VIDEO_MODE_ROW_BYTES;
 	const uint32 bytes_per_pixel = bytes_per_row / VIDEO_MODE_X;
 	const uint32 dst_bytes_per_row = drv->s->pitch;
-	for (uint32 y = 0; y < VIDEO_MODE_Y; y += N_PIXELS) {
+	for (uint32 y = first * N_PIXELS; y < VIDEO_MODE_Y && y < last * N_PIXELS; y += N_PIXELS) {
 		uint32 h = N_PIXELS;
 		if (h > VIDEO_MODE_Y - y)
 			h = VIDEO_MODE_Y - y;
+		bool *dirty = &args->dirty[(y / N_PIXELS) * args->n_x_boxes];
 		for (uint32 x = 0; x < VIDEO_MODE_X; x += N_PIXELS) {
 			uint32 w = N_PIXELS;
 			if (w > VIDEO_MODE_X - x)
 				w = VIDEO_MODE_X - x;
 			const int xs = w * bytes_per_pixel;
 			const int xb = x * bytes_per_pixel;
-			bool dirty = false;
+			*dirty = false;
 			for (uint32 j = y; j < (y + h); j++) {
 				const uint32 yb = j * bytes_per_row;
 				const uint32 dst_yb = j * dst_bytes_per_row;
 				if (memcmp(&the_buffer[yb + xb], &the_buffer_copy[yb + xb], xs) != 0) {
 					memcpy(&the_buffer_copy[yb + xb], &the_buffer[yb + xb], xs);
-					if (blit) Screen_blit((uint8 *)drv->s->pixels + dst_yb + xb, the_buffer + yb + xb, xs);
-					dirty = true;
+					if (args->blit) Screen_blit((uint8 *)drv->s->pixels + dst_yb + xb, the_buffer + yb + xb, xs);
+					*dirty = true;
 				}
 			}
-			if (dirty) {
-				boxes[nr_boxes].x = x;
-				boxes[nr_boxes].y = y;
-				boxes[nr_boxes].w = w;
-				boxes[nr_boxes].h = h;
-				nr_boxes++;
-			}
+			dirty++;
 		}
 	}
+}
+
+static void update_display_static_bbox(driver_base *drv)
+{
+	const VIDEO_MODE &mode = drv->mode;
+	const uint32 N_PIXELS = BBOX_N_PIXELS;
+
+	// Allocate bounding boxes for SDL_UpdateRects()
+	const uint32 n_x_boxes = (VIDEO_MODE_X + N_PIXELS - 1) / N_PIXELS;
+	const uint32 n_y_boxes = (VIDEO_MODE_Y + N_PIXELS - 1) / N_PIXELS;
+	SDL_Rect *boxes = (SDL_Rect *)alloca(sizeof(SDL_Rect) * n_x_boxes * n_y_boxes);
+	uint32 nr_boxes = 0;
+
+	// Lock surface, if required
+	if (SDL_MUSTLOCK(drv->s))
+		SDL_LockSurface(drv->s);
+
+	// Update the surface from Mac screen, in bands of box rows
+	update_bbox_args args;
+	args.drv = drv;
+	args.blit = (int)VIDEO_MODE_DEPTH == VIDEO_DEPTH_16BIT;
+	args.n_x_boxes = n_x_boxes;
+	args.dirty = (bool *)alloca(sizeof(bool) * n_x_boxes * n_y_boxes);
+	Screen_blit_bands(update_display_static_bbox_band, &args, n_y_boxes, N_PIXELS * VIDEO_MODE_ROW_BYTES);
 
 	// Unlock surface, if required
 	if (SDL_MUSTLOCK(drv->s))
 		SDL_UnlockSurface(drv->s);
 
+	// Collect dirty boxes
+	for (uint32 y = 0; y < VIDEO_MODE_Y; y += N_PIXELS) {
+		for (uint32 x = 0; x < VIDEO_MODE_X; x += N_PIXELS) {
+			if (args.dirty[(y / N_PIXELS) * n_x_boxes + x / N_PIXELS]) {
+				boxes[nr_boxes].x = x;
+				boxes[nr_boxes].y = y;
+				boxes[nr_boxes].w = (VIDEO_MODE_X - x < N_PIXELS) ? VIDEO_MODE_X - x : N_PIXELS;
+				boxes[nr_boxes].h = (VIDEO_MODE_Y - y < N_PIXELS) ? VIDEO_MODE_Y - y : N_PIXELS;
+				nr_boxes++;
+			}
+		}
+	}
+
 	// Refresh display
 	if (nr_boxes)
 		update_sdl_video(drv->s, nr_boxes, boxes);
@@ -2747,7 +2773,7 @@ static void video_refresh_dga_vosf(void)
 	static uint32 tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		if (mainBuffer.dirty) {
+		if (video_vosf_dirty()) {
 			LOCK_VOSF;
 			update_display_dga_vosf(drv);
 			UNLOCK_VOSF;
@@ -2765,7 +2791,7 @@ static void video_refresh_window_vosf(void)
 	static uint32 tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		if (mainBuffer.dirty) {
+		if (video_vosf_dirty()) {
 			LOCK_VOSF;
 			update_display_window_vosf(drv);
 			UNLOCK_VOSF;
@@ -0,0 +1,707 @@
+/*
+ *  disk_compressed.cpp - Read-only compressed disk image files
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  A compressed image holds the bytes of a disk image file in chunks of
+ *  64K that are compressed independently, so any part of the image can be
+ *  read without decompressing what comes before it. The file consists of a
+ *  64 byte header, the compressed chunks, and an index with the file
+ *  offset of each chunk plus the end offset of the last one. A chunk whose
+ *  compressed size equals its size is stored uncompressed, a chunk of size
+ *  zero is all zeroes.
+ *
+ *  Header (all numbers big-endian):
+ *     0  "B2CMPDSK"
+ *     8  version (1)
+ *    12  compression method (1 = zlib, 2 = zstd)
+ *    16  chunk size in bytes
+ *    24  size of uncompressed image file in bytes
+ *    32  index offset
+ *
+ *  Decompressed chunks are kept in a small cache. Chunks needed by a read
+ *  and the chunks following a sequential read are decompressed by a pool
+ *  of threads, the reading thread helps out while it waits.
+ *
+ *  Compressed images are made with the diskcompress tool, which is built
+ *  from this file with DISK_COMPRESS_TOOL defined.
+ */
+
+#include "sysdeps.h"
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+
+#include "disk_unix.h"
+#ifndef DISK_COMPRESS_TOOL
+#include "macos_util.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <deque>
+#include <algorithm>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define DEBUG 0
+#include "debug.h"
+
+static const char COMPRESSED_MAGIC[8] = {'B', '2', 'C', 'M', 'P', 'D', 'S', 'K'};
+const uint32 COMPRESSED_VERSION = 1;
+const uint32 COMPRESSED_HEADER_SIZE = 64;
+const uint32 COMPRESSED_CHUNK_SIZE = 65536;
+
+// Compression methods
+enum {
+	METHOD_ZLIB = 1,
+	METHOD_ZSTD = 2
+};
+
+const int NUM_CACHED_CHUNKS = 64;	// Decompressed chunks kept per image
+const int MAX_WORKERS = 4;			// Maximum number of decompression threads
+
+static inline uint32 get_be32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64 get_be64(const uint8 *p)
+{
+	return ((uint64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static inline void put_be32(uint8 *p, uint32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static inline void put_be64(uint8 *p, uint64 v)
+{
+	put_be32(p, v >> 32);
+	put_be32(p + 4, v);
+}
+
+
+/*
+ *  Compression methods
+ */
+
+static bool method_supported(uint32 method)
+{
+	switch (method) {
+#ifdef HAVE_LIBZ
+	case METHOD_ZLIB:
+		return true;
+#endif
+#ifdef HAVE_LIBZSTD
+	case METHOD_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+// Decompress exactly dst_len bytes
+static bool decompress_chunk(uint32 method, const uint8 *src, size_t src_len, uint8 *dst, size_t dst_len)
+{
+	switch (method) {
+#ifdef HAVE_LIBZ
+	case METHOD_ZLIB: {
+		uLongf actual = dst_len;
+		return uncompress(dst, &actual, src, src_len) == Z_OK && actual == dst_len;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case METHOD_ZSTD: {
+		size_t actual = ZSTD_decompress(dst, dst_len, src, src_len);
+		return !ZSTD_isError(actual) && actual == dst_len;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+
+/*
+ *  Compressed disk, the chunk cache is protected by a mutex
+ */
+
+#ifdef HAVE_PTHREADS
+#define LOCK_CHUNKS pthread_mutex_lock(&lock)
+#define UNLOCK_CHUNKS pthread_mutex_unlock(&lock)
+#else
+#define LOCK_CHUNKS
+#define UNLOCK_CHUNKS
+#endif
+
+struct disk_compressed : disk_generic {
+	disk_compressed(int fd, uint32 method, uint32 chunk_size, loff_t image_size,
+		uint64 *index, size_t max_packed)
+	: fd(fd), method(method), chunk_size(chunk_size), image_size(image_size),
+		start_byte(0), disk_size(image_size), index(index), max_packed(max_packed),
+		stamp(0), next_offset(-1), num_workers(0), quit(false),
+		num_loaded(0), num_hits(0) {
+		num_chunks = (image_size + chunk_size - 1) / chunk_size;
+		for (int i = 0; i < NUM_CACHED_CHUNKS; i++) {
+			cache[i].chunk = -1;
+			cache[i].state = CHUNK_EMPTY;
+			cache[i].pins = 0;
+			cache[i].stamp = 0;
+			cache[i].data = new uint8[chunk_size];
+		}
+#ifdef HAVE_PTHREADS
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&work_cond, NULL);
+		pthread_cond_init(&done_cond, NULL);
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int want = ncpus > 1 ? (int)std::min(ncpus, (long)MAX_WORKERS) : 0;
+		while (num_workers < want && pthread_create(&workers[num_workers], NULL, worker_func, this) == 0)
+			num_workers++;
+#endif
+	}
+
+	virtual ~disk_compressed() {
+#ifdef HAVE_PTHREADS
+		LOCK_CHUNKS;
+		quit = true;
+		pthread_cond_broadcast(&work_cond);
+		UNLOCK_CHUNKS;
+		for (int i = 0; i < num_workers; i++)
+			pthread_join(workers[i], NULL);
+		pthread_cond_destroy(&done_cond);
+		pthread_cond_destroy(&work_cond);
+		pthread_mutex_destroy(&lock);
+#endif
+		D(bug("compressed disk: %lu chunks decompressed, %lu cache hits\n", num_loaded, num_hits));
+		for (int i = 0; i < NUM_CACHED_CHUNKS; i++)
+			delete[] cache[i].data;
+		delete[] index;
+		close(fd);
+	}
+
+	// The disk starts after a possible image file header
+	void set_layout(loff_t start, loff_t size) {
+		start_byte = start;
+		disk_size = size;
+	}
+
+	virtual bool is_read_only() { return true; }
+	virtual loff_t size() { return disk_size; }
+
+	virtual size_t read(void *buf, loff_t offset, size_t length) {
+		if (offset >= disk_size)
+			return 0;
+		length = (size_t)std::min((loff_t)length, disk_size - offset);
+		if (length == 0)
+			return 0;
+		uint8 *packed = new uint8[max_packed];
+
+		LOCK_CHUNKS;
+		bool sequential = offset == next_offset;
+		uint8 *b = (uint8 *)buf;
+		size_t done = 0;
+		while (done < length) {
+
+			// Up to a quarter of the cache at a time, so read-ahead can't evict what we need
+			loff_t pos = start_byte + offset + done;
+			loff_t first = pos / chunk_size;
+			loff_t last = (start_byte + offset + length - 1) / chunk_size;
+			last = std::min(last, first + NUM_CACHED_CHUNKS / 4 - 1);
+			chunk_entry *needed[NUM_CACHED_CHUNKS / 4];
+			int n = 0;
+			for (loff_t c = first; c <= last; c++) {
+				needed[n] = get_chunk(c);
+				needed[n++]->pins++;
+			}
+
+			// Start decompressing the chunks that will be read next
+			if (sequential && jobs.size() < NUM_CACHED_CHUNKS / 4) {
+				loff_t ahead = std::min(last + 1 + std::max(2 * num_workers, 2), num_chunks);
+				for (loff_t c = last + 1; c < ahead; c++)
+					get_chunk(c);
+			}
+
+			// Copy chunk data, decompressing chunks ourselves while we wait
+			bool ok = true;
+			for (int i = 0; i < n; i++) {
+				chunk_entry *e = needed[i];
+				while (e->state == CHUNK_QUEUED || e->state == CHUNK_BUSY) {
+					if (!jobs.empty())
+						run_job(packed);
+#ifdef HAVE_PTHREADS
+					else
+						pthread_cond_wait(&done_cond, &lock);
+#endif
+				}
+				if (ok && e->state == CHUNK_READY) {
+					size_t skip = (size_t)(pos - e->chunk * chunk_size);
+					size_t size = std::min(length - done, (size_t)chunk_size - skip);
+					memcpy(b + done, e->data + skip, size);
+					done += size;
+					pos += size;
+				} else {
+					if (e->state == CHUNK_ERROR)
+						e->state = CHUNK_EMPTY;	// try again next time
+					ok = false;
+				}
+				e->pins--;
+			}
+			if (!ok)
+				break;
+		}
+		next_offset = offset + done;
+		UNLOCK_CHUNKS;
+
+		delete[] packed;
+		return done;
+	}
+
+	virtual size_t write(void *buf, loff_t offset, size_t length) {
+		return 0;
+	}
+
+private:
+	enum {
+		CHUNK_EMPTY,		// entry unused
+		CHUNK_QUEUED,		// waiting for decompression
+		CHUNK_BUSY,			// being decompressed
+		CHUNK_READY,		// data valid
+		CHUNK_ERROR			// read or decompression failed
+	};
+
+	struct chunk_entry {
+		loff_t chunk;		// chunk number, -1 = none
+		int state;
+		int pins;			// number of reads waiting for this chunk
+		uint32 stamp;		// time of last use, for LRU replacement
+		uint8 *data;
+	};
+
+	int fd;
+	uint32 method;
+	uint32 chunk_size;
+	loff_t image_size;		// size of uncompressed image file
+	loff_t start_byte;		// start of disk data in image file
+	loff_t disk_size;		// size of disk data
+	loff_t num_chunks;
+	uint64 *index;			// file offsets of chunks, num_chunks + 1 entries
+	size_t max_packed;		// largest compressed chunk
+
+	chunk_entry cache[NUM_CACHED_CHUNKS];
+	std::deque<chunk_entry *> jobs;
+	uint32 stamp;
+	loff_t next_offset;		// offset following last read, to detect sequential reads
+
+	int num_workers;
+	bool quit;
+#ifdef HAVE_PTHREADS
+	pthread_t workers[MAX_WORKERS];
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	// signalled when jobs are queued
+	pthread_cond_t done_cond;	// signalled when a chunk is done
+#endif
+
+	unsigned long num_loaded, num_hits;
+
+	// Find chunk in cache, or queue it for decompression (lock held)
+	chunk_entry *get_chunk(loff_t c) {
+		chunk_entry *victim = NULL;
+		for (int i = 0; i < NUM_CACHED_CHUNKS; i++) {
+			chunk_entry *e = &cache[i];
+			if (e->chunk == c && e->state != CHUNK_EMPTY) {
+				e->stamp = ++stamp;
+				num_hits++;
+				return e;
+			}
+			if (e->pins == 0 && (e->state == CHUNK_EMPTY || e->state == CHUNK_READY || e->state == CHUNK_ERROR)
+					&& (victim == NULL || (victim->state != CHUNK_EMPTY && (e->state == CHUNK_EMPTY || e->stamp < victim->stamp))))
+				victim = e;
+		}
+
+		// At most a quarter of the cache is pinned and read-ahead is limited, so there is always a victim
+		victim->chunk = c;
+		victim->state = CHUNK_QUEUED;
+		victim->stamp = ++stamp;
+		jobs.push_back(victim);
+#ifdef HAVE_PTHREADS
+		pthread_cond_signal(&work_cond);
+#endif
+		return victim;
+	}
+
+	// Decompress the oldest queued chunk (lock held, released while working)
+	void run_job(uint8 *packed) {
+		chunk_entry *e = jobs.front();
+		jobs.pop_front();
+		e->state = CHUNK_BUSY;
+		loff_t c = e->chunk;
+		UNLOCK_CHUNKS;
+		bool ok = load_chunk(c, e->data, packed);
+		LOCK_CHUNKS;
+		e->state = ok ? CHUNK_READY : CHUNK_ERROR;
+		num_loaded++;
+#ifdef HAVE_PTHREADS
+		pthread_cond_broadcast(&done_cond);
+#endif
+	}
+
+#ifdef HAVE_PTHREADS
+	static void *worker_func(void *arg) {
+		disk_compressed *d = (disk_compressed *)arg;
+		uint8 *packed = new uint8[d->max_packed];
+		pthread_mutex_lock(&d->lock);
+		while (!d->quit) {
+			if (d->jobs.empty())
+				pthread_cond_wait(&d->work_cond, &d->lock);
+			else
+				d->run_job(packed);
+		}
+		pthread_mutex_unlock(&d->lock);
+		delete[] packed;
+		return NULL;
+	}
+#endif
+
+public:
+	// Read and decompress one chunk
+	bool load_chunk(loff_t c, uint8 *dst, uint8 *packed) {
+		size_t size = (size_t)std::min((loff_t)chunk_size, image_size - c * chunk_size);
+		size_t packed_size = index[c + 1] - index[c];
+		if (packed_size == 0) {
+			memset(dst, 0, size);
+			return true;
+		} else if (packed_size == size)
+			return pread(fd, dst, size, index[c]) == (ssize_t)size;
+		else if (pread(fd, packed, packed_size, index[c]) != (ssize_t)packed_size) {
+			fprintf(stderr, "compressed disk: Can't read chunk %d (%s)\n", (int)c, strerror(errno));
+			return false;
+		} else if (!decompress_chunk(method, packed, packed_size, dst, size)) {
+			fprintf(stderr, "compressed disk: Chunk %d is corrupt\n", (int)c);
+			return false;
+		}
+		return true;
+	}
+};
+
+
+/*
+ *  Open compressed image file
+ */
+
+static disk_generic::status open_compressed(const char *path, disk_compressed **disk)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return disk_generic::DISK_UNKNOWN;
+
+	uint8 header[COMPRESSED_HEADER_SIZE];
+	if (pread(fd, header, sizeof(header), 0) != sizeof(header)
+			|| memcmp(header, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) != 0) {
+		close(fd);
+		return disk_generic::DISK_UNKNOWN;
+	}
+
+	// It's a compressed image, check the header
+	uint32 method = get_be32(header + 12);
+	uint32 chunk_size = get_be32(header + 16);
+	loff_t image_size = get_be64(header + 24);
+	loff_t index_offset = get_be64(header + 32);
+	if (get_be32(header + 8) != COMPRESSED_VERSION || chunk_size == 0 || chunk_size > 16 * 1024 * 1024 || image_size < 0) {
+		fprintf(stderr, "compressed disk: %s: Bad version or chunk size\n", path);
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+	if (!method_supported(method)) {
+		fprintf(stderr, "compressed disk: %s: Compression method %d not supported\n", path, method);
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+
+	// Load index
+	loff_t num_chunks = (image_size + chunk_size - 1) / chunk_size;
+	size_t index_bytes = (num_chunks + 1) * 8;
+	uint8 *raw_index = new uint8[index_bytes];
+	if (pread(fd, raw_index, index_bytes, index_offset) != (ssize_t)index_bytes) {
+		fprintf(stderr, "compressed disk: %s: Can't read index\n", path);
+		delete[] raw_index;
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+	uint64 *index = new uint64[num_chunks + 1];
+	size_t max_packed = 0;
+	bool ok = true;
+	for (loff_t i = 0; i <= num_chunks; i++) {
+		index[i] = get_be64(raw_index + i * 8);
+		if (i > 0) {
+			if (index[i] < index[i - 1] || index[i] > (uint64)index_offset)
+				ok = false;
+			else
+				max_packed = std::max(max_packed, (size_t)(index[i] - index[i - 1]));
+		}
+	}
+	delete[] raw_index;
+	if (!ok || max_packed > 2 * chunk_size) {
+		fprintf(stderr, "compressed disk: %s: Bad index\n", path);
+		delete[] index;
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+
+	D(bug("compressed disk %s, method %d, %d chunks of %d bytes\n", path, method, (int)num_chunks, chunk_size));
+	*disk = new disk_compressed(fd, method, chunk_size, image_size, index, std::max(max_packed, (size_t)1));
+	return disk_generic::DISK_VALID;
+}
+
+#ifndef DISK_COMPRESS_TOOL
+disk_generic::status disk_compressed_factory(const char *path, bool read_only,
+		disk_generic **disk)
+{
+	disk_compressed *d;
+	disk_generic::status st = open_compressed(path, &d);
+	if (st != disk_generic::DISK_VALID)
+		return st;
+
+	// Skip image file header, just like for uncompressed image files
+	uint8 data[256];
+	memset(data, 0, sizeof(data));
+	d->read(data, 0, sizeof(data));
+	loff_t start, size;
+	FileDiskLayout(d->size(), data, start, size);
+	d->set_layout(start, size);
+	*disk = d;
+	return disk_generic::DISK_VALID;
+}
+#endif
+
+#endif
+
+
+#ifdef DISK_COMPRESS_TOOL
+
+/*
+ *  diskcompress tool: make a compressed image from an image file, or
+ *  expand a compressed image back into the original file
+ */
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+
+static void usage(const char *prg)
+{
+	fprintf(stderr, "Usage: %s [-m zlib|zstd] [-l level] IMAGE COMPRESSED\n", prg);
+	fprintf(stderr, "       %s -d COMPRESSED IMAGE\n", prg);
+	exit(1);
+}
+
+// Compress src, returns compressed size or 0 if the chunk doesn't compress
+static size_t compress_chunk(uint32 method, int level, const uint8 *src, size_t src_len, uint8 *dst, size_t dst_len)
+{
+	switch (method) {
+#ifdef HAVE_LIBZ
+	case METHOD_ZLIB: {
+		uLongf actual = dst_len;
+		if (compress2(dst, &actual, src, src_len, level < 0 ? Z_BEST_COMPRESSION : level) != Z_OK)
+			return 0;
+		return actual;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case METHOD_ZSTD: {
+		size_t actual = ZSTD_compress(dst, dst_len, src, src_len, level < 0 ? 19 : level);
+		return ZSTD_isError(actual) ? 0 : actual;
+	}
+#endif
+	default:
+		return 0;
+	}
+}
+
+static bool write_all(int fd, const void *buf, size_t len, loff_t pos)
+{
+	return pwrite(fd, buf, len, pos) == (ssize_t)len;
+}
+
+static int do_compress(const char *in_path, const char *out_path, uint32 method, int level)
+{
+	int in_fd = open(in_path, O_RDONLY);
+	if (in_fd < 0) {
+		fprintf(stderr, "Can't open %s (%s)\n", in_path, strerror(errno));
+		return 1;
+	}
+	loff_t image_size = lseek(in_fd, 0, SEEK_END);
+	int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (image_size < 0 || out_fd < 0) {
+		fprintf(stderr, "Can't create %s (%s)\n", out_path, strerror(errno));
+		close(in_fd);
+		return 1;
+	}
+
+	const uint32 chunk_size = COMPRESSED_CHUNK_SIZE;
+	loff_t num_chunks = (image_size + chunk_size - 1) / chunk_size;
+	uint8 *index = new uint8[(num_chunks + 1) * 8];
+	uint8 *chunk = new uint8[chunk_size];
+	uint8 *zero = new uint8[chunk_size];
+	memset(zero, 0, chunk_size);
+	size_t packed_max = 2 * chunk_size;
+	uint8 *packed = new uint8[packed_max];
+
+	loff_t pos = COMPRESSED_HEADER_SIZE;
+	bool ok = true;
+	for (loff_t c = 0; ok && c < num_chunks; c++) {
+		size_t size = (size_t)std::min((loff_t)chunk_size, image_size - c * chunk_size);
+		put_be64(index + c * 8, pos);
+		if (pread(in_fd, chunk, size, c * chunk_size) != (ssize_t)size) {
+			fprintf(stderr, "Can't read %s (%s)\n", in_path, strerror(errno));
+			ok = false;
+			break;
+		}
+		if (memcmp(chunk, zero, size) == 0)
+			continue;
+		size_t packed_size = compress_chunk(method, level, chunk, size, packed, packed_max);
+		if (packed_size > 0 && packed_size < size) {
+			ok = write_all(out_fd, packed, packed_size, pos);
+			pos += packed_size;
+		} else {
+			ok = write_all(out_fd, chunk, size, pos);
+			pos += size;
+		}
+	}
+	put_be64(index + num_chunks * 8, pos);
+
+	uint8 header[COMPRESSED_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC));
+	put_be32(header + 8, COMPRESSED_VERSION);
+	put_be32(header + 12, method);
+	put_be32(header + 16, chunk_size);
+	put_be64(header + 24, image_size);
+	put_be64(header + 32, pos);
+	if (ok && !(write_all(out_fd, index, (num_chunks + 1) * 8, pos) && write_all(out_fd, header, sizeof(header), 0))) {
+		fprintf(stderr, "Can't write %s (%s)\n", out_path, strerror(errno));
+		ok = false;
+	}
+	if (ok)
+		printf("%s: %lld -> %lld bytes\n", out_path, (long long)image_size, (long long)(pos + (num_chunks + 1) * 8));
+
+	delete[] packed;
+	delete[] zero;
+	delete[] chunk;
+	delete[] index;
+	close(out_fd);
+	close(in_fd);
+	if (!ok)
+		unlink(out_path);
+	return ok ? 0 : 1;
+}
+
+static int do_expand(const char *in_path, const char *out_path)
+{
+	disk_compressed *d;
+	if (open_compressed(in_path, &d) != disk_generic::DISK_VALID) {
+		fprintf(stderr, "%s is not a compressed image\n", in_path);
+		return 1;
+	}
+	int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out_fd < 0) {
+		fprintf(stderr, "Can't create %s (%s)\n", out_path, strerror(errno));
+		delete d;
+		return 1;
+	}
+
+	// Sequential reads, so the worker threads decompress ahead of us
+	const size_t buf_size = 1024 * 1024;
+	uint8 *buf = new uint8[buf_size];
+	loff_t size = d->size();
+	bool ok = true;
+	for (loff_t pos = 0; ok && pos < size; pos += buf_size) {
+		size_t len = (size_t)std::min((loff_t)buf_size, size - pos);
+		ok = d->read(buf, pos, len) == len && write_all(out_fd, buf, len, pos);
+	}
+	if (ok && ftruncate(out_fd, size) < 0)
+		ok = false;
+	if (!ok)
+		fprintf(stderr, "Can't expand %s to %s\n", in_path, out_path);
+
+	delete[] buf;
+	close(out_fd);
+	delete d;
+	if (!ok)
+		unlink(out_path);
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_LIBZSTD
+	uint32 method = METHOD_ZSTD;
+#else
+	uint32 method = METHOD_ZLIB;
+#endif
+	int level = -1;
+	bool expand = false;
+
+	int i;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-d") == 0)
+			expand = true;
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			level = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "zlib") == 0)
+				method = METHOD_ZLIB;
+			else if (strcmp(argv[i], "zstd") == 0)
+				method = METHOD_ZSTD;
+			else
+				usage(argv[0]);
+		} else
+			usage(argv[0]);
+	}
+	if (argc - i != 2)
+		usage(argv[0]);
+	if (!method_supported(method)) {
+		fprintf(stderr, "Compression method not supported by this build\n");
+		return 1;
+	}
+
+	return expand ? do_expand(argv[i], argv[i + 1]) : do_compress(argv[i], argv[i + 1], method, level);
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+	fprintf(stderr, "Built without zlib and zstd, compressed images not supported\n");
+	return 1;
+}
+
+#endif
+
+#endif
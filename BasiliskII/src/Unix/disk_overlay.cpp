@@ -0,0 +1,388 @@
+/*
+ *  disk_overlay.cpp - Copy-on-write overlay for disk image files
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  An overlay file holds the blocks written to a disk image whose backing
+ *  file is only ever read. It consists of a 512 byte header, a bitmap with
+ *  one bit per block telling whether the block is stored in the overlay,
+ *  and the block data at its natural position after the bitmap. Blocks
+ *  that were never written are holes in the overlay file, so it only takes
+ *  up as much space as the data written to it.
+ *
+ *  Header (all numbers big-endian):
+ *     0  "B2OVRLAY"
+ *     8  version (1)
+ *    12  block size in bytes
+ *    16  disk size in bytes
+ *    24  bitmap offset
+ *    32  data offset
+ *    40  start of disk data in backing file
+ *    48  path of backing file, null-terminated
+ */
+
+#include "sysdeps.h"
+#include "disk_unix.h"
+#include "macos_util.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#define DEBUG 0
+#include "debug.h"
+
+static const char OVERLAY_MAGIC[8] = {'B', '2', 'O', 'V', 'R', 'L', 'A', 'Y'};
+const uint32 OVERLAY_VERSION = 1;
+const uint32 OVERLAY_HEADER_SIZE = 512;
+const uint32 OVERLAY_PATH_OFFSET = 48;
+const uint32 OVERLAY_BLOCK_SIZE = 4096;
+
+static inline uint32 get_be32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64 get_be64(const uint8 *p)
+{
+	return ((uint64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static inline void put_be32(uint8 *p, uint32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static inline void put_be64(uint8 *p, uint64 v)
+{
+	put_be32(p, v >> 32);
+	put_be32(p + 4, v);
+}
+
+struct disk_overlay : disk_generic {
+	disk_overlay(int base_fd, int delta_fd, bool read_only, loff_t total_size,
+		uint32 block_size, loff_t bitmap_offset, loff_t data_offset,
+		loff_t base_start, loff_t base_size, uint8 *bitmap)
+	: base_fd(base_fd), delta_fd(delta_fd), read_only(read_only),
+		total_size(total_size), block_size(block_size),
+		bitmap_offset(bitmap_offset), data_offset(data_offset),
+		base_start(base_start), base_size(base_size), bitmap(bitmap) {
+	}
+
+	virtual ~disk_overlay() {
+		close(base_fd);
+		close(delta_fd);
+		delete[] bitmap;
+	}
+
+	virtual bool is_read_only() { return read_only; }
+	virtual loff_t size() { return total_size; }
+
+	virtual size_t read(void *buf, loff_t offset, size_t length) {
+		if (offset >= total_size)
+			return 0;
+		length = (size_t)std::min((loff_t)length, total_size - offset);
+
+		// Read runs of blocks that are all in the overlay or all in the backing file
+		uint8 *b = (uint8 *)buf;
+		size_t done = 0;
+		while (done < length) {
+			loff_t pos = offset + done;
+			loff_t block = pos / block_size;
+			bool in_delta = is_stored(block);
+			size_t run = (size_t)((block + 1) * block_size - pos);
+			while (done + run < length && is_stored(++block) == in_delta)
+				run += block_size;
+			run = std::min(run, length - done);
+
+			size_t actual = in_delta ? delta_read(b + done, pos, run) : base_read(b + done, pos, run);
+			done += actual;
+			if (actual < run)
+				break;
+		}
+		return done;
+	}
+
+	virtual size_t write(void *buf, loff_t offset, size_t length) {
+		if (read_only || offset >= total_size)
+			return 0;
+		length = (size_t)std::min((loff_t)length, total_size - offset);
+
+		const uint8 *b = (const uint8 *)buf;
+		size_t done = 0;
+		loff_t first_new = -1, last_new = -1;
+		while (done < length) {
+			loff_t pos = offset + done;
+			loff_t block = pos / block_size;
+			size_t skip = (size_t)(pos - block * block_size);
+
+			if (skip == 0 && length - done >= block_size) {
+
+				// Whole blocks, write them directly
+				size_t run = (length - done) / block_size * block_size;
+				if (delta_write(b + done, pos, run) != run)
+					break;
+				for (loff_t i = block; i < block + (loff_t)(run / block_size); i++)
+					mark_stored(i, first_new, last_new);
+				done += run;
+
+			} else {
+
+				// Partial block, copy the rest from the backing file first
+				size_t size = std::min(length - done, (size_t)block_size - skip);
+				if (!is_stored(block)) {
+					uint8 *tmp = new uint8[block_size];
+					loff_t start = block * block_size;
+					size_t n = (size_t)std::min((loff_t)block_size, total_size - start);
+					bool ok = base_read(tmp, start, n) == n;
+					memcpy(tmp + skip, b + done, size);
+					ok = ok && delta_write(tmp, start, n) == n;
+					delete[] tmp;
+					if (!ok)
+						break;
+					mark_stored(block, first_new, last_new);
+				} else if (delta_write(b + done, pos, size) != size)
+					break;
+				done += size;
+			}
+		}
+
+		// Write back changed part of bitmap
+		if (first_new >= 0) {
+			loff_t start = (first_new / 8) & ~(loff_t)511;
+			loff_t end = std::min(((last_new / 8) | 511) + 1, bitmap_bytes());
+			if (pwrite(delta_fd, bitmap + start, end - start, bitmap_offset + start) != end - start)
+				return 0;
+		}
+		return done;
+	}
+
+protected:
+	int base_fd;			// backing file, opened read-only
+	int delta_fd;			// overlay file
+	bool read_only;
+	loff_t total_size;
+	uint32 block_size;
+	loff_t bitmap_offset, data_offset;
+	loff_t base_start;		// start of disk data in backing file
+	loff_t base_size;		// size of disk data in backing file
+	uint8 *bitmap;			// one bit per block, set = stored in overlay
+
+	loff_t bitmap_bytes() const {
+		return ((total_size + block_size - 1) / block_size + 7) / 8;
+	}
+
+	bool is_stored(loff_t block) const {
+		return bitmap[block >> 3] & (0x80 >> (block & 7));
+	}
+
+	void mark_stored(loff_t block, loff_t &first, loff_t &last) {
+		if (is_stored(block))
+			return;
+		bitmap[block >> 3] |= 0x80 >> (block & 7);
+		if (first < 0 || block < first)
+			first = block;
+		if (block > last)
+			last = block;
+	}
+
+	size_t delta_read(uint8 *buf, loff_t pos, size_t len) {
+		ssize_t actual = pread(delta_fd, buf, len, data_offset + pos);
+		if (actual < 0)
+			return 0;
+		if ((size_t)actual < len)	// hole at the end of the overlay file
+			memset(buf + actual, 0, len - actual);
+		return len;
+	}
+
+	size_t delta_write(const uint8 *buf, loff_t pos, size_t len) {
+		ssize_t actual = pwrite(delta_fd, buf, len, data_offset + pos);
+		return actual < 0 ? 0 : actual;
+	}
+
+	size_t base_read(uint8 *buf, loff_t pos, size_t len) {
+		size_t avail = pos >= base_size ? 0 : (size_t)std::min((loff_t)len, base_size - pos);
+		if (avail) {
+			ssize_t actual = pread(base_fd, buf, avail, base_start + pos);
+			if (actual < (ssize_t)avail)
+				return actual < 0 ? 0 : actual;
+		}
+		memset(buf + avail, 0, len - avail);	// backing file is shorter than the disk
+		return len;
+	}
+};
+
+
+/*
+ *  Open backing file, find its disk data (skipping disk image headers)
+ */
+
+static int open_base(const char *path, loff_t &start, loff_t &size)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	loff_t file_size = lseek(fd, 0, SEEK_END);
+	uint8 data[256];
+	memset(data, 0, sizeof(data));
+	if (file_size < 0 || pread(fd, data, sizeof(data), 0) < 0) {
+		close(fd);
+		return -1;
+	}
+	FileDiskLayout(file_size, data, start, size);
+	return fd;
+}
+
+
+/*
+ *  Open existing overlay file
+ */
+
+disk_generic::status disk_overlay_factory(const char *path, bool read_only,
+		disk_generic **disk)
+{
+	int fd = open(path, read_only ? O_RDONLY : O_RDWR);
+	if (fd < 0 && !read_only) {
+		read_only = true;
+		fd = open(path, O_RDONLY);
+	}
+	if (fd < 0)
+		return disk_generic::DISK_UNKNOWN;
+
+	uint8 header[OVERLAY_HEADER_SIZE];
+	if (pread(fd, header, sizeof(header), 0) != sizeof(header)
+			|| memcmp(header, OVERLAY_MAGIC, sizeof(OVERLAY_MAGIC)) != 0) {
+		close(fd);
+		return disk_generic::DISK_UNKNOWN;
+	}
+
+	// It's an overlay, check the header
+	uint32 block_size = get_be32(header + 12);
+	loff_t total_size = get_be64(header + 16);
+	loff_t bitmap_offset = get_be64(header + 24);
+	loff_t data_offset = get_be64(header + 32);
+	header[OVERLAY_HEADER_SIZE - 1] = 0;
+	const char *base_path = (const char *)header + OVERLAY_PATH_OFFSET;
+	if (get_be32(header + 8) != OVERLAY_VERSION || block_size == 0 || (block_size & 511)) {
+		fprintf(stderr, "overlay: %s: Bad version or block size\n", path);
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+
+	// Load bitmap
+	loff_t n_bytes = ((total_size + block_size - 1) / block_size + 7) / 8;
+	uint8 *bitmap = new uint8[n_bytes];
+	memset(bitmap, 0, n_bytes);
+	if (pread(fd, bitmap, n_bytes, bitmap_offset) < 0) {
+		fprintf(stderr, "overlay: %s: Can't read bitmap (%s)\n", path, strerror(errno));
+		delete[] bitmap;
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+
+	// Open backing file
+	loff_t base_start, base_size;
+	int base_fd = open_base(base_path, base_start, base_size);
+	if (base_fd < 0) {
+		fprintf(stderr, "overlay: %s: Can't open backing file %s (%s)\n", path, base_path, strerror(errno));
+		delete[] bitmap;
+		close(fd);
+		return disk_generic::DISK_INVALID;
+	}
+	if (base_start != (loff_t)get_be64(header + 40))
+		fprintf(stderr, "overlay: %s: Backing file %s has changed\n", path, base_path);
+
+	D(bug("overlay %s over %s, %d blocks of %d bytes\n", path, base_path, (int)((total_size + block_size - 1) / block_size), block_size));
+	*disk = new disk_overlay(base_fd, fd, read_only, total_size, block_size,
+		bitmap_offset, data_offset, base_start, base_size, bitmap);
+	return disk_generic::DISK_VALID;
+}
+
+
+/*
+ *  Create new overlay for a disk image file in the given directory
+ */
+
+disk_generic::status disk_overlay_create(const char *path, const char *dir,
+		disk_generic **disk)
+{
+	// Only plain files (and not overlays themselves) get an overlay
+	struct stat st;
+	if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+		return disk_generic::DISK_UNKNOWN;
+	char base_path[PATH_MAX];
+	if (realpath(path, base_path) == NULL || strlen(base_path) >= OVERLAY_HEADER_SIZE - OVERLAY_PATH_OFFSET)
+		return disk_generic::DISK_UNKNOWN;
+	loff_t base_start, base_size;
+	int base_fd = open_base(base_path, base_start, base_size);
+	if (base_fd < 0)
+		return disk_generic::DISK_UNKNOWN;
+	char magic[sizeof(OVERLAY_MAGIC)];
+	if (pread(base_fd, magic, sizeof(magic), 0) == sizeof(magic) && memcmp(magic, OVERLAY_MAGIC, sizeof(magic)) == 0) {
+		close(base_fd);
+		return disk_generic::DISK_UNKNOWN;
+	}
+
+	// Create overlay file, named after the disk image
+	const char *name = strrchr(base_path, '/');
+	name = name ? name + 1 : base_path;
+	char delta_path[PATH_MAX];
+	if (snprintf(delta_path, sizeof(delta_path), "%s/%s.XXXXXX", dir, name) >= (int)sizeof(delta_path)) {
+		close(base_fd);
+		return disk_generic::DISK_UNKNOWN;
+	}
+	int fd = mkstemp(delta_path);
+	if (fd < 0) {
+		fprintf(stderr, "overlay: Can't create overlay in %s (%s)\n", dir, strerror(errno));
+		close(base_fd);
+		return disk_generic::DISK_INVALID;
+	}
+
+	// Write header and empty bitmap
+	const uint32 block_size = OVERLAY_BLOCK_SIZE;
+	loff_t total_size = base_size;
+	loff_t n_bytes = ((total_size + block_size - 1) / block_size + 7) / 8;
+	loff_t bitmap_offset = OVERLAY_HEADER_SIZE;
+	loff_t data_offset = (bitmap_offset + n_bytes + block_size - 1) / block_size * block_size;
+	uint8 header[OVERLAY_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, OVERLAY_MAGIC, sizeof(OVERLAY_MAGIC));
+	put_be32(header + 8, OVERLAY_VERSION);
+	put_be32(header + 12, block_size);
+	put_be64(header + 16, total_size);
+	put_be64(header + 24, bitmap_offset);
+	put_be64(header + 32, data_offset);
+	put_be64(header + 40, base_start);
+	strcpy((char *)header + OVERLAY_PATH_OFFSET, base_path);
+	if (pwrite(fd, header, sizeof(header), 0) != sizeof(header) || ftruncate(fd, data_offset) < 0) {
+		fprintf(stderr, "overlay: Can't write %s (%s)\n", delta_path, strerror(errno));
+		close(fd);
+		unlink(delta_path);
+		close(base_fd);
+		return disk_generic::DISK_INVALID;
+	}
+
+	uint8 *bitmap = new uint8[n_bytes];
+	memset(bitmap, 0, n_bytes);
+	printf("Using overlay %s for %s\n", delta_path, base_path);
+	*disk = new disk_overlay(base_fd, fd, false, total_size, block_size,
+		bitmap_offset, data_offset, base_start, base_size, bitmap);
+	return disk_generic::DISK_VALID;
+}
@@ -29,17 +29,30 @@
 #define __MACOSX__ 1
 #endif
 
+// Number of band files kept open
+const int BAND_CACHE_SIZE = 64;
+
+// Bands grow in steps of this size
+const loff_t BAND_GROW_SIZE = 1024 * 1024;
+
 struct disk_sparsebundle : disk_generic {
 	disk_sparsebundle(const char *bands, int fd, bool read_only,
 		loff_t band_size, loff_t total_size)
 	: token_fd(fd), read_only(read_only), band_size(band_size),
-		total_size(total_size), band_dir(strdup(bands)),
-		band_cur(-1), band_fd(-1), band_alloc(-1) {
+		total_size(total_size), band_dir(strdup(bands)), band_clock(0) {
+		for (int i = 0; i < BAND_CACHE_SIZE; i++) {
+			band_cache[i].band = -1;
+			band_cache[i].fd = -1;
+			band_cache[i].alloc = -1;
+			band_cache[i].last_use = 0;
+		}
 	}
 	
 	virtual ~disk_sparsebundle() {
-		if (band_fd != -1)
-			close(band_fd);
+		for (int i = 0; i < BAND_CACHE_SIZE; i++) {
+			if (band_cache[i].fd != -1)
+				close(band_cache[i].fd);
+		}
 		close(token_fd);
 		free(band_dir);
 	}
@@ -61,10 +74,15 @@ protected:
 	loff_t band_size, total_size;
 	char *band_dir;			// directory containing band files
 	
-	// Currently open band
-	loff_t band_cur;		// index of the band
-	int band_fd;			// -1 if not open
-	loff_t band_alloc;		// how much space is already used?
+	// Open bands, least recently used one is closed first
+	struct open_band_info {
+		loff_t band;		// index of the band (-1 = unused entry)
+		int fd;
+		loff_t alloc;		// how much space is already used?
+		uint32 last_use;
+	};
+	open_band_info band_cache[BAND_CACHE_SIZE];
+	uint32 band_clock;
 	
 	typedef ssize_t (disk_sparsebundle::*band_func)(char *buf, loff_t band,
 		size_t offset, size_t len);
@@ -100,9 +118,19 @@ protected:
 		OPEN_NOENT,		// Band doesn't exist yet
 		OPEN_OK,
 	};
-	open_ret open_band(loff_t band, bool create) {
-		if (band_cur == band)
-			return OPEN_OK;
+	open_ret open_band(loff_t band, bool create, open_band_info **info) {
+		// Already open?
+		open_band_info *victim = &band_cache[0];
+		for (int i = 0; i < BAND_CACHE_SIZE; i++) {
+			open_band_info *p = &band_cache[i];
+			if (p->band == band) {
+				p->last_use = ++band_clock;
+				*info = p;
+				return OPEN_OK;
+			}
+			if (p->last_use < victim->last_use)
+				victim = p;
+		}
 		
 		char path[PATH_MAX + 1];
 		if (snprintf(path, PATH_MAX, "%s/%lx", band_dir,
@@ -110,41 +138,57 @@ protected:
 			return OPEN_FAILED;
 		}
 		
-		if (band_fd != -1)
-			close(band_fd);
-		band_alloc = -1;
-		band_cur = -1;
-		
 		int oflags = read_only ? O_RDONLY : O_RDWR;
 		if (create)
 			oflags |= O_CREAT;
-		band_fd = open(path, oflags, 0644);
-		if (band_fd == -1) {
+		int fd = open(path, oflags, 0644);
+		if (fd == -1) {
 			return (!create && errno == ENOENT) ? OPEN_NOENT : OPEN_FAILED;
 		}
 		
+		// Replace least recently used band
+		if (victim->fd != -1)
+			close(victim->fd);
+		victim->band = band;
+		victim->fd = fd;
+		victim->last_use = ++band_clock;
+		
 		// Get the allocated size
-		if (!read_only) {
-			band_alloc = lseek(band_fd, 0, SEEK_END);
-			if (band_alloc == -1)
-				band_alloc = band_size;
-		}
-		band_cur = band;
+		victim->alloc = lseek(fd, 0, SEEK_END);
+		if (victim->alloc == -1)
+			victim->alloc = band_size;
+		*info = victim;
 		return OPEN_OK;
 	}
 	
+	// Make sure the band file covers at least 'end' bytes. It grows in
+	// large steps so that sequential writes don't extend it every time.
+	void grow_band(open_band_info *info, loff_t end) {
+		if (end <= info->alloc)
+			return;
+		loff_t new_alloc = std::min(band_size,
+			(end + BAND_GROW_SIZE - 1) / BAND_GROW_SIZE * BAND_GROW_SIZE);
+#if defined(__linux__)
+		if (posix_fallocate(info->fd, info->alloc, new_alloc - info->alloc) == 0) {
+			info->alloc = new_alloc;
+			return;
+		}
+#endif
+		if (ftruncate(info->fd, new_alloc) == 0)
+			info->alloc = new_alloc;
+	}
+	
 	ssize_t band_read(char *buf, loff_t band, size_t off, size_t len) {
-		open_ret st = open_band(band, false);
+		open_band_info *info = NULL;
+		open_ret st = open_band(band, false, &info);
 		if (st == OPEN_FAILED)
 			return -1;
 		
 		// Unallocated bytes 
-		size_t want = (st == OPEN_NOENT || off >= band_alloc) ? 0
-			: std::min(len, (size_t)band_alloc - off);
+		size_t want = (st == OPEN_NOENT || off >= info->alloc) ? 0
+			: std::min(len, (size_t)info->alloc - off);
 		if (want) {
-			if (lseek(band_fd, off, SEEK_SET) == -1)
-				return -1;
-			ssize_t err = ::read(band_fd, buf, want);
+			ssize_t err = pread(info->fd, buf, want, off);
 			if (err < want)
 				return err;
 		}
@@ -160,18 +204,18 @@ protected:
 		for (; nz > 0 && !buf[nz-1]; --nz)
 			; // pass
 		
-		open_ret st = open_band(band, nz);
+		open_band_info *info = NULL;
+		open_ret st = open_band(band, nz, &info);
 		if (st != OPEN_OK)
 			return st == OPEN_NOENT ? len : -1;
 
-		if (lseek(band_fd, off, SEEK_SET) == -1)
-			return -1;
-		
-		size_t space = (off >= band_alloc ? 0 : band_alloc - off);
+		size_t space = (off >= info->alloc ? 0 : info->alloc - off);
 		size_t want = std::max(nz, std::min(space, len));
-		ssize_t err = ::write(band_fd, buf, want);
+		if (want)
+			grow_band(info, off + want);
+		ssize_t err = pwrite(info->fd, buf, want, off);
 		if (err >= 0)
-			band_alloc = std::max(band_alloc, loff_t(off + err));
+			info->alloc = std::max(info->alloc, loff_t(off + err));
 		if (err < want)
 			return err;
 		return len;
@@ -313,3 +357,146 @@ disk_generic::status disk_sparsebundle_factory(const char *path,
 		total_size);
 	return disk_generic::DISK_VALID;
 }
+
+
+#ifdef TEST_SPARSEBUNDLE
+/*
+ *  Microbenchmark: compare sparse bundle throughput against a raw image
+ *  (build with "make sparsebundle-bench")
+ */
+
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static double get_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Raw image, for reference
+struct disk_raw : disk_generic {
+	disk_raw(int fd, loff_t size) : fd(fd), total_size(size) { }
+	virtual ~disk_raw() { close(fd); }
+	virtual bool is_read_only() { return false; }
+	virtual loff_t size() { return total_size; }
+	virtual size_t read(void *buf, loff_t offset, size_t length) {
+		ssize_t actual = pread(fd, buf, length, offset);
+		return actual < 0 ? 0 : actual;
+	}
+	virtual size_t write(void *buf, loff_t offset, size_t length) {
+		ssize_t actual = pwrite(fd, buf, length, offset);
+		return actual < 0 ? 0 : actual;
+	}
+	int fd;
+	loff_t total_size;
+};
+
+static bool write_file(const char *path, const char *data)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+		return false;
+	fputs(data, f);
+	fclose(f);
+	return true;
+}
+
+static disk_generic *create_sparsebundle(const char *dir, loff_t size, loff_t band_size)
+{
+	char path[PATH_MAX], plist[1024];
+	snprintf(path, sizeof(path), "%s/test.sparsebundle", dir);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/test.sparsebundle/bands", dir);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/test.sparsebundle/token", dir);
+	write_file(path, "");
+	snprintf(plist, sizeof(plist),
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<plist version=\"1.0\">\n<dict>\n"
+		"\t<key>CFBundleInfoDictionaryVersion</key>\n\t<string>6.0</string>\n"
+		"\t<key>band-size</key>\n\t<integer>%lld</integer>\n"
+		"\t<key>bundle-backingstore-version</key>\n\t<integer>1</integer>\n"
+		"\t<key>diskimage-bundle-type</key>\n\t<string>com.apple.diskimage.sparsebundle</string>\n"
+		"\t<key>size</key>\n\t<integer>%lld</integer>\n"
+		"</dict>\n</plist>\n", (long long)band_size, (long long)size);
+	snprintf(path, sizeof(path), "%s/test.sparsebundle/Info.plist", dir);
+	write_file(path, plist);
+
+	snprintf(path, sizeof(path), "%s/test.sparsebundle", dir);
+	disk_generic *disk = NULL;
+	if (disk_sparsebundle_factory(path, false, &disk) != disk_generic::DISK_VALID)
+		return NULL;
+	return disk;
+}
+
+static double run_pass(disk_generic *disk, bool write, size_t block, int count, bool random, uint8 *buf)
+{
+	loff_t n_blocks = disk->size() / block;
+	srand(1234);
+	double start = get_time();
+	for (int i = 0; i < count; i++) {
+		loff_t pos = (random ? ((loff_t)rand() * RAND_MAX + rand()) % n_blocks : i % n_blocks) * block;
+		size_t actual = write ? disk->write(buf, pos, block) : disk->read(buf, pos, block);
+		if (actual != block) {
+			fprintf(stderr, "%s failed at %lld\n", write ? "write" : "read", (long long)pos);
+			exit(1);
+		}
+	}
+	return (double)block * count / (get_time() - start) / (1024 * 1024);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = argc > 1 ? argv[1] : "/tmp";
+	const loff_t size = 256 * 1024 * 1024;
+	const loff_t band_size = 1024 * 1024;
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/test.img", dir);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, size) < 0) {
+		perror(path);
+		return 1;
+	}
+	disk_generic *raw = new disk_raw(fd, size);
+	disk_generic *bundle = create_sparsebundle(dir, size, band_size);
+	if (bundle == NULL) {
+		fprintf(stderr, "Can't create sparse bundle in %s\n", dir);
+		return 1;
+	}
+
+	static const struct {
+		const char *name;
+		bool write;
+		size_t block;
+		int count;
+		bool random;
+	} passes[] = {
+		{ "sequential write 64K", true, 65536, 4096, false },
+		{ "sequential read 64K", false, 65536, 4096, false },
+		{ "random read 4K", false, 4096, 50000, true },
+		{ "random read 192K", false, 196608, 2000, true },
+		{ "random write 4K", true, 4096, 20000, true },
+	};
+
+	uint8 *buf = new uint8[256 * 1024];
+	for (int i = 0; i < 256 * 1024; i++)
+		buf[i] = i * 7 + 1;
+	printf("%-24s %12s %12s\n", "", "raw MB/s", "bundle MB/s");
+	for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i++) {
+		double r = run_pass(raw, passes[i].write, passes[i].block, passes[i].count, passes[i].random, buf);
+		double b = run_pass(bundle, passes[i].write, passes[i].block, passes[i].count, passes[i].random, buf);
+		printf("%-24s %12.1f %12.1f\n", passes[i].name, r, b);
+	}
+
+	delete raw;
+	delete bundle;
+	delete[] buf;
+	unlink(path);
+	snprintf(path, sizeof(path), "rm -rf %s/test.sparsebundle", dir);
+	system(path);
+	return 0;
+}
+#endif
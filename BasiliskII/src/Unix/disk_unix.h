@@ -42,7 +42,12 @@ struct disk_generic {
 typedef disk_generic::status (disk_factory)(const char *path, bool read_only,
 	disk_generic **disk);
 
+extern disk_factory disk_overlay_factory;
+extern disk_factory disk_compressed_factory;
 extern disk_factory disk_sparsebundle_factory;
 extern disk_factory disk_vhd_factory;
 
+extern disk_generic::status disk_overlay_create(const char *path,
+	const char *dir, disk_generic **disk);
+
 #endif
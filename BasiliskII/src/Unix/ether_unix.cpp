@@ -40,6 +40,10 @@
 #include <sys/poll.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef __sun__
 #define BSD_COMP 1
 #endif
@@ -142,7 +146,7 @@ static int fd = -1;							// fd of sheep_net device
 static pthread_t ether_thread;				// Packet reception thread
 static pthread_attr_t ether_thread_attr;	// Packet reception thread attributes
 static bool thread_active = false;			// Flag: Packet reception thread installed
-static sem_t int_ack;						// Interrupt acknowledge semaphore
+static sem_t int_ack;						// Ring space semaphore, posted when the reception thread may go on
 static bool udp_tunnel;						// Flag: UDP tunnelling active, fd is the socket descriptor
 static int net_if_type = -1;				// Ethernet device type
 static char *net_if_name = NULL;			// TUN/TAP device name
@@ -169,6 +173,42 @@ static uint8 packet_buffer[2048];
 // Attached network protocols, maps protocol type to MacOS handler address
 static map<uint16, uint32> net_protocols;
 
+// Reception ring, filled by the packet reception thread and drained by
+// ether_do_interrupt(). There is one writer for each index, so no lock
+// is needed.
+const uint32 RX_RING_SIZE = 128;			// Number of packets, must be a power of two
+const int RX_BATCH = 32;					// Maximum number of packets per recvmmsg() call
+
+struct rx_slot {
+	int length;								// Packet length
+	uint8 data[1516];						// Packet data as read from the device
+#ifndef SHEEPSHAVER
+	struct sockaddr_in from;				// Sender of UDP tunnel packets
+#endif
+};
+
+static rx_slot *rx_ring = NULL;
+static uint32 rx_head;						// Next slot to fill, written by reception thread
+static uint32 rx_tail;						// Next slot to drain, written by ether_do_interrupt()
+static int rx_irq_pending;					// Flag: Ethernet interrupt triggered, ring not drained yet
+static int rx_thread_blocked;				// Flag: reception thread waits for free slots
+
+// Reception statistics
+static uint32 rx_packets;					// Packets put into the ring
+static uint64 rx_bytes;						// Bytes put into the ring
+static uint32 rx_dropped;					// Runt packets and read errors
+static uint32 rx_ring_full;					// Number of times the ring was full
+
+static inline uint32 rx_load(uint32 *p)
+{
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void rx_store(uint32 *p, uint32 v)
+{
+	__atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
 // Prototypes
 static void *receive_func(void *arg);
 static void *slirp_receive_func(void *arg);
@@ -196,6 +236,14 @@ static bool start_thread(void)
 		return false;
 	}
 
+	rx_ring = (rx_slot *)malloc(RX_RING_SIZE * sizeof(rx_slot));
+	if (rx_ring == NULL) {
+		printf("WARNING: Cannot allocate Ethernet reception ring");
+		return false;
+	}
+	rx_head = rx_tail = 0;
+	rx_irq_pending = rx_thread_blocked = 0;
+
 	Set_pthread_attr(&ether_thread_attr, 1);
 	thread_active = (pthread_create(&ether_thread, &ether_thread_attr, receive_func, NULL) == 0);
 	if (!thread_active) {
@@ -241,6 +289,9 @@ static void stop_thread(void)
 		sem_destroy(&int_ack);
 		thread_active = false;
 	}
+
+	free(rx_ring);
+	rx_ring = NULL;
 }
 
 
@@ -587,6 +638,8 @@ void ether_exit(void)
 	if (net_if_type == NET_IF_VDE)
 		vde_close(vde_conn);
 #endif
+
+	D(bug("%u packets (%llu bytes) received, %u dropped, reception ring full %u times\n", rx_packets, (unsigned long long)rx_bytes, rx_dropped, rx_ring_full));
 #if STATISTICS
 	// Show statistics
 	printf("%ld messages put on write queue\n", num_wput);
@@ -697,10 +750,7 @@ void EtherIRQ(void)
 	OTEnterInterrupt();
 	ether_do_interrupt();
 	OTLeaveInterrupt();
-
-	// Acknowledge interrupt to reception thread
 	D(bug(" EtherIRQ done\n"));
-	sem_post(&int_ack);
 }
 #else
 // Add multicast address
@@ -763,10 +813,7 @@ void EtherInterrupt(void)
 {
 	D(bug("EtherIRQ\n"));
 	ether_do_interrupt();
-
-	// Acknowledge interrupt to reception thread
 	D(bug(" EtherIRQ done\n"));
-	sem_post(&int_ack);
 }
 #endif
 
@@ -965,7 +1012,25 @@ void slirp_output(const uint8 *packet, int len)
 	write(slirp_output_fd, packet, len);
 }
 
-void *slirp_receive_func(void *arg)
+// Feed one packet from MacOS to slirp
+static void slirp_input_packet(int slirp_input_fd)
+{
+	int len;
+	read(slirp_input_fd, &len, sizeof(len));
+	uint8 packet[1516];
+	assert(len <= sizeof(packet));
+
+	// Read straight into a slirp mbuf when possible
+	int max;
+	uint8 *buf = slirp_input_begin(&max);
+	if (buf && len <= max) {
+		read(slirp_input_fd, buf, len);
+		slirp_input_end(len);
+	} else
+		read(slirp_input_fd, packet, len);
+}
+
+static void slirp_select_loop(void)
 {
 	const int slirp_input_fd = slirp_input_fds[0];
 
@@ -980,14 +1045,8 @@ void *slirp_receive_func(void *arg)
 		FD_SET(slirp_input_fd, &rfds);
 		tv.tv_sec = 0;
 		tv.tv_usec = 0;
-		if (select(slirp_input_fd + 1, &rfds, NULL, NULL, &tv) > 0) {
-			int len;
-			read(slirp_input_fd, &len, sizeof(len));
-			uint8 packet[1516];
-			assert(len <= sizeof(packet));
-			read(slirp_input_fd, packet, len);
-			slirp_input(packet, len);
-		}
+		if (select(slirp_input_fd + 1, &rfds, NULL, NULL, &tv) > 0)
+			slirp_input_packet(slirp_input_fd);
 
 		// ... in the output queue
 		nfds = -1;
@@ -1009,6 +1068,65 @@ void *slirp_receive_func(void *arg)
 		pthread_testcancel();
 #endif
 	}
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void slirp_epoll_cleanup(void *arg)
+{
+	close(*(int *)arg);
+}
+
+// Wait for packets from MacOS and for slirp socket events together
+static void slirp_epoll_loop(int epfd)
+{
+	const int slirp_input_fd = slirp_input_fds[0];
+	const int MAX_EVENTS = 64;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = slirp_input_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, slirp_input_fd, &ev) < 0)
+		return;
+
+	for (;;) {
+		int timeout = slirp_epoll_fill(epfd);
+#if ! USE_SLIRP_TIMEOUT
+		timeout = 10000;
+#endif
+		struct epoll_event events[MAX_EVENTS];
+		int n = epoll_wait(epfd, events, MAX_EVENTS, timeout < 0 ? -1 : (timeout + 999) / 1000);
+		if (n < 0)
+			n = 0;
+
+		// Packets from MacOS first, a few at a time
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.fd == slirp_input_fd) {
+				for (int j = 0; j < 32; j++) {
+					slirp_input_packet(slirp_input_fd);
+					struct pollfd pf = {slirp_input_fd, POLLIN, 0};
+					if (poll(&pf, 1, 0) <= 0)
+						break;
+				}
+			}
+		}
+
+		slirp_epoll_poll(events, n);
+	}
+}
+#endif
+
+void *slirp_receive_func(void *arg)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	int epfd = epoll_create(64);
+	if (epfd >= 0) {
+		pthread_cleanup_push(slirp_epoll_cleanup, &epfd);
+		slirp_epoll_loop(epfd);
+		pthread_cleanup_pop(1);
+	}
+#endif
+	slirp_select_loop();
 	return NULL;
 }
 #else
@@ -1023,6 +1141,128 @@ void slirp_output(const uint8 *packet, int len)
 #endif
 
 
+/*
+ *  Read one packet into reception ring slot, returns packet length or -1
+ */
+
+static int read_one_packet(rx_slot *s)
+{
+	ssize_t length;
+#ifndef SHEEPSHAVER
+	if (udp_tunnel) {
+		socklen_t from_len = sizeof(s->from);
+		length = recvfrom(fd, s->data, 1514, 0, (struct sockaddr *)&s->from, &from_len);
+	} else
+#endif
+#ifdef ENABLE_MACOSX_ETHERHELPER
+	if (net_if_type == NET_IF_ETHERHELPER) {
+		length = read_packet();
+		if (length > 0)
+			memcpy(s->data, packet_buffer + 2, length);
+	} else
+#endif
+#ifdef HAVE_LIBVDEPLUG
+	if (net_if_type == NET_IF_VDE)
+		length = vde_recv(vde_conn, s->data, 1514, 0);
+	else
+#endif
+#if defined(__linux__)
+		length = read(fd, s->data, net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
+#else
+		length = read(fd, s->data, 1514);
+#endif
+	return length;
+}
+
+
+/*
+ *  Read all pending packets into the reception ring (as far as they fit),
+ *  returns the number of packets read
+ */
+
+static int receive_packets(void)
+{
+	uint32 head = rx_head;
+	uint32 space = RX_RING_SIZE - (head - rx_load(&rx_tail));
+	int n = 0;
+
+#if defined(HAVE_RECVMMSG) && !defined(SHEEPSHAVER)
+	if (udp_tunnel) {
+
+		// Many datagrams with one system call
+		while (space > 0) {
+			struct mmsghdr msgs[RX_BATCH];
+			struct iovec iov[RX_BATCH];
+			int batch = space < (uint32)RX_BATCH ? space : RX_BATCH;
+			for (int i = 0; i < batch; i++) {
+				rx_slot *s = &rx_ring[(head + i) & (RX_RING_SIZE - 1)];
+				iov[i].iov_base = s->data;
+				iov[i].iov_len = 1514;
+				memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+				msgs[i].msg_hdr.msg_name = &s->from;
+				msgs[i].msg_hdr.msg_namelen = sizeof(s->from);
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			int got = recvmmsg(fd, msgs, batch, MSG_DONTWAIT, NULL);
+			if (got <= 0)
+				break;
+			uint32 first = head;
+			for (int i = 0; i < got; i++) {
+				int length = msgs[i].msg_len;
+				if (length < 14) {
+					rx_dropped++;
+					continue;
+				}
+
+				// Close the gap left by dropped packets
+				rx_slot *src = &rx_ring[(first + i) & (RX_RING_SIZE - 1)];
+				rx_slot *s = &rx_ring[head & (RX_RING_SIZE - 1)];
+				if (s != src) {
+					memcpy(s->data, src->data, length);
+					s->from = src->from;
+				}
+				s->length = length;
+				rx_packets++;
+				rx_bytes += length;
+				head++;
+				space--;
+				n++;
+			}
+			rx_store(&rx_head, head);
+			if (got < batch)
+				break;
+		}
+		return n;
+	}
+#endif
+
+	while (space > 0) {
+		rx_slot *s = &rx_ring[head & (RX_RING_SIZE - 1)];
+		int length = read_one_packet(s);
+		if (length < 0)
+			break;
+		if (length < 14) {		// Runt packet or end of file, try again after next poll()
+			rx_dropped++;
+			break;
+		}
+		s->length = length;
+		rx_packets++;
+		rx_bytes += length;
+		rx_store(&rx_head, ++head);
+		space--;
+		n++;
+
+#ifdef ENABLE_MACOSX_ETHERHELPER
+		// The helper tool connection blocks, only read what poll() announced
+		if (net_if_type == NET_IF_ETHERHELPER)
+			break;
+#endif
+	}
+	return n;
+}
+
+
 /*
  *  Packet reception thread
  */
@@ -1052,23 +1292,26 @@ static void *receive_func(void *arg)
 		if (res <= 0)
 			break;
 
-#ifdef ENABLE_MACOSX_ETHERHELPER
-		if (net_if_type == NET_IF_ETHERHELPER) {
-			if (read_packet() < 1) {
-				break;
-			}
+		if (!ether_driver_opened) {
+			Delay_usec(20000);
+			continue;
 		}
-#endif
-		if (ether_driver_opened) {
-			// Trigger Ethernet interrupt
-			D(bug(" packet received, triggering Ethernet interrupt\n"));
+
+		// Read packets into ring, trigger Ethernet interrupt unless one is pending
+		receive_packets();
+		if (rx_head != rx_load(&rx_tail) && __atomic_exchange_n(&rx_irq_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+			D(bug(" packets received, triggering Ethernet interrupt\n"));
 			SetInterruptFlag(INTFLAG_ETHER);
 			TriggerInterrupt();
+		}
 
-			// Wait for interrupt acknowledge by EtherInterrupt()
-			sem_wait(&int_ack);
-		} else
-			Delay_usec(20000);
+		// Ring full? Then wait until ether_do_interrupt() has drained it
+		if (rx_head - rx_load(&rx_tail) == RX_RING_SIZE) {
+			rx_ring_full++;
+			__atomic_store_n(&rx_thread_blocked, 1, __ATOMIC_SEQ_CST);
+			if (rx_head - rx_load(&rx_tail) == RX_RING_SIZE || __atomic_exchange_n(&rx_thread_blocked, 0, __ATOMIC_SEQ_CST) == 0)
+				sem_wait(&int_ack);
+		}
 	}
 	return NULL;
 }
@@ -1080,76 +1323,56 @@ static void *receive_func(void *arg)
 
 void ether_do_interrupt(void)
 {
+	// Packets arriving from now on need another interrupt
+	__atomic_store_n(&rx_irq_pending, 0, __ATOMIC_SEQ_CST);
+	if (rx_ring == NULL)
+		return;
+
 	// Call protocol handler for received packets
 	EthernetPacket ether_packet;
 	uint32 packet = ether_packet.addr();
-	ssize_t length;
-	for (;;) {
+	uint32 tail = rx_tail;
+	uint32 head = rx_load(&rx_head);
+	while (tail != head) {
+		rx_slot *s = &rx_ring[tail & (RX_RING_SIZE - 1)];
+		int length = s->length;
+		Host2Mac_memcpy(packet, s->data, length);
+#ifndef SHEEPSHAVER
+		struct sockaddr_in from = s->from;
+#endif
+		rx_store(&rx_tail, ++tail);
 
 #ifndef SHEEPSHAVER
 		if (udp_tunnel) {
-
-			// Read packet from socket
-			struct sockaddr_in from;
-			socklen_t from_len = sizeof(from);
-			length = recvfrom(fd, Mac2HostAddr(packet), 1514, 0, (struct sockaddr *)&from, &from_len);
-			if (length < 14)
-				break;
 			ether_udp_read(packet, length, &from);
-
-		} else
-#endif
-#ifdef ENABLE_MACOSX_ETHERHELPER
-		if (net_if_type == NET_IF_ETHERHELPER) {
-			unsigned short *pkt_len;
-			uint32 p = packet;
-
-			pkt_len = (unsigned short *)packet_buffer;
-			length = *pkt_len;
-			memcpy(Mac2HostAddr(packet), pkt_len + 1, length);
-			ether_dispatch_packet(p, length);
-			break;
-		} else
-#endif
-		{
-#ifdef HAVE_LIBVDEPLUG
-			if (net_if_type == NET_IF_VDE) {
-				length = vde_recv(vde_conn, Mac2HostAddr(packet), 1514, 0);
-			} else
-#endif
-			{
-				// Read packet from sheep_net device
-#if defined(__linux__)
-				length = read(fd, Mac2HostAddr(packet), net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
-#else
-				length = read(fd, Mac2HostAddr(packet), 1514);
+			continue;
+		}
 #endif
-			}
-
-			if (length < 14)
-				break;
 
 #if MONITOR
-			bug("Receiving Ethernet packet:\n");
-			for (int i=0; i<length; i++) {
-				bug("%02x ", ReadMacInt8(packet + i));
-			}
-			bug("\n");
+		bug("Receiving Ethernet packet:\n");
+		for (int i=0; i<length; i++) {
+			bug("%02x ", ReadMacInt8(packet + i));
+		}
+		bug("\n");
 #endif
 
-			// Pointer to packet data (Ethernet header)
-			uint32 p = packet;
+		// Pointer to packet data (Ethernet header)
+		uint32 p = packet;
 #if defined(__linux__)
-			if (net_if_type == NET_IF_ETHERTAP) {
-				p += 2;			// Linux ethertap has two random bytes before the packet
-				length -= 2;
-			}
+		if (net_if_type == NET_IF_ETHERTAP) {
+			p += 2;			// Linux ethertap has two random bytes before the packet
+			length -= 2;
+		}
 #endif
 
-			// Dispatch packet
-			ether_dispatch_packet(p, length);
-		}
+		// Dispatch packet
+		ether_dispatch_packet(p, length);
 	}
+
+	// Wake up reception thread if it waits for free slots
+	if (__atomic_exchange_n(&rx_thread_blocked, 0, __ATOMIC_SEQ_CST))
+		sem_post(&int_ack);
 }
 
 // Helper function for port forwarding
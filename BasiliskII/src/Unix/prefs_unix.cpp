@@ -35,12 +35,15 @@ prefs_desc platform_prefs_items[] = {
 	{"keycodefile", TYPE_STRING, false,    "path of keycode translation file"},
 	{"mousewheelmode", TYPE_INT32, false,  "mouse wheel support mode (0=page up/down, 1=cursor up/down)"},
 	{"mousewheellines", TYPE_INT32, false, "number of lines to scroll in mouse wheel mode 1"},
+	{"cpuprofile", TYPE_STRING, false,     "output file of PowerPC block profiler (collapsed stacks)"},
 #else
 	{"fbdevicefile", TYPE_STRING, false,   "path of frame buffer device specification file"},
 #endif
 	{"dsp", TYPE_STRING, false,            "audio output (dsp) device name"},
 	{"mixer", TYPE_STRING, false,          "audio mixer device name"},
 	{"idlewait", TYPE_BOOLEAN, false,      "sleep when idle"},
+	{"diskcache", TYPE_INT32, false,       "size of disk image block cache in KB (0 = no cache)"},
+	{"diskoverlay", TYPE_STRING, false,    "directory for copy-on-write overlays of disk image files"},
 #ifdef USE_SDL_VIDEO
 	{"sdlrender", TYPE_STRING, false,      "SDL_Renderer driver (\"auto\", \"software\" (may be faster), etc.)"},
 #endif
@@ -366,4 +369,5 @@ void AddPlatformPrefsDefaults(void)
 	PrefsReplaceString("mixer", "/dev/mixer");
 #endif
 	PrefsAddBool("idlewait", true);
+	PrefsAddInt32("diskcache", 0);
 }
@@ -24,6 +24,16 @@
 #include <sys/stat.h>
 #include <errno.h>
 
+#include <vector>
+#include <algorithm>
+
+#ifndef NO_STD_NAMESPACE
+using std::vector;
+using std::sort;
+using std::min;
+using std::max;
+#endif
+
 #ifdef HAVE_AVAILABILITYMACROS_H
 #include <AvailabilityMacros.h>
 #endif
@@ -69,6 +79,10 @@
 
 static disk_factory *disk_factories[] = {
 #ifndef STANDALONE_GUI
+	disk_overlay_factory,
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+	disk_compressed_factory,
+#endif
 	disk_sparsebundle_factory,
 #if defined(HAVE_LIBVHD)
 	disk_vhd_factory,
@@ -93,6 +107,11 @@ struct mac_file_handle {
 	bool is_media_present;		// Flag: media is inserted and available
 	disk_generic *generic_disk;
 
+	bool is_cached;				// Flag: accesses go through block cache
+	loff_t cache_next_offset;	// End of last cached read
+	uint32 cache_readahead;		// Current read-ahead window in blocks
+	bool cache_write_error;		// Flag: writing back cached blocks failed
+
 #if defined(__linux__)
 	int cdrom_cap;		// CD-ROM capability flags (only valid if is_cdrom is true)
 #elif defined(__FreeBSD__)
@@ -123,12 +142,507 @@ static void cdrom_close(mac_file_handle *fh);
 static bool cdrom_open(mac_file_handle *fh, const char *path = NULL);
 
 
+/*
+ *  Unbuffered access to file/device data
+ */
+
+static size_t raw_read(mac_file_handle *fh, void *buffer, loff_t offset, size_t length)
+{
+	if (fh->generic_disk)
+		return fh->generic_disk->read(buffer, offset, length);
+
+	// Seek to position
+	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
+		return 0;
+
+	// Read data
+	ssize_t actual = read(fh->fd, buffer, length);
+	return actual < 0 ? 0 : actual;
+}
+
+static size_t raw_write(mac_file_handle *fh, void *buffer, loff_t offset, size_t length)
+{
+	if (fh->generic_disk)
+		return fh->generic_disk->write(buffer, offset, length);
+
+	// Seek to position
+	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
+		return 0;
+
+	// Write data
+	ssize_t actual = write(fh->fd, buffer, length);
+	return actual < 0 ? 0 : actual;
+}
+
+
+/*
+ *  Block cache
+ *
+ *  Reads and writes to disk images go through an LRU cache of 4K blocks
+ *  that is shared by all drives. A miss is filled with one read for all
+ *  missing blocks of the request and, if the request continues the
+ *  previous one on the same drive, a growing read-ahead window. Written
+ *  blocks are kept in the cache until they are evicted, too many blocks
+ *  are dirty, or the volume is ejected or closed. Requests larger than
+ *  a quarter of the cache bypass it. Blocks that can't be written back
+ *  stay dirty, and further writes to the drive fail until they could be
+ *  written back.
+ */
+
+const int CACHE_BLOCK_BITS = 12;
+const uint32 CACHE_BLOCK_SIZE = 1 << CACHE_BLOCK_BITS;
+const uint32 CACHE_MAX_READAHEAD = 32;			// Maximum read-ahead in blocks
+const uint32 CACHE_MAX_BYPASS = 256 * 1024;		// Requests up to this size can be cached
+const uint32 CACHE_NONE = 0xffffffff;
+
+struct cache_block {
+	mac_file_handle *fh;	// File handle (NULL = free block)
+	loff_t num;				// Block number
+	uint32 hash_next;		// Next block in hash chain
+	uint32 lru_prev;		// Next more recently used block
+	uint32 lru_next;		// Next less recently used block
+	bool dirty;				// Flag: block must be written back
+};
+
+static B2_mutex *cache_lock = NULL;
+static cache_block *cache_blocks = NULL;	// Block descriptors
+static uint8 *cache_data = NULL;			// Block contents
+static uint8 *cache_buffer = NULL;			// Buffer for multi-block reads
+static uint8 *cache_flush_buffer = NULL;	// Buffer for coalesced writes
+static uint32 cache_buffer_size;
+static uint32 cache_max_request;			// Largest cached request
+static uint32 cache_num_blocks = 0;
+static uint32 *cache_hash = NULL;			// Hash table of chains
+static uint32 cache_hash_mask;
+static uint32 cache_lru_head, cache_lru_tail;	// Most/least recently used block
+static uint32 cache_num_dirty;
+
+// Statistics
+static struct {
+	uint64 hits;
+	uint64 misses;
+	uint64 readahead;
+	uint64 bypassed;
+	uint64 writebacks;
+	uint64 write_errors;
+} cache_stats;
+
+static inline uint32 cache_hash_of(mac_file_handle *fh, loff_t num)
+{
+	return ((uint32)((uintptr)fh >> 4) ^ (uint32)num * 0x9e3779b1) & cache_hash_mask;
+}
+
+static inline uint8 *cache_block_data(uint32 i)
+{
+	return cache_data + ((uintptr)i << CACHE_BLOCK_BITS);
+}
+
+// Find cached block, returns CACHE_NONE if not found
+static uint32 cache_find(mac_file_handle *fh, loff_t num)
+{
+	for (uint32 i = cache_hash[cache_hash_of(fh, num)]; i != CACHE_NONE; i = cache_blocks[i].hash_next) {
+		if (cache_blocks[i].fh == fh && cache_blocks[i].num == num)
+			return i;
+	}
+	return CACHE_NONE;
+}
+
+static void cache_lru_remove(uint32 i)
+{
+	cache_block &b = cache_blocks[i];
+	if (b.lru_prev != CACHE_NONE)
+		cache_blocks[b.lru_prev].lru_next = b.lru_next;
+	else
+		cache_lru_head = b.lru_next;
+	if (b.lru_next != CACHE_NONE)
+		cache_blocks[b.lru_next].lru_prev = b.lru_prev;
+	else
+		cache_lru_tail = b.lru_prev;
+}
+
+static void cache_lru_insert_head(uint32 i)
+{
+	cache_block &b = cache_blocks[i];
+	b.lru_prev = CACHE_NONE;
+	b.lru_next = cache_lru_head;
+	if (cache_lru_head != CACHE_NONE)
+		cache_blocks[cache_lru_head].lru_prev = i;
+	else
+		cache_lru_tail = i;
+	cache_lru_head = i;
+}
+
+static void cache_lru_insert_tail(uint32 i)
+{
+	cache_block &b = cache_blocks[i];
+	b.lru_next = CACHE_NONE;
+	b.lru_prev = cache_lru_tail;
+	if (cache_lru_tail != CACHE_NONE)
+		cache_blocks[cache_lru_tail].lru_next = i;
+	else
+		cache_lru_head = i;
+	cache_lru_tail = i;
+}
+
+// Mark block as most recently used
+static inline void cache_touch(uint32 i)
+{
+	if (cache_lru_head != i) {
+		cache_lru_remove(i);
+		cache_lru_insert_head(i);
+	}
+}
+
+// Remove block from hash table and put it at the end of the LRU list
+static void cache_drop(uint32 i)
+{
+	cache_block &b = cache_blocks[i];
+	uint32 *p = &cache_hash[cache_hash_of(b.fh, b.num)];
+	while (*p != i)
+		p = &cache_blocks[*p].hash_next;
+	*p = b.hash_next;
+	if (b.dirty)
+		cache_num_dirty--;
+	b.fh = NULL;
+	b.dirty = false;
+	cache_lru_remove(i);
+	cache_lru_insert_tail(i);
+}
+
+static bool cache_block_less(uint32 a, uint32 b)
+{
+	const cache_block &x = cache_blocks[a], &y = cache_blocks[b];
+	return x.fh < y.fh || (x.fh == y.fh && x.num < y.num);
+}
+
+// Write back dirty blocks of one file handle (or all if fh is NULL), returns false on error
+static bool cache_flush(mac_file_handle *fh)
+{
+	if (cache_num_dirty == 0)
+		return true;
+
+	vector<uint32> dirty;
+	for (uint32 i = 0; i < cache_num_blocks; i++) {
+		if (cache_blocks[i].dirty && (fh == NULL || cache_blocks[i].fh == fh))
+			dirty.push_back(i);
+	}
+	sort(dirty.begin(), dirty.end(), cache_block_less);
+
+	// Coalesce runs of consecutive blocks into single writes
+	const uint32 max_run = cache_buffer_size >> CACHE_BLOCK_BITS;
+	bool ok = true;
+	for (size_t i = 0; i < dirty.size(); ) {
+		const cache_block &first = cache_blocks[dirty[i]];
+		uint32 n = 0;
+		while (i + n < dirty.size() && n < max_run) {
+			const cache_block &b = cache_blocks[dirty[i + n]];
+			if (b.fh != first.fh || b.num != first.num + n)
+				break;
+			memcpy(cache_flush_buffer + (n << CACHE_BLOCK_BITS), cache_block_data(dirty[i + n]), CACHE_BLOCK_SIZE);
+			n++;
+		}
+		size_t length = n << CACHE_BLOCK_BITS;
+		mac_file_handle *bfh = first.fh;
+		if (raw_write(bfh, cache_flush_buffer, first.num << CACHE_BLOCK_BITS, length) != length) {
+			// Keep the blocks dirty, they are written back next time
+			if (!bfh->cache_write_error)
+				printf("WARNING: Cannot write back cached blocks of %s (%s)\n", bfh->name, strerror(errno));
+			bfh->cache_write_error = true;
+			cache_stats.write_errors++;
+			ok = false;
+			i += n;
+			continue;
+		}
+		cache_stats.writebacks += n;
+		for (uint32 j = 0; j < n; j++)
+			cache_blocks[dirty[i + j]].dirty = false;
+		cache_num_dirty -= n;
+		i += n;
+	}
+
+	// Drives are in error state as long as they have blocks left to write back
+	for (size_t i = 0; i < dirty.size(); i++)
+		cache_blocks[dirty[i]].fh->cache_write_error = false;
+	for (size_t i = 0; i < dirty.size(); i++) {
+		if (cache_blocks[dirty[i]].dirty)
+			cache_blocks[dirty[i]].fh->cache_write_error = true;
+	}
+	return ok;
+}
+
+// Forget all blocks of a file handle, dirty ones too unless keep_dirty is set
+static void cache_invalidate(mac_file_handle *fh, bool keep_dirty = false)
+{
+	for (uint32 i = 0; i < cache_num_blocks; i++) {
+		if (cache_blocks[i].fh == fh && !(keep_dirty && cache_blocks[i].dirty))
+			cache_drop(i);
+	}
+}
+
+// Allocate block for new data, evicting the least recently used one that
+// is clean or could be written back, returns CACHE_NONE if there is none
+static uint32 cache_alloc(mac_file_handle *fh, loff_t num)
+{
+	uint32 i = cache_lru_tail;
+	if (cache_blocks[i].fh) {
+		if (cache_blocks[i].dirty && !cache_blocks[i].fh->cache_write_error)
+			cache_flush(cache_blocks[i].fh);
+		while (i != CACHE_NONE && cache_blocks[i].dirty)
+			i = cache_blocks[i].lru_prev;
+		if (i == CACHE_NONE)
+			return CACHE_NONE;
+		if (cache_blocks[i].fh)
+			cache_drop(i);
+	}
+	cache_block &b = cache_blocks[i];
+	b.fh = fh;
+	b.num = num;
+	b.dirty = false;
+	uint32 h = cache_hash_of(fh, num);
+	b.hash_next = cache_hash[h];
+	cache_hash[h] = i;
+	cache_touch(i);
+	return i;
+}
+
+static void cache_init(void)
+{
+	int32 size = PrefsFindInt32("diskcache");
+	if (size <= 0)
+		return;
+	cache_num_blocks = ((uint32)size * 1024) >> CACHE_BLOCK_BITS;
+	if (cache_num_blocks < 16)
+		cache_num_blocks = 16;
+	cache_max_request = cache_num_blocks / 4 * CACHE_BLOCK_SIZE;
+	if (cache_max_request > CACHE_MAX_BYPASS)
+		cache_max_request = CACHE_MAX_BYPASS;
+	cache_buffer_size = cache_max_request + (CACHE_MAX_READAHEAD + 1) * CACHE_BLOCK_SIZE;
+
+	uint32 hash_size = 1;
+	while (hash_size < cache_num_blocks)
+		hash_size <<= 1;
+	cache_hash_mask = hash_size - 1;
+
+	cache_blocks = new cache_block[cache_num_blocks];
+	cache_hash = new uint32[hash_size];
+	cache_data = (uint8 *)malloc((size_t)cache_num_blocks << CACHE_BLOCK_BITS);
+	cache_buffer = (uint8 *)malloc(cache_buffer_size);
+	cache_flush_buffer = (uint8 *)malloc(cache_buffer_size);
+	cache_lock = B2_create_mutex();
+	if (cache_data == NULL || cache_buffer == NULL || cache_flush_buffer == NULL || cache_lock == NULL) {
+		printf("WARNING: Cannot allocate %d KB disk cache\n", size);
+		free(cache_data);
+		free(cache_buffer);
+		free(cache_flush_buffer);
+		cache_data = cache_buffer = cache_flush_buffer = NULL;
+		delete[] cache_blocks;
+		delete[] cache_hash;
+		cache_blocks = NULL;
+		cache_hash = NULL;
+		if (cache_lock) {
+			B2_delete_mutex(cache_lock);
+			cache_lock = NULL;
+		}
+		cache_num_blocks = 0;
+		return;
+	}
+
+	for (uint32 i = 0; i < hash_size; i++)
+		cache_hash[i] = CACHE_NONE;
+	cache_lru_head = cache_lru_tail = CACHE_NONE;
+	for (uint32 i = 0; i < cache_num_blocks; i++) {
+		cache_blocks[i].fh = NULL;
+		cache_blocks[i].dirty = false;
+		cache_lru_insert_tail(i);
+	}
+	cache_num_dirty = 0;
+	memset(&cache_stats, 0, sizeof(cache_stats));
+	D(bug("Disk cache: %u blocks of %u bytes\n", cache_num_blocks, CACHE_BLOCK_SIZE));
+}
+
+static void cache_exit(void)
+{
+	if (cache_num_blocks == 0)
+		return;
+	if (!cache_flush(NULL))
+		printf("WARNING: Unwritten disk data is lost\n");
+	printf("Disk cache: %llu hits, %llu misses, %llu blocks read ahead, %llu uncached requests, %llu blocks written back, %llu write errors\n",
+		   (unsigned long long)cache_stats.hits, (unsigned long long)cache_stats.misses,
+		   (unsigned long long)cache_stats.readahead, (unsigned long long)cache_stats.bypassed,
+		   (unsigned long long)cache_stats.writebacks, (unsigned long long)cache_stats.write_errors);
+	free(cache_data);
+	free(cache_buffer);
+	free(cache_flush_buffer);
+	cache_data = cache_buffer = cache_flush_buffer = NULL;
+	delete[] cache_blocks;
+	delete[] cache_hash;
+	cache_blocks = NULL;
+	cache_hash = NULL;
+	B2_delete_mutex(cache_lock);
+	cache_lock = NULL;
+	cache_num_blocks = 0;
+}
+
+static size_t cache_read(mac_file_handle *fh, uint8 *buffer, loff_t offset, size_t length)
+{
+	// Large request? Then read directly, taking newer data from dirty blocks
+	if (length > cache_max_request) {
+		cache_stats.bypassed++;
+		size_t actual = raw_read(fh, buffer, offset, length);
+		if (cache_num_dirty) {
+			loff_t last = (offset + actual - 1) >> CACHE_BLOCK_BITS;
+			for (loff_t num = offset >> CACHE_BLOCK_BITS; actual && num <= last; num++) {
+				uint32 i = cache_find(fh, num);
+				if (i == CACHE_NONE || !cache_blocks[i].dirty)
+					continue;
+				loff_t start = max(offset, num << CACHE_BLOCK_BITS);
+				loff_t end = min(offset + (loff_t)actual, (num + 1) << CACHE_BLOCK_BITS);
+				memcpy(buffer + (start - offset), cache_block_data(i) + (start & (CACHE_BLOCK_SIZE - 1)), end - start);
+			}
+		}
+		fh->cache_next_offset = offset + actual;
+		fh->cache_readahead = 0;
+		return actual;
+	}
+
+	// Sequential stream? Then increase read-ahead window
+	if (offset == fh->cache_next_offset) {
+		if (fh->cache_readahead == 0)
+			fh->cache_readahead = 4;
+		else if (fh->cache_readahead < CACHE_MAX_READAHEAD)
+			fh->cache_readahead *= 2;
+	} else
+		fh->cache_readahead = 0;
+
+	size_t actual = 0;
+	const loff_t last = (offset + length - 1) >> CACHE_BLOCK_BITS;
+	for (loff_t num = offset >> CACHE_BLOCK_BITS; num <= last; ) {
+		loff_t block_start = num << CACHE_BLOCK_BITS;
+		uint32 i = cache_find(fh, num);
+		if (i != CACHE_NONE) {
+
+			// Hit, copy data from cache
+			cache_stats.hits++;
+			cache_touch(i);
+			size_t skip = offset + actual - block_start;
+			size_t size = min(length - actual, (size_t)CACHE_BLOCK_SIZE - skip);
+			memcpy(buffer + actual, cache_block_data(i) + skip, size);
+			actual += size;
+			num++;
+			continue;
+		}
+
+		// Miss, read all missing blocks of the request plus read-ahead
+		uint32 n = 1;
+		while (num + n <= last && cache_find(fh, num + n) == CACHE_NONE)
+			n++;
+		uint32 wanted = n;
+		if (num + n > last) {
+			for (uint32 ra = 0; ra < fh->cache_readahead && cache_find(fh, num + n) == CACHE_NONE; ra++)
+				n++;
+		}
+		cache_stats.misses += wanted;
+		size_t got = raw_read(fh, cache_buffer, block_start, (size_t)n << CACHE_BLOCK_BITS);
+
+		// Enter complete blocks into cache
+		uint32 complete = got >> CACHE_BLOCK_BITS;
+		for (uint32 j = 0; j < complete; j++) {
+			uint32 i = cache_alloc(fh, num + j);
+			if (i != CACHE_NONE)
+				memcpy(cache_block_data(i), cache_buffer + (j << CACHE_BLOCK_BITS), CACHE_BLOCK_SIZE);
+		}
+		if (complete > wanted)
+			cache_stats.readahead += complete - wanted;
+
+		// Copy requested part
+		size_t skip = offset + actual - block_start;
+		if (got <= skip)
+			break;
+		size_t size = min(length - actual, ((size_t)wanted << CACHE_BLOCK_BITS) - skip);
+		if (size > got - skip)
+			size = got - skip;
+		memcpy(buffer + actual, cache_buffer + skip, size);
+		actual += size;
+		if (complete < wanted)
+			break;
+		num += wanted;
+	}
+
+	fh->cache_next_offset = offset + actual;
+	return actual;
+}
+
+static size_t cache_write(mac_file_handle *fh, uint8 *buffer, loff_t offset, size_t length)
+{
+	const loff_t first = offset >> CACHE_BLOCK_BITS;
+	const loff_t last = (offset + length - 1) >> CACHE_BLOCK_BITS;
+
+	// Earlier data could not be written back? Then report an error until it is
+	if (fh->cache_write_error && !cache_flush(fh))
+		return 0;
+
+	// Large request? Then write directly and update cached blocks
+	if (length > cache_max_request) {
+		cache_stats.bypassed++;
+		size_t actual = raw_write(fh, buffer, offset, length);
+		for (loff_t num = first; num <= last; num++) {
+			uint32 i = cache_find(fh, num);
+			if (i == CACHE_NONE)
+				continue;
+			loff_t start = max(offset, num << CACHE_BLOCK_BITS);
+			loff_t end = min(offset + (loff_t)length, (num + 1) << CACHE_BLOCK_BITS);
+			memcpy(cache_block_data(i) + (start & (CACHE_BLOCK_SIZE - 1)), buffer + (start - offset), end - start);
+		}
+		return actual;
+	}
+
+	size_t actual = 0;
+	for (loff_t num = first; num <= last; num++) {
+		loff_t block_start = num << CACHE_BLOCK_BITS;
+		size_t skip = offset + actual - block_start;
+		size_t size = min(length - actual, (size_t)CACHE_BLOCK_SIZE - skip);
+		uint32 i = cache_find(fh, num);
+		if (i == CACHE_NONE) {
+			if (size == CACHE_BLOCK_SIZE) {
+				if ((i = cache_alloc(fh, num)) == CACHE_NONE)
+					break;
+			} else {
+				// Partial block, read old contents first
+				if (raw_read(fh, cache_buffer, block_start, CACHE_BLOCK_SIZE) != CACHE_BLOCK_SIZE) {
+					// Incomplete block at end of file, write through
+					if (raw_write(fh, buffer + actual, offset + actual, size) != size)
+						break;
+					actual += size;
+					continue;
+				}
+				if ((i = cache_alloc(fh, num)) == CACHE_NONE)
+					break;
+				memcpy(cache_block_data(i), cache_buffer, CACHE_BLOCK_SIZE);
+			}
+		} else
+			cache_touch(i);
+		memcpy(cache_block_data(i) + skip, buffer + actual, size);
+		if (!cache_blocks[i].dirty) {
+			cache_blocks[i].dirty = true;
+			cache_num_dirty++;
+		}
+		actual += size;
+	}
+
+	// Don't let too much unwritten data accumulate
+	if (cache_num_dirty > cache_num_blocks / 2)
+		cache_flush(NULL);
+	return actual;
+}
+
+
 /*
  *  Initialization
  */
 
 void SysInit(void)
 {
+	cache_init();
 #if defined __MACOSX__
 	extern void DarwinSysInit(void);
 	DarwinSysInit();
@@ -142,6 +656,7 @@ void SysInit(void)
 
 void SysExit(void)
 {
+	cache_exit();
 #if defined __MACOSX__
 	extern void DarwinSysExit(void);
 	DarwinSysExit();
@@ -540,6 +1055,18 @@ static mac_file_handle *open_filehandle(const char *name)
 		return fh;
 }
 
+static mac_file_handle *open_generic(const char *name, disk_generic *generic)
+{
+	mac_file_handle *fh = open_filehandle(name);
+	fh->generic_disk = generic;
+	fh->file_size = generic->size();
+	fh->read_only = generic->is_read_only();
+	fh->is_media_present = true;
+	fh->is_cached = cache_num_blocks > 0;
+	sys_add_mac_file_handle(fh);
+	return fh;
+}
+
 void *Sys_open(const char *name, bool read_only, bool is_cdrom)
 {
 	bool is_file = strncmp(name, "/dev/", 5) != 0;
@@ -572,6 +1099,7 @@ void *Sys_open(const char *name, bool read_only, bool is_cdrom)
 #endif
 
 	D(bug("Sys_open(%s, %s)\n", name, read_only ? "read-only" : "read/write"));
+	bool want_read_only = read_only;
 
 	// Check if write access is allowed, set read-only flag if not
 	if (!read_only && access(name, W_OK))
@@ -614,16 +1142,22 @@ void *Sys_open(const char *name, bool read_only, bool is_cdrom)
 		disk_generic::status st = f(name, read_only, &generic);
 		if (st == disk_generic::DISK_INVALID)
 			return NULL;
-		if (st == disk_generic::DISK_VALID) {
-			mac_file_handle *fh = open_filehandle(name);
-			fh->generic_disk = generic;
-			fh->file_size = generic->size();
-			fh->read_only = generic->is_read_only();
-			fh->is_media_present = true;
-			sys_add_mac_file_handle(fh);
-			return fh;
-		}
+		if (st == disk_generic::DISK_VALID)
+			return open_generic(name, generic);
+	}
+
+#ifndef STANDALONE_GUI
+	// Writable disk image file? Then put a new copy-on-write overlay over it
+	const char *overlay_dir = PrefsFindString("diskoverlay");
+	if (overlay_dir && *overlay_dir && is_file && !is_cdrom && !want_read_only) {
+		disk_generic *generic;
+		disk_generic::status st = disk_overlay_create(name, overlay_dir, &generic);
+		if (st == disk_generic::DISK_INVALID)
+			return NULL;
+		if (st == disk_generic::DISK_VALID)
+			return open_generic(name, generic);
 	}
+#endif
 
 	int open_flags = (read_only ? O_RDONLY : O_RDWR);
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__MACOSX__)
@@ -667,6 +1201,7 @@ void *Sys_open(const char *name, bool read_only, bool is_cdrom)
 			lseek(fd, 0, SEEK_SET);
 			read(fd, data, 256);
 			FileDiskLayout(size, data, fh->start_byte, fh->file_size);
+			fh->is_cached = cache_num_blocks > 0;
 		} else {
 			struct stat st;
 			if (fstat(fd, &st) == 0) {
@@ -727,6 +1262,15 @@ void Sys_close(void *arg)
 
 	sys_remove_mac_file_handle(fh);
 
+	// Write back and forget cached blocks
+	if (fh->is_cached && cache_num_blocks) {
+		B2_lock_mutex(cache_lock);
+		if (!cache_flush(fh))
+			printf("WARNING: Unwritten data of %s is lost\n", fh->name);
+		cache_invalidate(fh);
+		B2_unlock_mutex(cache_lock);
+	}
+
 #if defined(BINCUE)
 	if (fh->is_bincue)
 		close_bincue(fh->bincue_fd);
@@ -760,15 +1304,14 @@ size_t Sys_read(void *arg, void *buffer, loff_t offset, size_t length)
 		return read_bincue(fh->bincue_fd, buffer, offset, length);
 #endif
 
-	if (fh->generic_disk)
-		return fh->generic_disk->read(buffer, offset, length);
-	
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
+	if (fh->is_cached && length) {
+		B2_lock_mutex(cache_lock);
+		size_t actual = cache_read(fh, (uint8 *)buffer, offset, length);
+		B2_unlock_mutex(cache_lock);
+		return actual;
+	}
 
-	// Read data
-	return read(fh->fd, buffer, length);
+	return raw_read(fh, buffer, offset, length);
 }
 
 
@@ -783,15 +1326,14 @@ size_t Sys_write(void *arg, void *buffer, loff_t offset, size_t length)
 	if (!fh)
 		return 0;
 
-	if (fh->generic_disk)
-		return fh->generic_disk->write(buffer, offset, length);
-
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
+	if (fh->is_cached && length) {
+		B2_lock_mutex(cache_lock);
+		size_t actual = cache_write(fh, (uint8 *)buffer, offset, length);
+		B2_unlock_mutex(cache_lock);
+		return actual;
+	}
 
-	// Write data
-	return write(fh->fd, buffer, length);
+	return raw_write(fh, buffer, offset, length);
 }
 
 
@@ -849,6 +1391,15 @@ void SysEject(void *arg)
 	if (!fh)
 		return;
 
+	// Write back and forget cached blocks, blocks that could not be
+	// written back are kept and retried by the next flush
+	if (fh->is_cached) {
+		B2_lock_mutex(cache_lock);
+		cache_flush(fh);
+		cache_invalidate(fh, true);
+		B2_unlock_mutex(cache_lock);
+	}
+
 #if defined(__linux__)
 	if (fh->is_floppy) {
 		if (fh->fd >= 0) {
@@ -220,6 +220,7 @@ typedef uae_u32 uaecptr;
 /* Timing functions */
 extern uint64 GetTicks_usec(void);
 extern void Delay_usec(uint64 usec);
+extern void Delay_until_usec(uint64 ticks);
 
 /* Spinlocks */
 #ifdef __GNUC__
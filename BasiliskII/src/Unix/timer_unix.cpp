@@ -339,6 +339,27 @@ void Delay_usec(uint64 usec)
 }
 
 
+/*
+ *  Delay until the microsecond timer reaches the specified value
+ *  (an absolute deadline doesn't drift if the thread is preempted
+ *  between reading the clock and going to sleep)
+ */
+
+void Delay_until_usec(uint64 ticks)
+{
+#if defined(HAVE_CLOCK_NANOSLEEP) && defined(HAVE_CLOCK_GETTIME) && !defined(__MACH__)
+	struct timespec t;
+	t.tv_sec = ticks / 1000000;
+	t.tv_nsec = (ticks % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &t, NULL) == EINTR) ;
+#else
+	int64 delay = ticks - GetTicks_usec();
+	if (delay > 0)
+		Delay_usec(delay);
+#endif
+}
+
+
 /*
  *  Suspend emulator thread, virtual CPU in idle mode
  */
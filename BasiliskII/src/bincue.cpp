@@ -40,6 +40,9 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <errno.h>
+#ifdef HAVE_PREADV
+#include <sys/uio.h>
+#endif
 
 #include <list>
 
@@ -65,6 +68,8 @@ static int bincue_core_audio_callback(void);
 #define MAXTRACK 100
 #define MAXLINE 512
 #define CD_FRAMES 75
+#define MAX_BATCH_SECTORS 64	// Maximum number of raw sectors per read
+#define AUDIO_READAHEAD (32 * 2352)	// Audio data read at once during playback
 //#define RAW_SECTOR_SIZE		2352
 //#define COOKED_SECTOR_SIZE	2048
 
@@ -112,6 +117,7 @@ typedef struct {
 	int cooked_sector_size; // Actual data bytes per sector (depends on Mode)
 	int header_size;		// Number of bytes used in header
 	int big_endian_audio;   // Expect raw audio samples in big-endian format
+	uint8 *batchbuf;		// Raw sectors of batched reads (if no preadv())
 } CueSheet;
 
 typedef struct CDPlayer {
@@ -126,6 +132,9 @@ typedef struct CDPlayer {
 	uint8 volume_right;			// CD player volume (right)
 	uint8 volume_mono;			// CD player single-channel volume
 	loff_t fileoffset;			// offset from file beginning to audiostart
+	uint8 *readahead;			// audio data read ahead
+	loff_t readahead_pos;		// file offset of read-ahead data
+	size_t readahead_len;		// bytes of read-ahead data
 	bool audio_enabled;			// audio initialized for this player?
 	bool scanning;				// is there currently scanning in progress
 	int reverse;                // for scanning, 0=forward, 1=reverse
@@ -523,6 +532,7 @@ void *open_bincue(const char *name)
 		D(bug("malloc failed\n"));
 		return NULL;
 	}
+	cs->batchbuf = NULL;
 	if (LoadCueSheet(name, cs)) {
 		CDPlayer *player = (CDPlayer *) malloc(sizeof(CDPlayer));
 		player->cs = cs;
@@ -531,6 +541,9 @@ void *open_bincue(const char *name)
 		player->volume_mono = 0;
 		player->audio_enabled = false;
 		player->scanning = false;
+		player->readahead = NULL;
+		player->readahead_pos = 0;
+		player->readahead_len = 0;
 #ifdef OSX_CORE_AUDIO
 		player->audio_enabled = true;
 #endif
@@ -568,10 +581,12 @@ void close_bincue(void *fh)
 
 		players.remove(player);
 
+		free(cs->batchbuf);
 		free(cs);
 #ifdef USE_SDL_AUDIO
 		ClosePlayerStream(player);
 #endif
+		free(player->readahead);
 		free(player);
 	}
 }
@@ -590,56 +605,104 @@ void close_bincue(void *fh)
  * sector.  We compute the byte address of that sector (sec)
  * and the offset of the first byte we want within that sector (secoff)
  *
- * Reading is performed one raw sector at a time, extracting as many
- * valid bytes as possible from that raw sector (available)
+ * Up to MAX_BATCH_SECTORS raw sectors are read at a time. With preadv(),
+ * the valid bytes of each sector go straight to the target buffer and the
+ * rest to a scratch buffer, otherwise the raw sectors are read into
+ * batchbuf and the valid bytes copied from there.
  */
 
 size_t read_bincue(void *fh, void *b, loff_t offset, size_t len)
 {
 	CueSheet *cs = (CueSheet *) fh;
-	
+	if (cs == NULL)
+		return -1;
+
 	size_t bytes_read = 0;						// bytes read so far
 	unsigned char *buf = (unsigned char *) b;	// target buffer
-	unsigned char secbuf[cs->raw_sector_size];		// temporary buffer
+	const size_t raw = cs->raw_sector_size;
+	const size_t cooked = cs->cooked_sector_size;
 
-	off_t sec = ((offset/cs->cooked_sector_size) * cs->raw_sector_size);
-	off_t secoff = offset % cs->cooked_sector_size;
+	off_t sec = ((offset/cooked) * raw);
+	size_t secoff = offset % cooked;
 
 	// sec contains location (in bytes) of next raw sector to read
 	// secoff contains offset within that sector at which to start
 	// reading since we can request a read that starts in the middle
 	// of a sector
 
-	if (cs == NULL || lseek(cs->binfh, sec, SEEK_SET) < 0) {
+#ifdef HAVE_PREADV
+	unsigned char scratch[raw];
+#else
+	if (cs->batchbuf == NULL && (cs->batchbuf = (uint8 *) malloc(MAX_BATCH_SECTORS * raw)) == NULL)
 		return -1;
-	}
+	if (lseek(cs->binfh, sec, SEEK_SET) < 0)
+		return -1;
+#endif
 	while (len) {
 
-		// bytes available in next raw sector or len (bytes)
-		// we want whichever is less
+		// number of raw sectors holding the rest of the request
+		// (or as many as we read at once)
 
-		size_t available = cs->cooked_sector_size - secoff;
-		available = (available > len) ? len : available;
+		size_t nsec = (secoff + len + cooked - 1) / cooked;
+		if (nsec > MAX_BATCH_SECTORS)
+			nsec = MAX_BATCH_SECTORS;
 
-		// read the next raw sector
+		// bytes available in each raw sector, the first one may start
+		// in the middle and the last one may end early
 
-		if (read(cs->binfh, secbuf, cs->raw_sector_size) != cs->raw_sector_size) {
-			return bytes_read;
+		size_t available[MAX_BATCH_SECTORS];
+		size_t wanted = 0;
+		for (size_t i = 0; i < nsec; i++) {
+			size_t skip = (i == 0) ? secoff : 0;
+			available[i] = cooked - skip;
+			if (available[i] > len - wanted)
+				available[i] = len - wanted;
+			wanted += available[i];
+		}
+
+#ifdef HAVE_PREADV
+		// scatter header, cooked bytes and trailer of every sector
+
+		struct iovec iov[3 * MAX_BATCH_SECTORS];
+		int niov = 0;
+		size_t dest = bytes_read;
+		for (size_t i = 0; i < nsec; i++) {
+			size_t head = cs->header_size + ((i == 0) ? secoff : 0);
+			size_t tail = raw - head - available[i];
+			if (head) {
+				iov[niov].iov_base = scratch;
+				iov[niov++].iov_len = head;
+			}
+			iov[niov].iov_base = &buf[dest];
+			iov[niov++].iov_len = available[i];
+			if (tail) {
+				iov[niov].iov_base = scratch;
+				iov[niov++].iov_len = tail;
+			}
+			dest += available[i];
 		}
+		ssize_t actual = preadv(cs->binfh, iov, niov, sec);
+#else
+		ssize_t actual = read(cs->binfh, cs->batchbuf, nsec * raw);
+#endif
+		size_t complete = (actual < 0) ? 0 : actual / raw;
 
-		// copy cooked sector bytes (skip header if needed, typically 16 bytes)
-		// we want out of those available
+		// account for (and copy, if needed) the complete sectors we got
 
-		bcopy(&secbuf[cs->header_size+secoff], &buf[bytes_read], available);
+		for (size_t i = 0; i < complete; i++) {
+#ifndef HAVE_PREADV
+			bcopy(&cs->batchbuf[i * raw + cs->header_size + ((i == 0) ? secoff : 0)], &buf[bytes_read], available[i]);
+#endif
+			bytes_read += available[i];
+			len -= available[i];
+		}
+		if (complete < nsec)
+			return bytes_read;
 
 		// next sector we start at the beginning
 
+		sec += nsec * raw;
 		secoff = 0;
-
-		// increment running count decrement request
-
-		bytes_read += available;
-		len -= available;
 	}
 	return bytes_read;
 }
@@ -959,6 +1022,48 @@ void CDGetVol_bincue(void* fh, uint8* left, uint8* right) {
 	}
 }
 
+/*
+ * Audio data read (raw)
+ * Playback asks for a few KB at a time, so read AUDIO_READAHEAD bytes
+ * at once and serve the following requests from that buffer. Returns
+ * the number of bytes read, -1 on read errors and -2 on seek errors.
+ */
+
+static ssize_t read_audio(CDPlayer *player, uint8 *dest, loff_t pos, size_t len)
+{
+	if (len == 0)
+		return 0;
+
+	// in read-ahead buffer?
+
+	if (player->readahead && pos >= player->readahead_pos &&
+		pos + (loff_t)len <= player->readahead_pos + (loff_t)player->readahead_len) {
+		memcpy(dest, player->readahead + (pos - player->readahead_pos), len);
+		return len;
+	}
+
+	if (lseek(player->audiofh, pos, SEEK_SET) < 0)
+		return -2;
+
+	if (len >= AUDIO_READAHEAD ||
+		(player->readahead == NULL && (player->readahead = (uint8 *) malloc(AUDIO_READAHEAD)) == NULL))
+		return read(player->audiofh, dest, len);
+
+	// refill read-ahead buffer
+
+	ssize_t ret = read(player->audiofh, player->readahead, AUDIO_READAHEAD);
+	if (ret < 0) {
+		player->readahead_len = 0;
+		return ret;
+	}
+	player->readahead_pos = pos;
+	player->readahead_len = ret;
+	if ((size_t)ret < len)
+		len = ret;
+	memcpy(dest, player->readahead, len);
+	return len;
+}
+
 static uint8 *fill_buffer(int stream_len, CDPlayer* player)
 {
 	static uint8 *buf = 0;
@@ -1056,18 +1161,17 @@ static uint8 *fill_buffer(int stream_len, CDPlayer* player)
 			}
 			current_read_bytes_limit = full_read_bytes_limit;
 
-			if (lseek(player->audiofh,
-					  player->fileoffset + player->audioposition - player->silence,
-						  SEEK_SET) < 0)
-				return NULL;
-
 			if (available < 0) {
 				player->audioposition += available; // correct end !;
 				available = 0;
 			}
 
-			ssize_t ret = 0;
-			if ((ret = read(player->audiofh, &buf[offset], available)) >= 0) {
+			ssize_t ret = read_audio(player, &buf[offset],
+					  player->fileoffset + player->audioposition - player->silence,
+					  available);
+			if (ret == -2)
+				return NULL;
+			if (ret >= 0) {
 				player->audioposition += ret;
 				offset += ret;
 				available -= ret;
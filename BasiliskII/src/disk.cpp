@@ -31,6 +31,10 @@
 #include <string.h>
 #include <vector>
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #ifndef NO_STD_NAMESPACE
 using std::vector;
 #endif
@@ -97,6 +101,140 @@ uint32 DiskIconAddr;
 static bool acc_run_called = false;
 
 
+/*
+ *  Asynchronous I/O
+ *
+ *  Asynchronous Prime() calls are handed to a host thread and the driver
+ *  returns to the Device Manager right away. When the transfer is done, the
+ *  thread triggers INTFLAG_DISK and DiskInterrupt() fills in the parameter
+ *  block and enqueues a Deferred Task that calls IODone. The Device Manager
+ *  only has one request per driver in flight, so one thread is enough.
+ */
+
+#ifdef HAVE_PTHREADS
+#define ASYNC_DISK_IO 1
+#endif
+
+// Disk driver Deferred Task structure
+enum {
+	diskdtCode = 20,	// DT code is stored here
+	diskdtResult = 30,
+	diskdtDCE = 34,
+	SIZEOF_diskdt = 38
+};
+
+#if ASYNC_DISK_IO
+enum {
+	IO_IDLE,			// No request
+	IO_QUEUED,			// Request waiting for I/O thread
+	IO_DONE				// Request complete, waiting for DiskInterrupt()
+};
+
+struct disk_request {
+	uint32 pb, dce;		// Mac parameter block and DCE
+	void *fh;			// File handle
+	void *buffer;		// Host address of data buffer
+	loff_t offset;		// Start byte on disk
+	size_t length;		// Requested number of bytes
+	size_t actual;		// Number of bytes transferred
+	bool write;			// Flag: write request
+};
+
+static bool async_io = false;				// Flag: asynchronous I/O enabled
+static uint32 disk_dt = 0;					// Mac address of Deferred Task for IODone
+static disk_request io_req;					// Current request
+static int io_state = IO_IDLE;				// State of current request
+static bool io_thread_active = false;		// Flag: I/O thread installed
+static volatile bool io_thread_cancel = false;	// Flag: cancel I/O thread
+static pthread_t io_thread;					// I/O thread
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+
+
+/*
+ *  I/O thread, performs queued requests
+ */
+
+static void *io_thread_func(void *arg)
+{
+	pthread_mutex_lock(&io_lock);
+	for (;;) {
+		while (io_state != IO_QUEUED && !io_thread_cancel)
+			pthread_cond_wait(&io_cond, &io_lock);
+		if (io_thread_cancel)
+			break;
+		disk_request req = io_req;
+		pthread_mutex_unlock(&io_lock);
+
+		if (req.write)
+			req.actual = Sys_write(req.fh, req.buffer, req.offset, req.length);
+		else
+			req.actual = Sys_read(req.fh, req.buffer, req.offset, req.length);
+
+		pthread_mutex_lock(&io_lock);
+		io_req.actual = req.actual;
+		io_state = IO_DONE;
+		pthread_cond_broadcast(&io_cond);
+		SetInterruptFlag(INTFLAG_DISK);
+		TriggerInterrupt();
+	}
+	pthread_mutex_unlock(&io_lock);
+	return NULL;
+}
+
+
+/*
+ *  Wait until the I/O thread is no longer accessing the disk
+ *  (before doing synchronous I/O on the emulator thread)
+ */
+
+static void wait_io_thread(void)
+{
+	if (!io_thread_active)
+		return;
+	pthread_mutex_lock(&io_lock);
+	while (io_state == IO_QUEUED)
+		pthread_cond_wait(&io_cond, &io_lock);
+	pthread_mutex_unlock(&io_lock);
+}
+
+
+/*
+ *  Complete finished request, enqueue Deferred Task to call IODone
+ *  (called during interrupt time)
+ */
+
+static void complete_async_io(void)
+{
+	pthread_mutex_lock(&io_lock);
+	if (io_state != IO_DONE) {
+		pthread_mutex_unlock(&io_lock);
+		return;
+	}
+	disk_request req = io_req;
+	io_state = IO_IDLE;
+	pthread_mutex_unlock(&io_lock);
+
+	int16 result = noErr;
+	if (req.actual != req.length)
+		result = req.write ? writErr : readErr;
+	else {
+		WriteMacInt32(req.pb + ioActCount, req.actual);
+		WriteMacInt32(req.dce + dCtlPosition, ReadMacInt32(req.dce + dCtlPosition) + req.actual);
+	}
+	D(bug(" async %s complete, pb %08x, result %d\n", req.write ? "write" : "read", req.pb, result));
+	WriteMacInt32(disk_dt + diskdtResult, uint16(result));
+	WriteMacInt32(disk_dt + diskdtDCE, req.dce);
+	M68kRegisters r;
+	r.a[0] = disk_dt;
+	Execute68kTrap(0xa082, &r);		// DTInstall()
+}
+#else
+static inline void wait_io_thread(void) { }
+static inline void complete_async_io(void) { }
+#endif
+
+
 /*
  *  Get pointer to drive info or drives.end() if not found
  */
@@ -121,6 +259,7 @@ static void find_hfs_partition(disk_drive_info &info)
 {
 	info.start_byte = 0;
 	info.num_blocks = 0;
+	wait_io_thread();
 	uint8 *map = new uint8[512];
 
 	// Search first 64 blocks for HFS partition
@@ -168,6 +307,19 @@ void DiskInit(void)
 		if (fh)
 			drives.push_back(disk_drive_info(fh, SysIsReadOnly(fh)));
 	}
+
+#if ASYNC_DISK_IO
+	// Start I/O thread for asynchronous requests
+	if (PrefsFindBool("diskasync") && !drives.empty()) {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		io_thread_cancel = false;
+		io_thread_active = (pthread_create(&io_thread, &attr, io_thread_func, NULL) == 0);
+		pthread_attr_destroy(&attr);
+		if (!io_thread_active)
+			printf("WARNING: Cannot start disk I/O thread, using synchronous I/O\n");
+	}
+#endif
 }
 
 
@@ -177,6 +329,20 @@ void DiskInit(void)
 
 void DiskExit(void)
 {
+#if ASYNC_DISK_IO
+	// Stop I/O thread
+	if (io_thread_active) {
+		wait_io_thread();
+		pthread_mutex_lock(&io_lock);
+		io_thread_cancel = true;
+		pthread_cond_broadcast(&io_cond);
+		pthread_mutex_unlock(&io_lock);
+		pthread_join(io_thread, NULL);
+		io_thread_active = false;
+		io_state = IO_IDLE;
+	}
+#endif
+
 	drive_vec::iterator info, end = drives.end();
 	for (info = drives.begin(); info != end; ++info)
 		info->close_fh();
@@ -254,6 +420,33 @@ int16 DiskOpen(uint32 pb, uint32 dce)
 	WriteMacInt32(dce + dCtlPosition, 0);
 	acc_run_called = false;
 
+#if ASYNC_DISK_IO
+	// Drop request left over from before a reset
+	wait_io_thread();
+	io_state = IO_IDLE;
+
+	// Allocate Deferred Task for completing asynchronous requests
+	async_io = false;
+	if (io_thread_active) {
+		M68kRegisters r;
+		r.d[0] = SIZEOF_diskdt;
+		Execute68kTrap(0xa71e, &r);		// NewPtrSysClear()
+		if (r.a[0]) {
+			disk_dt = r.a[0];
+			D(bug(" disk_dt %08x\n", disk_dt));
+			WriteMacInt16(disk_dt + qType, dtQType);
+			WriteMacInt32(disk_dt + dtAddr, disk_dt + diskdtCode);
+			WriteMacInt32(disk_dt + dtParam, disk_dt + diskdtResult);
+														// Deferred function for signalling that Prime is complete (pointer to diskdtResult in a1)
+			WriteMacInt16(disk_dt + diskdtCode, 0x2019);		// move.l	(a1)+,d0	(result)
+			WriteMacInt16(disk_dt + diskdtCode + 2, 0x2251);	// move.l	(a1),a1		(dce)
+			WriteMacInt32(disk_dt + diskdtCode + 4, 0x207808fc);	// move.l	JIODone,a0
+			WriteMacInt16(disk_dt + diskdtCode + 8, 0x4ed0);	// jmp		(a0)
+			async_io = true;
+		}
+	}
+#endif
+
 	// Install drives
 	drive_vec::iterator info, end = drives.end();
 	for (info = drives.begin(); info != end; ++info) {
@@ -329,9 +522,35 @@ int16 DiskPrime(uint32 pb, uint32 dce)
 		position = ((loff_t)ReadMacInt32(pb + ioWPosOffset) << 32) | ReadMacInt32(pb + ioWPosOffset + 4);
 	if ((length & 0x1ff) || (position & 0x1ff))
 		return paramErr;
+	bool write = (ReadMacInt16(pb + ioTrap) & 0xff) != aRdCmd;
+	if (write && info->read_only)
+		return wPrErr;
+
+#if ASYNC_DISK_IO
+	// Asynchronous, queued request? Then hand it to the I/O thread
+	uint16 trap = ReadMacInt16(pb + ioTrap);
+	if (async_io && (trap & 0x0400) && !(trap & 0x0200) && length) {
+		pthread_mutex_lock(&io_lock);
+		while (io_state != IO_IDLE)		// Shouldn't happen, the Device Manager serializes requests
+			pthread_cond_wait(&io_cond, &io_lock);
+		io_req.pb = pb;
+		io_req.dce = dce;
+		io_req.fh = info->fh;
+		io_req.buffer = buffer;
+		io_req.offset = position + info->start_byte;
+		io_req.length = length;
+		io_req.actual = 0;
+		io_req.write = write;
+		io_state = IO_QUEUED;
+		pthread_cond_broadcast(&io_cond);
+		pthread_mutex_unlock(&io_lock);
+		return 1;	// Request in progress, IODone is called by DiskInterrupt()
+	}
+	wait_io_thread();
+#endif
 
 	size_t actual = 0;
-	if ((ReadMacInt16(pb + ioTrap) & 0xff) == aRdCmd) {
+	if (!write) {
 
 		// Read
 		actual = Sys_read(info->fh, buffer, position + info->start_byte, length);
@@ -341,8 +560,6 @@ int16 DiskPrime(uint32 pb, uint32 dce)
 	} else {
 
 		// Write
-		if (info->read_only)
-			return wPrErr;
 		actual = Sys_write(info->fh, buffer, position + info->start_byte, length);
 		if (actual != length)
 			return writErr;
@@ -469,7 +686,11 @@ int16 DiskStatus(uint32 pb, uint32 dce)
 					WriteMacInt32(pb + csParam + 4, EMULATOR_ID_4);
 					break;
 				case FOURCC('s','y','n','c'):	// Only synchronous operation?
+#if ASYNC_DISK_IO
+					WriteMacInt32(pb + csParam + 4, async_io ? 0 : 0x01000000);
+#else
 					WriteMacInt32(pb + csParam + 4, 0x01000000);
+#endif
 					break;
 				case FOURCC('b','o','o','t'):	// Boot ID
 					if (info != drives.end())
@@ -534,11 +755,14 @@ int16 DiskStatus(uint32 pb, uint32 dce)
 
 
 /*
- *  Driver interrupt routine (1Hz) - check for volumes to be mounted
+ *  Driver interrupt routine (1Hz and INTFLAG_DISK) - complete asynchronous
+ *  requests and check for volumes to be mounted
  */
 
 void DiskInterrupt(void)
 {
+	complete_async_io();
+
 	if (!acc_run_called)
 		return;
 
@@ -461,9 +461,7 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 				if (HasMacStarted()) {
 
 					// Mac has started, execute all 60Hz interrupt functions
-#if !PRECISE_TIMING
 					TimerInterrupt();
-#endif
 					VideoInterrupt();
 
 					// Call DoVBLTask(0)
@@ -486,6 +484,12 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 				}
 			}
 
+			if (InterruptFlags & INTFLAG_DISK) {
+				ClearInterruptFlag(INTFLAG_DISK);
+				if (HasMacStarted())
+					DiskInterrupt();
+			}
+
 			if (InterruptFlags & INTFLAG_SERIAL) {
 				ClearInterruptFlag(INTFLAG_SERIAL);
 				SerialInterrupt();
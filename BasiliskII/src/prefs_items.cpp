@@ -56,6 +56,7 @@ prefs_desc common_prefs_items[] = {
 	{"modelid", TYPE_INT32, false,    "Mac Model ID (Gestalt Model ID minus 6)"},
 	{"cpu", TYPE_INT32, false,        "CPU type (0 = 68000, 1 = 68010 etc.)"},
 	{"fpu", TYPE_BOOLEAN, false,      "enable FPU emulation"},
+	{"diskasync", TYPE_BOOLEAN, false, "perform asynchronous disk I/O in a host thread"},
 	{"nocdrom", TYPE_BOOLEAN, false,  "don't install CD-ROM driver"},
 	{"nosound", TYPE_BOOLEAN, false,  "don't enable sound output"},
 	{"noclipconversion", TYPE_BOOLEAN, false, "don't convert clipboard contents"},
@@ -67,6 +68,8 @@ prefs_desc common_prefs_items[] = {
 	{"jitlazyflush", TYPE_BOOLEAN, false, "enable lazy invalidation of translation cache"},
 	{"jitinline", TYPE_BOOLEAN, false,   "enable translation through constant jumps"},
 	{"jitblacklist", TYPE_STRING, false, "blacklist opcodes from translation"},
+	{"jitbgcompile", TYPE_BOOLEAN, false, "translate hot blocks in a background thread"},
+	{"jitcachelog", TYPE_BOOLEAN, false, "log translation cache statistics"},
 	{"keyboardtype", TYPE_INT32, false, "hardware keyboard type"},
 	{"keycodes", TYPE_BOOLEAN, false, "use keycodes rather than keysyms to decode keyboard"},
 	{"keycodefile", TYPE_STRING, false, "path of keycode translation file"},
@@ -84,6 +87,7 @@ prefs_desc common_prefs_items[] = {
 	{"host_domain", TYPE_STRING, true,	"handle DNS requests for this domain on the host (slirp only)"},
 	{"title", TYPE_STRING, false,	"window title"},
 	{"sound_buffer", TYPE_INT32, false,	"sound buffer length"},
+	{"sound_blocks", TYPE_INT32, false,	"number of sound buffers queued ahead (SDL audio)"},
 	{"name_encoding", TYPE_INT32, false,	"file name encoding"},
 	{"delay", TYPE_INT32, false,	"additional delay [uS] every 64k instructions"},
 	{"init_grab", TYPE_BOOLEAN, false,	"initially grabbing mouse"},
@@ -109,8 +113,10 @@ void AddPrefsDefaults(void)
 	PrefsAddInt32("cpu", 3);		// 68030
 	PrefsAddInt32("displaycolordepth", 0);
 	PrefsAddBool("fpu", false);
+	PrefsAddBool("diskasync", false);
 	PrefsAddBool("nocdrom", false);
 	PrefsAddBool("nosound", false);
+	PrefsAddInt32("sound_blocks", 2);
 	PrefsAddBool("noclipconversion", false);
 	PrefsAddBool("nogui", false);
 	
@@ -122,6 +128,8 @@ void AddPrefsDefaults(void)
 	PrefsAddInt32("jitcachesize", 8192);
 	PrefsAddBool("jitlazyflush", true);
 	PrefsAddBool("jitinline", true);
+	PrefsAddBool("jitbgcompile", false);
+	PrefsAddBool("jitcachelog", false);
 #else
 	PrefsAddBool("jit", false);
 #endif
@@ -37,101 +37,82 @@
  *
  * This routine is very heavily used in the network
  * code and should be modified for each CPU to be as fast as possible.
- * 
- * XXX Since we will never span more than 1 mbuf, we can optimise this
+ *
+ * Since we will never span more than 1 mbuf, the data is summed up as
+ * native 64-bit words with the carries counted separately, and folded
+ * down to 16 bits at the end (RFC 1071).  The byte order of the words
+ * does not matter as long as the partial sums are folded in host order.
  */
 
-#define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
-
-int cksum(struct mbuf *m, int len)
+static inline u_int64_t cksum_add(const u_int8_t *p, int len)
 {
-	register u_int16_t *w;
-	register int sum = 0;
-	register int mlen = 0;
-	int byte_swapped = 0;
+	u_int64_t sum0 = 0, sum1 = 0, carry = 0, w;
+	u_int32_t l;
+	u_int16_t s;
 
-	union {
-		u_int8_t	c[2];
-		u_int16_t	s;
-	} s_util;
-	union {
-		u_int16_t s[2];
-		u_int32_t l;
-	} l_util;
-	
-	if (m->m_len == 0)
-	   goto cont;
-	w = mtod(m, u_int16_t *);
-	
-	mlen = m->m_len;
-	
-	if (len < mlen)
-	   mlen = len;
-	len -= mlen;
 	/*
-	 * Force to even boundary.
+	 * Two independent chains to keep the adds and carry
+	 * computations of consecutive words apart
 	 */
-	if ((1 & (long) w) && (mlen > 0)) {
-		REDUCE;
-		sum <<= 8;
-		s_util.c[0] = *(u_int8_t *)w;
-		w = (u_int16_t *)((int8_t *)w + 1);
-		mlen--;
-		byte_swapped = 1;
+	while (len >= 32) {
+		memcpy(&w, p, 8);
+		sum0 += w; carry += (sum0 < w);
+		memcpy(&w, p + 8, 8);
+		sum1 += w; carry += (sum1 < w);
+		memcpy(&w, p + 16, 8);
+		sum0 += w; carry += (sum0 < w);
+		memcpy(&w, p + 24, 8);
+		sum1 += w; carry += (sum1 < w);
+		p += 32;
+		len -= 32;
 	}
-	/*
-	 * Unroll the loop to make overhead from
-	 * branches &c small.
-	 */
-	while ((mlen -= 32) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-		sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-		sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-		w += 16;
+	w = (sum0 & 0xffffffff) + (sum0 >> 32) + (sum1 & 0xffffffff) + (sum1 >> 32) + carry;
+	while (len >= 4) {
+		memcpy(&l, p, 4);
+		w += l;
+		p += 4;
+		len -= 4;
 	}
-	mlen += 32;
-	while ((mlen -= 8) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		w += 4;
+	if (len >= 2) {
+		memcpy(&s, p, 2);
+		w += s;
+		p += 2;
+		len -= 2;
 	}
-	mlen += 8;
-	if (mlen == 0 && byte_swapped == 0)
-	   goto cont;
-	REDUCE;
-	while ((mlen -= 2) >= 0) {
-		sum += *w++;
+	if (len) {
+		/* The odd byte is the first byte of a zero padded word */
+		union {
+			u_int8_t	c[2];
+			u_int16_t	s;
+		} s_util;
+		s_util.c[0] = *p;
+		s_util.c[1] = 0;
+		w += s_util.s;
 	}
-	
-	if (byte_swapped) {
-		REDUCE;
-		sum <<= 8;
-		byte_swapped = 0;
-		if (mlen == -1) {
-			s_util.c[1] = *(u_int8_t *)w;
-			sum += s_util.s;
-			mlen = 0;
-		} else
-		   
-		   mlen = -1;
-	} else if (mlen == -1)
-	   s_util.c[0] = *(u_int8_t *)w;
-	
-cont:
+	return w;
+}
+
+int cksum(struct mbuf *m, int len)
+{
+	u_int64_t sum = 0;
+	int mlen = m->m_len;
+
+	if (len < mlen)
+	   mlen = len;
+	len -= mlen;
+	if (mlen > 0)
+	   sum = cksum_add(mtod(m, u_int8_t *), mlen);
+
 #ifdef DEBUG
 	if (len) {
 		DEBUG_ERROR((dfd, "cksum: out of data\n"));
 		DEBUG_ERROR((dfd, " len = %d\n", len));
 	}
 #endif
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		 standard (the odd byte may be shifted left by 8 bits
-			   or not as determined by endian-ness of the machine) */
-		s_util.c[1] = 0;
-		sum += s_util.s;
-	}
-	REDUCE;
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
 	return (~sum & 0xffff);
 }
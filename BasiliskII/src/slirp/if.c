@@ -221,6 +221,7 @@ diddit:
 	if (so) {
 		/* Update *_queued */
 		so->so_queued++;
+		slirp_socket_changed(so);
 		so->so_nqueued++;
 		/*
 		 * Check if the interactive session should be downgraded to
@@ -307,6 +308,7 @@ if_start(void)
 	
 	/* Update so_queued */
 	if (ifm->ifq_so) {
+		slirp_socket_changed(ifm->ifq_so);
 		if (--ifm->ifq_so->so_queued == 0)
 		   /* If there's no more queued, reset nqueued */
 		   ifm->ifq_so->so_nqueued = 0;
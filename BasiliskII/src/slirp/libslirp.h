@@ -29,7 +29,15 @@ int slirp_select_fill(int *pnfds,
 
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds);
 
+#ifdef HAVE_SYS_EPOLL_H
+struct epoll_event;
+int slirp_epoll_fill(int epfd);
+void slirp_epoll_poll(struct epoll_event *events, int nevents);
+#endif
+
 void slirp_input(const uint8 *pkt, int pkt_len);
+uint8 *slirp_input_begin(int *max);
+void slirp_input_end(int pkt_len);
 
 /* you must provide the following functions: */
 int slirp_can_output(void);
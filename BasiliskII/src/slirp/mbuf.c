@@ -26,12 +26,37 @@ int mbuf_thresh = 30;
 int mbuf_max = 0;
 int msize;
 
+/*
+ * The first MBUF_POOL_SIZE mbufs are carved out of one preallocated
+ * block, so that the usual traffic never goes through malloc() and
+ * dtom() can find them without walking the used list.  Only the slirp
+ * thread ever touches them.
+ */
+static char *mbuf_pool, *mbuf_pool_end;
+
 void
 m_init()
 {
+	int i;
+
 	m_freelist.m_next = m_freelist.m_prev = &m_freelist;
 	m_usedlist.m_next = m_usedlist.m_prev = &m_usedlist;
 	msize_init();
+
+	/* Keep each mbuf header 8-byte aligned */
+	msize = (msize + 7) & ~7;
+	mbuf_pool = (char *)malloc(MBUF_POOL_SIZE * msize);
+	if (mbuf_pool == NULL)
+		return;
+	mbuf_pool_end = mbuf_pool + MBUF_POOL_SIZE * msize;
+	for (i = 0; i < MBUF_POOL_SIZE; i++) {
+		struct mbuf *m = (struct mbuf *)(mbuf_pool + i * msize);
+		m->m_flags = M_FREELIST;
+		insque(m, m_freelist.m_prev);
+	}
+	mbuf_alloced = MBUF_POOL_SIZE;
+	mbuf_max = mbuf_alloced;
+	mbuf_thresh += MBUF_POOL_SIZE;
 }
 
 void
@@ -229,6 +254,14 @@ dtom(dat)
 	DEBUG_CALL("dtom");
 	DEBUG_ARG("dat = %lx", (long )dat);
 
+	/* Pool mbufs are found by address */
+	if ((char *)dat >= mbuf_pool && (char *)dat < mbuf_pool_end) {
+	  m = (struct mbuf *)(mbuf_pool + ((char *)dat - mbuf_pool) / msize * msize);
+	  if ((m->m_flags & (M_USEDLIST|M_EXT)) == M_USEDLIST &&
+	      (char *)dat >= m->m_dat && (char *)dat < (m->m_dat + m->m_size))
+	    return m;
+	}
+
 	/* bug corrected for M_EXT buffers */
 	for (m = m_usedlist.m_next; m != &m_usedlist; m = m->m_next) {
 	  if (m->m_flags & M_EXT) {
@@ -37,6 +37,7 @@
 
 
 #define MINCSIZE 4096	/* Amount to increase mbuf if too small */
+#define MBUF_POOL_SIZE 128	/* Number of preallocated mbufs */
 
 /*
  * Macros for type conversion
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "slirp.h"
 #ifdef __MINGW32__
 #include <winerror.h>
@@ -194,19 +195,120 @@ static void updtime(void)
 }
 #endif
 
-int slirp_select_fill(int *pnfds, 
-					  fd_set *readfds, fd_set *writefds, fd_set *xfds)
+/*
+ * Events a TCP socket should be polled for
+ */
+static int tcp_events(struct socket *so)
+{
+	int events = 0;
+
+	/*
+	 * NOFDREF can include still connecting to local-host,
+	 * newly socreated() sockets etc. Don't want to select these.
+	 */
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+		return 0;
+
+	/*
+	 * Set for reading sockets which are accepting
+	 */
+	if (so->so_state & SS_FACCEPTCONN)
+		return SO_EV_READ;
+
+	/*
+	 * Set for writing sockets which are connecting
+	 */
+	if (so->so_state & SS_ISFCONNECTING)
+		return SO_EV_WRITE;
+
+	/*
+	 * Set for writing if we are connected, can send more, and
+	 * we have something to send
+	 */
+	if (CONN_CANFSEND(so) && so->so_rcv.sb_cc)
+		events |= SO_EV_WRITE;
+
+	/*
+	 * Set for reading (and urgent data) if we are connected, can
+	 * receive more, and we have room for it XXX /2 ?
+	 */
+	if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2)))
+		events |= SO_EV_READ | SO_EV_URG;
+
+	return events;
+}
+
+/*
+ * Events a UDP (or ICMP) socket should be polled for
+ */
+static int udp_events(struct socket *so)
+{
+	/*
+	 * When UDP packets are received from over the
+	 * link, they're sendto()'d straight away, so
+	 * no need for setting for writing
+	 * Limit the number of packets queued by this session
+	 * to 4.  Note that even though we try and limit this
+	 * to 4 packets, the session could have more queued
+	 * if the packets needed to be fragmented
+	 * (XXX <= 4 ?)
+	 */
+	if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4)
+		return SO_EV_READ;
+	return 0;
+}
+
+/*
+ * Return the timeout (in us) until the next TCP or IP timer needs to
+ * run, or -1 if there's none
+ */
+static int slirp_timeout(void)
 {
-    struct socket *so, *so_next;
-    int nfds;
     int timeout, tmp_time;
 
-    /* fail safe */
-    global_readfds = NULL;
-    global_writefds = NULL;
-    global_xfds = NULL;
-    
-    nfds = *pnfds;
+	/*
+	 * Setup timeout to use minimum CPU usage, especially when idle
+	 */
+
+	timeout = -1;
+
+	/*
+	 * If a slowtimo is needed, set timeout to 5ms from the last
+	 * slow timeout. If a fast timeout is needed, set timeout within
+	 * 2ms of when it was requested.
+	 */
+#	define SLOW_TIMO 5
+#	define FAST_TIMO 2
+	if (do_slowtimo) {
+		timeout = (SLOW_TIMO - (curtime - last_slowtimo)) * 1000;
+		if (timeout < 0)
+		   timeout = 0;
+		else if (timeout > (SLOW_TIMO * 1000))
+		   timeout = SLOW_TIMO * 1000;
+		
+		/* Can only fasttimo if we also slowtimo */
+		if (time_fasttimo) {
+			tmp_time = (FAST_TIMO - (curtime - time_fasttimo)) * 1000;
+			if (tmp_time < 0)
+				tmp_time = 0;
+			
+			/* Choose the smallest of the 2 */
+			if (tmp_time < timeout)
+			   timeout = tmp_time;
+		}
+	}
+	return timeout;
+}
+
+/*
+ * Walk all sockets, tell "want" which events each of them should be
+ * polled for, and return the timeout (in us) until the next TCP or IP
+ * timer needs to run, or -1 if there's none
+ */
+static int slirp_fill(void (*want)(struct socket *so, int events, void *arg), void *arg)
+{
+    struct socket *so, *so_next;
+
 	/*
 	 * First, TCP sockets
 	 */
@@ -228,49 +330,8 @@ int slirp_select_fill(int *pnfds,
 			if (time_fasttimo == 0 && so->so_tcpcb->t_flags & TF_DELACK)
 			   time_fasttimo = curtime; /* Flag when we want a fasttimo */
 			
-			/*
-			 * NOFDREF can include still connecting to local-host,
-			 * newly socreated() sockets etc. Don't want to select these.
-	 		 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-			
-			/*
-			 * Set for reading sockets which are accepting
-			 */
-			if (so->so_state & SS_FACCEPTCONN) {
-                                FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-			
-			/*
-			 * Set for writing sockets which are connecting
-			 */
-			if (so->so_state & SS_ISFCONNECTING) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-			
-			/*
-			 * Set for writing if we are connected, can send more, and
-			 * we have something to send
-			 */
-			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-			}
-			
-			/*
-			 * Set for reading (and urgent data) if we are connected, can
-			 * receive more, and we have room for it XXX /2 ?
-			 */
-			if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
-				FD_SET(so->s, readfds);
-				FD_SET(so->s, xfds);
-				UPD_NFDS(so->s);
-			}
+			if (so->s != -1)
+				want(so, tcp_events(so), arg);
 		}
 		
 		/*
@@ -290,55 +351,51 @@ int slirp_select_fill(int *pnfds,
 					do_slowtimo = 1; /* Let socket expire */
 			}
 			
-			/*
-			 * When UDP packets are received from over the
-			 * link, they're sendto()'d straight away, so
-			 * no need for setting for writing
-			 * Limit the number of packets queued by this session
-			 * to 4.  Note that even though we try and limit this
-			 * to 4 packets, the session could have more queued
-			 * if the packets needed to be fragmented
-			 * (XXX <= 4 ?)
-			 */
-			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-				FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-			}
+			if (so->s != -1)
+				want(so, udp_events(so), arg);
 		}
 	}
-	
-	/*
-	 * Setup timeout to use minimum CPU usage, especially when idle
-	 */
 
-	timeout = -1;
+	return slirp_timeout();
+}
 
-	/*
-	 * If a slowtimo is needed, set timeout to 5ms from the last
-	 * slow timeout. If a fast timeout is needed, set timeout within
-	 * 2ms of when it was requested.
-	 */
-#	define SLOW_TIMO 5
-#	define FAST_TIMO 2
-	if (do_slowtimo) {
-		timeout = (SLOW_TIMO - (curtime - last_slowtimo)) * 1000;
-		if (timeout < 0)
-		   timeout = 0;
-		else if (timeout > (SLOW_TIMO * 1000))
-		   timeout = SLOW_TIMO * 1000;
-		
-		/* Can only fasttimo if we also slowtimo */
-		if (time_fasttimo) {
-			tmp_time = (FAST_TIMO - (curtime - time_fasttimo)) * 1000;
-			if (tmp_time < 0)
-				tmp_time = 0;
-			
-			/* Choose the smallest of the 2 */
-			if (tmp_time < timeout)
-			   timeout = tmp_time;
-		}
-	}
-	*pnfds = nfds;
+struct select_fill_args {
+	fd_set *readfds, *writefds, *xfds;
+	int nfds;
+};
+
+static void select_want(struct socket *so, int events, void *arg)
+{
+	struct select_fill_args *a = (struct select_fill_args *)arg;
+	if (events == 0)
+		return;
+	if (events & SO_EV_READ)
+		FD_SET(so->s, a->readfds);
+	if (events & SO_EV_WRITE)
+		FD_SET(so->s, a->writefds);
+	if (events & SO_EV_URG)
+		FD_SET(so->s, a->xfds);
+	if (a->nfds < so->s)
+		a->nfds = so->s;
+}
+
+int slirp_select_fill(int *pnfds, 
+					  fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+    struct select_fill_args a;
+    int timeout;
+
+    /* fail safe */
+    global_readfds = NULL;
+    global_writefds = NULL;
+    global_xfds = NULL;
+    
+    a.readfds = readfds;
+    a.writefds = writefds;
+    a.xfds = xfds;
+    a.nfds = *pnfds;
+    timeout = slirp_fill(select_want, &a);
+    *pnfds = a.nfds;
 
 	/*
 	 * Adjust the timeout to make the minimum timeout
@@ -350,15 +407,11 @@ int slirp_select_fill(int *pnfds,
 	return timeout;
 }	
 
-void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
+/*
+ * Run TCP and IP timers that are due, return whether the slow timeout ran
+ */
+static int slirp_timers(void)
 {
-    struct socket *so, *so_next;
-    int ret;
-
-    global_readfds = readfds;
-    global_writefds = writefds;
-    global_xfds = xfds;
-
 	/* Update time */
 	updtime();
 	
@@ -374,43 +427,37 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			ip_slowtimo();
 			tcp_slowtimo();
 			last_slowtimo = curtime;
+			return 1;
 		}
 	}
-	
-	/*
-	 * Check sockets
-	 */
-	if (link_up) {
-		/*
-		 * Check TCP sockets
-		 */
-		for (so = tcb.so_next; so != &tcb; so = so_next) {
-			so_next = so->so_next;
-			
-			/*
-			 * FD_ISSET is meaningless on these sockets
-			 * (and they can crash the program)
-			 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-			
+	return 0;
+}
+
+/*
+ * Handle the events in so->so_revents of a TCP socket. Shutting down a
+ * direction of the socket clears the corresponding events.
+ */
+static void tcp_dispatch(struct socket *so)
+{
+    int ret;
+
 			/*
 			 * Check for URG data
 			 * This will soread as well, so no need to
 			 * test for readfds below if this succeeds
 			 */
-			if (FD_ISSET(so->s, xfds))
+			if (so->so_revents & SO_EV_URG)
 			   sorecvoob(so);
 			/*
 			 * Check sockets for reading
 			 */
-			else if (FD_ISSET(so->s, readfds)) {
+			else if (so->so_revents & SO_EV_READ) {
 				/*
 				 * Check for incoming connections
 				 */
 				if (so->so_state & SS_FACCEPTCONN) {
 					tcp_connect(so);
-					continue;
+					return;
 				} /* else */
 				ret = soread(so);
 				
@@ -422,7 +469,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			/*
 			 * Check sockets for writing
 			 */
-			if (FD_ISSET(so->s, writefds)) {
+			if (so->so_revents & SO_EV_WRITE) {
 			  /*
 			   * Check for non-blocking, still-connecting sockets
 			   */
@@ -435,7 +482,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			      /* XXXXX Must fix, zero bytes is a NOP */
 			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
 				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
+				return;
 			      
 			      /* else failed */
 			      so->so_state = SS_NOFDREF;
@@ -469,7 +516,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			    /* XXX */
 			    if (errno == EAGAIN || errno == EWOULDBLOCK ||
 				errno == EINPROGRESS || errno == ENOTCONN)
-			      continue; /* Still connecting, continue */
+			      return; /* Still connecting, continue */
 			    
 			    /* else failed */
 			    so->so_state = SS_NOFDREF;
@@ -481,7 +528,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			      /* XXX */
 			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
 				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
+				return;
 			      /* else failed */
 			      so->so_state = SS_NOFDREF;
 			    } else
@@ -491,6 +538,43 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
 			} /* SS_ISFCONNECTING */
 #endif
+}
+
+void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+    struct socket *so, *so_next;
+
+    global_readfds = readfds;
+    global_writefds = writefds;
+    global_xfds = xfds;
+
+	slirp_timers();
+	
+	/*
+	 * Check sockets
+	 */
+	if (link_up) {
+		/*
+		 * Check TCP sockets
+		 */
+		for (so = tcb.so_next; so != &tcb; so = so_next) {
+			so_next = so->so_next;
+			
+			/*
+			 * FD_ISSET is meaningless on these sockets
+			 * (and they can crash the program)
+			 */
+			if (so->so_state & SS_NOFDREF || so->s == -1)
+			   continue;
+			
+			so->so_revents = 0;
+			if (FD_ISSET(so->s, readfds))
+				so->so_revents |= SO_EV_READ;
+			if (FD_ISSET(so->s, writefds))
+				so->so_revents |= SO_EV_WRITE;
+			if (FD_ISSET(so->s, xfds))
+				so->so_revents |= SO_EV_URG;
+			tcp_dispatch(so);
 		}
 		
 		/*
@@ -523,6 +607,250 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	 global_xfds = NULL;
 }
 
+/*
+ * Socket lookup by file descriptor, for event notification mechanisms
+ * that report descriptors. Sockets are entered when they are registered
+ * for events and removed by sofree(), so events for sockets that were
+ * closed in the meantime are ignored.
+ */
+static struct socket **fd_sockets;
+static int num_fd_sockets;
+
+static int fd_socket_set(int fd, struct socket *so)
+{
+	if (fd >= num_fd_sockets) {
+		int n = num_fd_sockets ? num_fd_sockets : 64;
+		struct socket **p;
+		while (n <= fd)
+			n *= 2;
+		p = (struct socket **)realloc(fd_sockets, n * sizeof(*p));
+		if (p == NULL)
+			return -1;
+		memset(p + num_fd_sockets, 0, (n - num_fd_sockets) * sizeof(*p));
+		fd_sockets = p;
+		num_fd_sockets = n;
+	}
+	fd_sockets[fd] = so;
+	return 0;
+}
+
+static struct socket *fd_socket(int fd)
+{
+	struct socket *so;
+	if (fd < 0 || fd >= num_fd_sockets)
+		return NULL;
+	so = fd_sockets[fd];
+	if (so == NULL || so->s != fd)
+		return NULL;
+	return so;
+}
+
+/*
+ * Sockets whose events have to be recomputed. The events of a socket only
+ * depend on its own state, which only changes when it is created, gets
+ * packets from the guest, is dispatched, has a timer fire or has packets
+ * sent to the guest, so all of these mark it with slirp_socket_changed().
+ * Changes are only tracked once an event loop asked for it, the select()
+ * loop looks at all sockets anyway.
+ */
+static struct socket *changed_sockets;
+static int track_changes;
+
+void slirp_socket_changed(struct socket *so)
+{
+	if (!track_changes || so->so_evchanged)
+		return;
+	so->so_evchanged = 1;
+	so->so_evnext = changed_sockets;
+	changed_sockets = so;
+}
+
+void slirp_forget_socket(struct socket *so)
+{
+	if (so->so_evfd >= 0 && so->so_evfd < num_fd_sockets && fd_sockets[so->so_evfd] == so)
+		fd_sockets[so->so_evfd] = NULL;
+	so->so_events = 0;
+
+	if (so->so_evchanged) {
+		struct socket **p = &changed_sockets;
+		while (*p != so)
+			p = &(*p)->so_evnext;
+		*p = so->so_evnext;
+		so->so_evchanged = 0;
+	}
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/*
+ * epoll() based event loop. Sockets stay registered with the epoll
+ * instance, and are only modified when the set of events they should be
+ * polled for changes. epoll_wait() then only returns the sockets that
+ * are ready, and there's no limit on the descriptor numbers.
+ */
+
+static void epoll_want(struct socket *so, int events, void *arg)
+{
+	int epfd = *(int *)arg;
+	struct epoll_event ev;
+	int op;
+
+	if (so->so_events && so->so_evfd != so->s)
+		so->so_events = 0;	/* descriptor was replaced, the old one is closed */
+	if (events == so->so_events)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = ((events & SO_EV_READ) ? EPOLLIN : 0) |
+		((events & SO_EV_WRITE) ? EPOLLOUT : 0) |
+		((events & SO_EV_URG) ? EPOLLPRI : 0);
+	ev.data.fd = so->s;
+	if (events == 0)
+		op = EPOLL_CTL_DEL;
+	else if (so->so_events == 0)
+		op = EPOLL_CTL_ADD;
+	else
+		op = EPOLL_CTL_MOD;
+	if (epoll_ctl(epfd, op, so->s, &ev) < 0) {
+		if (op == EPOLL_CTL_ADD && errno == EEXIST)
+			epoll_ctl(epfd, EPOLL_CTL_MOD, so->s, &ev);
+		else if (op == EPOLL_CTL_MOD && errno == ENOENT)
+			epoll_ctl(epfd, EPOLL_CTL_ADD, so->s, &ev);
+	}
+
+	if (events && fd_socket_set(so->s, so) < 0)
+		events = 0;
+	so->so_events = events;
+	so->so_evfd = so->s;
+}
+
+/* UDP sockets that will time out exist */
+static int udp_expiring;
+
+/*
+ * Detach timed out UDP sockets, from the slow timeout
+ */
+static void udp_expire(void)
+{
+	struct socket *so, *so_next;
+
+	udp_expiring = 0;
+	for (so = udb.so_next; so != &udb; so = so_next) {
+		so_next = so->so_next;
+		if (so->so_expire) {
+			if (so->so_expire <= curtime)
+				udp_detach(so);
+			else
+				udp_expiring = 1;
+		}
+	}
+}
+
+int slirp_epoll_fill(int epfd)
+{
+	struct socket *so;
+	int timeout;
+
+    global_readfds = NULL;
+    global_writefds = NULL;
+    global_xfds = NULL;
+
+	/*
+	 * Register the sockets that existed before the first call, after
+	 * that only the changed ones are looked at
+	 */
+	if (!track_changes) {
+		track_changes = 1;
+		for (so = tcb.so_next; so != &tcb; so = so->so_next)
+			slirp_socket_changed(so);
+		for (so = udb.so_next; so != &udb; so = so->so_next)
+			slirp_socket_changed(so);
+	}
+
+	do_slowtimo = 0;
+	if (link_up) {
+		while ((so = changed_sockets) != NULL) {
+			changed_sockets = so->so_evnext;
+			so->so_evchanged = 0;
+
+			if (so->so_tcpcb) {
+				if (time_fasttimo == 0 && so->so_tcpcb->t_flags & TF_DELACK)
+					time_fasttimo = curtime; /* Flag when we want a fasttimo */
+				if (so->s != -1)
+					epoll_want(so, tcp_events(so), &epfd);
+			} else {
+				if (so->so_expire)
+					udp_expiring = 1;
+				if (so->s != -1)
+					epoll_want(so, udp_events(so), &epfd);
+			}
+		}
+
+		do_slowtimo = ((tcb.so_next != &tcb) ||
+			 (&ipq.ip_link != ipq.ip_link.next) || udp_expiring);
+	}
+
+	timeout = slirp_timeout();
+
+	/*
+	 * Nothing to wait for but socket events? Then sleep until they come,
+	 * otherwise wait at least 2ms (XXX?) to lessen the CPU load
+	 */
+	if (timeout >= 0 && timeout < (FAST_TIMO * 1000))
+		timeout = FAST_TIMO * 1000;
+	return timeout;
+}
+
+void slirp_epoll_poll(struct epoll_event *events, int nevents)
+{
+	struct socket *so;
+	int i;
+
+	if (slirp_timers() && link_up)
+		udp_expire();
+
+	if (link_up) {
+
+		/*
+		 * Collect events first, so that sockets shut down or closed
+		 * while handling others don't see stale events
+		 */
+		for (i = 0; i < nevents; i++) {
+			if ((so = fd_socket(events[i].data.fd)) == NULL)
+				continue;
+			so->so_revents = 0;
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				so->so_revents |= so->so_events & SO_EV_READ;
+			if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+				so->so_revents |= so->so_events & SO_EV_WRITE;
+			if (events[i].events & EPOLLPRI)
+				so->so_revents |= so->so_events & SO_EV_URG;
+		}
+
+		for (i = 0; i < nevents; i++) {
+			if ((so = fd_socket(events[i].data.fd)) == NULL || so->so_revents == 0)
+				continue;
+			slirp_socket_changed(so);
+			if (so->so_tcpcb == NULL) {			/* UDP (or ICMP) */
+				so->so_revents = 0;
+				sorecvfrom(so);
+			} else if (!(so->so_state & SS_NOFDREF)) {
+				tcp_dispatch(so);
+				if ((so = fd_socket(events[i].data.fd)) != NULL)
+					so->so_revents = 0;
+			}
+		}
+	}
+
+	/*
+	 * See if we can start outputting
+	 */
+	if (if_queued && link_up)
+	   if_start();
+}
+
+#endif
+
 #define ETH_ALEN 6
 #define ETH_HLEN 14
 
@@ -604,29 +932,43 @@ void arp_input(const uint8_t *pkt, int pkt_len)
     }
 }
 
-void slirp_input(const uint8_t *pkt, int pkt_len)
+/* mbuf handed out by slirp_input_begin() */
+static struct mbuf *input_mbuf;
+
+/*
+ * Let the caller receive an ethernet frame directly into an mbuf.
+ * The data is filled in at the returned address, at most *max bytes,
+ * and then passed on with slirp_input_end().
+ */
+uint8_t *slirp_input_begin(int *max)
+{
+    if (input_mbuf == NULL && (input_mbuf = m_get()) == NULL)
+        return NULL;
+    /* Note: we add to align the IP header */
+    *max = M_FREEROOM(input_mbuf) - 2;
+    return (uint8_t *)input_mbuf->m_data + 2;
+}
+
+void slirp_input_end(int pkt_len)
 {
-    struct mbuf *m;
+    struct mbuf *m = input_mbuf;
+    const uint8_t *pkt;
     int proto;
 
-    if (pkt_len < ETH_HLEN)
+    if (m == NULL || pkt_len < ETH_HLEN)
         return;
-    
+
+    pkt = (const uint8_t *)m->m_data + 2;
     proto = (pkt[12] << 8) | pkt[13];
     switch(proto) {
     case ETH_P_ARP:
+        /* The mbuf stays around for the next frame */
         arp_input(pkt, pkt_len);
         break;
     case ETH_P_IP:
-        m = m_get();
-        if (!m)
-            return;
-        /* Note: we add to align the IP header */
-        m->m_len = pkt_len + 2;
-        memcpy(m->m_data + 2, pkt, pkt_len);
-
+        input_mbuf = NULL;
         m->m_data += 2 + ETH_HLEN;
-        m->m_len -= 2 + ETH_HLEN;
+        m->m_len = pkt_len - ETH_HLEN;
 
         ip_input(m);
         break;
@@ -635,6 +977,19 @@ void slirp_input(const uint8_t *pkt, int pkt_len)
     }
 }
 
+void slirp_input(const uint8_t *pkt, int pkt_len)
+{
+    uint8_t *buf;
+    int max;
+
+    if (pkt_len < ETH_HLEN)
+        return;
+    if ((buf = slirp_input_begin(&max)) == NULL || pkt_len > max)
+        return;
+    memcpy(buf, pkt, pkt_len);
+    slirp_input_end(pkt_len);
+}
+
 /* output the IP packet to the ethernet device */
 void if_encap(const uint8_t *ip_data, int ip_data_len)
 {
@@ -674,3 +1029,342 @@ int slirp_add_exec(int do_pty, const char *args, int addr_low_byte,
     return add_exec(&exec_list, do_pty, (char *)args, 
                     addr_low_byte, htons(guest_port));
 }
+
+#if defined(TEST_SLIRP) && defined(HAVE_SYS_EPOLL_H)
+/*
+ *  Stress test for the epoll event loop (build with "make slirp-test"):
+ *  the guest opens many TCP connections to a server on the host and gets
+ *  its data echoed back, then the host closes them all. The interest sets
+ *  that are kept up to date incrementally are compared with a full
+ *  recomputation after every iteration, and the cost of an idle iteration
+ *  is measured for epoll and select with all connections open.
+ */
+
+#define TEST_GUEST_PORT 20000
+
+struct test_conn {
+	uint32_t snd_nxt, rcv_nxt;
+	int state;			/* 0 = SYN sent, 1 = data sent, 2 = echoed, 3 = closed */
+};
+
+static struct test_conn *test_conns;
+static int test_nconns, test_host_port, test_errors, test_mismatches;
+static uint16_t test_ip_id;
+
+/* Packets from the guest wait here, slirp isn't reentrant */
+static uint8_t *test_queue;
+static int test_queue_len;
+
+static double test_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void test_put16(uint8_t *p, uint32_t v) { p[0] = v >> 8; p[1] = v; }
+static void test_put32(uint8_t *p, uint32_t v) { test_put16(p, v >> 16); test_put16(p + 2, v); }
+static uint32_t test_get32(const uint8_t *p) { return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+static uint32_t test_sum(uint32_t sum, const uint8_t *p, int len)
+{
+	int i;
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (p[i] << 8) | p[i + 1];
+	if (len & 1)
+		sum += p[len - 1] << 8;
+	return sum;
+}
+
+static uint16_t test_fold(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+static void test_guest_send(int i, int flags, const char *data, int len)
+{
+	struct test_conn *c = &test_conns[i];
+	uint8_t *pkt = test_queue + test_queue_len;
+	uint8_t *ip = pkt + 2 + ETH_HLEN, *th = ip + 20;
+	struct in_addr guest_addr;
+	uint32_t sum;
+
+	guest_addr.s_addr = special_addr.s_addr | htonl(15);
+	memset(pkt, 0, 2 + ETH_HLEN + 40);
+	test_put16(pkt, ETH_HLEN + 40 + len);
+	memcpy(pkt + 2, special_ethaddr, ETH_ALEN);
+	memcpy(pkt + 2 + ETH_ALEN, special_ethaddr, ETH_ALEN);
+	pkt[2 + ETH_ALEN + 5] = 15;
+	test_put16(pkt + 2 + 12, ETH_P_IP);
+
+	ip[0] = 0x45;
+	test_put16(ip + 2, 40 + len);
+	test_put16(ip + 4, test_ip_id++);
+	ip[8] = 64;
+	ip[9] = IPPROTO_TCP;
+	memcpy(ip + 12, &guest_addr, 4);
+	memcpy(ip + 16, &alias_addr, 4);
+	test_put16(ip + 10, test_fold(test_sum(0, ip, 20)));
+
+	test_put16(th, TEST_GUEST_PORT + i);
+	test_put16(th + 2, test_host_port);
+	test_put32(th + 4, c->snd_nxt);
+	test_put32(th + 8, c->rcv_nxt);
+	th[12] = 5 << 4;
+	th[13] = flags;
+	test_put16(th + 14, 32768);
+	memcpy(th + 20, data, len);
+	sum = test_sum(0, ip + 12, 8) + IPPROTO_TCP + 20 + len;
+	test_put16(th + 16, test_fold(test_sum(sum, th, 20 + len)));
+
+	c->snd_nxt += len + ((flags & (TH_SYN | TH_FIN)) ? 1 : 0);
+	test_queue_len += 2 + ETH_HLEN + 40 + len;
+}
+
+static void test_guest_flush(void)
+{
+	int pos, len;
+	for (pos = 0; pos < test_queue_len; pos += 2 + len) {
+		len = (test_queue[pos] << 8) | test_queue[pos + 1];
+		slirp_input(test_queue + pos + 2, len);
+	}
+	test_queue_len = 0;
+}
+
+static void test_message(int i, char *buf)
+{
+	sprintf(buf, "connection %d\n", i);
+}
+
+const char *PrefsFindStringC(const char *name, int index)
+{
+	return NULL;
+}
+
+int slirp_can_output(void)
+{
+	return 1;
+}
+
+/* The guest side of the connections */
+void slirp_output(const uint8_t *pkt, int pkt_len)
+{
+	const uint8_t *ip = pkt + ETH_HLEN, *th, *data;
+	struct test_conn *c;
+	int i, flags, len;
+	char msg[32];
+
+	if (pkt_len < ETH_HLEN + 40 || ip[9] != IPPROTO_TCP)
+		return;
+	th = ip + (ip[0] & 0xf) * 4;
+	i = ((th[2] << 8) | th[3]) - TEST_GUEST_PORT;
+	if (i < 0 || i >= test_nconns)
+		return;
+	c = &test_conns[i];
+	flags = th[13];
+	data = th + (th[12] >> 4) * 4;
+	len = ((ip[2] << 8) | ip[3]) - (data - ip);
+
+	if (flags & TH_RST) {
+		printf("connection %d: reset\n", i);
+		test_errors++;
+		c->state = 3;
+		return;
+	}
+	if ((flags & TH_SYN) && c->state == 0) {
+		c->rcv_nxt = test_get32(th + 4) + 1;
+		test_message(i, msg);
+		test_guest_send(i, TH_ACK | TH_PUSH, msg, strlen(msg));
+		c->state = 1;
+		return;
+	}
+	if (test_get32(th + 4) != c->rcv_nxt)
+		return;			/* retransmission */
+	if (len > 0) {
+		test_message(i, msg);
+		if (c->state != 1 || len != (int)strlen(msg) || memcmp(data, msg, len) != 0) {
+			printf("connection %d: unexpected data\n", i);
+			test_errors++;
+		}
+		c->rcv_nxt += len;
+		c->state = 2;
+	}
+	if (flags & TH_FIN) {
+		c->rcv_nxt++;
+		test_guest_send(i, TH_ACK | TH_FIN, "", 0);
+		c->state = 3;
+	} else if (len > 0)
+		test_guest_send(i, TH_ACK, "", 0);
+}
+
+/* Compare the registered events with the ones the select() loop would use */
+static void test_check_events(void)
+{
+	struct socket *so;
+	int events, registered;
+
+	for (so = tcb.so_next; so != &tcb; so = so->so_next) {
+		if (so->s == -1)
+			continue;
+		events = tcp_events(so);
+		registered = so->so_evfd == so->s ? so->so_events : 0;
+		if (events != registered && test_mismatches++ < 10)
+			printf("fd %d: events %d registered, %d wanted\n", so->s, registered, events);
+	}
+	for (so = udb.so_next; so != &udb; so = so->so_next) {
+		if (so->s == -1)
+			continue;
+		events = udp_events(so);
+		registered = so->so_evfd == so->s ? so->so_events : 0;
+		if (events != registered && test_mismatches++ < 10)
+			printf("fd %d: events %d registered, %d wanted\n", so->s, registered, events);
+	}
+}
+
+/* Accept connections and echo what they send, or close them all */
+static int *test_host_fds;
+static int test_naccepted;
+
+static void test_host(int listen_fd, int close_all)
+{
+	char buf[256];
+	int i, fd, n;
+
+	while (test_naccepted < test_nconns && (fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		fd_nonblock(fd);
+		test_host_fds[test_naccepted++] = fd;
+	}
+	for (i = 0; i < test_naccepted; i++) {
+		if ((fd = test_host_fds[i]) < 0)
+			continue;
+		if (close_all) {
+			close(fd);
+			test_host_fds[i] = -1;
+		} else if ((n = read(fd, buf, sizeof(buf))) > 0)
+			write(fd, buf, n);
+	}
+}
+
+static int test_count(int state)
+{
+	int i, n = 0;
+	for (i = 0; i < test_nconns; i++)
+		if (test_conns[i].state >= state)
+			n++;
+	return n;
+}
+
+/* Run the epoll loop until "state" is reached by all connections */
+static int test_run(int epfd, int listen_fd, int state)
+{
+	struct epoll_event events[64];
+	double end = test_time() + 10;
+	int n;
+
+	while (test_count(state) < test_nconns) {
+		if (test_time() > end) {
+			printf("timeout, %d of %d connections in state %d\n", test_count(state), test_nconns, state);
+			return 0;
+		}
+		slirp_epoll_fill(epfd);
+		test_check_events();
+		n = epoll_wait(epfd, events, 64, 1);
+		slirp_epoll_poll(events, n < 0 ? 0 : n);
+		test_host(listen_fd, state == 3);
+		test_guest_flush();
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const int n_iter = 20000;
+	struct epoll_event events[64];
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	double start, t_epoll, t_select;
+	int epfd, listen_fd, i, n, ok;
+
+	test_nconns = argc > 1 ? atoi(argv[1]) : 400;
+	test_conns = (struct test_conn *)calloc(test_nconns, sizeof(*test_conns));
+	test_host_fds = (int *)calloc(test_nconns, sizeof(int));
+	test_queue = (uint8_t *)malloc(test_nconns * 2 * (2 + ETH_HLEN + 40 + 32));
+	if (test_conns == NULL || test_host_fds == NULL || test_queue == NULL)
+		return 1;
+
+	signal(SIGPIPE, SIG_IGN);
+	slirp_init();
+	epfd = epoll_create(64);
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (epfd < 0 || listen_fd < 0 ||
+		bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(listen_fd, test_nconns) < 0 ||
+		getsockname(listen_fd, (struct sockaddr *)&addr, &addrlen) < 0) {
+		perror("slirp-test");
+		return 1;
+	}
+	fd_nonblock(listen_fd);
+	test_host_port = ntohs(addr.sin_port);
+
+	// Connect and echo
+	for (i = 0; i < test_nconns; i++) {
+		test_conns[i].snd_nxt = 1000 * i;
+		test_guest_send(i, TH_SYN, "", 0);
+	}
+	test_guest_flush();
+	ok = test_run(epfd, listen_fd, 2);
+	printf("%d connections echoed\n", test_count(2));
+
+	// Idle iterations with all connections open
+	start = test_time();
+	for (i = 0; i < n_iter; i++) {
+		slirp_epoll_fill(epfd);
+		n = epoll_wait(epfd, events, 64, 0);
+		slirp_epoll_poll(events, n < 0 ? 0 : n);
+	}
+	t_epoll = (test_time() - start) / n_iter;
+	t_select = 0;
+	if (test_host_fds[test_naccepted - 1] < FD_SETSIZE - 16) {
+		fd_set rfds, wfds, xfds;
+		struct timeval tv;
+		start = test_time();
+		for (i = 0; i < n_iter; i++) {
+			int nfds = -1;
+			FD_ZERO(&rfds);
+			FD_ZERO(&wfds);
+			FD_ZERO(&xfds);
+			slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
+			tv.tv_sec = tv.tv_usec = 0;
+			if (select(nfds + 1, &rfds, &wfds, &xfds, &tv) < 0) {
+				FD_ZERO(&rfds);
+				FD_ZERO(&wfds);
+				FD_ZERO(&xfds);
+			}
+			slirp_select_poll(&rfds, &wfds, &xfds);
+		}
+		t_select = (test_time() - start) / n_iter;
+	}
+	printf("idle iteration: epoll %.2fus", t_epoll * 1e6);
+	if (t_select)
+		printf(", select %.2fus", t_select * 1e6);
+	printf("\n");
+
+	// Close from the host side
+	if (ok)
+		ok = test_run(epfd, listen_fd, 3);
+	printf("%d connections closed\n", test_count(3));
+
+	printf("%d interest mismatches, %d errors\n", test_mismatches, test_errors);
+	if (!ok || test_mismatches || test_errors) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
+#endif
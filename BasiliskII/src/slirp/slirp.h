@@ -188,6 +188,9 @@ int inet_aton _P((const char *cp, struct in_addr *ia));
 #endif
 #ifndef _WIN32
 #include <sys/socket.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #endif
 
 #if defined(HAVE_SYS_IOCTL_H)
@@ -160,6 +160,7 @@ socreate()
     memset(so, 0, sizeof(struct socket));
     so->so_state = SS_NOFDREF;
     so->s = -1;
+    so->so_evfd = -1;
   }
   return(so);
 }
@@ -181,6 +182,7 @@ sofree(so)
     udp_last_so = &udb;
 	
   m_free(so->so_m);
+  slirp_forget_socket(so);
 	
   if(so->so_next && so->so_prev) 
     remque(so);  /* crashes if so is not in a queue */
@@ -962,6 +964,7 @@ solisten(port, laddr, lport, flags)
 		return NULL;
 	}
 	insque(so,&tcb);
+	slirp_socket_changed(so);
 	
 	/* 
 	 * SS_FACCEPTONCE sockets must time out.
@@ -1064,6 +1067,7 @@ sofcantrcvmore(so)
 		if(global_writefds) {
 		  FD_CLR(so->s,global_writefds);
 		}
+		so->so_revents &= ~SO_EV_WRITE;
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTSENDMORE)
@@ -1084,6 +1088,7 @@ sofcantsendmore(so)
             if (global_xfds) {
                 FD_CLR(so->s,global_xfds);
             }
+            so->so_revents &= ~(SO_EV_READ | SO_EV_URG);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTRCVMORE)
@@ -51,8 +51,21 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  int	so_events;		/* Events registered for (SO_EV_*) */
+  int	so_evfd;		/* Descriptor registered for events */
+  int	so_revents;		/* Events to handle */
+  int	so_evchanged;		/* Events need to be recomputed */
+  struct socket *so_evnext;	/* Next socket with changed events */
 };
 
+/*
+ * Socket events
+ */
+#define SO_EV_READ		0x1	/* readable or accepting */
+#define SO_EV_WRITE		0x2	/* writable or connected */
+#define SO_EV_URG		0x4	/* urgent data */
+
 
 /*
  * Socket state bits. (peer means the host on the Internet,
@@ -85,6 +98,8 @@ void so_init _P((void));
 struct socket * solookup _P((struct socket *, struct in_addr, u_int, struct in_addr, u_int));
 struct socket * socreate _P((void));
 void sofree _P((struct socket *));
+void slirp_socket_changed _P((struct socket *));
+void slirp_forget_socket _P((struct socket *));
 int soread _P((struct socket *));
 void sorecvoob _P((struct socket *));
 int sosendoob _P((struct socket *));
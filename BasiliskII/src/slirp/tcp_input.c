@@ -416,6 +416,7 @@ findso:
 	  tp = sototcpcb(so);
 	  tp->t_state = TCPS_LISTEN;
 	}
+	slirp_socket_changed(so);
            
         /*
          * If this is a still-connecting socket, this probably
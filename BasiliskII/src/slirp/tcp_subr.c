@@ -547,6 +547,7 @@ tcp_attach(so)
 	   return -1;
 	
 	insque(so, &tcb);
+	slirp_socket_changed(so);
 
 	return 0;
 }
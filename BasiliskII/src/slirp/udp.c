@@ -349,6 +349,7 @@ udp_attach(so)
       /* success, insert in queue */
       so->so_expire = curtime + SO_EXPIRE;
       insque(so,&udb);
+      slirp_socket_changed(so);
     }
   }
   return(so->s);
@@ -644,6 +645,7 @@ udp_listen(port, laddr, lport, flags)
 	so->s = socket(AF_INET,SOCK_DGRAM,0);
 	so->so_expire = curtime + SO_EXPIRE;
 	insque(so,&udb);
+	slirp_socket_changed(so);
 
 	memset(&addr, 0, sizeof(struct sockaddr_in));
 	addr.sin_family = AF_INET;
@@ -24,10 +24,15 @@
 #include "main.h"
 #include "cpu_emulation.h"
 
+#include <map>
+#include <vector>
+
 #ifdef PRECISE_TIMING_POSIX
 #include <pthread.h>
-#include <semaphore.h>
-#include <signal.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
 #endif
 
 #ifdef PRECISE_TIMING_MACH
@@ -50,14 +55,25 @@ enum {	// TMTask struct
 };
 
 
-// Array of additional info for each installed TMTask
+// Tasks due within this many microseconds are run together
+const int32 TIMER_SLACK_USEC = 50;
+
+
+// Additional info for each installed TMTask
 struct TMDesc {
 	uint32 task;		// Mac address of associated TMTask
 	tm_time_t wakeup;	// Time this task is scheduled for execution
-	TMDesc *next;
+	int index;			// Position in the active tasks heap, -1 if not active
+	uint32 serial;		// Value of prime_serial when last primed
 };
 
-static TMDesc *tmDescList;
+// Installed tasks, by TMTask address
+typedef std::map<uint32, TMDesc *> tm_desc_map;
+static tm_desc_map tmDescs;
+
+// Active tasks, as a binary heap ordered by wakeup time
+static std::vector<TMDesc *> tmActive;
+static uint32 prime_serial;
 
 #if PRECISE_TIMING
 #ifdef PRECISE_TIMING_BEOS
@@ -75,6 +91,10 @@ static volatile bool timer_thread_cancel = false;
 static tm_time_t wakeup_time_max = { 0x7fffffff, 999999999 };
 static tm_time_t wakeup_time = wakeup_time_max;
 static pthread_mutex_t wakeup_time_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup_time_cond = PTHREAD_COND_INITIALIZER;
+#ifdef HAVE_SYS_TIMERFD_H
+static int timer_fd = -1;
+#endif
 static void *timer_func(void *arg);
 #endif
 #ifdef PRECISE_TIMING_MACH
@@ -89,38 +109,106 @@ static void *timer_func(void *arg);
 #endif
 
 
-inline static void free_desc(TMDesc *desc)
+/*
+ *  Active tasks heap operations
+ */
+
+static inline bool heap_before(int i, int j)
 {
-	if (desc == tmDescList) {
-		tmDescList = desc->next;
-	} else {
-		for (TMDesc *d = tmDescList; d; d = d->next) {
-			if (d->next == desc) {
-				d->next = desc->next;
-				break;
-			}
-		}
+	return timer_cmp_time(tmActive[i]->wakeup, tmActive[j]->wakeup) < 0;
+}
+
+static inline void heap_swap(int i, int j)
+{
+	TMDesc *d = tmActive[i];
+	tmActive[i] = tmActive[j];
+	tmActive[j] = d;
+	tmActive[i]->index = i;
+	tmActive[j]->index = j;
+}
+
+static void heap_sift(int i)
+{
+	const int n = tmActive.size();
+	while (i > 0 && heap_before(i, (i - 1) / 2)) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	for (;;) {
+		int c = 2 * i + 1;
+		if (c >= n)
+			break;
+		if (c + 1 < n && heap_before(c + 1, c))
+			c++;
+		if (!heap_before(c, i))
+			break;
+		heap_swap(i, c);
+		i = c;
+	}
+}
+
+static void heap_insert(TMDesc *desc)
+{
+	if (desc->index < 0) {
+		desc->index = tmActive.size();
+		tmActive.push_back(desc);
 	}
+	heap_sift(desc->index);
+}
+
+static void heap_remove(TMDesc *desc)
+{
+	int i = desc->index;
+	if (i < 0)
+		return;
+	int last = tmActive.size() - 1;
+	if (i != last)
+		heap_swap(i, last);
+	tmActive.pop_back();
+	desc->index = -1;
+	if (i != last)
+		heap_sift(i);
+}
+
+
+/*
+ *  Free descriptor
+ */
+
+inline static void free_desc(TMDesc *desc)
+{
+	heap_remove(desc);
+	tmDescs.erase(desc->task);
 	delete desc;
 }
 
+
 /*
  *  Find descriptor associated with given TMTask
  */
 
 inline static TMDesc *find_desc(uint32 tm)
 {
-	TMDesc *desc = tmDescList;
-	while (desc) {
-		if (desc->task == tm) {
-			return desc;
-		}
-		desc = desc->next;
-	}
-	return NULL;
+	tm_desc_map::const_iterator it = tmDescs.find(tm);
+	return it != tmDescs.end() ? it->second : NULL;
 }
 
 
+#if PRECISE_TIMING
+/*
+ *  Set wakeup_time to the time the next task has to be called
+ */
+
+static inline void update_wakeup_time(void)
+{
+	if (tmActive.empty())
+		wakeup_time = wakeup_time_max;
+	else
+		wakeup_time = tmActive[0]->wakeup;
+}
+#endif
+
+
 /*
  *  Enqueue task in Time Manager queue
  */
@@ -159,100 +247,70 @@ static void dequeue_tm(uint32 tm)
  */
 
 #ifdef PRECISE_TIMING_POSIX
-const int SIGSUSPEND = SIGRTMIN + 6;
-const int SIGRESUME  = SIGRTMIN + 7;
-static struct sigaction sigsuspend_action;
-static struct sigaction sigresume_action;
-
-static int suspend_count = 0;
-static pthread_mutex_t suspend_count_lock = PTHREAD_MUTEX_INITIALIZER;
-static sem_t suspend_ack_sem;
-static sigset_t suspend_handler_mask;
-
-// Signal handler for suspended thread
-static void sigsuspend_handler(int sig)
+static tm_time_t armed_time = wakeup_time_max;
+
+// Program the timer thread for a new wakeup_time, wakeup_time_lock must be held
+static void timer_thread_rearm(void)
 {
-	sem_post(&suspend_ack_sem);
-	sigsuspend(&suspend_handler_mask);
+	if (timer_cmp_time(wakeup_time, armed_time) == 0)
+		return;
+	armed_time = wakeup_time;
+#ifdef HAVE_SYS_TIMERFD_H
+	if (timer_fd >= 0) {
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		if (timer_cmp_time(wakeup_time, wakeup_time_max) != 0)
+			its.it_value = wakeup_time;
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+		return;
+	}
+#endif
+	pthread_cond_signal(&wakeup_time_cond);
 }
 
-// Signal handler for resumed thread
-static void sigresume_handler(int sig)
+// Check whether wakeup_time has passed, wakeup_time_lock must be held
+static bool timer_thread_expired(void)
 {
-	/* simply trigger a signal to stop clock_nanosleep() */
+	tm_time_t system_time;
+	timer_current_time(system_time);
+	if (timer_cmp_time(wakeup_time, system_time) > 0)
+		return false;
+	wakeup_time = armed_time = wakeup_time_max;
+	return true;
 }
 
 // Initialize timer thread
 static bool timer_thread_init(void)
 {
-	// Install suspend signal handler
-	sigemptyset(&sigsuspend_action.sa_mask);
-	sigaddset(&sigsuspend_action.sa_mask, SIGRESUME);
-	sigsuspend_action.sa_handler = sigsuspend_handler;
-	sigsuspend_action.sa_flags = SA_RESTART;
-#ifdef HAVE_SIGNAL_SA_RESTORER
-	sigsuspend_action.sa_restorer = NULL;
-#endif
-	if (sigaction(SIGSUSPEND, &sigsuspend_action, NULL) < 0)
-		return false;
-
-	// Install resume signal handler
-	sigemptyset(&sigresume_action.sa_mask);
-	sigresume_action.sa_handler = sigresume_handler;
-	sigresume_action.sa_flags = SA_RESTART;
-#ifdef HAVE_SIGNAL_SA_RESTORER
-	sigresume_action.sa_restorer = NULL;
+#ifdef HAVE_SYS_TIMERFD_H
+	// The thread sleeps on a timerfd if available, on a condition variable otherwise
+	timer_fd = timerfd_create(CLOCK_REALTIME, 0);
 #endif
-	if (sigaction(SIGRESUME, &sigresume_action, NULL) < 0)
-		return false;
-
-	// Initialize semaphore
-	if (sem_init(&suspend_ack_sem, 0, 0) < 0)
-		return false;
-
-	// Initialize suspend_handler_mask, it excludes SIGRESUME
-	if (sigfillset(&suspend_handler_mask) != 0)
-		return false;
-	if (sigdelset(&suspend_handler_mask, SIGRESUME) != 0)
-		return false;
-
-	// Create thread in running state
-	suspend_count = 0;
 	return (pthread_create(&timer_thread, NULL, timer_func, NULL) == 0);
 }
 
 // Kill timer thread
 static void timer_thread_kill(void)
 {
+	pthread_mutex_lock(&wakeup_time_lock);
 	timer_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-	pthread_cancel(timer_thread);
+#ifdef HAVE_SYS_TIMERFD_H
+	if (timer_fd >= 0) {
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_nsec = 1;
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	}
 #endif
+	pthread_cond_signal(&wakeup_time_cond);
+	pthread_mutex_unlock(&wakeup_time_lock);
 	pthread_join(timer_thread, NULL);
-}
-
-// Suspend timer thread
-static void timer_thread_suspend(void)
-{
-	pthread_mutex_lock(&suspend_count_lock);
-	if (suspend_count == 0) {
-		suspend_count ++;
-		if (pthread_kill(timer_thread, SIGSUSPEND) == 0)
-			sem_wait(&suspend_ack_sem);
-	}
-	pthread_mutex_unlock(&suspend_count_lock);
-}
-
-// Resume timer thread
-static void timer_thread_resume(void)
-{
-	pthread_mutex_lock(&suspend_count_lock);
-	assert(suspend_count > 0);
-	if (suspend_count == 1) {
-		suspend_count = 0;
-		pthread_kill(timer_thread, SIGRESUME);
+#ifdef HAVE_SYS_TIMERFD_H
+	if (timer_fd >= 0) {
+		close(timer_fd);
+		timer_fd = -1;
 	}
-	pthread_mutex_unlock(&suspend_count_lock);
+#endif
 }
 #endif
 
@@ -321,13 +379,10 @@ void TimerExit(void)
 
 void TimerReset(void)
 {
-	TMDesc *desc = tmDescList;
-	while (desc) {
-		TMDesc *next = desc->next;
-		delete desc;
-		desc = next;
-	}
-	tmDescList = NULL;
+	for (tm_desc_map::iterator it = tmDescs.begin(); it != tmDescs.end(); ++it)
+		delete it->second;
+	tmDescs.clear();
+	tmActive.clear();
 }
 
 
@@ -344,8 +399,9 @@ int16 InsTime(uint32 tm, uint16 trap)
 	else {
 		TMDesc *desc = new TMDesc;
 		desc->task = tm;
-		desc->next = tmDescList;
-		tmDescList = desc;
+		desc->index = -1;
+		desc->serial = 0;
+		tmDescs[tm] = desc;
 	}
 	return 0;
 }
@@ -377,20 +433,16 @@ int16 RmvTime(uint32 tm)
 #endif
 #if PRECISE_TIMING_POSIX
 	pthread_mutex_lock(&wakeup_time_lock);
-	timer_thread_suspend();
 #endif
 	if (ReadMacInt16(tm + qType) & 0x8000) {
 
 		// Yes, make task inactive and remove it from the Time Manager queue
 		WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
 		dequeue_tm(tm);
+		heap_remove(desc);
 #if PRECISE_TIMING
 		// Look for next task to be called and set wakeup_time
-		wakeup_time = wakeup_time_max;
-		for (TMDesc *d = tmDescList; d; d = d->next)
-			if ((ReadMacInt16(d->task + qType) & 0x8000))
-				if (timer_cmp_time(d->wakeup, wakeup_time) < 0)
-					wakeup_time = d->wakeup;
+		update_wakeup_time();
 #endif
 
 		// Compute remaining time
@@ -415,9 +467,8 @@ int16 RmvTime(uint32 tm)
 	thread_resume(timer_thread);
 #endif
 #if PRECISE_TIMING_POSIX
+	timer_thread_rearm();
 	pthread_mutex_unlock(&wakeup_time_lock);
-	timer_thread_resume();
-	assert(suspend_count == 0);
 #endif
 
 	// Free descriptor
@@ -494,17 +545,14 @@ int16 PrimeTime(uint32 tm, int32 time)
 #endif
 #if PRECISE_TIMING_POSIX
 	pthread_mutex_lock(&wakeup_time_lock);
-	timer_thread_suspend();
 #endif
 	WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) | 0x8000);
 	enqueue_tm(tm);
+	desc->serial = ++prime_serial;
+	heap_insert(desc);
 #if PRECISE_TIMING
 	// Look for next task to be called and set wakeup_time
-	wakeup_time = wakeup_time_max;
-	for (TMDesc *d = tmDescList; d; d = d->next)
-		if ((ReadMacInt16(d->task + qType) & 0x8000))
-			if (timer_cmp_time(d->wakeup, wakeup_time) < 0)
-				wakeup_time = d->wakeup;
+	update_wakeup_time();
 #ifdef PRECISE_TIMING_BEOS
 	release_sem(wakeup_time_sem);
 	thread_info info;
@@ -519,9 +567,8 @@ int16 PrimeTime(uint32 tm, int32 time)
 	thread_resume(timer_thread);
 #endif
 #ifdef PRECISE_TIMING_POSIX
+	timer_thread_rearm();
 	pthread_mutex_unlock(&wakeup_time_lock);
-	timer_thread_resume();
-	assert(suspend_count == 0);
 #endif
 #endif
 	return 0;
@@ -581,41 +628,77 @@ static void *timer_func(void *arg)
 #ifdef PRECISE_TIMING_POSIX
 static void *timer_func(void *arg)
 {
+#ifdef HAVE_SYS_TIMERFD_H
+	if (timer_fd >= 0) {
+		while (!timer_thread_cancel) {
+			// Wait until the timerfd armed for wakeup_time expires
+			uint64 expirations;
+			if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+				continue;
+
+			pthread_mutex_lock(&wakeup_time_lock);
+			bool expired = !timer_thread_cancel && timer_thread_expired();
+			pthread_mutex_unlock(&wakeup_time_lock);
+			if (expired) {
+
+				// Timer expired, trigger interrupt
+				SetInterruptFlag(INTFLAG_TIMER);
+				TriggerInterrupt();
+			}
+		}
+		return NULL;
+	}
+#endif
+
+	pthread_mutex_lock(&wakeup_time_lock);
 	while (!timer_thread_cancel) {
-		// Wait until time specified by wakeup_time
-		clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wakeup_time, NULL);
+		// Wait until time specified by wakeup_time, or until it changes
+		if (timer_cmp_time(wakeup_time, wakeup_time_max) == 0)
+			pthread_cond_wait(&wakeup_time_cond, &wakeup_time_lock);
+		else
+			pthread_cond_timedwait(&wakeup_time_cond, &wakeup_time_lock, &wakeup_time);
 
-		tm_time_t system_time;
-		timer_current_time(system_time);
-		if (timer_cmp_time(wakeup_time, system_time) < 0) {
+		if (!timer_thread_cancel && timer_thread_expired()) {
 
 			// Timer expired, trigger interrupt
-			pthread_mutex_lock(&wakeup_time_lock);
-			wakeup_time = wakeup_time_max;
 			pthread_mutex_unlock(&wakeup_time_lock);
 			SetInterruptFlag(INTFLAG_TIMER);
 			TriggerInterrupt();
+			pthread_mutex_lock(&wakeup_time_lock);
 		}
 	}
+	pthread_mutex_unlock(&wakeup_time_lock);
 	return NULL;
 }
 #endif
 
 
 /*
- *  Timer interrupt function (executed as part of 60Hz interrupt)
+ *  Timer interrupt function (executed as part of 60Hz interrupt, and
+ *  on INTFLAG_TIMER with PRECISE_TIMING)
  */
 
 void TimerInterrupt(void)
 {
-	// Look for active TMTasks that have expired
-	tm_time_t now;
+	// Look for active TMTasks that have expired, tasks due within the
+	// next TIMER_SLACK_USEC are run now instead of on a wakeup of their own
+	tm_time_t now, slack;
 	timer_current_time(now);
-	TMDesc *desc = tmDescList;
-	while (desc) {
-		TMDesc *next = desc->next;
+	timer_mac2host_time(slack, -TIMER_SLACK_USEC);
+	timer_add_time(now, now, slack);
+	if (tmActive.empty() || timer_cmp_time(tmActive[0]->wakeup, now) > 0)
+		return;
+
+	// Tasks primed again from within a timer function are left for the
+	// next interrupt, as they would be if they were never removed
+	const uint32 serial = prime_serial;
+	while (!tmActive.empty()) {
+		TMDesc *desc = tmActive[0];
+		if (timer_cmp_time(desc->wakeup, now) > 0 || (int32)(desc->serial - serial) > 0)
+			break;
+		heap_remove(desc);
 		uint32 tm = desc->task;
-		if ((ReadMacInt16(tm + qType) & 0x8000) && timer_cmp_time(desc->wakeup, now) <= 0) {
+		if (ReadMacInt16(tm + qType) & 0x8000) {
 
 			// Found one, mark as inactive and remove it from the Time Manager queue
 			WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
@@ -632,7 +715,6 @@ void TimerInterrupt(void)
 				D(bug(" returned from TimeTask\n"));
 			}
 		}
-		desc = next;
 	}
 
 #if PRECISE_TIMING
@@ -647,13 +729,8 @@ void TimerInterrupt(void)
 #endif
 #if PRECISE_TIMING_POSIX
 	pthread_mutex_lock(&wakeup_time_lock);
-	timer_thread_suspend();
 #endif
-	wakeup_time = wakeup_time_max;
-	for (TMDesc *d = tmDescList; d; d = d->next)
-		if ((ReadMacInt16(d->task + qType) & 0x8000))
-			if (timer_cmp_time(d->wakeup, wakeup_time) < 0)
-				wakeup_time = d->wakeup;
+	update_wakeup_time();
 #if PRECISE_TIMING_BEOS
 	release_sem(wakeup_time_sem);
 	thread_info info;
@@ -668,9 +745,8 @@ void TimerInterrupt(void)
 	thread_resume(timer_thread);
 #endif
 #if PRECISE_TIMING_POSIX
+	timer_thread_rearm();
 	pthread_mutex_unlock(&wakeup_time_lock);
-	timer_thread_resume();
-	assert(suspend_count == 0);
 #endif
 #endif
 }
@@ -264,3 +264,216 @@ void Execute68k(uint32 addr, struct M68kRegisters *r)
 		r->a[i] = m68k_areg(regs, i);
 	quit_program = false;
 }
+
+
+#ifdef TEST_JIT_CACHE
+/*
+ *  Translation cache test (build with "make jit-cache-test"): a chain of
+ *  small 68k blocks with data-dependent branches between them is run
+ *  through the interpreter, then through the JIT compiler with several
+ *  cache sizes. The smaller caches can't hold all the translations, so
+ *  their segments get recycled while blocks still jump into them. Every
+ *  run has its own process, the JIT compiler can only be set up once.
+ */
+
+#include <sys/wait.h>
+#include "vm_alloc.h"
+
+// Stand-ins for the rest of the emulator
+int CPUType = 4;
+int FPUType = 1;
+uint32 InterruptFlags = 0;
+
+#ifdef USE_CPU_EMUL_SERVICES
+int32 emulated_ticks = 1000;
+
+void cpu_do_check_ticks(void)
+{
+	emulated_ticks = 1000;
+}
+#else
+uint16 emulated_ticks;
+
+void cpu_do_check_ticks(void)
+{
+}
+#endif
+
+void idle_resume(void)
+{
+}
+
+void EmulOp(uint16 opcode, M68kRegisters *r)
+{
+}
+
+static bool test_jit;
+static int32 test_cache_size;
+
+bool PrefsFindBool(const char *name)
+{
+	if (strcmp(name, "jit") == 0)
+		return test_jit;
+	return strcmp(name, "jitfpu") == 0 || strcmp(name, "jitlazyflush") == 0 ||
+		strcmp(name, "jitinline") == 0 || strcmp(name, "jitcachelog") == 0;
+}
+
+int32 PrefsFindInt32(const char *name)
+{
+	return strcmp(name, "jitcachesize") == 0 ? test_cache_size : 0;
+}
+
+const char *PrefsFindString(const char *name, int index)
+{
+	return NULL;
+}
+
+const int TEST_BLOCKS = 20000;			// Number of 68k blocks
+const int TEST_LOOPS = 40;				// Number of runs through all of them
+const int TEST_BLOCK_SIZE = 20;			// Size of a 68k block in bytes
+const uint32 TEST_DATA = 0x800;			// Memory operand
+const uint32 TEST_CODE = 0x1000;		// Start of the first block
+
+// Run the test program with the current settings and print the result
+static void test_run(void)
+{
+	vm_init();
+	RAMSize = 0x100000;
+	ROMSize = 0x100000;
+	RAMBaseHost = (uint8 *)vm_acquire(RAMSize + ROMSize, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	if (RAMBaseHost == VM_MAP_FAILED) {
+		printf("Could not allocate memory\n");
+		exit(1);
+	}
+	ROMBaseHost = RAMBaseHost + RAMSize;
+#if DIRECT_ADDRESSING
+	MEMBaseDiff = (uintptr)RAMBaseHost;
+#endif
+	if (!Init680x0()) {
+		printf("Could not initialize the CPU\n");
+		exit(1);
+	}
+
+	// Each block mixes some registers, updates the memory operand and
+	// skips the next block if the result is negative
+	uint32 pc = TEST_CODE;
+	for (int i = 0; i < TEST_BLOCKS; i++) {
+		uint32 target = TEST_CODE + TEST_BLOCK_SIZE * (i + 2 < TEST_BLOCKS ? i + 2 : TEST_BLOCKS);
+		put_word(pc, 0x0681);				// addi.l #imm,d1
+		put_long(pc + 2, i * 0x9e3779b9);
+		put_word(pc + 6, 0xd081);			// add.l d1,d0
+		put_word(pc + 8, 0xb182);			// eor.l d0,d2
+		put_word(pc + 10, 0xe79a);			// rol.l #3,d2
+		put_word(pc + 12, 0x5083 | ((i & 7) << 9));	// addq.l #n,d3
+		put_word(pc + 14, 0xd191);			// add.l d0,(a1)
+		put_word(pc + 16, 0x6b00);			// bmi.w target
+		put_word(pc + 18, target - (pc + 18));
+		pc += TEST_BLOCK_SIZE;
+	}
+	put_word(pc, 0x5387);					// subq.l #1,d7
+	put_word(pc + 2, 0x6706);				// beq.s exit
+	put_word(pc + 4, 0x4ef9);				// jmp TEST_CODE
+	put_long(pc + 6, TEST_CODE);
+	put_word(pc + 10, M68K_EXEC_RETURN);	// exit
+
+	m68k_reset();
+	for (int i = 0; i < 8; i++)
+		m68k_dreg(regs, i) = 0;
+	m68k_dreg(regs, 7) = TEST_LOOPS;
+	m68k_areg(regs, 1) = TEST_DATA;
+	put_long(TEST_DATA, 0);
+	m68k_setpc(TEST_CODE);
+	fill_prefetch_0();
+	quit_program = false;
+#if USE_JIT
+	if (UseJIT) {
+		set_cache_state(1);		// As if the 68k cache was enabled by MacOS
+		m68k_compile_execute();
+	}
+	else
+#endif
+		m68k_execute();
+
+	printf("regs");
+	for (int i = 0; i < 8; i++)
+		printf(" %08x", m68k_dreg(regs, i));
+	printf(", memory %08x\n", get_long(TEST_DATA));
+	Exit680x0();
+}
+
+// Run the test in a child process, return the lines we are interested in
+static bool test_run_child(bool jit, int32 cache_size, char *result, char *stats, size_t size)
+{
+	int fds[2];
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return false;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return false;
+	}
+	if (pid == 0) {
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+		test_jit = jit;
+		test_cache_size = cache_size;
+		alarm(60);
+		test_run();
+		fflush(stdout);
+		_exit(0);
+	}
+	close(fds[1]);
+
+	result[0] = stats[0] = 0;
+	FILE *f = fdopen(fds[0], "r");
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = 0;
+		if (strncmp(line, "regs", 4) == 0)
+			snprintf(result, size, "%s", line);
+		else if (strstr(line, "translation cache statistics: "))
+			snprintf(stats, size, "%s", strstr(line, "statistics: ") + 12);
+	}
+	fclose(f);
+
+	int status;
+	waitpid(pid, &status, 0);
+	if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+		snprintf(result, size, "timed out");
+	else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		snprintf(result, size, "failed");
+	return result[0] && strncmp(result, "regs", 4) == 0;
+}
+
+int main(void)
+{
+	char expected[512], result[512], stats[512];
+	int errors = 0;
+
+	printf("%d blocks, %d loops\n", TEST_BLOCKS, TEST_LOOPS);
+	if (!test_run_child(false, 0, expected, stats, sizeof(expected))) {
+		printf("interpreter: %s\n", expected);
+		return 1;
+	}
+	printf("interpreter: %s\n", expected);
+#if USE_JIT
+	static const int32 cache_sizes[] = { 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384 };
+	for (size_t i = 0; i < sizeof(cache_sizes) / sizeof(cache_sizes[0]); i++) {
+		bool ok = test_run_child(true, cache_sizes[i], result, stats, sizeof(result));
+		ok = ok && strcmp(result, expected) == 0;
+		printf("JIT, %5d KB cache: %s\n", cache_sizes[i], ok ? "ok" : result);
+		if (stats[0])
+			printf("  %s\n", stats);
+		if (!ok)
+			errors++;
+	}
+#else
+	printf("JIT compiler not built, nothing to compare\n");
+#endif
+	return errors != 0;
+}
+#endif
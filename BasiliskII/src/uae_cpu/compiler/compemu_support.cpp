@@ -88,6 +88,13 @@
 #define PROFILE_COMPILE_TIME		0
 #define PROFILE_UNTRANSLATED_INSNS	0
 
+/* Translate hot blocks on a worker thread, see "jitbgcompile" */
+#ifdef HAVE_PTHREADS
+#define USE_BG_COMPILE				1
+#else
+#define USE_BG_COMPILE				0
+#endif
+
 #if defined(__x86_64__) && 0
 #define RECORD_REGISTER_USAGE		1
 #endif
@@ -158,9 +165,21 @@ const bool		follow_const_jumps	= false;
 #endif
 
 const uae_u32	MIN_CACHE_SIZE		= 1024;		// Minimal translation cache size (1 MB)
+const int		CACHE_SEGMENTS		= 8;		// Number of translation cache segments recycled in FIFO order
 static uae_u32	cache_size			= 0;		// Size of total cache allocated for compiled blocks
+static uae_u32	cache_segment_size	= 0;		// Size of a translation cache segment, 0 if the cache is flushed as a whole
 static uae_u32	current_cache_size	= 0;		// Cache grows upwards: how much has been consumed already
+static bool		log_cache_stats		= false;	// Flag: log translation cache statistics
 static bool		lazy_flush			= true;		// Flag: lazy translation cache invalidation
+#if USE_BG_COMPILE
+static bool		bg_compile			= false;	// Flag: translate hot blocks on a worker thread
+static bool		bg_compiling		= false;	// Flag: compile_block() runs on the worker thread
+static bool		bg_promote			= false;	// Flag: worker request comes from an expired countdown
+#else
+const bool		bg_compile			= false;
+const bool		bg_compiling		= false;
+const bool		bg_promote			= false;
+#endif
 static bool		avoid_fpu			= true;		// Flag: compile FPU instructions ?
 static bool		have_cmov			= false;	// target has CMOV instructions ?
 static bool		have_lahf_lm		= true;		// target has LAHF supported in long mode ?
@@ -223,6 +242,12 @@ int segvcount=0;
 int soft_flush_count=0;
 int hard_flush_count=0;
 int checksum_count=0;
+static uae_u32 evict_count=0;			// Translation cache segments recycled
+static uae_u32 evicted_blocks=0;		// Blocks thrown away with them
+static uae_u64 evicted_bytes=0;
+static uae_u32 translate_count=0;		// Calls to compile_block() that generated code
+static uae_u32 recompile_count=0;		// ... for blocks that were evicted before
+static uae_u8 evicted_cl[TAGSIZE/8];	// Cache lines of evicted blocks
 static uae_u8* current_compile_p=NULL;
 static uae_u8* max_compile_start;
 static uae_u8* compiled_code=NULL;
@@ -238,6 +263,47 @@ static void* popall_cache_miss=NULL;
 static void* popall_recompile_block=NULL;
 static void* popall_check_checksum=NULL;
 
+#if USE_BG_COMPILE
+/* Background compilation. The translator, the block lists and the
+   translation cache belong to whoever holds compiler_lock. The worker
+   keeps it while translating a block, whereas the emulation thread
+   only tries to get it from the popall handlers and interprets the
+   current block if the worker is busy. The lock is recursive because
+   flush_icache() can be reached from code interpreted in
+   execute_normal() */
+static pthread_mutex_t compiler_lock;
+static uae_u32 bg_generation = 0;				// Bumped on every translation cache flush
+
+static void bg_start(void);
+static void bg_stop(void);
+static void bg_execute_normal(void);
+static void bg_cache_miss(void);
+static void bg_recompile_block(void);
+static void bg_check_checksum(void);
+
+/* C handler reached through the popall_* stubs */
+#define popall_target(handler) (bg_compile ? bg_##handler : handler)
+#else
+#define popall_target(handler) handler
+#endif
+static volatile bool bg_flush_pending = false;	// Worker ran out of translation cache
+
+static inline void lock_compiler(void)
+{
+#if USE_BG_COMPILE
+	if (bg_compile)
+		pthread_mutex_lock(&compiler_lock);
+#endif
+}
+
+static inline void unlock_compiler(void)
+{
+#if USE_BG_COMPILE
+	if (bg_compile)
+		pthread_mutex_unlock(&compiler_lock);
+#endif
+}
+
 /* The 68k only ever executes from even addresses. So right now, we
  * waste half the entries in this array
  * UPDATE: We now use those entries to store the start of the linked
@@ -271,8 +337,15 @@ extern struct cputbl op_smalltbl_5_nf[];
 
 static void flush_icache_hard(int n);
 static void flush_icache_lazy(int n);
+static void flush_icache_full(int n);
+static uae_u8 *cache_segment_end(uae_u8 *start);
+static void log_cache_eviction(const char *what);
 static void flush_icache_none(int n);
 void (*flush_icache)(int n) = flush_icache_none;
+#if USE_BG_COMPILE
+static void flush_icache_locked(int n);
+static void (*flush_icache_unlocked)(int n) = flush_icache_none;
+#endif
 
 
 
@@ -5009,6 +5082,8 @@ void compiler_init(void)
 	lazy_flush = PrefsFindBool("jitlazyflush");
 	write_log("<JIT compiler> : lazy translation cache invalidation : %s\n", str_on_off(lazy_flush));
 	flush_icache = lazy_flush ? flush_icache_lazy : flush_icache_hard;
+	log_cache_stats = PrefsFindBool("jitcachelog");
+	write_log("<JIT compiler> : log translation cache statistics : %s\n", str_on_off(log_cache_stats));
 	
 	// Compiler features
 	write_log("<JIT compiler> : register aliasing : %s\n", str_on_off(1));
@@ -5019,10 +5094,20 @@ void compiler_init(void)
 #endif
 	write_log("<JIT compiler> : translate through constant jumps : %s\n", str_on_off(follow_const_jumps));
 	write_log("<JIT compiler> : separate blockinfo allocation : %s\n", str_on_off(USE_SEPARATE_BIA));
+#if USE_BG_COMPILE
+	bg_compile = PrefsFindBool("jitbgcompile");
+#endif
+	write_log("<JIT compiler> : translate hot blocks in the background : %s\n", str_on_off(bg_compile));
 	
 	// Build compiler tables
 	build_comp();
 	
+#if USE_BG_COMPILE
+	// Start background compiler
+	if (bg_compile)
+		bg_start();
+#endif
+	
 	initialized = true;
 	
 #if PROFILE_UNTRANSLATED_INSNS
@@ -5041,6 +5126,14 @@ void compiler_exit(void)
 	emul_end_time = clock();
 #endif
 	
+#if USE_BG_COMPILE
+	// Stop background compiler
+	bg_stop();
+#endif
+	
+	if (log_cache_stats)
+		log_cache_eviction("translation cache statistics");
+	
 	// Deallocate translation cache
 	if (compiled_code) {
 		vm_release(compiled_code, cache_size * 1024);
@@ -5612,9 +5705,11 @@ void calc_disp_ea_020(int base, uae_u32 dp, int target, int tmp)
 
 void set_cache_state(int enabled)
 {
+    lock_compiler();
     if (enabled!=letit)
 	flush_icache_hard(77);
     letit=enabled;
+    unlock_compiler();
 }
 
 int get_cache_state(void)
@@ -5709,8 +5804,13 @@ void alloc_cache(void)
 	
 	if (compiled_code) {
 		write_log("<JIT compiler> : actual translation cache size : %d KB at 0x%08X\n", cache_size, compiled_code);
-		max_compile_start = compiled_code + cache_size*1024 - BYTES_PER_INST;
+		// Segments are recycled only if blockinfos don't live in the cache
+		cache_segment_size = cache_size * 1024 / CACHE_SEGMENTS;
+		if (!USE_SEPARATE_BIA || cache_segment_size < 4 * BYTES_PER_INST)
+			cache_segment_size = 0;
+		write_log("<JIT compiler> : translation cache segment size : %d KB\n", cache_segment_size / 1024);
 		current_compile_p = compiled_code;
+		max_compile_start = cache_segment_end(current_compile_p) - BYTES_PER_INST;
 		current_cache_size = 0;
 	}
 }
@@ -5922,7 +6022,9 @@ static __inline__ void match_states(blockinfo* bi)
     int i;
     smallstate* s=&(bi->env);
     
-    if (bi->status==BI_NEED_CHECK) {
+    /* The worker must not patch code the emulation thread may be running,
+       the check is left to check_checksum() instead */
+    if (bi->status==BI_NEED_CHECK && !bg_compiling) {
 	block_check_checksum(bi);
     }
     if (bi->status==BI_ACTIVE || 
@@ -6016,7 +6118,7 @@ static __inline__ void create_popalls(void)
       if (need_to_preserve[i])
 	  raw_pop_l_r(i);
   }
-  raw_jmp((uintptr)execute_normal);
+  raw_jmp((uintptr)popall_target(execute_normal));
 
   align_target(align_jumps);
   popall_cache_miss=get_target();
@@ -6025,7 +6127,7 @@ static __inline__ void create_popalls(void)
       if (need_to_preserve[i])
 	  raw_pop_l_r(i);
   }
-  raw_jmp((uintptr)cache_miss);
+  raw_jmp((uintptr)popall_target(cache_miss));
 
   align_target(align_jumps);
   popall_recompile_block=get_target();
@@ -6034,7 +6136,7 @@ static __inline__ void create_popalls(void)
       if (need_to_preserve[i])
 	  raw_pop_l_r(i);
   }
-  raw_jmp((uintptr)recompile_block);
+  raw_jmp((uintptr)popall_target(recompile_block));
 
   align_target(align_jumps);
   popall_exec_nostats=get_target();
@@ -6052,7 +6154,7 @@ static __inline__ void create_popalls(void)
       if (need_to_preserve[i])
 	  raw_pop_l_r(i);
   }
-  raw_jmp((uintptr)check_checksum);
+  raw_jmp((uintptr)popall_target(check_checksum));
 
   // no need to further write into popallspace
   vm_protect(popallspace, POPALLSPACE_SIZE, VM_PAGE_READ | VM_PAGE_EXECUTE);
@@ -6068,10 +6170,9 @@ static __inline__ void reset_lists(void)
     dormant=NULL;
 }
 
-static void prepare_block(blockinfo* bi)
+/* The entry points other blocks jump to while this one is not translated */
+static void emit_block_pens(blockinfo* bi)
 {
-    int i;
-
     set_target(current_compile_p);
     align_target(align_jumps);
     bi->direct_pen=(cpuop_func *)get_target();
@@ -6085,6 +6186,13 @@ static void prepare_block(blockinfo* bi)
     raw_mov_l_mr((uintptr)&regs.pc_p,0);
     raw_jmp((uintptr)popall_check_checksum);
     current_compile_p=get_target();
+}
+
+static void prepare_block(blockinfo* bi)
+{
+    int i;
+
+    emit_block_pens(bi);
 
     bi->deplist=NULL;
     for (i=0;i<2;i++) {
@@ -6315,6 +6423,10 @@ static void flush_icache_hard(int n)
     blockinfo* bi, *dbi;
 
     hard_flush_count++;
+#if USE_BG_COMPILE
+    bg_generation++;
+    bg_flush_pending=false;
+#endif
 #if 0
     write_log("Flush Icache_hard(%d/%x/%p), %u KB\n",
 	   n,regs.pc,regs.pc_p,current_cache_size/1024);
@@ -6336,13 +6448,180 @@ static void flush_icache_hard(int n)
     }
 
     reset_lists();
+    memset(evicted_cl, 0, sizeof(evicted_cl));
     if (!compiled_code)
 	return;
     current_compile_p=compiled_code;
+    max_compile_start=cache_segment_end(current_compile_p)-BYTES_PER_INST;
 	SPCFLAGS_SET( SPCFLAG_JIT_EXEC_RETURN ); /* To get out of compiled code */
 }
 
 
+/* Translation cache eviction. The cache is filled one segment at a
+   time, and once it is full, the segments are recycled in FIFO order so
+   that only the oldest translations are thrown away. A block never
+   straddles a segment boundary, so the handlers tell where its code is.
+*/
+
+static void log_cache_eviction(const char *what)
+{
+	printf("<JIT compiler> : %s: %u evictions, %u blocks (%u KB) evicted, %d hard flushes, "
+		   "%u translations, %u recompiled after eviction (%.1f%%)\n",
+		   what, evict_count, evicted_blocks, (uae_u32)(evicted_bytes / 1024), hard_flush_count,
+		   translate_count, recompile_count,
+		   translate_count ? 100.0 * recompile_count / translate_count : 0.0);
+}
+
+static inline bool block_code_in(cpuop_func *handler, const uae_u8 *start, const uae_u8 *end)
+{
+	return (uintptr)handler - (uintptr)start < (uintptr)(end - start);
+}
+
+static bool block_in_segment(blockinfo *bi, const uae_u8 *start, const uae_u8 *end)
+{
+	return block_code_in(bi->direct_pen, start, end) ||
+		block_code_in(bi->handler, start, end) ||
+		block_code_in(bi->direct_handler, start, end) ||
+		block_code_in(bi->handler_to_use, start, end) ||
+		block_code_in(bi->direct_handler_to_use, start, end);
+}
+
+/* Forget the direct jumps whose code is in the segment, so that only
+   jumps from the rest of the cache keep a block alive */
+static void unlink_segment_jumps(blockinfo *bi, const uae_u8 *start, const uae_u8 *end)
+{
+	for (; bi; bi = bi->next) {
+		bool in_segment = block_in_segment(bi, start, end);
+		for (int i = 0; i < 2; i++) {
+			if (in_segment || block_code_in((cpuop_func *)bi->dep[i].jmp_off, start, end))
+				remove_dep(&(bi->dep[i]));
+		}
+	}
+}
+
+static void evict_block(blockinfo *bi)
+{
+	uae_u32 cl = cacheline(bi->pc_p);
+	evicted_cl[cl / 8] |= 1 << (cl % 8);
+
+	if (bi->deplist && current_compile_p < max_compile_start) {
+		/* Other blocks still jump here directly. Keep the blockinfo with
+		   new entry points in the recycled segment, so that set_dhtu()
+		   relinks these jumps once the block is translated again */
+		emit_block_pens(bi);
+		bi->direct_handler_to_use = NULL; /* Force set_dhtu() to patch them */
+		invalidate_block(bi);
+#if USE_CHECKSUM_INFO
+		free_checksum_info_chain(bi->csi);
+		bi->csi = NULL;
+#endif
+		if (bi == cache_tags[cl + 1].bi)
+			cache_tags[cl].handler = (cpuop_func *)popall_execute_normal;
+		remove_from_list(bi);
+		add_to_active(bi);
+		return;
+	}
+
+	/* No room left for the entry points. Unlink the direct jumps from
+	   other blocks: they fall through to their exit code, which returns
+	   to the dispatcher with regs.pc_p set to this block */
+	dependency *x = bi->deplist;
+	while (x) {
+		dependency *next = x->next;
+		if (x->jmp_off)
+			adjust_jmpdep(x, (cpuop_func *)(x->jmp_off + 1));
+		x->jmp_off = NULL;
+		x->target = NULL;
+		remove_dep(x);
+		x = next;
+	}
+	remove_deps(bi);
+
+	remove_from_cl_list(bi);
+	remove_from_list(bi);
+	free_blockinfo(bi);
+}
+
+static int evict_blocks(blockinfo *bi, const uae_u8 *start, const uae_u8 *end)
+{
+	int count = 0;
+	while (bi) {
+		blockinfo *dbi = bi;
+		bi = bi->next;
+		if (block_in_segment(dbi, start, end)) {
+			evict_block(dbi);
+			count++;
+		}
+	}
+	return count;
+}
+
+static uae_u8 *cache_segment_end(uae_u8 *start)
+{
+	uae_u8 *cache_end = compiled_code + cache_size * 1024;
+	if (cache_segment_size == 0)
+		return cache_end;
+	uae_u8 *end = start + cache_segment_size;
+	if ((uae_u32)(cache_end - end) < cache_segment_size)
+		end = cache_end;
+	return end;
+}
+
+/* Make room for new code in the next segment */
+static void evict_cache_segment(void)
+{
+	uae_u8 *start = max_compile_start + BYTES_PER_INST;
+	if (start >= compiled_code + cache_size * 1024)
+		start = compiled_code;
+	uae_u8 *end = cache_segment_end(start);
+
+#if USE_BG_COMPILE
+	bg_generation++;
+	bg_flush_pending=false;
+#endif
+	/* Blocks that are kept get their entry points at the segment start */
+	current_compile_p = start;
+	max_compile_start = end - BYTES_PER_INST;
+
+	unlink_segment_jumps(active, start, end);
+	unlink_segment_jumps(dormant, start, end);
+	/* Kept blocks move to the head of the active list, behind the walk */
+	int count = evict_blocks(active, start, end) + evict_blocks(dormant, start, end);
+	/* alloc_blockinfos() only refills the hold_bi[] slots up to the
+	   first one in use, so they are released altogether */
+	bool hold_evicted = false;
+	for (int i = 0; i < MAX_HOLD_BI; i++) {
+		if (hold_bi[i] && block_code_in(hold_bi[i]->direct_pen, start, end))
+			hold_evicted = true;
+	}
+	for (int i = 0; hold_evicted && i < MAX_HOLD_BI; i++) {
+		if (hold_bi[i])
+			free_blockinfo(hold_bi[i]);
+		hold_bi[i] = NULL;
+	}
+
+	/* The first round only finds empty segments */
+	if (count) {
+		evict_count++;
+		evicted_blocks += count;
+		evicted_bytes += end - start;
+		if (log_cache_stats)
+			log_cache_eviction("evicted translation cache segment");
+	}
+
+	SPCFLAGS_SET( SPCFLAG_JIT_EXEC_RETURN ); /* To get out of compiled code */
+}
+
+/* The translation cache is full */
+static void flush_icache_full(int n)
+{
+	if (cache_segment_size)
+		evict_cache_segment();
+	else
+		flush_icache_hard(n);
+}
+
+
 /* "Soft flushing" --- instead of actually throwing everything away,
    we simply mark everything as "needs to be checked". 
 */
@@ -6353,6 +6632,9 @@ static inline void flush_icache_lazy(int n)
     blockinfo* bi2;
 
         soft_flush_count++;
+#if USE_BG_COMPILE
+	bg_generation++;
+#endif
 	if (!active)
 	    return;
 
@@ -6389,10 +6671,16 @@ static inline void flush_icache_lazy(int n)
 
 void flush_icache_range(uae_u8 *start_p, uae_u32 length)
 {
-	if (!active)
+	lock_compiler();
+	if (!active) {
+		unlock_compiler();
 		return;
+	}
 
 #if LAZY_FLUSH_ICACHE_RANGE
+#if USE_BG_COMPILE
+	bg_generation++;
+#endif
 	blockinfo *bi = active;
 	while (bi) {
 #if USE_CHECKSUM_INFO
@@ -6430,10 +6718,21 @@ void flush_icache_range(uae_u8 *start_p, uae_u32 length)
 			add_to_dormant(dbi);
 		}
 	}
+	unlock_compiler();
 	return;
 #endif
 	flush_icache(-1);
+	unlock_compiler();
+}
+
+#if USE_BG_COMPILE
+static void flush_icache_locked(int n)
+{
+	pthread_mutex_lock(&compiler_lock);
+	flush_icache_unlocked(n);
+	pthread_mutex_unlock(&compiler_lock);
 }
+#endif
 
 int failure;
 
@@ -6573,14 +6872,27 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	int extra_len=0;
 
 	redo_current_block=0;
-	if (current_compile_p>=max_compile_start)
-	    flush_icache_hard(7);
+	if (current_compile_p>=max_compile_start) {
+	    if (bg_compiling) {
+		/* Only the emulation thread knows when no translated code
+		   is running, let it make room in the cache */
+		bg_flush_pending=true;
+		return;
+	    }
+	    flush_icache_full(7);
+	}
 
 	alloc_blockinfos();
 
 	bi=get_blockinfo_addr_new(pc_hist[0].location,0);
 	bi2=get_blockinfo(cl);
 
+	translate_count++;
+	if (evicted_cl[cl/8] & (1 << (cl%8))) {
+	    evicted_cl[cl/8] &= ~(1 << (cl%8));
+	    recompile_count++;
+	}
+
 	optlev=bi->optlevel;
 	if (bi->status!=BI_INVALID) {
 	    Dif (bi!=bi2) { 
@@ -6592,13 +6904,15 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 		abort();
 	    }
 
-	    Dif (bi->count!=-1 && bi->status!=BI_NEED_RECOMP) {
+	    Dif (bi->count!=-1 && bi->status!=BI_NEED_RECOMP && !bg_compiling) {
 		write_log("bi->count=%d, bi->status=%d\n",bi->count,bi->status);
 		/* What the heck? We are not supposed to be here! */
 		abort();
 	    }
 	}	
-	if (bi->count==-1) {
+	/* The countdown code keeps running while the worker is busy, so
+	   the request tells whether this is a promotion instead */
+	if (bg_compiling ? bg_promote : bi->count==-1) {
 	    optlev++;
 	    while (!optcount[optlev])
 		optlev++;
@@ -6659,7 +6973,8 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	was_comp=0;
 
 	bi->direct_handler=(cpuop_func *)get_target();
-	set_dhtu(bi,bi->direct_handler);
+	if (!bg_compiling) /* Otherwise done by bg_install_blocks() */
+	    set_dhtu(bi,bi->direct_handler);
 	bi->status=BI_COMPILING;
 	current_block_start_target=(uintptr)get_target();
 	
@@ -6701,8 +7016,12 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 		}
 #endif
 		
+	    /* The blockinfos and alignment may have used up the room left
+	       before max_compile_start, but the slack of BYTES_PER_INST
+	       always fits one instruction. Without it, the block would
+	       only jump to itself */
 	    for (i=0;i<blocklen &&
-		     get_target_noopt()<max_compile_start;i++) {
+		     (i==0 || get_target_noopt()<max_compile_start);i++) {
 		cpuop_func **cputbl;
 		compop_func **comptbl;
 		uae_u32 opcode=DO_GET_OPCODE(pc_hist[i].location);
@@ -6992,21 +7311,26 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	current_compile_p=get_target();
 	raise_in_cl_list(bi);
 	
-	/* We will flush soon, anyway, so let's do it now */
-	if (current_compile_p>=max_compile_start)
-		flush_icache_hard(7);
-	
 	bi->status=BI_ACTIVE;
-	if (redo_current_block)
+	if (redo_current_block && !bg_compiling)
 	    block_need_recompile(bi);
 	
+	/* We will flush soon, anyway, so let's do it now */
+	if (current_compile_p>=max_compile_start) {
+	    if (bg_compiling)
+		bg_flush_pending=true;
+	    else
+		flush_icache_full(7);
+	}
+	
 #if PROFILE_COMPILE_TIME
 	compile_time += (clock() - start_time);
 #endif
     }
 
     /* Account for compilation time */
-    cpu_do_check_ticks();
+    if (!bg_compiling)
+	cpu_do_check_ticks();
 }
 
 void do_nothing(void)
@@ -7029,11 +7353,273 @@ void exec_nostats(void)
 	}
 }
 
+#if USE_BG_COMPILE
+/* Background compilation requests. Slots from bg_queue_head up to
+   bg_queue_done were handled by the worker and wait for
+   bg_install_blocks(), the ones up to bg_queue_tail are still to be
+   translated. Only the emulation thread moves head and tail */
+struct bg_request {
+	cpu_history		pc_hist[MAXRUN];
+	int				blocklen;
+	uae_u8 *		start_pc_p;
+	uae_u32			start_pc;
+	uae_u32			generation;		// Translation cache generation at queue time
+	int				status;			// Block state at queue time
+	int				optlevel;
+	bool			promote;		// Countdown expired, translate at next optlevel
+	blockinfo *		bi;				// Translated block, NULL if the request was dropped
+	cpuop_func *	direct_handler;
+	bool			redo;
+};
+
+const int BG_QUEUE_SIZE = 16;
+static bg_request bg_queue[BG_QUEUE_SIZE];
+static uae_u32 bg_queue_head = 0;
+static uae_u32 bg_queue_done = 0;
+static uae_u32 bg_queue_tail = 0;
+static pthread_mutex_t bg_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bg_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t bg_thread;
+static bool bg_thread_active = false;
+static bool bg_thread_cancel = false;
+
+static bool bg_block_queued(void *pc_p)
+{
+	for (uae_u32 i = bg_queue_head; i != bg_queue_tail; i++) {
+		if (bg_queue[i % BG_QUEUE_SIZE].pc_hist[0].location == pc_p)
+			return true;
+	}
+	return false;
+}
+
+static void bg_queue_block(cpu_history *pc_hist, int blocklen, blockinfo *bi)
+{
+	if (bg_queue_tail - bg_queue_head >= BG_QUEUE_SIZE)
+		return; /* We will try again next time */
+
+	bg_request *req = &bg_queue[bg_queue_tail % BG_QUEUE_SIZE];
+	memcpy(req->pc_hist, pc_hist, blocklen * sizeof(cpu_history));
+	req->blocklen = blocklen;
+	req->start_pc_p = start_pc_p;
+	req->start_pc = start_pc;
+	req->generation = bg_generation;
+	req->status = bi->status;
+	req->optlevel = bi->optlevel;
+	req->promote = bi->status != BI_NEED_RECOMP;
+	req->bi = NULL;
+
+	pthread_mutex_lock(&bg_queue_lock);
+	bg_queue_tail++;
+	pthread_cond_signal(&bg_queue_cond);
+	pthread_mutex_unlock(&bg_queue_lock);
+}
+
+/* Worker side, called with compiler_lock held. The new code is only
+   reachable through cache_tags[] on return, direct jumps from other
+   blocks are redirected by bg_install_blocks() */
+static void bg_compile_block(bg_request *req)
+{
+	blockinfo *bi = get_blockinfo_addr(req->pc_hist[0].location);
+
+	/* Drop requests for blocks that were flushed or retranslated meanwhile */
+	if (req->generation != bg_generation || !bi ||
+		bi->status != req->status || bi->optlevel != req->optlevel)
+		return;
+
+	cpuop_func *direct_handler = bi->direct_handler;
+	start_pc_p = req->start_pc_p;
+	start_pc = req->start_pc;
+	bg_compiling = true;
+	bg_promote = req->promote;
+	compile_block(req->pc_hist, req->blocklen);
+	bg_compiling = false;
+	bg_promote = false;
+
+	if (bi->status == BI_ACTIVE && bi->direct_handler != direct_handler) {
+		req->bi = bi;
+		req->direct_handler = bi->direct_handler;
+		req->redo = redo_current_block != 0;
+	}
+}
+
+static void *bg_compile_thread(void *arg)
+{
+	pthread_mutex_lock(&bg_queue_lock);
+	for (;;) {
+		while (bg_queue_done == bg_queue_tail && !bg_thread_cancel)
+			pthread_cond_wait(&bg_queue_cond, &bg_queue_lock);
+		if (bg_thread_cancel)
+			break;
+		bg_request *req = &bg_queue[bg_queue_done % BG_QUEUE_SIZE];
+		pthread_mutex_unlock(&bg_queue_lock);
+
+		pthread_mutex_lock(&compiler_lock);
+		bg_compile_block(req);
+		pthread_mutex_unlock(&compiler_lock);
+
+		pthread_mutex_lock(&bg_queue_lock);
+		bg_queue_done++;
+	}
+	pthread_mutex_unlock(&bg_queue_lock);
+	return NULL;
+}
+
+/* Emulation thread side, called with compiler_lock held. No translated
+   code is running, so it is now safe to patch the jumps to blocks the
+   worker has translated */
+static void bg_install_blocks(void)
+{
+	pthread_mutex_lock(&bg_queue_lock);
+	uae_u32 done = bg_queue_done;
+	pthread_mutex_unlock(&bg_queue_lock);
+
+	for (; bg_queue_head != done; bg_queue_head++) {
+		bg_request *req = &bg_queue[bg_queue_head % BG_QUEUE_SIZE];
+		blockinfo *bi = req->bi;
+		if (bi && req->generation == bg_generation &&
+			bi->status == BI_ACTIVE && bi->direct_handler == req->direct_handler) {
+			if (req->redo)
+				block_need_recompile(bi);
+			else
+				set_dhtu(bi, bi->direct_handler);
+		}
+	}
+}
+
+static void bg_start(void)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&compiler_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	flush_icache_unlocked = flush_icache;
+	flush_icache = flush_icache_locked;
+
+	bg_thread_cancel = false;
+	bg_thread_active = pthread_create(&bg_thread, NULL, bg_compile_thread, NULL) == 0;
+	if (!bg_thread_active) {
+		write_log("<JIT compiler> : could not create background compiler thread\n");
+		bg_compile = false;
+	}
+}
+
+static void bg_stop(void)
+{
+	if (bg_thread_active) {
+		pthread_mutex_lock(&bg_queue_lock);
+		bg_thread_cancel = true;
+		pthread_cond_signal(&bg_queue_cond);
+		pthread_mutex_unlock(&bg_queue_lock);
+		pthread_join(bg_thread, NULL);
+		bg_thread_active = false;
+	}
+}
+
+/* What execute_normal() does with the block at regs.pc_p. Countdown
+   code for new blocks is cheap enough to be generated right away,
+   whereas hot blocks are queued to the worker and interpreted until
+   their translation is installed */
+enum {
+	BG_COMPILE_NOW,				// Translate the block on this thread
+	BG_COMPILE_LATER,			// Interpret the block and queue it to the worker
+	BG_INTERPRET,				// Interpret the block, a request is pending
+	BG_DISPATCH					// Block was just installed, return to the dispatcher
+};
+
+static int bg_compile_action(blockinfo *bi)
+{
+	if (!bi || bi->status == BI_INVALID)
+		return BG_COMPILE_NOW;
+	if (bg_block_queued(bi->pc_p))
+		return BG_INTERPRET;
+	if (bi->status == BI_NEED_RECOMP && bi->optlevel > 0)
+		return BG_COMPILE_LATER;
+	if (bi->status == BI_ACTIVE && bi->optlevel == 0 && bi->count < 0)
+		return BG_COMPILE_LATER;
+	if (bi->status == BI_ACTIVE && bi->optlevel > 0 &&
+		cache_tags[cacheline(bi->pc_p)].handler == bi->handler_to_use)
+		return BG_DISPATCH;
+	return BG_COMPILE_NOW;
+}
+
+/* The popall handlers only try to get the translator. If the worker is
+   busy with it, the current block is interpreted */
+static bool bg_enter(void)
+{
+	if (pthread_mutex_trylock(&compiler_lock) != 0) {
+		exec_nostats();
+		return false;
+	}
+	if (bg_flush_pending) {
+		flush_icache_full(7);
+		pthread_mutex_unlock(&compiler_lock);
+		exec_nostats();
+		return false;
+	}
+	bg_install_blocks();
+	return true;
+}
+
+static inline void bg_leave(void)
+{
+	pthread_mutex_unlock(&compiler_lock);
+}
+
+static void bg_execute_normal(void)
+{
+	if (bg_enter()) {
+		execute_normal();
+		bg_leave();
+	}
+}
+
+static void bg_cache_miss(void)
+{
+	if (bg_enter()) {
+		cache_miss();
+		bg_leave();
+	}
+}
+
+static void bg_recompile_block(void)
+{
+	if (bg_enter()) {
+		recompile_block();
+		bg_leave();
+	}
+}
+
+static void bg_check_checksum(void)
+{
+	if (bg_enter()) {
+		check_checksum();
+		bg_leave();
+	}
+}
+#endif
+
 void execute_normal(void)
 {
 	if (!check_for_cache_miss()) {
 		cpu_history pc_hist[MAXRUN];
 		int blocklen = 0;
+#if USE_BG_COMPILE
+		blockinfo *bi = NULL;
+		int action = BG_COMPILE_NOW;
+		uae_u32 generation = bg_generation;
+		if (bg_compile) {
+			bi = get_blockinfo_addr(regs.pc_p);
+			action = bg_compile_action(bi);
+			if (action == BG_DISPATCH)
+				return;
+			if (action == BG_INTERPRET) {
+				exec_nostats();
+				return;
+			}
+		}
+#endif
 #if REAL_ADDRESSING || DIRECT_ADDRESSING
 		start_pc_p = regs.pc_p;
 		start_pc = get_virtual_address(regs.pc_p);
@@ -7050,6 +7636,14 @@ void execute_normal(void)
 			(*cpufunctbl[opcode])(opcode);
 			cpu_check_ticks();
 			if (end_block(opcode) || SPCFLAGS_TEST(SPCFLAG_ALL) || blocklen>=MAXRUN) {
+#if USE_BG_COMPILE
+				if (action == BG_COMPILE_LATER) {
+					/* Unless the block was flushed by the code we ran */
+					if (generation == bg_generation)
+						bg_queue_block(pc_hist, blocklen, bi);
+					return;
+				}
+#endif
 				compile_block(pc_hist, blocklen);
 				return; /* We will deal with the spcflags in the caller */
 			}
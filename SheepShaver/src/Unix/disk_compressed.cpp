@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/disk_compressed.cpp
\ No newline at end of file
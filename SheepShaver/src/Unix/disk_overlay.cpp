@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/disk_overlay.cpp
\ No newline at end of file
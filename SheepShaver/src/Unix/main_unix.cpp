@@ -1519,7 +1519,7 @@ static void *tick_func(void *arg)
 		next += 16625;
 		int64 delay = next - GetTicks_usec();
 		if (delay > 0)
-			Delay_usec(delay);
+			Delay_until_usec(next);
 		else if (delay < -16625)
 			next = GetTicks_usec();
 		if (tick_inhibit) continue;
@@ -119,6 +119,7 @@
 #define PPC_PROFILE_COMPILE_TIME 0
 #define PPC_PROFILE_GENERIC_CALLS 0
 #define PPC_PROFILE_REGS_USE 0
+#define PPC_PROFILE_BLOCKS 1
 #define KPX_MAX_CPUS 1
 #if ENABLE_DYNGEN
 #define PPC_ENABLE_JIT 1
@@ -438,6 +439,7 @@ typedef struct timeval tm_time_t;
 // Timing functions
 extern uint64 GetTicks_usec(void);
 extern void Delay_usec(uint64 usec);
+extern void Delay_until_usec(uint64 ticks);
 
 #ifdef HAVE_PTHREADS
 // Setup pthread attributes
@@ -2548,7 +2548,7 @@ static void *redraw_func(void *arg)
 #ifdef ENABLE_VOSF
 					if (use_vosf) {
 						XDisplayLock();
-						if (mainBuffer.dirty) {
+						if (video_vosf_dirty()) {
 							LOCK_VOSF;
 							update_display_window_vosf();
 							UNLOCK_VOSF;
@@ -2584,7 +2584,7 @@ static void *redraw_func(void *arg)
 				// Update display (VOSF variant)
 				if (++tick_counter >= frame_skip) {
 					tick_counter = 0;
-					if (mainBuffer.dirty) {
+					if (video_vosf_dirty()) {
 						LOCK_VOSF;
 						update_display_dga_vosf();
 						UNLOCK_VOSF;
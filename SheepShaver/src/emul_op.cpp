@@ -315,9 +315,7 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 			if (HasMacStarted()) {
 				if (InterruptFlags & INTFLAG_VIA) {
 					ClearInterruptFlag(INTFLAG_VIA);
-#if !PRECISE_TIMING
 					TimerInterrupt();
-#endif
 					ExecuteNative(NATIVE_VIDEO_VBL);
 
 					static int tick_counter = 0;
@@ -330,6 +328,10 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 
 					r->d[0] = 1;		// Flag: 68k interrupt routine executes VBLTasks etc.
 				}
+				if (InterruptFlags & INTFLAG_DISK) {
+					ClearInterruptFlag(INTFLAG_DISK);
+					DiskInterrupt();
+				}
 				if (InterruptFlags & INTFLAG_SERIAL) {
 					ClearInterruptFlag(INTFLAG_SERIAL);
 					SerialInterrupt();
@@ -27,6 +27,15 @@
 #define DEBUG 0
 #include "debug.h"
 
+// Generic vectors for the row loops, they compile to SSE2 on x86 and to NEON on ARM
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define NQD_VECTOR 1
+typedef uint64 nqd_vec __attribute__((vector_size(16)));
+typedef uint8 nqd_vec_8 __attribute__((vector_size(16)));
+typedef uint16 nqd_vec_16 __attribute__((vector_size(16)));
+typedef uint32 nqd_vec_32 __attribute__((vector_size(16)));
+#endif
+
 
 /*
  *	Utility functions
@@ -91,6 +100,16 @@ static inline void do_invrect(uint8 *dest, uint32 length)
 	}
 #endif
 
+#if NQD_VECTOR
+	// Invert 16-byte vectors
+	for (; length >= sizeof(nqd_vec); length -= sizeof(nqd_vec), dest += sizeof(nqd_vec)) {
+		nqd_vec v;
+		memcpy(&v, dest, sizeof(v));
+		v = ~v;
+		memcpy(dest, &v, sizeof(v));
+	}
+#endif
+
 	// Invert 8-byte words
 	if (length >= 8) {
 		const int r = (length / 8) % 8;
@@ -204,6 +223,16 @@ static inline void do_fillrect(uint8 *dest, uint32 color, uint32 length)
 	}
 #endif
 
+#if NQD_VECTOR
+	// Fill 16-byte vectors
+	if (length >= sizeof(nqd_vec)) {
+		const uint64 c = (((uint64)color) << 32) | color;
+		const nqd_vec v = {c, c};
+		for (; length >= sizeof(nqd_vec); length -= sizeof(nqd_vec), dest += sizeof(nqd_vec))
+			memcpy(dest, &v, sizeof(v));
+	}
+#endif
+
 	// Fill 8-byte words
 	if (length >= 8) {
 		const uint64 c = (((uint64)color) << 32) | color;
@@ -318,6 +347,167 @@ bool NQD_fillrect_hook(uint32 p)
  *	Isomorphic rectangle blitting
  */
 
+/*
+  BitBlt transfer modes:
+  0 : srcCopy
+  1 : srcOr
+  2 : srcXor
+  3 : srcBic
+  4 : notSrcCopy
+  5 : notSrcOr
+  6 : notSrcXor
+  7 : notSrcBic
+  32 : blend
+  33 : addPin
+  34 : addOver
+  35 : subPin
+  36 : transparent
+  37 : adMax
+  38 : subOver
+  39 : adMin
+  50 : hilite
+*/
+
+// Blit one row of length bytes. mask selects the color bits of 32 bits worth
+// of pixels in memory order, key is the background color of transparent mode
+typedef void (*nqd_blit_func)(uint8 *dest, const uint8 *src, uint32 length, uint32 key, uint32 mask);
+
+static void nqd_blit_copy(uint8 *dest, const uint8 *src, uint32 length, uint32, uint32)
+{
+	memmove(dest, src, length);
+}
+
+// Boolean modes combine the bits of indexed pixel values, 1 bits are black
+#define NQD_BOOLEAN_MODE(NAME, EXPR) \
+	struct NAME { template< class T > static inline T apply(T s, T d) { return EXPR; } };
+NQD_BOOLEAN_MODE(nqd_src_or, s | d)
+NQD_BOOLEAN_MODE(nqd_src_xor, s ^ d)
+NQD_BOOLEAN_MODE(nqd_src_bic, d & ~s)
+NQD_BOOLEAN_MODE(nqd_not_src_copy, ~s)
+NQD_BOOLEAN_MODE(nqd_not_src_or, ~s | d)
+NQD_BOOLEAN_MODE(nqd_not_src_xor, ~(s ^ d))
+NQD_BOOLEAN_MODE(nqd_not_src_bic, s & d)
+#undef NQD_BOOLEAN_MODE
+
+// Source rows must not start within the destination row, see NQD_bitblt().
+// The unused bits of direct pixels are left alone
+template< class OP >
+static void nqd_blit_boolean(uint8 *dest, const uint8 *src, uint32 length, uint32, uint32 mask)
+{
+	const uint64 m = ((uint64)mask << 32) | mask;
+#if NQD_VECTOR
+	const nqd_vec vm = {m, m};
+	for (; length >= sizeof(nqd_vec); length -= sizeof(nqd_vec), src += sizeof(nqd_vec), dest += sizeof(nqd_vec)) {
+		nqd_vec s, d;
+		memcpy(&s, src, sizeof(s));
+		memcpy(&d, dest, sizeof(d));
+		d = (OP::apply(s, d) & vm) | (d & ~vm);
+		memcpy(dest, &d, sizeof(d));
+	}
+#endif
+	for (; length >= 8; length -= 8, src += 8, dest += 8) {
+		uint64 s, d;
+		memcpy(&s, src, sizeof(s));
+		memcpy(&d, dest, sizeof(d));
+		d = (OP::apply(s, d) & m) | (d & ~m);
+		memcpy(dest, &d, sizeof(d));
+	}
+	if (length > 0) {
+		// Rows start with a whole pixel, so the mask lines up with the remaining bytes
+		uint64 s = 0, d = 0;
+		memcpy(&s, src, length);
+		memcpy(&d, dest, length);
+		d = (OP::apply(s, d) & m) | (d & ~m);
+		memcpy(dest, &d, length);
+	}
+}
+
+// Transparent mode copies the source pixels that differ from the background color
+template< class T > struct nqd_vector_type;
+#if NQD_VECTOR
+template<> struct nqd_vector_type<uint8> { typedef nqd_vec_8 type; };
+template<> struct nqd_vector_type<uint16> { typedef nqd_vec_16 type; };
+template<> struct nqd_vector_type<uint32> { typedef nqd_vec_32 type; };
+#endif
+
+template< class T >
+static void nqd_blit_transparent(uint8 *dest, const uint8 *src, uint32 length, uint32 key, uint32 mask)
+{
+#if NQD_VECTOR
+	typedef typename nqd_vector_type<T>::type V;
+	V k, m;
+	for (unsigned i = 0; i < sizeof(V) / sizeof(T); i++) {
+		k[i] = key;
+		m[i] = mask;
+	}
+	for (; length >= sizeof(V); length -= sizeof(V), src += sizeof(V), dest += sizeof(V)) {
+		V s, d;
+		memcpy(&s, src, sizeof(s));
+		memcpy(&d, dest, sizeof(d));
+		V keep = (V)((s & m) == k);
+		d = (d & keep) | (s & ~keep);
+		memcpy(dest, &d, sizeof(d));
+	}
+#endif
+	for (; length >= sizeof(T); length -= sizeof(T), src += sizeof(T), dest += sizeof(T)) {
+		T s;
+		memcpy(&s, src, sizeof(s));
+		if ((s & mask) != key)
+			memcpy(dest, &s, sizeof(s));
+	}
+}
+
+// Are the pens black and white? Boolean modes don't colorize the source then
+static bool NQD_black_and_white(uint32 p)
+{
+	const uint32 fore_pen = ReadMacInt32(p + acclForePen);
+	const uint32 back_pen = ReadMacInt32(p + acclBackPen);
+	switch (ReadMacInt32(p + acclDestPixelSize)) {
+	case 8:
+		return (fore_pen & 0xff) == 0xff && (back_pen & 0xff) == 0;
+	case 16:
+		return (fore_pen & 0x7fff) == 0 && (back_pen & 0x7fff) == 0x7fff;
+	case 32:
+		return (fore_pen & 0xffffff) == 0 && (back_pen & 0xffffff) == 0xffffff;
+	}
+	return false;
+}
+
+// Get blitter for the transfer mode, NULL if it can't be accelerated
+static nqd_blit_func NQD_blit_func(uint32 p)
+{
+	static const nqd_blit_func boolean_funcs[8] = {
+		nqd_blit_copy,
+		nqd_blit_boolean<nqd_src_or>,
+		nqd_blit_boolean<nqd_src_xor>,
+		nqd_blit_boolean<nqd_src_bic>,
+		nqd_blit_boolean<nqd_not_src_copy>,
+		nqd_blit_boolean<nqd_not_src_or>,
+		nqd_blit_boolean<nqd_not_src_xor>,
+		nqd_blit_boolean<nqd_not_src_bic>
+	};
+
+	const uint32 transfer_mode = ReadMacInt32(p + acclTransferMode);
+	const int depth = ReadMacInt32(p + acclSrcPixelSize);
+	if (transfer_mode == 0)
+		return nqd_blit_copy;
+	else if (transfer_mode < 8) {
+		if (!NQD_black_and_white(p))
+			return NULL;
+		// Black is 0 in direct pixels, so the complementary operation is applied
+		// to their bits (e.g. srcOr ANDs them, so that black source pixels win)
+		return boolean_funcs[depth > 8 ? 8 - transfer_mode : transfer_mode];
+	}
+	else if (transfer_mode == 36) {
+		switch (depth) {
+		case 8: return nqd_blit_transparent<uint8>;
+		case 16: return nqd_blit_transparent<uint16>;
+		case 32: return nqd_blit_transparent<uint32>;
+		}
+	}
+	return NULL;
+}
+
 void NQD_bitblt(uint32 p)
 {
 	D(bug("accl_bitblt %08x\n", p));
@@ -331,18 +521,54 @@ void NQD_bitblt(uint32 p)
 	int16 height = (int16)ReadMacInt16(p + acclDestRect + 4) - (int16)ReadMacInt16(p + acclDestRect + 0);
 	D(bug(" src addr %08x, dest addr %08x\n", ReadMacInt32(p + acclSrcBaseAddr), ReadMacInt32(p + acclDestBaseAddr)));
 	D(bug(" src X %d, src Y %d, dest X %d, dest Y %d\n", src_X, src_Y, dest_X, dest_Y));
-	D(bug(" width %d, height %d\n", width, height));
+	D(bug(" width %d, height %d, transfer mode %d\n", width, height, ReadMacInt32(p + acclTransferMode)));
 
-	// And perform the blit
+	nqd_blit_func blit = NQD_blit_func(p);
+	if (blit == NULL)
+		return;
+
+	// Background color for transparent mode, compared in Mac byte order without the unused bits
 	const int bpp = bytes_per_pixel(ReadMacInt32(p + acclSrcPixelSize));
+	uint32 key = ReadMacInt32(p + acclBackPen), mask;
+	switch (bpp) {
+	case 1:
+		key &= 0xff;
+		mask = 0xffffffff;
+		break;
+	case 2:
+		key = htons(key & 0x7fff);
+		mask = htons(0x7fff) * 0x10001;
+		break;
+	default:
+		key = htonl(key & 0xffffff);
+		mask = htonl(0xffffff);
+		break;
+	}
+
+	// Rows are processed from left to right, a source row that starts within
+	// the destination row (scrolling right) is saved before it is overwritten
+	static uint8 *row_buffer = NULL;
+	static int row_buffer_size = 0;
 	width *= bpp;
+	if (blit != nqd_blit_copy && width > row_buffer_size) {
+		free(row_buffer);
+		row_buffer = (uint8 *)malloc(width);
+		row_buffer_size = row_buffer ? width : 0;
+		if (row_buffer == NULL)
+			return;
+	}
+
+	// And perform the blit
 	if ((int32)ReadMacInt32(p + acclSrcRowBytes) > 0) {
 		const int src_row_bytes = (int32)ReadMacInt32(p + acclSrcRowBytes);
 		const int dst_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
 		uint8 *src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + (src_Y * src_row_bytes) + (src_X * bpp));
 		uint8 *dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + (dest_Y * dst_row_bytes) + (dest_X * bpp));
 		for (int i = 0; i < height; i++) {
-			memmove(dst, src, width);
+			if (blit != nqd_blit_copy && dst > src && dst < src + width)
+				blit(dst, (const uint8 *)memcpy(row_buffer, src, width), width, key, mask);
+			else
+				blit(dst, src, width, key, mask);
 			src += src_row_bytes;
 			dst += dst_row_bytes;
 		}
@@ -353,34 +579,16 @@ void NQD_bitblt(uint32 p)
 		uint8 *src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + ((src_Y + height - 1) * src_row_bytes) + (src_X * bpp));
 		uint8 *dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + ((dest_Y + height - 1) * dst_row_bytes) + (dest_X * bpp));
 		for (int i = height - 1; i >= 0; i--) {
-			memmove(dst, src, width);
+			if (blit != nqd_blit_copy && dst > src && dst < src + width)
+				blit(dst, (const uint8 *)memcpy(row_buffer, src, width), width, key, mask);
+			else
+				blit(dst, src, width, key, mask);
 			src -= src_row_bytes;
 			dst -= dst_row_bytes;
 		}
 	}
 }
 
-/*
-  BitBlt transfer modes:
-  0 : srcCopy
-  1 : srcOr
-  2 : srcXor
-  3 : srcBic
-  4 : notSrcCopy
-  5 : notSrcOr
-  6 : notSrcXor
-  7 : notSrcBic
-  32 : blend
-  33 : addPin
-  34 : addOver
-  35 : subPin
-  36 : transparent
-  37 : adMax
-  38 : subOver
-  39 : adMin
-  50 : hilite
-*/
-
 bool NQD_bitblt_hook(uint32 p)
 {
 	D(bug("accl_draw_hook %08x\n", p));
@@ -392,7 +600,7 @@ bool NQD_bitblt_hook(uint32 p)
 		ReadMacInt32(p + acclSrcPixelSize) >= 8 &&
 		ReadMacInt32(p + acclSrcPixelSize) == ReadMacInt32(p + acclDestPixelSize) &&
 		(int32)(ReadMacInt32(p + acclSrcRowBytes) ^ ReadMacInt32(p + acclDestRowBytes)) >= 0 &&	// same sign?
-		ReadMacInt32(p + acclTransferMode) == 0 &&												// srcCopy?
+		NQD_blit_func(p) != NULL &&																// supported transfer mode?
 		(int32)ReadMacInt32(p + 0x15c) > 0) {
 
 		// Yes, set function pointer
@@ -459,3 +667,240 @@ void VideoInstallAccel(void)
 		}
 	}
 }
+
+
+/*
+ *	Test and benchmark of the accelerated operations against per-pixel
+ *	reference implementations
+ */
+
+#ifdef TEST_GFXACCEL
+#include <sys/time.h>
+#include <algorithm>
+#include "vm_alloc.h"
+#include "thunks.h"
+
+uint32 screen_base = 0;
+uintptr SheepMem::proc;
+uintptr SheepMem::data;
+void video_set_dirty_area(int x, int y, int w, int h) { }
+bool PrefsFindBool(const char *name) { return false; }
+uint32 NativeTVECT(int selector) { return 0x1000 + selector; }
+void NQDMisc(uint32 arg1, uintptr arg2) { }
+
+static double accel_test_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static uint32 test_get_pixel(const uint8 *p, int bpp)
+{
+	uint32 v = 0;
+	for (int i = 0; i < bpp; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void test_put_pixel(uint8 *p, int bpp, uint32 v)
+{
+	for (int i = bpp - 1; i >= 0; i--, v >>= 8)
+		p[i] = v;
+}
+
+// QuickDraw semantics of the transfer modes with black foreground and white background pens
+static uint32 test_transfer_pixel(int mode, int depth, uint32 s, uint32 d, uint32 back_pen)
+{
+	const uint32 color_mask = depth == 8 ? 0xff : depth == 16 ? 0x7fff : 0xffffff;
+	if (mode == 36)
+		return ((s ^ back_pen) & color_mask) == 0 ? d : s;
+
+	// Direct pixels are black when the color bits are all 0, indexed ones when they are all 1
+	const uint32 black = depth == 8 ? 0 : color_mask;
+	const uint32 bs = s ^ black, bd = d ^ black;
+	uint32 r;
+	switch (mode) {
+	case 0: r = bs; break;
+	case 1: r = bs | bd; break;
+	case 2: r = bs ^ bd; break;
+	case 3: r = bd & ~bs; break;
+	case 4: r = ~bs; break;
+	case 5: r = ~bs | bd; break;
+	case 6: r = ~(bs ^ bd); break;
+	default: r = bs & bd; break;
+	}
+	r ^= black;
+	if (mode == 0)	// srcCopy copies whole pixels
+		return s;
+	return (r & color_mask) | (d & ~color_mask);
+}
+
+static void test_set_rect(uint32 p, uint32 offset, int top, int left, int bottom, int right)
+{
+	WriteMacInt16(p + offset + 0, top);
+	WriteMacInt16(p + offset + 2, left);
+	WriteMacInt16(p + offset + 4, bottom);
+	WriteMacInt16(p + offset + 6, right);
+}
+
+int main(int argc, char *argv[])
+{
+	const int n_loops = argc > 1 ? atoi(argv[1]) : 100;
+	const int modes[] = {0, 1, 2, 3, 4, 5, 6, 7, 36};
+	const int n_modes = sizeof(modes) / sizeof(modes[0]);
+	const int W = 1024, H = 768;
+	const uint32 buffer_size = W * H * 4;
+
+	vm_init();
+	uint8 *memory = (uint8 *)vm_acquire(3 * buffer_size + 0x1000, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	uint8 *check = (uint8 *)malloc(buffer_size);
+	if (memory == VM_MAP_FAILED || check == NULL) {
+		fprintf(stderr, "Not enough memory\n");
+		return 1;
+	}
+	const uint32 params = Host2MacAddr(memory);
+	uint8 *src = memory + 0x1000, *dst = src + buffer_size, *orig = dst + buffer_size;
+	const uint32 src_addr = Host2MacAddr(src), dst_addr = Host2MacAddr(dst);
+
+	bool failed = false;
+	srand(1);
+	for (int depth = 8; depth <= 32; depth *= 2) {
+		const int bpp = depth / 8;
+		const uint32 fore_pen = depth == 8 ? 0xff : 0;
+		const uint32 back_pen = depth == 8 ? 0 : depth == 16 ? 0x7fff : 0xffffff;
+
+		// Compare random and overlapping rectangles with the reference
+		for (int m = 0; m < n_modes; m++) {
+			const int mode = modes[m];
+			int errors = 0;
+			for (int n = 0; n < 300; n++) {
+				const int row_bytes = 200 * bpp + (rand() % 3) * 4;
+				const int w = 1 + rand() % 199, h = 1 + rand() % 39;
+				const int sx = rand() % (200 - w + 1), sy = rand() % (40 - h + 1);
+				int dx = rand() % (200 - w + 1), dy = rand() % (40 - h + 1);
+				const bool overlap = rand() & 1;
+				if (overlap) {
+					// Scroll within the same rows, rows are blitted one after the other
+					dy = sy;
+					dx = std::min(200 - w, sx + rand() % 8);
+				}
+				for (int i = 0; i < row_bytes * 40; i++)
+					dst[i] = rand();
+				for (int i = 0; i < 400; i++)
+					test_put_pixel(dst + (rand() % 40) * row_bytes + (rand() % 200) * bpp, bpp, back_pen | ((rand() & 1) << (depth - 1)));
+				memcpy(orig, dst, row_bytes * 40);
+				memcpy(src, dst, row_bytes * 40);
+
+				memset(memory, 0, 0x1000);
+				WriteMacInt32(params + acclSrcBaseAddr, overlap ? dst_addr : src_addr);
+				WriteMacInt32(params + acclDestBaseAddr, dst_addr);
+				WriteMacInt32(params + acclSrcRowBytes, row_bytes);
+				WriteMacInt32(params + acclDestRowBytes, row_bytes);
+				WriteMacInt32(params + acclSrcPixelSize, depth);
+				WriteMacInt32(params + acclDestPixelSize, depth);
+				WriteMacInt32(params + acclForePen, fore_pen);
+				WriteMacInt32(params + acclBackPen, back_pen);
+				WriteMacInt32(params + acclTransferMode, mode);
+				WriteMacInt32(params + 0x15c, 1);
+				test_set_rect(params, acclSrcRect, sy, sx, sy + h, sx + w);
+				test_set_rect(params, acclDestRect, dy, dx, dy + h, dx + w);
+				if (!NQD_bitblt_hook(params)) {
+					errors++;
+					continue;
+				}
+				NQD_bitblt(params);
+
+				memcpy(check, orig, row_bytes * 40);
+				for (int y = 0; y < h; y++)
+					for (int x = 0; x < w; x++) {
+						const uint32 s = test_get_pixel(orig + (sy + y) * row_bytes + (sx + x) * bpp, bpp);
+						const uint32 d = test_get_pixel(orig + (dy + y) * row_bytes + (dx + x) * bpp, bpp);
+						test_put_pixel(check + (dy + y) * row_bytes + (dx + x) * bpp, bpp, test_transfer_pixel(mode, depth, s, d, back_pen));
+					}
+				if (memcmp(dst, check, row_bytes * 40) != 0)
+					errors++;
+			}
+
+			// Colored pens can't be accelerated in boolean modes
+			WriteMacInt32(params + acclForePen, depth == 8 ? 0x23 : 0x1234);
+			if (mode >= 1 && mode <= 7 && NQD_bitblt_hook(params))
+				errors++;
+			WriteMacInt32(params + acclForePen, fore_pen);
+
+			// Throughput of full screen blits
+			WriteMacInt32(params + acclSrcBaseAddr, src_addr);
+			WriteMacInt32(params + acclSrcRowBytes, W * bpp);
+			WriteMacInt32(params + acclDestRowBytes, W * bpp);
+			test_set_rect(params, acclSrcRect, 0, 0, H, W);
+			test_set_rect(params, acclDestRect, 0, 0, H, W);
+			const double start = accel_test_time();
+			for (int n = 0; n < n_loops; n++)
+				NQD_bitblt(params);
+			const double rate = (double)W * H * bpp * n_loops / (accel_test_time() - start) / 1e9;
+			printf("bitblt %2d bpp mode %2d %7.2f GB/s  %s\n", depth, mode, rate, errors ? "MISMATCH" : "ok");
+			if (errors)
+				failed = true;
+		}
+
+		// Fill and invert rectangles
+		for (int op = 8; op <= 10; op += 2) {
+			int errors = 0;
+			for (int n = 0; n < 300; n++) {
+				const int row_bytes = 200 * bpp + (rand() % 3) * 4;
+				const int w = 1 + rand() % 199, h = 1 + rand() % 39;
+				const int dx = rand() % (200 - w + 1), dy = rand() % (40 - h + 1);
+				const uint32 color = depth == 8 ? (rand() & 0xff) * 0x01010101 : depth == 16 ? (rand() & 0xffff) * 0x10001 : rand();
+				for (int i = 0; i < row_bytes * 40; i++)
+					dst[i] = rand();
+				memcpy(check, dst, row_bytes * 40);
+
+				memset(memory, 0, 0x1000);
+				WriteMacInt32(params + acclDestBaseAddr, dst_addr);
+				WriteMacInt32(params + acclDestRowBytes, row_bytes);
+				WriteMacInt32(params + acclDestPixelSize, depth);
+				WriteMacInt32(params + acclForePen, color);
+				WriteMacInt32(params + acclPenMode, 8);
+				WriteMacInt32(params + acclTransferMode, op);
+				WriteMacInt32(params + 0x284, 1);
+				test_set_rect(params, acclDestRect, dy, dx, dy + h, dx + w);
+				if (!NQD_fillrect_hook(params)) {
+					errors++;
+					continue;
+				}
+				if (op == 8)
+					NQD_fillrect(params);
+				else
+					NQD_invrect(params);
+
+				for (int y = 0; y < h; y++)
+					for (int x = 0; x < w; x++) {
+						uint8 *p = check + (dy + y) * row_bytes + (dx + x) * bpp;
+						test_put_pixel(p, bpp, op == 8 ? color : ~test_get_pixel(p, bpp));
+					}
+				if (memcmp(dst, check, row_bytes * 40) != 0)
+					errors++;
+			}
+
+			WriteMacInt32(params + acclDestRowBytes, W * bpp);
+			test_set_rect(params, acclDestRect, 0, 0, H, W);
+			const double start = accel_test_time();
+			for (int n = 0; n < n_loops; n++) {
+				if (op == 8)
+					NQD_fillrect(params);
+				else
+					NQD_invrect(params);
+			}
+			const double rate = (double)W * H * bpp * n_loops / (accel_test_time() - start) / 1e9;
+			printf("%-6s %2d bpp         %7.2f GB/s  %s\n", op == 8 ? "fill" : "invert", depth, rate, errors ? "MISMATCH" : "ok");
+			if (errors)
+				failed = true;
+		}
+	}
+
+	free(check);
+	vm_release(memory, 3 * buffer_size + 0x1000);
+	vm_exit();
+	return failed ? 1 : 0;
+}
+#endif
@@ -55,6 +55,13 @@
 #include "mon_disass.h"
 #endif
 
+#if PPC_PROFILE_BLOCKS
+#include <signal.h>
+#if ENABLE_MON
+#include "mon_atraps.h"
+#endif
+#endif
+
 #define DEBUG 0
 #include "debug.h"
 
@@ -177,6 +184,12 @@ public:
 	// Handle MacOS interrupt
 	void interrupt(uint32 entry);
 
+#if PPC_PROFILE_BLOCKS
+	// Sampling block profiler hooks
+	virtual uint32 profile_context();
+	virtual void profile_frames(char *buf, int size, uint32 pc, uint32 ctx);
+#endif
+
 	// Make sure the SIGSEGV handler can access CPU registers
 	friend sigsegv_return_t sigsegv_handler(sigsegv_info_t *sip);
 };
@@ -186,8 +199,20 @@ sheepshaver_cpu::sheepshaver_cpu()
 	init_decoder();
 
 #if PPC_ENABLE_JIT
-	if (PrefsFindBool("jit"))
+	if (PrefsFindBool("jit")) {
 		enable_jit();
+#if PPC_ENABLE_JIT_TRACES
+		// Saved trace profiles are only useful to trace formation,
+		// so a trace cache file enables it as well
+		const char *filename = PrefsFindString("jitcache");
+		const bool use_jit_cache = filename && filename[0];
+		if (PrefsFindBool("jittraces") || use_jit_cache) {
+			enable_jit_traces();
+			if (use_jit_cache)
+				load_trace_profiles(filename);
+		}
+#endif
+	}
 #endif
 }
 
@@ -717,6 +742,78 @@ inline void sheepshaver_cpu::get_resource(uint32 old_get_resource)
 	gpr(1) += 56;
 }
 
+#if PPC_PROFILE_BLOCKS
+// Profile sample contexts, 68k emulator samples hold the 68k PC with bit 0 set
+enum {
+	PROFILE_CTX_NATIVE	= 0,
+	PROFILE_CTX_EMUL_OP	= 2,
+	PROFILE_CTX_68K		= 1
+};
+
+uint32 sheepshaver_cpu::profile_context()
+{
+	switch (ReadMacInt32(XLM_RUN_MODE)) {
+	case MODE_68K:
+		return gpr(24) | PROFILE_CTX_68K;
+	case MODE_EMUL_OP:
+		return PROFILE_CTX_EMUL_OP;
+	}
+	return PROFILE_CTX_NATIVE;
+}
+
+// Name the Mac address space region ADDR lives in
+static const char *profile_region(uint32 addr)
+{
+	if (addr - RAMBase < RAMSize)
+		return "RAM";
+	if (addr - ROMBase < ROM_AREA_SIZE)
+		return "ROM";
+	if (addr - DR_EMULATOR_BASE < DR_EMULATOR_SIZE)
+		return "DR_emulator";
+	if (addr - DR_CACHE_BASE < DR_CACHE_SIZE)
+		return "DR_cache";
+	if (addr - KERNEL_DATA_BASE < 0x2000)
+		return "kernel_data";
+	return "unknown";
+}
+
+void sheepshaver_cpu::profile_frames(char *buf, int size, uint32 pc, uint32 ctx)
+{
+	if ((ctx & PROFILE_CTX_68K) == 0) {
+		snprintf(buf, size, "%s;%s", ctx == PROFILE_CTX_EMUL_OP ? "emul_op" : "ppc", profile_region(pc));
+		return;
+	}
+
+	// The 68k PC points past the current opcode, name A-line traps
+	const uint32 pc68k = (ctx & ~PROFILE_CTX_68K) - 2;
+	const char *region = profile_region(pc68k);
+	uint16 opcode = 0;
+	if (strcmp(region, "RAM") == 0 || strcmp(region, "ROM") == 0)
+		opcode = ReadMacInt16(pc68k);
+	if ((opcode & 0xf000) == 0xa000) {
+		const char *name = NULL;
+#if ENABLE_MON
+		// Look for the exact trap word first, then ignore the flag bits
+		const uint16 mask = (opcode & 0x0800) ? 0xfbff : 0xf8ff;
+		for (const atrap_info *p = atraps; name == NULL && p->word; p++) {
+			if (p->word == opcode)
+				name = p->name;
+		}
+		for (const atrap_info *p = atraps; name == NULL && p->word; p++) {
+			if ((p->word & mask) == (opcode & mask))
+				name = p->name;
+		}
+#endif
+		if (name)
+			snprintf(buf, size, "68k;%s;_%s", region, name);
+		else
+			snprintf(buf, size, "68k;%s;_%04X", region, opcode);
+	}
+	else
+		snprintf(buf, size, "68k;%s;0x%08x", region, pc68k);
+}
+#endif
+
 
 /**
  *		SheepShaver CPU engine interface
@@ -743,6 +840,29 @@ static void dump_log(void)
 	ppc_cpu->dump_log();
 }
 
+#if PPC_PROFILE_BLOCKS
+// Sampling block profiler, SIGUSR1 toggles it at run-time
+static const char *profile_filename = "SheepShaver.folded";
+static volatile sig_atomic_t profile_toggle_pending = 0;
+
+static void sigusr1_handler(int sig)
+{
+	profile_toggle_pending = 1;
+}
+
+// This must be called from the emulator thread, outside of compiled code
+static void toggle_profile(void)
+{
+	if (ppc_cpu->is_profiling()) {
+		ppc_cpu->stop_profile();
+		if (!ppc_cpu->dump_profile(profile_filename))
+			printf("WARNING: Could not write block profile to %s\n", profile_filename);
+	}
+	else if (!ppc_cpu->start_profile())
+		printf("WARNING: Could not start block profiler\n");
+}
+#endif
+
 static int read_mem(bfd_vma memaddr, bfd_byte *myaddr, int length, struct disassemble_info *info)
 {
 	Mac2Host_memcpy(myaddr, memaddr, length);
@@ -858,6 +978,21 @@ void init_emul_ppc(void)
 	mon_add_command("log", dump_log, "log                      Dump PowerPC emulation log\n");
 #endif
 
+#if PPC_PROFILE_BLOCKS
+	// Start profiling right away if an output file was specified
+	const char *filename = PrefsFindString("cpuprofile");
+	if (filename && filename[0]) {
+		profile_filename = filename;
+		toggle_profile();
+	}
+
+	struct sigaction sigusr1_action;
+	sigemptyset(&sigusr1_action.sa_mask);
+	sigusr1_action.sa_handler = sigusr1_handler;
+	sigusr1_action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sigusr1_action, NULL);
+#endif
+
 #if EMUL_TIME_STATS
 	emul_start_time = clock();
 #endif
@@ -895,6 +1030,20 @@ void exit_emul_ppc(void)
 	printf("\n");
 #endif
 
+#if PPC_PROFILE_BLOCKS
+	if (ppc_cpu->is_profiling())
+		toggle_profile();
+#endif
+
+#if PPC_ENABLE_JIT && PPC_ENABLE_JIT_TRACES
+	// Save trace profiles for the next run
+	const char *filename = PrefsFindString("jitcache");
+	if (filename && filename[0] && PrefsFindBool("jit")) {
+		if (!ppc_cpu->save_trace_profiles(filename))
+			printf("WARNING: Could not write JIT trace cache to %s\n", filename);
+	}
+#endif
+
 	delete ppc_cpu;
 	ppc_cpu = NULL;
 }
@@ -961,6 +1110,14 @@ void HandleInterrupt(powerpc_registers *r)
 	SDL_PumpEvents();
 #endif
 
+#if PPC_PROFILE_BLOCKS
+	// Block cache is stable here, this is a safe place to dump profiles
+	if (profile_toggle_pending) {
+		profile_toggle_pending = 0;
+		toggle_profile();
+	}
+#endif
+
 	// Do nothing if interrupts are disabled
 	if (int32(ReadMacInt32(XLM_IRQ_NEST)) > 0)
 		return;
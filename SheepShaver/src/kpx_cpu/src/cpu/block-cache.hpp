@@ -21,8 +21,29 @@
 #ifndef BLOCK_CACHE_H
 #define BLOCK_CACHE_H
 
+#include <string.h>
 #include "block-alloc.hpp"
 
+/**
+ *	Basic block cache
+ *
+ *		Blocks are looked up through a direct-mapped table of the most
+ *		recently used block per cacheline, then through a hash table
+ *		keyed on their entry PC. The latter starts with 2^HASH_BITS
+ *		entries and is doubled whenever the load factor exceeds
+ *		HASH_LOAD_FACTOR.
+ *
+ *		NOTE: CACHE_TAGS[] shall remain the first table after the
+ *		allocator, and keep 2^HASH_BITS entries, since fast_find() is
+ *		also inlined into precompiled dyngen code.
+ *
+ *		Active and dormant blocks are also linked into a page index so
+ *		that range invalidation only visits blocks that intersect the
+ *		range. The BLOCK_INFO type shall provide [MIN_PC, MAX_PC] bounds
+ *		for that purpose. Blocks spanning more than MAX_PAGES pages are
+ *		kept in a separate list that is always checked.
+ **/
+
 template< class block_info, template<class T> class block_allocator = slow_allocator >
 class block_cache
 {
@@ -30,6 +51,23 @@ private:
 	static const uint32 HASH_BITS = 15;
 	static const uint32 HASH_SIZE = 1 << HASH_BITS;
 	static const uint32 HASH_MASK = HASH_SIZE - 1;
+	static const uint32 HASH_MAX_BITS = 20;
+	static const uint32 HASH_LOAD_FACTOR = 2;
+
+	static const uint32 PAGE_BITS = 12;
+	static const uint32 PAGE_HASH_BITS = 12;
+	static const uint32 PAGE_HASH_SIZE = 1 << PAGE_HASH_BITS;
+	static const uint32 PAGE_HASH_MASK = PAGE_HASH_SIZE - 1;
+	static const int MAX_PAGES = 2;
+
+	struct entry;
+
+	struct page_link
+	{
+		entry *					owner;
+		page_link *				next;
+		page_link **			prev_p;
+	};
 
 	struct entry
 		: public block_info
@@ -38,10 +76,17 @@ private:
 		entry **				prev_same_cl_p;
 		entry *					next;
 		entry **				prev_p;
+		page_link				pages[MAX_PAGES];
 	};
 
 	block_allocator<entry>		allocator;
 	entry *						cache_tags[HASH_SIZE];
+	entry **					hash_tags;
+	uint32						hash_bits;
+	uint32						hash_mask;
+	uint32						cl_count;
+	page_link *					page_tags[PAGE_HASH_SIZE];
+	page_link *					large_blocks;
 	entry *						active;
 	entry *						dormant;
 
@@ -49,8 +94,30 @@ private:
 		return (addr >> 2) & HASH_MASK;
 	}
 
+	uint32 hashline(uintptr addr) const {
+		return (addr >> 2) & hash_mask;
+	}
+
+	void link_cl(entry *bce);
+	void unlink_cl(entry *bce);
+	void resize(uint32 bits);
+
+	void add_to_page_index(entry *bce);
+	void remove_from_page_index(entry *bce);
+	void clear_page_chain(page_link *p, uintptr start, uintptr end);
+	entry *find_in_page_chain(page_link *p, uintptr pc, entry *best);
+
 public:
 
+	// Invalidation statistics
+	struct stats_t {
+		uint32 resize_count;			// Number of hash table resizes
+		uint32 clear_count;				// Number of full cache flushes
+		uint64 range_count;				// Number of clear_range() calls
+		uint64 range_visits;			// Blocks examined by clear_range()
+		uint64 range_invalidations;		// Blocks removed by clear_range()
+	};
+
 	block_cache();
 	~block_cache();
 
@@ -62,6 +129,7 @@ public:
 	void clear_range(uintptr start, uintptr end);
 	block_info *fast_find(uintptr pc);
 	block_info *find(uintptr pc);
+	block_info *find_enclosing(uintptr pc);
 
 	void remove_from_cl_list(block_info *bi);
 	void remove_from_list(block_info *bi);
@@ -72,12 +140,21 @@ public:
 
 	void add_to_active_list(block_info *bi);
 	void add_to_dormant_list(block_info *bi);
+
+	uint32 hash_size() const { return hash_mask + 1; }
+	stats_t const & get_stats() const { return stats; }
+
+private:
+	stats_t						stats;
 };
 
 template< class block_info, template<class T> class block_allocator >
 block_cache< block_info, block_allocator >::block_cache()
-	: active(NULL), dormant(NULL)
+	: hash_tags(NULL), hash_bits(HASH_BITS), hash_mask(HASH_MASK),
+	  active(NULL), dormant(NULL)
 {
+	memset(&stats, 0, sizeof(stats));
+	hash_tags = new entry *[1 << hash_bits];
 	initialize();
 }
 
@@ -85,13 +162,21 @@ template< class block_info, template<class T> class block_allocator >
 block_cache< block_info, block_allocator >::~block_cache()
 {
 	clear();
+	delete[] hash_tags;
 }
 
 template< class block_info, template<class T> class block_allocator >
 void block_cache< block_info, block_allocator >::initialize()
 {
-	for (int i = 0; i < HASH_SIZE; i++)
+	for (uint32 i = 0; i < HASH_SIZE; i++)
 		cache_tags[i] = NULL;
+	for (uint32 i = 0; i <= hash_mask; i++)
+		hash_tags[i] = NULL;
+	cl_count = 0;
+
+	for (uint32 i = 0; i < PAGE_HASH_SIZE; i++)
+		page_tags[i] = NULL;
+	large_blocks = NULL;
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -114,51 +199,123 @@ void block_cache< block_info, block_allocator >::clear()
 		delete_blockinfo(d);
 	}
 	dormant = NULL;
+
+	stats.clear_count++;
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::resize(uint32 bits)
+{
+	delete[] hash_tags;
+	hash_tags = new entry *[1 << bits];
+	hash_bits = bits;
+	hash_mask = (1 << bits) - 1;
+	for (uint32 i = 0; i <= hash_mask; i++)
+		hash_tags[i] = NULL;
+
+	// Relink all blocks that were reachable through the hash table
+	entry *lists[2] = { active, dormant };
+	for (int i = 0; i < 2; i++) {
+		for (entry *p = lists[i]; p != NULL; p = p->next) {
+			if (p->prev_same_cl_p)
+				link_cl(p);
+		}
+	}
+
+	stats.resize_count++;
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::add_to_page_index(entry *bce)
+{
+	const uintptr first_page = bce->min_pc >> PAGE_BITS;
+	const uintptr last_page = bce->max_pc >> PAGE_BITS;
+	page_link **heads[MAX_PAGES];
+	int n_pages = 0;
+
+	if (last_page - first_page >= MAX_PAGES) {
+		heads[0] = &large_blocks;
+		n_pages = 1;
+	}
+	else {
+		for (uintptr page = first_page; page <= last_page; page++)
+			heads[n_pages++] = &page_tags[page & PAGE_HASH_MASK];
+	}
+
+	for (int i = 0; i < n_pages; i++) {
+		page_link *l = &bce->pages[i];
+		if (*heads[i])
+			(*heads[i])->prev_p = &l->next;
+		l->next = *heads[i];
+		*heads[i] = l;
+		l->prev_p = heads[i];
+	}
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::remove_from_page_index(entry *bce)
+{
+	for (int i = 0; i < MAX_PAGES; i++) {
+		page_link *l = &bce->pages[i];
+		if (l->prev_p == NULL)
+			break;
+		*l->prev_p = l->next;
+		if (l->next)
+			l->next->prev_p = l->prev_p;
+		l->prev_p = NULL;
+	}
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::clear_page_chain(page_link *p, uintptr start, uintptr end)
+{
+	// NOTE: the links of a given block are never in the same chain
+	// since they are for consecutive pages, so NEXT remains valid
+	while (p) {
+		entry *q = p->owner;
+		p = p->next;
+		stats.range_visits++;
+		if (q->intersect(start, end)) {
+			q->invalidate();
+			remove_from_cl_list(q);
+			remove_from_list(q);
+			delete_blockinfo(q);
+			stats.range_invalidations++;
+		}
+	}
 }
 
 template< class block_info, template<class T> class block_allocator >
 void block_cache< block_info, block_allocator >::clear_range(uintptr start, uintptr end)
 {
-	if (!active)
+	if ((!active && !dormant) || end <= start)
 		return;
 
-	entry *p, *q;
-	if (cacheline(start) < cacheline(end - 1)) {
-		// Optimize for short ranges flush
-		const int end_cl = cacheline(end - 1);
-		for (int cl = cacheline(start); cl <= end_cl; cl++) {
-			p = cache_tags[cl];
-			while (p) {
-				q = p;
-				p = p->next_same_cl;
-				if (q->intersect(start, end)) {
-					q->invalidate();
-					remove_from_cl_list(q);
-					remove_from_list(q);
-					delete_blockinfo(q);
-				}
-			}
-		}
+	stats.range_count++;
+	const uintptr first_page = start >> PAGE_BITS;
+	const uintptr last_page = (end - 1) >> PAGE_BITS;
+	if (last_page - first_page < PAGE_HASH_SIZE) {
+		// Only visit the pages covered by the range
+		for (uintptr page = first_page; page <= last_page; page++)
+			clear_page_chain(page_tags[page & PAGE_HASH_MASK], start, end);
 	}
 	else {
-		p = active;
-		while (p) {
-			q = p;
-			p = p->next;
-			if (q->intersect(start, end)) {
-				q->invalidate();
-				remove_from_cl_list(q);
-				remove_from_list(q);
-				delete_blockinfo(q);
-			}
-		}
+		// Range is larger than the page index, visit it once
+		for (uint32 i = 0; i < PAGE_HASH_SIZE; i++)
+			clear_page_chain(page_tags[i], start, end);
 	}
+	clear_page_chain(large_blocks, start, end);
 }
 
 template< class block_info, template<class T> class block_allocator >
 inline block_info *block_cache< block_info, block_allocator >::new_blockinfo()
 {
 	entry * bce = allocator.acquire();
+	bce->prev_same_cl_p = NULL;
+	for (int i = 0; i < MAX_PAGES; i++) {
+		bce->pages[i].owner = bce;
+		bce->pages[i].prev_p = NULL;
+	}
 	return bce;
 }
 
@@ -188,10 +345,9 @@ block_info *block_cache< block_info, block_allocator >::find(uintptr pc)
 	if (bce && bce->pc == pc)
 		return bce;
 
-	// Miss: perform full list search and move block to front if found
-	while (bce) {
-		bce = bce->next_same_cl;
-		if (bce && bce->pc == pc) {
+	// Miss: perform hash chain search and move block to front if found
+	for (bce = hash_tags[hashline(pc)]; bce != NULL; bce = bce->next_same_cl) {
+		if (bce->pc == pc) {
 			raise_in_cl_list(bce);
 			return bce;
 		}
@@ -202,33 +358,85 @@ block_info *block_cache< block_info, block_allocator >::find(uintptr pc)
 }
 
 template< class block_info, template<class T> class block_allocator >
-void block_cache< block_info, block_allocator >::remove_from_cl_list(block_info *bi)
+typename block_cache< block_info, block_allocator >::entry *
+block_cache< block_info, block_allocator >::find_in_page_chain(page_link *p, uintptr pc, entry *best)
+{
+	for (; p != NULL; p = p->next) {
+		entry *q = p->owner;
+		if (q->pc <= pc && q->intersect(pc, pc + 1) && (best == NULL || q->pc > best->pc))
+			best = q;
+	}
+	return best;
+}
+
+template< class block_info, template<class T> class block_allocator >
+block_info *block_cache< block_info, block_allocator >::find_enclosing(uintptr pc)
+{
+	// Return the block with the closest entry point before PC
+	// whose range covers PC. This does not alter the lookup tables
+	entry *bce = find_in_page_chain(page_tags[(pc >> PAGE_BITS) & PAGE_HASH_MASK], pc, NULL);
+	return find_in_page_chain(large_blocks, pc, bce);
+}
+
+template< class block_info, template<class T> class block_allocator >
+inline void block_cache< block_info, block_allocator >::unlink_cl(entry *bce)
 {
-	entry * bce = (entry *)bi;
 	if (bce->prev_same_cl_p)
 		*bce->prev_same_cl_p = bce->next_same_cl;
 	if (bce->next_same_cl)
 		bce->next_same_cl->prev_same_cl_p = bce->prev_same_cl_p;
+	bce->prev_same_cl_p = NULL;
+	bce->next_same_cl = NULL;
+}
+
+template< class block_info, template<class T> class block_allocator >
+inline void block_cache< block_info, block_allocator >::link_cl(entry *bce)
+{
+	const uint32 hl = hashline(bce->pc);
+	if (hash_tags[hl])
+		hash_tags[hl]->prev_same_cl_p = &bce->next_same_cl;
+	bce->next_same_cl = hash_tags[hl];
+	
+	hash_tags[hl] = bce;
+	bce->prev_same_cl_p = &hash_tags[hl];
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::remove_from_cl_list(block_info *bi)
+{
+	// Blocks may be removed from the hash table and still live in
+	// the active or dormant list, e.g. superseded blocks
+	entry * bce = (entry *)bi;
+	if (bce->prev_same_cl_p) {
+		unlink_cl(bce);
+		cl_count--;
+	}
+
+	const uint32 cl = cacheline(bce->pc);
+	if (cache_tags[cl] == bce)
+		cache_tags[cl] = NULL;
 }
 
 template< class block_info, template<class T> class block_allocator >
 void block_cache< block_info, block_allocator >::add_to_cl_list(block_info *bi)
 {
+	// Grow hash table first, BI is not linked to any list yet
+	if (cl_count >= HASH_LOAD_FACTOR * hash_size() && hash_bits < HASH_MAX_BITS)
+		resize(hash_bits + 1);
+
 	entry * bce = (entry *)bi;
-	const uint32 cl = cacheline(bi->pc);
-	if (cache_tags[cl])
-		cache_tags[cl]->prev_same_cl_p = &bce->next_same_cl;
-	bce->next_same_cl = cache_tags[cl];
-	
-	cache_tags[cl] = bce;
-	bce->prev_same_cl_p = &cache_tags[cl];
+	link_cl(bce);
+	cl_count++;
+	cache_tags[cacheline(bce->pc)] = bce;
 }
 
 template< class block_info, template<class T> class block_allocator >
 inline void block_cache< block_info, block_allocator >::raise_in_cl_list(block_info *bi)
 {
-	remove_from_cl_list(bi);
-	add_to_cl_list(bi);
+	entry * bce = (entry *)bi;
+	unlink_cl(bce);
+	link_cl(bce);
+	cache_tags[cacheline(bce->pc)] = bce;
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -239,6 +447,7 @@ void block_cache< block_info, block_allocator >::remove_from_list(block_info *bi
 		*bce->prev_p = bce->next;
 	if (bce->next)
 		bce->next->prev_p = bce->prev_p;
+	remove_from_page_index(bce);
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -252,6 +461,8 @@ void block_cache< block_info, block_allocator >::add_to_active_list(block_info *
 	
 	active = bce;
 	bce->prev_p = &active;
+
+	add_to_page_index(bce);
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -265,6 +476,8 @@ void block_cache< block_info, block_allocator >::add_to_dormant_list(block_info
 	
 	dormant = bce;
 	bce->prev_p = &dormant;
+
+	add_to_page_index(bce);
 }
 
 template< class block_info, template<class T> class block_allocator >
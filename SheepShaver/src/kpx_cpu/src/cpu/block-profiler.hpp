@@ -0,0 +1,123 @@
+/*
+ *  block-profiler.hpp - Sampling profiler for emulated code
+ *
+ *  Kheperix (C) 2003-2005 Gwenole Beauchesne
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BLOCK_PROFILER_H
+#define BLOCK_PROFILER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *	Sampling profiler
+ *
+ *		Samples are (PC, CTX) pairs accumulated into a fixed size open
+ *		addressing table, so that record() can be called from a signal
+ *		handler. CTX is an opaque value supplied by the caller, e.g. the
+ *		emulated run mode. Samples that don't fit into the table, or
+ *		that were taken while another host thread was running, are only
+ *		counted.
+ **/
+
+class block_profiler
+{
+public:
+
+	struct sample {
+		uint32 pc;
+		uint32 ctx;
+		uint32 count;
+	};
+
+private:
+
+	static const uint32 TABLE_BITS = 14;
+	static const uint32 TABLE_SIZE = 1 << TABLE_BITS;
+	static const uint32 TABLE_MASK = TABLE_SIZE - 1;
+	static const int MAX_PROBES = 16;
+
+	sample *					table;
+	volatile uint32				total_count;
+	volatile uint32				lost_count;
+	volatile uint32				host_count;
+
+	static uint32 hash(uint32 pc, uint32 ctx) {
+		return ((pc >> 2) ^ (ctx * 0x9e3779b1)) & TABLE_MASK;
+	}
+
+public:
+
+	block_profiler()
+		: table(NULL), total_count(0), lost_count(0), host_count(0)
+		{ }
+
+	~block_profiler()
+		{ free(table); }
+
+	bool initialize();
+	void clear();
+	void record(uint32 pc, uint32 ctx);
+	void record_host()
+		{ total_count++; host_count++; }
+
+	uint32 samples() const			{ return total_count; }
+	uint32 lost_samples() const		{ return lost_count; }
+	uint32 host_samples() const		{ return host_count; }
+
+	// Iterate over the recorded samples, empty slots have a zero count
+	sample const *begin() const		{ return table; }
+	sample const *end() const		{ return table ? table + TABLE_SIZE : NULL; }
+};
+
+inline bool block_profiler::initialize()
+{
+	if (table == NULL && (table = (sample *)malloc(TABLE_SIZE * sizeof(sample))) == NULL)
+		return false;
+	clear();
+	return true;
+}
+
+inline void block_profiler::clear()
+{
+	if (table)
+		memset(table, 0, TABLE_SIZE * sizeof(sample));
+	total_count = lost_count = host_count = 0;
+}
+
+inline void block_profiler::record(uint32 pc, uint32 ctx)
+{
+	total_count++;
+	uint32 h = hash(pc, ctx);
+	for (int i = 0; i < MAX_PROBES; i++) {
+		sample *s = &table[(h + i) & TABLE_MASK];
+		if (s->count == 0) {
+			s->pc = pc;
+			s->ctx = ctx;
+			s->count = 1;
+			return;
+		}
+		if (s->pc == pc && s->ctx == ctx) {
+			s->count++;
+			return;
+		}
+	}
+	lost_count++;
+}
+
+#endif /* BLOCK_PROFILER_H */
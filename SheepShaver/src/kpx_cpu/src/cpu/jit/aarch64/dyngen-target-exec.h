@@ -0,0 +1,51 @@
+/*
+ *  dyngen defines for micro operation code
+ *
+ *  Copyright (c) 2003-2004-2004 Fabrice Bellard
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DYNGEN_TARGET_EXEC_H
+#define DYNGEN_TARGET_EXEC_H
+
+enum {
+  /* callee save registers */
+#define AREG0 "x19"
+  AREG0_ID = 19,
+
+#define AREG1 "x20"
+  AREG1_ID = 20,
+
+#define AREG2 "x21"
+  AREG2_ID = 21,
+
+#define AREG3 "x22"
+  AREG3_ID = 22,
+
+#define AREG4 "x23"
+  AREG4_ID = 23,
+
+#define AREG5 "x24"
+  AREG5_ID = 24,
+
+#define AREG6 "x25"
+  AREG6_ID = 25,
+
+#define AREG7 "x26"
+  AREG7_ID = 26,
+};
+
+#endif /* DYNGEN_TARGET_EXEC_H */
@@ -0,0 +1,43 @@
+/*
+ *  jit-target-cache.hpp - Target specific code to invalidate cache
+ *
+ *  Kheperix (C) 2003-2005 Gwenole Beauchesne
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef JIT_TARGET_CACHE_H
+#define JIT_TARGET_CACHE_H
+
+static inline void flush_icache_range(unsigned long start, unsigned long stop)
+{
+	unsigned long ctr_el0, p;
+	asm volatile ("mrs %0,ctr_el0" : "=r" (ctr_el0));
+
+	// Clean data cache to the point of unification
+	const unsigned long dline = 4 << ((ctr_el0 >> 16) & 15);
+	for (p = start & ~(dline - 1); p < stop; p += dline)
+		asm volatile ("dc cvau,%0" : : "r" (p) : "memory");
+	asm volatile ("dsb ish" : : : "memory");
+
+	// Invalidate instruction cache to the point of unification
+	const unsigned long iline = 4 << (ctr_el0 & 15);
+	for (p = start & ~(iline - 1); p < stop; p += iline)
+		asm volatile ("ic ivau,%0" : : "r" (p) : "memory");
+	asm volatile ("dsb ish" : : : "memory");
+	asm volatile ("isb" : : : "memory");
+}
+
+#endif /* JIT_TARGET_CACHE_H */
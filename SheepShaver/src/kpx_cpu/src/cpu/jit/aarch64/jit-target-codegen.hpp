@@ -0,0 +1,130 @@
+/*
+ *  jit-target-codegen.hpp - Target specific code generator
+ *
+ *  Kheperix (C) 2003-2005 Gwenole Beauchesne
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef JIT_AARCH64_CODEGEN_H
+#define JIT_AARCH64_CODEGEN_H
+
+// Instruction encodings
+enum {
+	AARCH64_NOP		= 0xd503201f,
+	AARCH64_B		= 0x14000000,
+	AARCH64_BL		= 0x94000000,
+	AARCH64_BR		= 0xd61f0000,
+	AARCH64_BLR		= 0xd63f0000,
+	AARCH64_MOVZ_X	= 0xd2800000,
+	AARCH64_MOVK_X	= 0xf2800000,
+	AARCH64_LDR_X16	= 0x58000050,	// ldr x16,.+8
+	AARCH64_BR_X16	= 0xd61f0200,	// br x16
+};
+
+// Maximum displacement of B/BL instructions (+/- 128 MB)
+const intptr AARCH64_BRANCH26_RANGE = 1L << 27;
+
+// Maximum page displacement of ADRP instructions (+/- 4 GB)
+const intptr AARCH64_ADRP_RANGE = 1L << 20;
+
+// Size of a veneer: ldr x16,.+8; br x16; .quad target
+const int AARCH64_VENEER_SIZE = 16;
+
+// Patch the 26-bit displacement of the B/BL instruction at INSN_P
+static inline void aarch64_set_branch26(uint8 *insn_p, const uint8 *target_p)
+{
+	uint32 *insn = (uint32 *)insn_p;
+	const intptr disp = (intptr)target_p - (intptr)insn_p;
+	assert(disp >= -AARCH64_BRANCH26_RANGE && disp < AARCH64_BRANCH26_RANGE && (disp & 3) == 0);
+	*insn = (*insn & 0xfc000000) | ((disp >> 2) & 0x03ffffff);
+}
+
+// Patch the 16-bit immediate of the MOVZ/MOVK instruction at INSN_P
+static inline void aarch64_set_movw16(uint8 *insn_p, uint32 imm16)
+{
+	uint32 *insn = (uint32 *)insn_p;
+	*insn = (*insn & ~(0xffff << 5)) | ((imm16 & 0xffff) << 5);
+}
+
+// Patch the page displacement of the ADRP instruction at INSN_P
+static inline void aarch64_set_adrp(uint8 *insn_p, uintptr value)
+{
+	uint32 *insn = (uint32 *)insn_p;
+	const intptr pages = (intptr)(value >> 12) - (intptr)((uintptr)insn_p >> 12);
+	assert(pages >= -AARCH64_ADRP_RANGE && pages < AARCH64_ADRP_RANGE);
+	*insn = (*insn & 0x9f00001f) | ((pages & 3) << 29) | (((pages >> 2) & 0x7ffff) << 5);
+}
+
+// Patch the low 12 bits of VALUE, scaled by the access SIZE, into ADD or LDR/STR
+static inline void aarch64_set_lo12(uint8 *insn_p, uintptr value, int shift)
+{
+	uint32 *insn = (uint32 *)insn_p;
+	*insn = (*insn & ~(0xfff << 10)) | (((value & 0xfff) >> shift) << 10);
+}
+
+// Write a veneer at VENEER_P that jumps to TARGET_P from anywhere
+static inline void aarch64_set_veneer(uint8 *veneer_p, const uint8 *target_p)
+{
+	uint32 *insn = (uint32 *)veneer_p;
+	insn[0] = AARCH64_LDR_X16;
+	insn[1] = AARCH64_BR_X16;
+	*(uint64 *)(veneer_p + 8) = (uintptr)target_p;
+}
+
+class aarch64_codegen
+	: public basic_jit_cache
+{
+public:
+
+	static bool branch26_possible(const uint8 *insn_p, uintptr target)
+	{
+		const intptr disp = (intptr)target - (intptr)insn_p;
+		return disp >= -AARCH64_BRANCH26_RANGE && disp < AARCH64_BRANCH26_RANGE;
+	}
+
+	// Patch the B/BL instruction at INSN_P, going through a veneer
+	// if TARGET_P is out of range (e.g. a function in a shared library)
+	void set_branch26(uint8 *insn_p, const uint8 *target_p)
+	{
+		if (!branch26_possible(insn_p, (uintptr)target_p))
+			target_p = get_veneer(target_p);
+		aarch64_set_branch26(insn_p, target_p);
+	}
+
+	void gen_nop()
+		{ emit_32(AARCH64_NOP); }
+	void gen_b(const uint8 *target)
+		{ uint8 *p = code_ptr(); emit_32(AARCH64_B); aarch64_set_branch26(p, target); }
+	void gen_bl(const uint8 *target)
+		{ uint8 *p = code_ptr(); emit_32(AARCH64_BL); aarch64_set_branch26(p, target); }
+	void gen_br(int r)
+		{ emit_32(AARCH64_BR | (r << 5)); }
+	void gen_blr(int r)
+		{ emit_32(AARCH64_BLR | (r << 5)); }
+
+	// Load 64-bit immediate, omitting zero halfwords
+	void gen_mov_64(uint64 value, int d)
+	{
+		emit_32(AARCH64_MOVZ_X | ((value & 0xffff) << 5) | d);
+		for (int hw = 1; hw < 4; hw++) {
+			const uint32 imm16 = (value >> (16 * hw)) & 0xffff;
+			if (imm16)
+				emit_32(AARCH64_MOVK_X | (hw << 21) | (imm16 << 5) | d);
+		}
+	}
+};
+
+#endif /* JIT_AARCH64_CODEGEN_H */
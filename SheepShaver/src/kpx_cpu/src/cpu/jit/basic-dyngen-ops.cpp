@@ -66,6 +66,11 @@ DYNGEN_DEFINE_GLOBAL_REGISTER(2);
 // XXX update for new 64-bit arches
 #if defined __x86_64__
 #define MOV_AD_REG(PARAM, REG) asm volatile ("movabsq $__op_" #PARAM ",%0" : "=r" (REG))
+#elif defined __aarch64__
+#define MOV_AD_REG(PARAM, REG) asm volatile ("movz %0,#:abs_g3:__op_" #PARAM "\n\t"	\
+											 "movk %0,#:abs_g2_nc:__op_" #PARAM "\n\t"	\
+											 "movk %0,#:abs_g1_nc:__op_" #PARAM "\n\t"	\
+											 "movk %0,#:abs_g0_nc:__op_" #PARAM : "=r" (REG))
 #else
 #define MOV_AD_REG(PARAM, REG) REG = PARAM
 #endif
@@ -226,6 +231,9 @@ DEFINE_OP(8,T0,1,T2);
 #ifdef __ppc__
 #define FORCE_RET() asm volatile ("blr")
 #endif
+#ifdef __aarch64__
+#define FORCE_RET() asm volatile ("ret")
+#endif
 #ifdef __s390__
 #define FORCE_RET() asm volatile ("br %r14")
 #endif
@@ -279,7 +287,14 @@ void OPPROTO op_execute(uint8 *entry_point, basic_cpu *this_cpu)
 
 void OPPROTO op_jmp_slow(void)
 {
+#if defined(__aarch64__)
+	// The translation cache is not necessarily mapped in the low 4 GB
+	uintptr target;
+	MOV_AD_REG(PARAM1, target);
+	DYNGEN_SLOW_DISPATCH(target);
+#else
 	DYNGEN_SLOW_DISPATCH(PARAM1);
+#endif
 }
 
 void OPPROTO op_jmp_fast(void)
@@ -311,7 +326,7 @@ void OPPROTO impl_##NAME(void)									\
 }																\
 extern void OPPROTO NAME(void) __attribute__((weak_import));	\
 asm(".set  helper_" #NAME "," #NAME);
-#elif defined(__powerpc__) || ((defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32))
+#elif defined(__powerpc__) || defined(__aarch64__) || ((defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32))
 // XXX there is a problem on Windows: coff_text_shndx != text_shndx
 // The latter is found by searching for ".text" in all symbols and
 // assigning its e_scnum.
@@ -346,6 +361,14 @@ void OPPROTO NAME(void)							\
 #define CALL(FUNC, ARGS) ((func_t)FUNC) ARGS
 #endif
 
+#if defined __aarch64__
+// Direct calls are BL instructions, patched through their CALL26 relocation
+extern "C" void __op_PARAM1(void);
+#define CALL_DIRECT(ARGS) ((func_t)__op_PARAM1) ARGS
+#else
+#define CALL_DIRECT(ARGS) CALL(PARAM1, ARGS)
+#endif
+
 DEFINE_OP(op_invoke, {
 	typedef void (*func_t)(void);
 	uintptr func;
@@ -425,57 +448,57 @@ DEFINE_OP(op_invoke_CPU_A0_ret_A0, {
 
 DEFINE_OP(op_invoke_direct, {
 	typedef void (*func_t)(void);
-	CALL(PARAM1, ());
+	CALL_DIRECT(());
 });
 
 DEFINE_OP(op_invoke_direct_T0, {
 	typedef void (*func_t)(uint32);
-	CALL(PARAM1, (T0));
+	CALL_DIRECT((T0));
 });
 
 DEFINE_OP(op_invoke_direct_T0_T1, {
 	typedef void (*func_t)(uint32, uint32);
-	CALL(PARAM1, (T0, T1));
+	CALL_DIRECT((T0, T1));
 });
 
 DEFINE_OP(op_invoke_direct_T0_T1_T2, {
 	typedef void (*func_t)(uint32, uint32, uint32);
-	CALL(PARAM1, (T0, T1, T2));
+	CALL_DIRECT((T0, T1, T2));
 });
 
 DEFINE_OP(op_invoke_direct_T0_ret_T0, {
 	typedef uint32 (*func_t)(uint32);
-	T0 = CALL(PARAM1, (T0));
+	T0 = CALL_DIRECT((T0));
 });
 
 DEFINE_OP(op_invoke_direct_im, {
 	typedef void (*func_t)(uint32);
-	CALL(PARAM1, (PARAM2));
+	CALL_DIRECT((PARAM2));
 });
 
 DEFINE_OP(op_invoke_direct_CPU, {
 	typedef void (*func_t)(void *);
-	CALL(PARAM1, (CPU));
+	CALL_DIRECT((CPU));
 });
 
 DEFINE_OP(op_invoke_direct_CPU_T0, {
 	typedef void (*func_t)(void *, uint32);
-	CALL(PARAM1, (CPU, T0));
+	CALL_DIRECT((CPU, T0));
 });
 
 DEFINE_OP(op_invoke_direct_CPU_im, {
 	typedef void (*func_t)(void *, uint32);
-	CALL(PARAM1, (CPU, PARAM2));
+	CALL_DIRECT((CPU, PARAM2));
 });
 
 DEFINE_OP(op_invoke_direct_CPU_im_im, {
 	typedef void (*func_t)(void *, uint32, uint32);
-	CALL(PARAM1, (CPU, PARAM2, PARAM3));
+	CALL_DIRECT((CPU, PARAM2, PARAM3));
 });
 
 DEFINE_OP(op_invoke_direct_CPU_A0_ret_A0, {
 	typedef void *(*func_t)(void *, uintptr);
-	A0 = (uintptr)CALL(PARAM1, (CPU, A0));
+	A0 = (uintptr)CALL_DIRECT((CPU, A0));
 });
 
 #undef DEFINE_OP
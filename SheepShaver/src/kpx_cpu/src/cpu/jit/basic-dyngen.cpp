@@ -177,6 +177,10 @@ basic_dyngen::gen_align(int align)
 	if (nbytes)
 		emit_block(f32_patt[nbytes - 1], nbytes);
 #endif
+#elif defined(__aarch64__)
+	// Code is always 4-byte aligned
+	for (int i = 0; i < nbytes; i += 4)
+		gen_nop();
 #else
 #warning "FIXME: tune for your target"
 	for (int i = 0; i < nbytes; i++)
@@ -38,6 +38,10 @@ static inline void dg_set_jmp_target_noflush(uint8 *jmp_addr, uint8 *addr)
 	// patch the branch destination
 	*(uint32 *)jmp_addr = addr - (jmp_addr + 4);
 #endif
+#if defined(__aarch64__)
+	// patch the branch destination
+	aarch64_set_branch26(jmp_addr, addr);
+#endif
 }
 
 static inline void dg_set_jmp_target(uint8 *jmp_addr, uint8 *addr)
@@ -51,6 +55,9 @@ static inline void dg_set_jmp_target(uint8 *jmp_addr, uint8 *addr)
     asm volatile ("sync" : : : "memory");
     asm volatile ("isync" : : : "memory");
 #endif
+#if defined(__aarch64__)
+	flush_icache_range((unsigned long)jmp_addr, (unsigned long)jmp_addr + 4);
+#endif
 }
 
 #ifdef SHEEPSHAVER
@@ -252,6 +259,9 @@ basic_dyngen::direct_jump_possible(uintptr target) const
 #if defined(__x86_64__)
 	const intptr offset = (intptr)target - (intptr)code_ptr() - sizeof(void *);
 	return offset <= 0xffffffff;
+#endif
+#if defined(__aarch64__)
+	return branch26_possible(code_ptr(), target);
 #endif
 	return false;
 }
@@ -294,6 +304,10 @@ basic_dyngen::direct_call_possible(uintptr target) const
 #if defined(__x86_64__)
 	const intptr offset = (intptr)target - (intptr)code_ptr() - sizeof(void *);
 	return offset <= 0xffffffff;
+#endif
+#if defined(__aarch64__)
+	// Direct calls are BL instructions, others load the function address
+	return branch26_possible(code_ptr(), target);
 #endif
 	return false;
 }
@@ -96,6 +96,16 @@ extern int __op_PARAM3 __hidden;
 #define PARAM1 PARAMN(1)
 #define PARAM2 PARAMN(2)
 #define PARAM3 PARAMN(3)
+#elif defined __aarch64__
+/* On AArch64, taking the address of a symbol generates an ADRP/ADD
+ * pair, i.e. a PC-relative page offset. We want an absolute value. */
+#define PARAMN(index) ({ register int _r; \
+		asm("movz %w0,#:abs_g1:__op_PARAM" #index "\n\t" \
+		    "movk %w0,#:abs_g0_nc:__op_PARAM" #index \
+		    : "=r"(_r)); _r; })
+#define PARAM1 PARAMN(1)
+#define PARAM2 PARAMN(2)
+#define PARAM3 PARAMN(3)
 #else
 #if defined(__APPLE__) && defined(__MACH__)
 static int __op_PARAM1, __op_PARAM2, __op_PARAM3;
@@ -114,6 +124,9 @@ extern int __op_PARAM1, __op_PARAM2, __op_PARAM3;
 #if defined(__i386__) || defined(__x86_64__)
 #define DYNGEN_FAST_DISPATCH(TARGET) asm volatile ("jmp " ASM_NAME(TARGET))
 #endif
+#if defined(__aarch64__)
+#define DYNGEN_FAST_DISPATCH(TARGET) asm volatile ("b " ASM_NAME(TARGET))
+#endif
 
 #define DYNGEN_SLOW_DISPATCH(TARGET) do {								\
 	static const void __attribute__((unused)) *label1 = &&dummy_label1;	\
@@ -66,6 +66,8 @@
 #define HOST_M68K 1
 #elif defined(__mips__)
 #define HOST_MIPS 1
+#elif defined(__aarch64__)
+#define HOST_AARCH64 1
 #endif
 
 /* Debug generated code */
@@ -234,6 +236,13 @@ static int pretty_print(char *buf, uintptr_t addr, uintptr_t base)
 #define ELF_USES_RELOCA
 #define ELF_USES_ALSO_RELOC
 
+#elif defined(HOST_AARCH64)
+
+#define ELF_CLASS	ELFCLASS64
+#define ELF_ARCH	EM_AARCH64
+#define elf_check_arch(x) ((x) == EM_AARCH64)
+#define ELF_USES_RELOCA
+
 #else
 #error unsupported CPU - please update the code
 #endif
@@ -1944,6 +1953,18 @@ void gen_code(const char *name, const char *demangled_name,
             error("jr ra expected at the end of %s", name);
         copy_size = p - p_start;
     }
+#elif defined(HOST_AARCH64)
+    {
+        uint8_t *p;
+        p = (void *)(p_end - 4);
+        if (p == p_start)
+            error("empty code for %s", name);
+        while (p > p_start && get32((uint32_t *)p) != 0xd65f03c0)
+            p -= 4;
+        if (get32((uint32_t *)p) != 0xd65f03c0)
+            error("ret expected at the end of %s", name);
+        copy_size = p - p_start;
+    }
 #else
 #error unsupported CPU
 #endif
@@ -2874,6 +2895,81 @@ void patch_relocations(FILE *outfile, const char *name, host_ulong size, host_ul
 			}
 		}
 	}
+#elif defined(HOST_AARCH64)
+	char final_sym_name[256];
+	const char *sym_name;
+	const char *p;
+	int type;
+	long addend;
+	for (i = 0, rel = relocs; i < nb_relocs; i++, rel++) {
+		if (rel->r_offset >= start_offset &&
+			rel->r_offset < start_offset + copy_size) {
+			int slide;
+			sym_name = strtab + symtab[ELFW(R_SYM)(rel->r_info)].st_name;
+			slide = rel->r_offset - start_offset;
+			if (is_op_jmp(sym_name, &p)) {
+				int n;
+				n = strtol(p, NULL, 10);
+				/* __op_jmp relocations are done at
+					runtime to do translated block
+					chaining: the offset of the instruction
+					needs to be stored */
+				fprintf(outfile, "    jmp_addr[%d] = code_ptr() + %d;\n",
+					n, slide);
+				continue;
+			}
+
+			if (*sym_name == '\0')
+				error("section relative relocation in %s, constants are not supported", name);
+
+			get_reloc_expr(final_sym_name, sizeof(final_sym_name), sym_name);
+			type = ELFW(R_TYPE)(rel->r_info);
+			addend = rel->r_addend;
+			switch (type) {
+			case R_AARCH64_ABS64:
+				fprintf(outfile, "    *(uint64_t *)(code_ptr() + %d) = (uint64_t)%s + %ld;\n",
+					slide, final_sym_name, addend);
+				break;
+			case R_AARCH64_MOVW_UABS_G0:
+			case R_AARCH64_MOVW_UABS_G0_NC:
+			case R_AARCH64_MOVW_UABS_G1:
+			case R_AARCH64_MOVW_UABS_G1_NC:
+			case R_AARCH64_MOVW_UABS_G2:
+			case R_AARCH64_MOVW_UABS_G2_NC:
+			case R_AARCH64_MOVW_UABS_G3:
+				fprintf(outfile, "    aarch64_set_movw16(code_ptr() + %d, (uint64_t)(%s + %ld) >> %d);\n",
+					slide, final_sym_name, addend, 16 * ((type - R_AARCH64_MOVW_UABS_G0) / 2));
+				break;
+			case R_AARCH64_JUMP26:
+			case R_AARCH64_CALL26:
+				/* out of range targets go through a veneer */
+				fprintf(outfile, "    set_branch26(code_ptr() + %d, (uint8 *)(%s + %ld));\n",
+					slide, final_sym_name, addend);
+				break;
+			case R_AARCH64_ADR_PREL_PG_HI21:
+				fprintf(outfile, "    aarch64_set_adrp(code_ptr() + %d, (uintptr)(%s + %ld));\n",
+					slide, final_sym_name, addend);
+				break;
+			case R_AARCH64_ADD_ABS_LO12_NC:
+			case R_AARCH64_LDST8_ABS_LO12_NC:
+				fprintf(outfile, "    aarch64_set_lo12(code_ptr() + %d, (uintptr)(%s + %ld), 0);\n",
+					slide, final_sym_name, addend);
+				break;
+			case R_AARCH64_LDST16_ABS_LO12_NC:
+			case R_AARCH64_LDST32_ABS_LO12_NC:
+			case R_AARCH64_LDST64_ABS_LO12_NC:
+				fprintf(outfile, "    aarch64_set_lo12(code_ptr() + %d, (uintptr)(%s + %ld), %d);\n",
+					slide, final_sym_name, addend, type - R_AARCH64_LDST16_ABS_LO12_NC + 1);
+				break;
+			case R_AARCH64_LDST128_ABS_LO12_NC:
+				fprintf(outfile, "    aarch64_set_lo12(code_ptr() + %d, (uintptr)(%s + %ld), 4);\n",
+					slide, final_sym_name, addend);
+				break;
+			default:
+				error("unsupported AArch64 relocation (%d)", type);
+			}
+		}
+	}
 #else
 #error unsupported CPU
 #endif
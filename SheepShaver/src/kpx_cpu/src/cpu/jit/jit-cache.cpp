@@ -24,6 +24,10 @@
 
 #include "vm_alloc.h"
 #include "cpu/jit/jit-cache.hpp"
+#if defined(__aarch64__)
+#include "cpu/jit/jit-codegen.hpp"
+#include <sys/mman.h>
+#endif
 
 #define DEBUG 0
 #include "debug.h"
@@ -38,8 +42,59 @@ const int JIT_CACHE_SIZE = 8 * 1024;
 #endif
 const int JIT_CACHE_SIZE_GUARD = 4096;
 
+#if defined(__aarch64__)
+// Veneers for out of range branches, at the end of the translation cache
+const int JIT_CACHE_VENEERS_SIZE = 4096;
+
+// Program text, as defined by the linker
+extern "C" char __executable_start[], etext[];
+
+// Check that B/BL from anywhere in [START, START + SIZE) reach the program text
+static bool near_program_text(const uint8 *start, uint32 size)
+{
+	const uintptr lo = (uintptr)start < (uintptr)__executable_start ? (uintptr)start : (uintptr)__executable_start;
+	const uintptr hi = (uintptr)start + size > (uintptr)etext ? (uintptr)start + size : (uintptr)etext;
+	return hi - lo < AARCH64_BRANCH26_RANGE;
+}
+#endif
+
+// Allocate memory for the translation cache or the data pool
+static uint8 *acquire_cache_memory(uint32 size)
+{
+#if defined(__aarch64__)
+	// Ops call helpers and reference globals with B/BL (+/- 128 MB) and
+	// ADRP (+/- 4 GB): map next to the program text, below or above it
+	const uintptr text_start = (uintptr)__executable_start & -(uintptr)vm_get_page_size();
+	const uintptr text_end = ((uintptr)etext + vm_get_page_size() - 1) & -(uintptr)vm_get_page_size();
+	const uintptr step = 4 * 1024 * 1024;
+	for (uintptr offset = 0; offset < AARCH64_BRANCH26_RANGE; offset += step) {
+		uintptr hints[2] = { 0, text_end + offset };
+		if (text_start > size + offset + step)
+			hints[0] = text_start - size - offset;
+		for (int i = 0; i < 2; i++) {
+			if (hints[i] == 0)
+				continue;
+			void *addr = mmap((void *)hints[i], size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (addr == MAP_FAILED)
+				continue;
+			if (near_program_text((uint8 *)addr, size))
+				return (uint8 *)addr;
+			munmap(addr, size);
+		}
+	}
+	D(bug("basic_jit_cache: Could not map %d KB next to the program text\n", size / 1024));
+	return NULL;
+#else
+	uint8 *addr = (uint8 *)vm_acquire(size, VM_MAP_PRIVATE | VM_MAP_32BIT);
+	return addr == VM_MAP_FAILED ? NULL : addr;
+#endif
+}
+
 basic_jit_cache::basic_jit_cache()
 	: cache_size(0), tcode_start(NULL), code_start(NULL), code_p(NULL), code_end(NULL), data(NULL)
+#if defined(__aarch64__)
+	, veneer_p(NULL), veneer_end(NULL)
+#endif
 {
 }
 
@@ -64,14 +119,21 @@ basic_jit_cache::init_translation_cache(uint32 size)
 
 	// Round up translation cache size to 16 KB boundaries
 	const uint32 roundup = 16 * 1024;
+#if defined(__aarch64__)
+	cache_size = (size + JIT_CACHE_SIZE_GUARD + JIT_CACHE_VENEERS_SIZE + roundup - 1) & -roundup;
+	if (cache_size >= AARCH64_BRANCH26_RANGE) {
+		fprintf(stderr, "JIT: Translation cache too large (%d KB), branches reach %ld KB\n",
+				cache_size / 1024, AARCH64_BRANCH26_RANGE / 1024);
+		return false;
+	}
+#else
 	cache_size = (size + JIT_CACHE_SIZE_GUARD + roundup - 1) & -roundup;
+#endif
 	assert(cache_size > 0);
 
-	tcode_start = (uint8 *)vm_acquire(cache_size, VM_MAP_PRIVATE | VM_MAP_32BIT);
-	if (tcode_start == VM_MAP_FAILED) {
-		tcode_start = NULL;
+	tcode_start = acquire_cache_memory(cache_size);
+	if (tcode_start == NULL)
 		return false;
-	}
 
 	if (vm_protect(tcode_start, cache_size,
 				   VM_PAGE_READ | VM_PAGE_WRITE | VM_PAGE_EXECUTE) < 0) {
@@ -84,6 +146,10 @@ basic_jit_cache::init_translation_cache(uint32 size)
 	code_start = tcode_start;
 	code_p = code_start;
 	code_end = code_p + size;
+#if defined(__aarch64__)
+	veneer_end = tcode_start + cache_size;
+	veneer_p = veneer_end - JIT_CACHE_VENEERS_SIZE;
+#endif
 	return true;
 }
 
@@ -129,8 +195,8 @@ basic_jit_cache::copy_data(const uint8 *block, uint32 size)
 		to_alloc = (to_alloc + page_size - 1) & -page_size;
 
 		D(bug("basic_jit_cache: Allocate data pool (%d KB)\n", to_alloc / 1024));
-		ptr = (uint8 *)vm_acquire(to_alloc, VM_MAP_PRIVATE | VM_MAP_32BIT);
-		if (ptr == VM_MAP_FAILED) {
+		ptr = acquire_cache_memory(to_alloc);
+		if (ptr == NULL) {
 			fprintf(stderr, "FATAL: Could not allocate data pool!\n");
 			abort();
 		}
@@ -150,4 +216,29 @@ basic_jit_cache::copy_data(const uint8 *block, uint32 size)
 	return ptr;
 }
 
+#if defined(__aarch64__)
+uint8 *
+basic_jit_cache::get_veneer(const uint8 *target)
+{
+	// Reuse any veneer to the same target
+	uint8 *p;
+	for (p = veneer_end - JIT_CACHE_VENEERS_SIZE; p < veneer_p; p += AARCH64_VENEER_SIZE) {
+		if (*(uint64 *)(p + 8) == (uintptr)target)
+			return p;
+	}
+
+	if (veneer_p + AARCH64_VENEER_SIZE > veneer_end) {
+		fprintf(stderr, "FATAL: No space left for branch veneers!\n");
+		abort();
+	}
+
+	p = veneer_p;
+	aarch64_set_veneer(p, target);
+	flush_icache_range((unsigned long)p, (unsigned long)p + AARCH64_VENEER_SIZE);
+	veneer_p += AARCH64_VENEER_SIZE;
+	D(bug("basic_jit_cache: VENEER %p -> %p\n", p, target));
+	return p;
+}
+#endif
+
 #endif //ENABLE_DYNGEN
@@ -45,6 +45,12 @@ class basic_jit_cache
 	};
 	data_chunk_t *data;
 
+#if defined(__aarch64__)
+	// Branch veneers (end of the translation cache, never invalidated)
+	uint8 *veneer_p;
+	uint8 *veneer_end;
+#endif
+
 protected:
 
 	// Initialize translation cache
@@ -87,6 +93,11 @@ public:
 
 	// Emit data to constant pool
 	uint8 *copy_data(const uint8 *block, uint32 size);
+
+#if defined(__aarch64__)
+	// Get a veneer jumping to TARGET, within branch range of the cache
+	uint8 *get_veneer(const uint8 *target);
+#endif
 };
 
 inline void
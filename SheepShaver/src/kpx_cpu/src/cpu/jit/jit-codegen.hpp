@@ -29,6 +29,9 @@ typedef x86_codegen jit_codegen;
 #elif defined(__x86_64__)
 #include "cpu/jit/amd64/jit-target-codegen.hpp"
 typedef amd64_codegen jit_codegen;
+#elif defined(__aarch64__)
+#include "cpu/jit/aarch64/jit-target-codegen.hpp"
+typedef aarch64_codegen jit_codegen;
 #else
 struct jit_codegen
 	: public basic_jit_cache
@@ -48,6 +48,8 @@
 #include _JIT_MAKE_HEADER(ppc,_JIT_HEADER)
 #elif defined(__mips__) || (defined __sgi && defined __mips)
 #include _JIT_MAKE_HEADER(mips,_JIT_HEADER)
+#elif defined(__aarch64__)
+#include _JIT_MAKE_HEADER(aarch64,_JIT_HEADER)
 #else
 #error "Unknown architecture, please submit bug report"
 #endif
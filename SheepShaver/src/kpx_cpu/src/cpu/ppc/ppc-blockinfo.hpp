@@ -36,6 +36,12 @@ struct powerpc_block_info
 	{
 		execute_fn		execute;
 		uint32			opcode;
+#if PPC_DECODE_CACHE_THREADED
+		const void *	handler;						// Threaded code handler
+		uint8			rD, rA, rB;						// Pre-decoded register fields
+		uint8			aux;							// Rc bit, crfD or branch AA/LK bits
+		uint32			imm;							// Pre-decoded immediate value
+#endif
 	};
 
 #if PPC_DECODE_CACHE
@@ -52,6 +58,21 @@ struct powerpc_block_info
 	static const uint32	INVALID_PC = 0xffffffff;		// An invalid PC address to mark jmp_pc[] as stale
 	link_info			li[MAX_TARGETS];
 #endif
+#if PPC_ENABLE_JIT_TRACES
+	enum {
+		TRACE_NONE,										// Regular block, or superblock
+		TRACE_PROFILE,									// Block with exit profiling code
+		TRACE_RETIRED									// Profiled block, superseded by a superblock
+	};
+	struct trace_info {
+		uint32			end_pc;							// Address of the profiled exit instruction
+		uint32			next_pc;						// Most frequent successor
+		uint32			next_votes;						// Majority vote counter for next_pc
+		uint32			exec_count;						// Number of profiled executions
+	};
+	trace_info			ti;
+	uint32				trace_state;
+#endif
 #endif
 	uintptr				min_pc, max_pc;
 
@@ -72,13 +93,20 @@ powerpc_block_info::init(uintptr start_pc)
 	for (int i = 0; i < MAX_TARGETS; i++)
 		li[i].jmp_pc = INVALID_PC;
 #endif
+#if PPC_ENABLE_JIT_TRACES
+	ti.end_pc = INVALID_PC;
+	ti.next_pc = INVALID_PC;
+	ti.next_votes = 0;
+	ti.exec_count = 0;
+	trace_state = TRACE_NONE;
+#endif
 #endif
 }
 
 inline bool
 powerpc_block_info::intersect(uintptr start, uintptr end)
 {
-	return (min_pc >= start && min_pc < end) || (max_pc >= start && max_pc < end);
+	return min_pc < end && max_pc >= start;
 }
 
 #endif /* PPC_BLOCKINFO_H */
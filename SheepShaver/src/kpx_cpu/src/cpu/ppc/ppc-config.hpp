@@ -88,6 +88,21 @@
 #endif
 
 
+/**
+ *	PPC_ENABLE_JIT_TRACES
+ *
+ *		Define to 1 to support profile-guided trace formation. When
+ *		enabled at run-time, blocks are first translated with exit
+ *		profiling code, then recompiled as superblocks that follow
+ *		their most frequent successors with side exits to the cold
+ *		paths. This requires direct block chaining.
+ **/
+
+#ifndef PPC_ENABLE_JIT_TRACES
+#define PPC_ENABLE_JIT_TRACES (PPC_ENABLE_JIT && DYNGEN_DIRECT_BLOCK_CHAINING)
+#endif
+
+
 /**
  *	PPC_EXECUTE_DUMP_STATE
  *
@@ -113,6 +128,24 @@
 #endif
 
 
+/**
+ *	PPC_DECODE_CACHE_THREADED
+ *
+ *		Define to 1 to execute decode cache blocks as direct threaded
+ *		code. Frequently used instructions are pre-decoded and run
+ *		through specialised handlers. This requires GCC labels as
+ *		values and is not compatible with PPC_EXECUTE_DUMP_STATE.
+ **/
+
+#ifndef PPC_DECODE_CACHE_THREADED
+#if PPC_DECODE_CACHE && defined(__GNUC__) && !PPC_EXECUTE_DUMP_STATE
+#define PPC_DECODE_CACHE_THREADED 1
+#else
+#define PPC_DECODE_CACHE_THREADED 0
+#endif
+#endif
+
+
 /**
  *	PPC_PROFILE_COMPILE_TIME
  *
@@ -147,4 +180,30 @@
 #define PPC_PROFILE_REGS_USE 0
 #endif
 
+
+/**
+ *	PPC_PROFILE_BLOCK_CACHE
+ *
+ *		Define to enable some block cache lookup table and range
+ *		invalidation statistics.
+ **/
+
+#ifndef PPC_PROFILE_BLOCK_CACHE
+#define PPC_PROFILE_BLOCK_CACHE 0
+#endif
+
+
+/**
+ *	PPC_PROFILE_BLOCKS
+ *
+ *		Define to 1 to support the sampling block profiler. When it is
+ *		started at run-time, a profiling timer periodically samples the
+ *		current PC and the results are written out as collapsed stacks
+ *		suitable for flame graph tools. This requires POSIX signals.
+ **/
+
+#ifndef PPC_PROFILE_BLOCKS
+#define PPC_PROFILE_BLOCKS 0
+#endif
+
 #endif /* PPC_CONFIG_H */
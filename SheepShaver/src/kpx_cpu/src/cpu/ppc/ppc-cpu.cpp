@@ -32,6 +32,15 @@
 #include "cpu/jit/dyngen-exec.h"
 #endif
 
+#if PPC_PROFILE_BLOCKS
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <map>
+#include <string>
+#endif
+
 #if ENABLE_MON
 #include "mon.h"
 #include "mon_disass.h"
@@ -237,6 +246,120 @@ void powerpc_cpu::dump_log(const char *filename)
 }
 #endif
 
+#if PPC_PROFILE_BLOCKS
+// Only one CPU can be profiled at a time, from the thread that started it
+static powerpc_cpu *profile_cpu = NULL;
+static pthread_t profile_thread;
+static struct sigaction profile_old_action;
+
+void powerpc_cpu::profile_handler(int sig)
+{
+	const int saved_errno = errno;
+	powerpc_cpu *cpu = profile_cpu;
+	if (cpu) {
+		if (pthread_equal(pthread_self(), profile_thread))
+			cpu->my_block_profiler.record(cpu->pc(), cpu->profile_context());
+		else
+			cpu->my_block_profiler.record_host();
+	}
+	errno = saved_errno;
+}
+
+bool powerpc_cpu::start_profile(int rate)
+{
+	if (profiling)
+		return true;
+	if (profile_cpu != NULL || !my_block_profiler.initialize())
+		return false;
+
+	if (rate <= 0)
+		rate = PROFILE_DEFAULT_RATE;
+	else if (rate > 1000000)
+		rate = 1000000;
+
+	profile_cpu = this;
+	profile_thread = pthread_self();
+
+	struct sigaction profile_action;
+	sigemptyset(&profile_action.sa_mask);
+	profile_action.sa_handler = profile_handler;
+	profile_action.sa_flags = SA_RESTART;
+	if (sigaction(SIGPROF, &profile_action, &profile_old_action) < 0) {
+		profile_cpu = NULL;
+		return false;
+	}
+
+	// ITIMER_PROF counts CPU time of the whole process, samples
+	// delivered to other threads are accounted separately
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / rate;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) < 0) {
+		sigaction(SIGPROF, &profile_old_action, NULL);
+		profile_cpu = NULL;
+		return false;
+	}
+
+	profiling = true;
+	return true;
+}
+
+void powerpc_cpu::stop_profile()
+{
+	if (!profiling)
+		return;
+
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	sigaction(SIGPROF, &profile_old_action, NULL);
+	profile_cpu = NULL;
+	profiling = false;
+}
+
+bool powerpc_cpu::dump_profile(const char *filename)
+{
+	FILE *f = fopen(filename, "w");
+	if (f == NULL)
+		return false;
+
+	// Attribute samples to their enclosing block, if it is still
+	// live, and merge identical stacks
+	std::map<std::string, uint32> stacks;
+	char frames[256], stack[320];
+	for (const block_profiler::sample *s = my_block_profiler.begin(); s != my_block_profiler.end(); s++) {
+		if (s->count == 0)
+			continue;
+		uint32 block_pc = s->pc;
+		block_info *bi = my_block_cache.find_enclosing(s->pc);
+		if (bi)
+			block_pc = bi->pc;
+		profile_frames(frames, sizeof(frames), s->pc, s->ctx);
+		if (frames[0])
+			snprintf(stack, sizeof(stack), "%s;0x%08x", frames, block_pc);
+		else
+			snprintf(stack, sizeof(stack), "0x%08x", block_pc);
+		stacks[stack] += s->count;
+	}
+	if (my_block_profiler.host_samples())
+		stacks["[host threads]"] += my_block_profiler.host_samples();
+
+	// Collapsed stacks format: "frame;frame;... count"
+	std::map<std::string, uint32>::const_iterator it;
+	for (it = stacks.begin(); it != stacks.end(); ++it)
+		fprintf(f, "%s %u\n", it->first.c_str(), it->second);
+	fclose(f);
+
+	printf("### Block profile written to %s\n", filename);
+	printf("Total samples : %u\n", my_block_profiler.samples());
+	printf("Other threads : %u\n", my_block_profiler.host_samples());
+	printf("Lost samples : %u\n", my_block_profiler.lost_samples());
+	printf("\n");
+	return true;
+}
+#endif
+
 #if ENABLE_MON
 static uint32 mon_read_byte_ppc(uintptr addr)
 {
@@ -278,6 +401,11 @@ void powerpc_cpu::initialize()
 	// Init cache range invalidate recorder
 	cache_range.start = cache_range.end = 0;
 
+#if PPC_ENABLE_JIT_TRACES
+	// Init trace formation
+	trace_pending = NULL;
+#endif
+
 	// Init syscalls handler
 	execute_do_syscall = NULL;
 
@@ -311,10 +439,11 @@ void powerpc_cpu::initialize()
 #if PPC_ENABLE_JIT
 void powerpc_cpu::enable_jit(uint32 cache_size)
 {
-	use_jit = true;
 	if (cache_size)
 		codegen.set_cache_size(cache_size);
-	codegen.initialize();
+	use_jit = codegen.initialize();
+	if (!use_jit)
+		fprintf(stderr, "WARNING: Could not allocate the JIT translation cache, using the interpreter\n");
 }
 #endif
 
@@ -371,6 +500,12 @@ powerpc_cpu::powerpc_cpu(task_struct *parent_task)
 {
 #if PPC_ENABLE_JIT
 	use_jit = false;
+#endif
+#if PPC_ENABLE_JIT_TRACES
+	use_jit_traces = false;
+#endif
+#if PPC_PROFILE_BLOCKS
+	profiling = false;
 #endif
 	spcflags().init();
 	++ppc_refcount;
@@ -380,6 +515,9 @@ powerpc_cpu::powerpc_cpu(task_struct *parent_task)
 powerpc_cpu::~powerpc_cpu()
 {
 	--ppc_refcount;
+#if PPC_PROFILE_BLOCKS
+	stop_profile();
+#endif
 #if PPC_PROFILE_COMPILE_TIME
 	clock_t emul_end_time = clock();
 
@@ -405,6 +543,18 @@ powerpc_cpu::~powerpc_cpu()
 	}
 #endif
 
+#if PPC_PROFILE_BLOCK_CACHE && (PPC_DECODE_CACHE || PPC_ENABLE_JIT)
+	const block_cache< block_info, lazy_allocator >::stats_t & bc_stats = my_block_cache.get_stats();
+	printf("### Statistics for block cache\n");
+	printf("Hash table size : %u entries (%u resizes)\n", my_block_cache.hash_size(), bc_stats.resize_count);
+	printf("Full invalidations : %u\n", bc_stats.clear_count);
+	printf("Range invalidations : %llu\n", (unsigned long long)bc_stats.range_count);
+	printf("Blocks visited : %llu (%.1f per range)\n", (unsigned long long)bc_stats.range_visits,
+		   bc_stats.range_count ? double(bc_stats.range_visits) / double(bc_stats.range_count) : 0.0);
+	printf("Blocks invalidated : %llu\n", (unsigned long long)bc_stats.range_invalidations);
+	printf("\n");
+#endif
+
 #if PPC_PROFILE_GENERIC_CALLS
 	if (use_jit && ppc_refcount == 0) {
 		uint64 total_generic_calls_count = 0;
@@ -512,6 +662,13 @@ bool powerpc_cpu::check_spcflags()
 		spcflags().clear(SPCFLAG_CPU_EXEC_RETURN);
 		return false;
 	}
+#if PPC_ENABLE_JIT_TRACES
+	// Do this first, interrupt handlers could invalidate the pending block
+	if (spcflags().test(SPCFLAG_JIT_COMPILE_TRACE)) {
+		spcflags().clear(SPCFLAG_JIT_COMPILE_TRACE);
+		compile_trace();
+	}
+#endif
 #ifdef SHEEPSHAVER
 	if (spcflags().test(SPCFLAG_CPU_HANDLE_INTERRUPT)) {
 		spcflags().clear(SPCFLAG_CPU_HANDLE_INTERRUPT);
@@ -567,6 +724,11 @@ void * PF_CONVENTION powerpc_cpu::compile_chain_block(block_info *sbi)
 		tbi = compile_block(tpc);
 	assert(tbi && tbi->pc == tpc);
 
+#if PPC_ENABLE_JIT_TRACES
+	// Don't chain to blocks being profiled, they will be recompiled
+	if (tbi->trace_state == block_info::TRACE_PROFILE)
+		return tbi->entry_point;
+#endif
 	dg_set_jmp_target(sbi->li[n].jmp_addr, tbi->entry_point);
 	return tbi->entry_point;
 }
@@ -649,11 +811,17 @@ void powerpc_cpu::execute(uint32 entry)
 				if (is_logging()) {
 					di->opcode = opcode;
 					di->execute = nv_mem_fun(&powerpc_cpu::record_step);
+#if PPC_DECODE_CACHE_THREADED
+					predecode_threaded(di, NULL);
+#endif
 					di++;
 				}
 #endif
 				di->opcode = opcode;
 				di->execute = ii->execute;
+#if PPC_DECODE_CACHE_THREADED
+				predecode_threaded(di, ii);
+#endif
 				di++;
 #if PPC_EXECUTE_DUMP_STATE
 				if (dump_state) {
@@ -671,9 +839,13 @@ void powerpc_cpu::execute(uint32 entry)
 					di = bi->di + blocklen;
 				}
 			} while ((ii->cflow & CFLOW_END_BLOCK) == 0);
+#if PPC_DECODE_CACHE_THREADED
+			// Terminate threaded code, there is always room for it
+			terminate_threaded(di++);
+#endif
 			bi->end_pc = dpc;
-			bi->min_pc = dpc;
-			bi->max_pc = entry;
+			bi->min_pc = bi->pc;
+			bi->max_pc = dpc;
 			bi->size = di - bi->di;
 			my_block_cache.add_to_cl_list(bi);
 			my_block_cache.add_to_active_list(bi);
@@ -685,6 +857,9 @@ void powerpc_cpu::execute(uint32 entry)
 			// Execute all cached blocks
 		  pdi_execute:
 			for (;;) {
+#if PPC_DECODE_CACHE_THREADED
+				execute_threaded(bi->di);
+#else
 				const int r = bi->size % 4;
 				di = bi->di + r;
 				int n = (bi->size + 3) / 4;
@@ -697,6 +872,7 @@ void powerpc_cpu::execute(uint32 entry)
 				case 1: di[-1].execute(this, di[-1].opcode);
 					} while (--n > 0);
 				}
+#endif
 
 				if (!spcflags().empty()) {
 					if (!check_spcflags())
@@ -776,6 +952,13 @@ void powerpc_cpu::init_decode_cache()
 	// Leave enough room to last calls to dump state functions
 	decode_cache_end_p -= 2;
 #endif
+#if PPC_DECODE_CACHE_THREADED
+	// Leave enough room to threaded code terminator
+	decode_cache_end_p -= 1;
+
+	// Initialize threaded code handlers
+	execute_threaded(NULL);
+#endif
 #endif
 }
 
@@ -797,6 +980,9 @@ void powerpc_cpu::invalidate_cache()
 #if PPC_ENABLE_JIT
 	codegen.invalidate_cache();
 #endif
+#if PPC_ENABLE_JIT_TRACES
+	trace_pending = NULL;
+#endif
 #if PPC_DECODE_CACHE
 	decode_cache_p = decode_cache;
 #endif
@@ -836,4 +1022,8 @@ void powerpc_cpu::invalidate_cache_range(uintptr start, uintptr end)
 	spcflags().set(SPCFLAG_JIT_EXEC_RETURN);
 	my_block_cache.clear_range(start, end);
 #endif
+#if PPC_ENABLE_JIT_TRACES
+	// Pending block may have been removed, it will be profiled again
+	trace_pending = NULL;
+#endif
 }
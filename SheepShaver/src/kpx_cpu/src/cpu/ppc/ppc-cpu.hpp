@@ -26,6 +26,9 @@
 #include "cpu/vm.hpp"
 #include "cpu/block-cache.hpp"
 #include "cpu/ppc/ppc-config.hpp"
+#if PPC_PROFILE_BLOCKS
+#include "cpu/block-profiler.hpp"
+#endif
 #include "cpu/ppc/ppc-bitfields.hpp"
 #include "cpu/ppc/ppc-blockinfo.hpp"
 #include "cpu/ppc/ppc-registers.hpp"
@@ -34,6 +37,7 @@
 #endif
 #include "cpu/ppc/ppc-instructions.hpp"
 #include <vector>
+#include <map>
 
 class powerpc_cpu
 #ifndef SHEEPSHAVER
@@ -277,6 +281,19 @@ public:
 	void dump_log(const char *filename = NULL) { }
 #endif
 
+	// Handle sampling block profiler
+#if PPC_PROFILE_BLOCKS
+	bool is_profiling() const { return profiling; }
+	bool start_profile(int rate = 0);
+	void stop_profile();
+	bool dump_profile(const char *filename);
+#else
+	bool is_profiling() const { return false; }
+	bool start_profile(int rate = 0) { return false; }
+	void stop_profile() { }
+	bool dump_profile(const char *filename) { return false; }
+#endif
+
 	// Dump registers
 	void dump_registers();
 	void dump_instruction(uint32 opcode);
@@ -309,6 +326,15 @@ protected:
 	// Init decoder with one instruction info
 	void init_decoder_entry(const instr_info_t * ii);
 
+#if PPC_PROFILE_BLOCKS
+	// Return an opaque context for the current profile sample, e.g.
+	// the emulated run mode. This is called from a signal handler
+	virtual uint32 profile_context() { return 0; }
+
+	// Format the caller frames of a sample into BUF, separated by ';'
+	virtual void profile_frames(char *buf, int size, uint32 pc, uint32 ctx) { buf[0] = '\0'; }
+#endif
+
 #if PPC_ENABLE_JIT
 	// Dynamic translation engine
 	struct codegen_context_t {
@@ -335,6 +361,11 @@ protected:
 	bool use_jit;
 public:
 	void enable_jit(uint32 cache_size = 0);
+#if PPC_ENABLE_JIT_TRACES
+	void enable_jit_traces() { use_jit_traces = use_jit; }
+	bool load_trace_profiles(const char *filename);
+	bool save_trace_profiles(const char *filename);
+#endif
 #endif
 
 private:
@@ -362,6 +393,11 @@ private:
 	block_info::decode_info * decode_cache;
 	block_info::decode_info * decode_cache_p;
 	block_info::decode_info * decode_cache_end_p;
+#if PPC_DECODE_CACHE_THREADED
+	void predecode_threaded(block_info::decode_info *di, const instr_info_t *ii);
+	void terminate_threaded(block_info::decode_info *di);
+	void execute_threaded(block_info::decode_info *di);
+#endif
 #endif
 
 #if PPC_ENABLE_JIT
@@ -370,12 +406,46 @@ private:
 	friend class powerpc_dyngen;
 	friend class powerpc_jit;
 	powerpc_jit codegen;
-	block_info *compile_block(uint32 entry);
+	block_info *compile_block(uint32 entry, block_info *trace_head = NULL);
 	static void call_do_record_step(powerpc_cpu * cpu, uint32 pc, uint32 opcode);
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 	void *compile_chain_block(block_info *sbi);
 	static void * call_compile_chain_block(powerpc_cpu * the_cpu, block_info *sbi);
 #endif
+#if PPC_ENABLE_JIT_TRACES
+	// Trace formation
+	static const uint32 TRACE_PROFILE_THRESHOLD = 64;	// Profiled executions before recompilation
+	static const int TRACE_MAX_BLOCKS = 8;				// Maximum number of blocks in a superblock
+	bool use_jit_traces;
+	block_info *trace_pending;
+	uint32 trace_successor(block_info::trace_info const & ti, uint32 head_pc) const;
+	void *profile_block(block_info *bi);
+	static void * call_profile_block(powerpc_cpu * the_cpu, block_info *bi);
+	void compile_trace();
+
+	// Trace profiles saved across runs, keyed by block entry PC and
+	// validated against a hash of the guest code
+	struct trace_profile {
+		uint32 min_pc, max_pc;
+		uint32 code_hash;
+		block_info::trace_info ti;
+	};
+	typedef std::map< uint32, trace_profile > trace_profile_map;
+	trace_profile_map trace_profiles;
+	static const uint32 TRACE_PROFILE_MAX_SIZE = 4096;	// Largest guest code range to hash
+	uint32 trace_code_hash(uint32 start, uint32 end);
+	uint32 trace_profile_key() const;
+	void record_trace_profile(block_info const *bi);
+	bool find_trace_profile(uint32 pc, block_info::trace_info & ti);
+#endif
+#endif
+
+#if PPC_PROFILE_BLOCKS
+	// Sampling block profiler
+	static const int PROFILE_DEFAULT_RATE = 1000;		// Samples per second of CPU time
+	block_profiler my_block_profiler;
+	bool profiling;
+	static void profile_handler(int sig);
 #endif
 
 	// Semantic action templates
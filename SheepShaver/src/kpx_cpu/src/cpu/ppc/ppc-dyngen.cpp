@@ -236,7 +236,7 @@ DEFINE_INSN(store, T0);
 
 #undef DEFINE_INSN
 
-void powerpc_dyngen::gen_bc(int bo, int bi, uint32 tpc, uint32 npc, bool direct_chaining)
+void powerpc_dyngen::gen_prep_bc(int bo, int bi)
 {
 	if (BO_CONDITIONAL_BRANCH(bo))
 		gen_load_T1_crb(bi);
@@ -262,7 +262,12 @@ void powerpc_dyngen::gen_bc(int bo, int bi, uint32 tpc, uint32 npc, bool direct_
 #undef _
 	default: abort();
 	}
-	
+}
+
+void powerpc_dyngen::gen_bc(int bo, int bi, uint32 tpc, uint32 npc, bool direct_chaining)
+{
+	gen_prep_bc(bo, bi);
+
 	if (BO_CONDITIONAL_BRANCH(bo) || BO_DECREMENT_CTR(bo)) {
 		// two-way branches
 		if (direct_chaining)
@@ -287,6 +292,28 @@ void powerpc_dyngen::gen_bc(int bo, int bi, uint32 tpc, uint32 npc, bool direct_
 	}
 }
 
+// Generate a two-way branch that falls through to the next generated
+// code if the branch direction is TAKEN, or sets PC to EXIT_PC and
+// leaves the block through EXIT_BLOCK otherwise (trace side exit)
+void powerpc_dyngen::gen_bc_side_exit(int bo, int bi, bool taken, uint32 exit_pc, uintptr exit_block)
+{
+	gen_prep_bc(bo, bi);
+	gen_op_branch_chain_2();
+	uint8 *jmp_taken = jmp_addr[0];
+	uint8 *jmp_not_taken = jmp_addr[1];
+	jmp_addr[0] = jmp_addr[1] = NULL;
+
+	uint8 *side_exit = code_ptr();
+	gen_set_PC_im(exit_pc);
+	gen_mov_ad_A0_im(exit_block);
+	gen_jump_next_A0();
+	gen_exec_return();
+
+	uint8 *fall_through = code_ptr();
+	dg_set_jmp_target_noflush(jmp_taken, taken ? fall_through : side_exit);
+	dg_set_jmp_target_noflush(jmp_not_taken, taken ? side_exit : fall_through);
+}
+
 /**
  *		Vector instructions
  **/
@@ -232,7 +232,9 @@ public:
 	void gen_store_single_F0_T1_im(int32 offset);
 
 	// Branch instructions
+	void gen_prep_bc(int bo, int bi);
 	void gen_bc(int bo, int bi, uint32 tpc, uint32 npc, bool direct_chaining);
+	void gen_bc_side_exit(int bo, int bi, bool taken, uint32 exit_pc, uintptr exit_block);
 
 	// Vector instructions
 	void gen_load_ad_VD_VR(int i);
@@ -1778,6 +1778,562 @@ void powerpc_cpu::execute_mtvscr(uint32 opcode)
 	increment_pc(4);
 }
 
+/**
+ *		Direct threaded code interpreter
+ *
+ *		Frequently used instructions of a decode cache block are
+ *		pre-decoded into register indices and immediate values, and
+ *		executed by specialised handlers. Other instructions go through
+ *		their regular semantic routine. Each block is terminated by an
+ *		END handler that returns to the dispatcher.
+ **/
+
+#if PPC_DECODE_CACHE_THREADED
+#define DEFINE_THREADED_HANDLERS(_)												\
+	_(GENERIC) _(END)															\
+	_(LI) _(ADDI) _(ADDIC) _(SUBFIC) _(MULLI)									\
+	_(ADD) _(SUBF) _(NEG) _(MULLW)												\
+	_(AND) _(ANDC) _(OR) _(MR) _(XOR) _(NOR)									\
+	_(ANDI) _(ORI) _(XORI)														\
+	_(RLWINM) _(RLWIMI) _(SLW) _(SRW) _(SRAWI)									\
+	_(EXTSB) _(EXTSH) _(CNTLZW)													\
+	_(CMP) _(CMPL) _(CMPI) _(CMPLI)												\
+	_(LWZ) _(LHZ) _(LHA) _(LBZ) _(STW) _(STH) _(STB)							\
+	_(LWZU) _(STWU) _(LWZX) _(LBZX) _(STWX) _(STBX)								\
+	_(MFLR) _(MTLR) _(MFCTR) _(MTCTR)											\
+	_(B) _(BC) _(BCLR) _(BCCTR)
+
+enum {
+#define _(NAME) THREADED_##NAME,
+	DEFINE_THREADED_HANDLERS(_)
+#undef _
+	THREADED_MAX
+};
+
+static const void *threaded_handlers[THREADED_MAX];
+
+void powerpc_cpu::terminate_threaded(block_info::decode_info *di)
+{
+	di->opcode = 0;
+	di->handler = threaded_handlers[THREADED_END];
+}
+
+void powerpc_cpu::predecode_threaded(block_info::decode_info *di, const instr_info_t *ii)
+{
+	// Plain call to di->execute(), e.g. flight recorder steps
+	if (ii == NULL) {
+		di->handler = threaded_handlers[THREADED_GENERIC];
+		return;
+	}
+
+	const uint32 opcode = di->opcode;
+	int handler = THREADED_GENERIC;
+	di->rD = rD_field::extract(opcode);
+	di->rA = rA_field::extract(opcode);
+	di->rB = rB_field::extract(opcode);
+	di->aux = Rc_field::extract(opcode);
+	di->imm = 0;
+
+	// Only specialise the common forms, i.e. without OE bit set
+	const bool oe = OE_field::test(opcode);
+	const uint32 simm = op_sign_extend_16_32::apply(SIMM_field::extract(opcode));
+	const uint32 uimm = UIMM_field::extract(opcode);
+
+	switch (ii->mnemo) {
+	case PPC_I(ADDI):
+		di->imm = simm;
+		handler = di->rA ? THREADED_ADDI : THREADED_LI;
+		break;
+	case PPC_I(ADDIS):
+		di->imm = simm << 16;
+		handler = di->rA ? THREADED_ADDI : THREADED_LI;
+		break;
+	case PPC_I(ADDIC):		di->imm = simm; handler = THREADED_ADDIC; break;
+	case PPC_I(SUBFIC):		di->imm = simm; handler = THREADED_SUBFIC; break;
+	case PPC_I(MULLI):		di->imm = simm; handler = THREADED_MULLI; break;
+	case PPC_I(ADD):		if (!oe) handler = THREADED_ADD; break;
+	case PPC_I(SUBF):		if (!oe) handler = THREADED_SUBF; break;
+	case PPC_I(NEG):		if (!oe) handler = THREADED_NEG; break;
+	case PPC_I(MULLW):		if (!oe) handler = THREADED_MULLW; break;
+	case PPC_I(AND):		handler = THREADED_AND; break;
+	case PPC_I(ANDC):		handler = THREADED_ANDC; break;
+	case PPC_I(OR):			handler = di->rD == di->rB ? THREADED_MR : THREADED_OR; break;
+	case PPC_I(XOR):		handler = THREADED_XOR; break;
+	case PPC_I(NOR):		handler = THREADED_NOR; break;
+	case PPC_I(ANDI):		di->imm = uimm; handler = THREADED_ANDI; break;
+	case PPC_I(ANDIS):		di->imm = uimm << 16; handler = THREADED_ANDI; break;
+	case PPC_I(ORI):		di->imm = uimm; handler = THREADED_ORI; break;
+	case PPC_I(ORIS):		di->imm = uimm << 16; handler = THREADED_ORI; break;
+	case PPC_I(XORI):		di->imm = uimm; handler = THREADED_XORI; break;
+	case PPC_I(XORIS):		di->imm = uimm << 16; handler = THREADED_XORI; break;
+	case PPC_I(RLWINM):		di->imm = operand_MASK::get(this, opcode); handler = THREADED_RLWINM; break;
+	case PPC_I(RLWIMI):		di->imm = operand_MASK::get(this, opcode); handler = THREADED_RLWIMI; break;
+	case PPC_I(SLW):		handler = THREADED_SLW; break;
+	case PPC_I(SRW):		handler = THREADED_SRW; break;
+	case PPC_I(SRAWI):		handler = THREADED_SRAWI; break;
+	case PPC_I(EXTSB):		handler = THREADED_EXTSB; break;
+	case PPC_I(EXTSH):		handler = THREADED_EXTSH; break;
+	case PPC_I(CNTLZW):		handler = THREADED_CNTLZW; break;
+	case PPC_I(CMP):		di->aux = crfD_field::extract(opcode); handler = THREADED_CMP; break;
+	case PPC_I(CMPL):		di->aux = crfD_field::extract(opcode); handler = THREADED_CMPL; break;
+	case PPC_I(CMPI):		di->aux = crfD_field::extract(opcode); di->imm = simm; handler = THREADED_CMPI; break;
+	case PPC_I(CMPLI):		di->aux = crfD_field::extract(opcode); di->imm = uimm; handler = THREADED_CMPLI; break;
+	case PPC_I(LWZ):		di->imm = simm; handler = THREADED_LWZ; break;
+	case PPC_I(LHZ):		di->imm = simm; handler = THREADED_LHZ; break;
+	case PPC_I(LHA):		di->imm = simm; handler = THREADED_LHA; break;
+	case PPC_I(LBZ):		di->imm = simm; handler = THREADED_LBZ; break;
+	case PPC_I(STW):		di->imm = simm; handler = THREADED_STW; break;
+	case PPC_I(STH):		di->imm = simm; handler = THREADED_STH; break;
+	case PPC_I(STB):		di->imm = simm; handler = THREADED_STB; break;
+	case PPC_I(LWZU):		di->imm = simm; if (di->rA) handler = THREADED_LWZU; break;
+	case PPC_I(STWU):		di->imm = simm; if (di->rA) handler = THREADED_STWU; break;
+	case PPC_I(LWZX):		handler = THREADED_LWZX; break;
+	case PPC_I(LBZX):		handler = THREADED_LBZX; break;
+	case PPC_I(STWX):		handler = THREADED_STWX; break;
+	case PPC_I(STBX):		handler = THREADED_STBX; break;
+	case PPC_I(MFSPR):
+		switch (operand_SPR::get(this, opcode)) {
+		case powerpc_registers::SPR_LR:		handler = THREADED_MFLR; break;
+		case powerpc_registers::SPR_CTR:	handler = THREADED_MFCTR; break;
+		}
+		break;
+	case PPC_I(MTSPR):
+		switch (operand_SPR::get(this, opcode)) {
+		case powerpc_registers::SPR_LR:		handler = THREADED_MTLR; break;
+		case powerpc_registers::SPR_CTR:	handler = THREADED_MTCTR; break;
+		}
+		break;
+	case PPC_I(B):
+		di->imm = operand_LI::get(this, opcode);
+		di->aux = (AA_field::test(opcode) ? 1 : 0) | (LK_field::test(opcode) ? 2 : 0);
+		handler = THREADED_B;
+		break;
+	case PPC_I(BC):
+		di->imm = operand_BD::get(this, opcode);
+		di->aux = (AA_field::test(opcode) ? 1 : 0) | (LK_field::test(opcode) ? 2 : 0);
+		handler = THREADED_BC;
+		break;
+	case PPC_I(BCLR):
+		di->aux = LK_field::test(opcode) ? 2 : 0;
+		handler = THREADED_BCLR;
+		break;
+	case PPC_I(BCCTR):
+		di->aux = LK_field::test(opcode) ? 2 : 0;
+		handler = THREADED_BCCTR;
+		break;
+	}
+
+	di->handler = threaded_handlers[handler];
+}
+
+void powerpc_cpu::execute_threaded(block_info::decode_info *di)
+{
+	// Initialize handlers table
+	if (di == NULL) {
+#define _(NAME) threaded_handlers[THREADED_##NAME] = &&do_##NAME;
+		DEFINE_THREADED_HANDLERS(_)
+#undef _
+		return;
+	}
+
+	// Keep a copy of PC in a register, stores to pc() are not reloaded
+	uint32 cpc = pc();
+
+#define NEXT				goto *(++di)->handler
+#define INCREMENT_PC		pc() = (cpc += 4)
+#define RECORD_CR0(D)		if (di->aux) record_cr0((int32)(D))
+#define RA_OR_0				(di->rA ? gpr(di->rA) : 0)
+
+	// Evaluate branch condition, and update CTR if needed
+#define BRANCH(TARGET) do {														\
+		const uint32 bo = di->rD;												\
+		bool ok = true;															\
+		if (BO_CONDITIONAL_BRANCH(bo)) {										\
+			ok = cr().test(di->rA);												\
+			if (!BO_BRANCH_IF_TRUE(bo))											\
+				ok = !ok;														\
+		}																		\
+		if (BO_DECREMENT_CTR(bo)) {												\
+			bool ctr_ok = (ctr() -= 1) == 0;									\
+			if (!BO_BRANCH_IF_CTR_ZERO(bo))										\
+				ctr_ok = !ctr_ok;												\
+			ok = ok && ctr_ok;													\
+		}																		\
+		const uint32 npc = cpc + 4;												\
+		pc() = cpc = ok ? ((TARGET) & -4) : npc;								\
+		if (di->aux & 2)														\
+			lr() = npc;															\
+	} while (0)
+
+	goto *di->handler;
+
+  do_GENERIC:
+	di->execute(this, di->opcode);
+	cpc = pc();
+	NEXT;
+
+  do_END:
+	// Chain to next block unless the dispatcher has work to do
+	if (spcflags().empty()) {
+		block_info *bi = my_block_cache.find(pc());
+		if (bi != NULL) {
+			di = bi->di;
+			goto *di->handler;
+		}
+	}
+	return;
+
+  do_LI:
+	gpr(di->rD) = di->imm;
+	INCREMENT_PC;
+	NEXT;
+
+  do_ADDI:
+	gpr(di->rD) = gpr(di->rA) + di->imm;
+	INCREMENT_PC;
+	NEXT;
+
+  do_ADDIC: {
+	const uint32 a = gpr(di->rA);
+	xer().set_ca(op_carry<op_add>::apply(a, di->imm, 0));
+	gpr(di->rD) = a + di->imm;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_SUBFIC: {
+	const uint32 a = ~gpr(di->rA);
+	xer().set_ca(op_carry<op_add>::apply(a, di->imm, 1));
+	gpr(di->rD) = a + di->imm + 1;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_MULLI:
+	gpr(di->rD) = gpr(di->rA) * di->imm;
+	INCREMENT_PC;
+	NEXT;
+
+  do_ADD: {
+	const uint32 d = gpr(di->rA) + gpr(di->rB);
+	RECORD_CR0(d);
+	gpr(di->rD) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_SUBF: {
+	const uint32 d = gpr(di->rB) - gpr(di->rA);
+	RECORD_CR0(d);
+	gpr(di->rD) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_NEG: {
+	const uint32 d = -gpr(di->rA);
+	RECORD_CR0(d);
+	gpr(di->rD) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_MULLW: {
+	const uint32 d = gpr(di->rA) * gpr(di->rB);
+	RECORD_CR0(d);
+	gpr(di->rD) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_AND: {
+	const uint32 d = gpr(di->rD) & gpr(di->rB);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_ANDC: {
+	const uint32 d = gpr(di->rD) & ~gpr(di->rB);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_OR: {
+	const uint32 d = gpr(di->rD) | gpr(di->rB);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_MR: {
+	const uint32 d = gpr(di->rD);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_XOR: {
+	const uint32 d = gpr(di->rD) ^ gpr(di->rB);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_NOR: {
+	const uint32 d = ~(gpr(di->rD) | gpr(di->rB));
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_ANDI: {
+	const uint32 d = gpr(di->rD) & di->imm;
+	record_cr0((int32)d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_ORI:
+	gpr(di->rA) = gpr(di->rD) | di->imm;
+	INCREMENT_PC;
+	NEXT;
+
+  do_XORI:
+	gpr(di->rA) = gpr(di->rD) ^ di->imm;
+	INCREMENT_PC;
+	NEXT;
+
+  do_RLWINM: {
+	const uint32 d = op_rotl::apply(gpr(di->rD), di->rB) & di->imm;
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_RLWIMI: {
+	const uint32 d = op_ppc_rlwimi::apply(gpr(di->rD), di->rB, di->imm, gpr(di->rA));
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_SLW: {
+	const uint32 n = gpr(di->rB) & 0x3f;
+	const uint32 d = (n & 0x20) ? 0 : gpr(di->rD) << n;
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_SRW: {
+	const uint32 n = gpr(di->rB) & 0x3f;
+	const uint32 d = (n & 0x20) ? 0 : gpr(di->rD) >> n;
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_SRAWI: {
+	const uint32 n = di->rB;
+	const uint32 r = gpr(di->rD);
+	const uint32 d = op_shra::apply(r, n);
+	xer().set_ca((r & 0x80000000) && (r & ~(0xffffffff << n)));
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_EXTSB: {
+	const uint32 d = (int32)(int8)gpr(di->rD);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_EXTSH: {
+	const uint32 d = (int32)(int16)gpr(di->rD);
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_CNTLZW: {
+	const uint32 d = op_cntlzw::apply(gpr(di->rD));
+	RECORD_CR0(d);
+	gpr(di->rA) = d;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_CMP: {
+	const int32 a = gpr(di->rA);
+	const int32 b = gpr(di->rB);
+	record_cr(di->aux, a < b ? -1 : (a > b ? +1 : 0));
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_CMPL: {
+	const uint32 a = gpr(di->rA);
+	const uint32 b = gpr(di->rB);
+	record_cr(di->aux, a < b ? -1 : (a > b ? +1 : 0));
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_CMPI: {
+	const int32 a = gpr(di->rA);
+	const int32 b = di->imm;
+	record_cr(di->aux, a < b ? -1 : (a > b ? +1 : 0));
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_CMPLI: {
+	const uint32 a = gpr(di->rA);
+	const uint32 b = di->imm;
+	record_cr(di->aux, a < b ? -1 : (a > b ? +1 : 0));
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_LWZ:
+	gpr(di->rD) = vm_read_memory_4(RA_OR_0 + di->imm);
+	INCREMENT_PC;
+	NEXT;
+
+  do_LHZ:
+	gpr(di->rD) = vm_read_memory_2(RA_OR_0 + di->imm);
+	INCREMENT_PC;
+	NEXT;
+
+  do_LHA:
+	gpr(di->rD) = (int32)(int16)vm_read_memory_2(RA_OR_0 + di->imm);
+	INCREMENT_PC;
+	NEXT;
+
+  do_LBZ:
+	gpr(di->rD) = vm_read_memory_1(RA_OR_0 + di->imm);
+	INCREMENT_PC;
+	NEXT;
+
+  do_STW:
+	vm_write_memory_4(RA_OR_0 + di->imm, gpr(di->rD));
+	INCREMENT_PC;
+	NEXT;
+
+  do_STH:
+	vm_write_memory_2(RA_OR_0 + di->imm, gpr(di->rD));
+	INCREMENT_PC;
+	NEXT;
+
+  do_STB:
+	vm_write_memory_1(RA_OR_0 + di->imm, gpr(di->rD));
+	INCREMENT_PC;
+	NEXT;
+
+  do_LWZU: {
+	const uint32 ea = gpr(di->rA) + di->imm;
+	gpr(di->rD) = vm_read_memory_4(ea);
+	gpr(di->rA) = ea;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_STWU: {
+	const uint32 ea = gpr(di->rA) + di->imm;
+	vm_write_memory_4(ea, gpr(di->rD));
+	gpr(di->rA) = ea;
+	INCREMENT_PC;
+	NEXT;
+  }
+
+  do_LWZX:
+	gpr(di->rD) = vm_read_memory_4(RA_OR_0 + gpr(di->rB));
+	INCREMENT_PC;
+	NEXT;
+
+  do_LBZX:
+	gpr(di->rD) = vm_read_memory_1(RA_OR_0 + gpr(di->rB));
+	INCREMENT_PC;
+	NEXT;
+
+  do_STWX:
+	vm_write_memory_4(RA_OR_0 + gpr(di->rB), gpr(di->rD));
+	INCREMENT_PC;
+	NEXT;
+
+  do_STBX:
+	vm_write_memory_1(RA_OR_0 + gpr(di->rB), gpr(di->rD));
+	INCREMENT_PC;
+	NEXT;
+
+  do_MFLR:
+	gpr(di->rD) = lr();
+	INCREMENT_PC;
+	NEXT;
+
+  do_MTLR:
+	lr() = gpr(di->rD);
+	INCREMENT_PC;
+	NEXT;
+
+  do_MFCTR:
+	gpr(di->rD) = ctr();
+	INCREMENT_PC;
+	NEXT;
+
+  do_MTCTR:
+	ctr() = gpr(di->rD);
+	INCREMENT_PC;
+	NEXT;
+
+  do_B: {
+	const uint32 npc = cpc + 4;
+	pc() = cpc = (((di->aux & 1) ? 0 : cpc) + di->imm) & -4;
+	if (di->aux & 2)
+		lr() = npc;
+	NEXT;
+  }
+
+  do_BC:
+	BRANCH(((di->aux & 1) ? 0 : cpc) + di->imm);
+	NEXT;
+
+  do_BCLR:
+	BRANCH(lr());
+	NEXT;
+
+  do_BCCTR:
+	BRANCH(ctr());
+	NEXT;
+
+#undef BRANCH
+#undef RA_OR_0
+#undef RECORD_CR0
+#undef INCREMENT_PC
+#undef NEXT
+}
+
+#undef DEFINE_THREADED_HANDLERS
+#endif
+
 /**
  *		Explicit template instantiations
  **/
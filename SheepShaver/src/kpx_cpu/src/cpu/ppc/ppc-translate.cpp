@@ -144,8 +144,259 @@ powerpc_cpu::call_execute_illegal(powerpc_cpu * cpu, uint32 param1) {
 	cpu->execute_illegal(param1);
 }
 
+#if PPC_ENABLE_JIT_TRACES
+void *
+powerpc_cpu::call_profile_block(powerpc_cpu * the_cpu, block_info *bi)
+{
+	return the_cpu->profile_block(bi);
+}
+
+void *
+powerpc_cpu::profile_block(block_info *bi)
+{
+	// Track the most frequent successor (majority vote)
+	block_info::trace_info & ti = bi->ti;
+	const uint32 npc = pc();
+	if (ti.next_pc == npc)
+		ti.next_votes++;
+	else if (ti.next_votes > 0)
+		ti.next_votes--;
+	else {
+		ti.next_pc = npc;
+		ti.next_votes = 1;
+	}
+
+	// Request recompilation once the block is hot enough
+	if (++ti.exec_count >= TRACE_PROFILE_THRESHOLD && trace_pending == NULL) {
+		trace_pending = bi;
+		spcflags().set(SPCFLAG_JIT_COMPILE_TRACE);
+	}
+	return bi;
+}
+
+// Returns the successor block to translate after the profiled exit,
+// or INVALID_PC if the trace shall end there
+uint32
+powerpc_cpu::trace_successor(block_info::trace_info const & ti, uint32 head_pc) const
+{
+	// Require about 7 out of 8 exits going to the same successor
+	if (ti.end_pc == block_info::INVALID_PC || ti.exec_count < TRACE_PROFILE_THRESHOLD / 4)
+		return block_info::INVALID_PC;
+	if (ti.next_votes * 4 < ti.exec_count * 3)
+		return block_info::INVALID_PC;
+
+	// Backward edges to the trace head are direct chained so that
+	// spcflags are checked on each iteration. Besides, all code shall
+	// lie in the same page as the head, or in ROM, for invalidation of
+	// any part of the trace to remove the whole superblock
+	const uint32 npc = ti.next_pc;
+	if (npc == head_pc || !direct_chaining_possible(head_pc, npc))
+		return block_info::INVALID_PC;
+	return npc;
+}
+
+void
+powerpc_cpu::compile_trace()
+{
+	block_info *bi = trace_pending;
+	trace_pending = NULL;
+	if (bi == NULL || bi->trace_state != block_info::TRACE_PROFILE)
+		return;
+
+	// Profiled block is no longer looked up but it is kept in the
+	// active list so that its code remains valid until invalidation
+	my_block_cache.remove_from_cl_list(bi);
+	bi->trace_state = block_info::TRACE_RETIRED;
+	record_trace_profile(bi);
+	compile_block(bi->pc, bi);
+}
+
+/**
+ *		Persistent trace profiles
+ *
+ *		Translated code embeds host addresses and can't be reused from
+ *		one run to the other. However, the profiles that decide how
+ *		superblocks are formed only depend on the guest code and on
+ *		where the translator ends blocks. They are saved on exit so that
+ *		hot blocks found in a previous run can be compiled as superblocks
+ *		right away, without going through the profiling stage again.
+ *
+ *		Each profile is checked against a hash of its guest code, and
+ *		the file against trace_profile_key(). Superblocks still test
+ *		their exits, so a stale profile only makes a poor superblock.
+ **/
+
+static const uint32 TRACE_PROFILE_MAGIC = 0x4b505854;	// 'KPXT'
+static const uint32 TRACE_PROFILE_VERSION = 2;			// Bump when block boundaries change
+
+struct trace_profile_header {
+	uint32 magic;
+	uint32 version;
+	uint32 key;
+	uint32 count;
+};
+
+struct trace_profile_record {
+	uint32 pc;
+	uint32 min_pc, max_pc;
+	uint32 code_hash;
+	uint32 end_pc, next_pc, next_votes, exec_count;
+};
+
+static inline uint32 trace_hash(uint32 h, uint32 v)
+{
+	return (h ^ v) * 16777619U;
+}
+
+// FNV-1a hash of the guest code in [START, END]
+uint32
+powerpc_cpu::trace_code_hash(uint32 start, uint32 end)
+{
+	uint32 h = 2166136261U;
+	for (uint32 pc = start; pc <= end; pc += 4)
+		h = trace_hash(h, vm_read_memory_4(pc));
+	return h;
+}
+
+// Hash of what profiles depend on besides the guest code: the record
+// layout, the trace formation parameters, and the decoder table, whose
+// control flow information decides where blocks end
+uint32
+powerpc_cpu::trace_profile_key() const
+{
+	const uint32 params[] = {
+		TRACE_PROFILE_VERSION,
+		sizeof(trace_profile_record),
+		TRACE_PROFILE_THRESHOLD,
+		TRACE_MAX_BLOCKS,
+		TRACE_PROFILE_MAX_SIZE
+	};
+	uint32 h = 2166136261U;
+	for (size_t i = 0; i < sizeof(params)/sizeof(params[0]); i++)
+		h = trace_hash(h, params[i]);
+	for (size_t i = 0; i < ii_table.size(); i++) {
+		const instr_info_t & ii = ii_table[i];
+		for (size_t j = 0; j < sizeof(ii.name) && ii.name[j]; j++)
+			h = trace_hash(h, (uint8)ii.name[j]);
+		h = trace_hash(h, ii.mnemo);
+		h = trace_hash(h, ii.format);
+		h = trace_hash(h, (ii.opcode << 16) | ii.xo);
+		h = trace_hash(h, ii.cflow);
+	}
+	return h;
+}
+
+void
+powerpc_cpu::record_trace_profile(block_info const *bi)
+{
+	// Only keep profiles whose code can be safely read back when the
+	// block is compiled again, i.e. from the same page or from ROM
+	if (bi->ti.end_pc == block_info::INVALID_PC || bi->max_pc - bi->min_pc >= TRACE_PROFILE_MAX_SIZE)
+		return;
+	if (!direct_chaining_possible(bi->pc, bi->min_pc) || !direct_chaining_possible(bi->pc, bi->max_pc))
+		return;
+
+	trace_profile & tp = trace_profiles[bi->pc];
+	tp.min_pc = bi->min_pc;
+	tp.max_pc = bi->max_pc;
+	tp.code_hash = trace_code_hash(bi->min_pc, bi->max_pc);
+	tp.ti = bi->ti;
+}
+
+bool
+powerpc_cpu::find_trace_profile(uint32 pc, block_info::trace_info & ti)
+{
+	trace_profile_map::iterator it = trace_profiles.find(pc);
+	if (it == trace_profiles.end())
+		return false;
+
+	// Drop profiles of code that was modified since
+	trace_profile const & tp = it->second;
+	if (trace_code_hash(tp.min_pc, tp.max_pc) != tp.code_hash) {
+		trace_profiles.erase(it);
+		return false;
+	}
+	ti = tp.ti;
+	return true;
+}
+
+bool
+powerpc_cpu::load_trace_profiles(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL)
+		return false;
+
+	trace_profile_header hdr;
+	bool ok = fread(&hdr, sizeof(hdr), 1, f) == 1
+		&& hdr.magic == TRACE_PROFILE_MAGIC
+		&& hdr.version == TRACE_PROFILE_VERSION
+		&& hdr.key == trace_profile_key();
+	for (uint32 i = 0; ok && i < hdr.count; i++) {
+		trace_profile_record r;
+		if (fread(&r, sizeof(r), 1, f) != 1) {
+			ok = false;
+			break;
+		}
+		if (r.max_pc < r.min_pc || r.max_pc - r.min_pc >= TRACE_PROFILE_MAX_SIZE)
+			continue;
+		if (!direct_chaining_possible(r.pc, r.min_pc) || !direct_chaining_possible(r.pc, r.max_pc))
+			continue;
+		trace_profile & tp = trace_profiles[r.pc];
+		tp.min_pc = r.min_pc;
+		tp.max_pc = r.max_pc;
+		tp.code_hash = r.code_hash;
+		tp.ti.end_pc = r.end_pc;
+		tp.ti.next_pc = r.next_pc;
+		tp.ti.next_votes = r.next_votes;
+		tp.ti.exec_count = r.exec_count;
+	}
+	fclose(f);
+
+	if (!ok)
+		trace_profiles.clear();
+	D(bug("Loaded %d trace profiles from %s\n", (int)trace_profiles.size(), filename));
+	return ok;
+}
+
+bool
+powerpc_cpu::save_trace_profiles(const char *filename)
+{
+	FILE *f = fopen(filename, "wb");
+	if (f == NULL)
+		return false;
+
+	trace_profile_header hdr;
+	hdr.magic = TRACE_PROFILE_MAGIC;
+	hdr.version = TRACE_PROFILE_VERSION;
+	hdr.key = trace_profile_key();
+	hdr.count = trace_profiles.size();
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+	trace_profile_map::const_iterator it;
+	for (it = trace_profiles.begin(); ok && it != trace_profiles.end(); ++it) {
+		trace_profile const & tp = it->second;
+		trace_profile_record r;
+		r.pc = it->first;
+		r.min_pc = tp.min_pc;
+		r.max_pc = tp.max_pc;
+		r.code_hash = tp.code_hash;
+		r.end_pc = tp.ti.end_pc;
+		r.next_pc = tp.ti.next_pc;
+		r.next_votes = tp.ti.next_votes;
+		r.exec_count = tp.ti.exec_count;
+		ok = fwrite(&r, sizeof(r), 1, f) == 1;
+	}
+	if (fclose(f) != 0)
+		ok = false;
+
+	D(bug("Saved %d trace profiles to %s\n", (int)trace_profiles.size(), filename));
+	return ok;
+}
+#endif
+
 powerpc_cpu::block_info *
-powerpc_cpu::compile_block(uint32 entry_point)
+powerpc_cpu::compile_block(uint32 entry_point, block_info *trace_head)
 {
 #if DEBUG
 	bool disasm = false;
@@ -161,6 +412,24 @@ powerpc_cpu::compile_block(uint32 entry_point)
 	powerpc_jit & dg = codegen;
 	codegen_context_t cg_context(dg);
 	cg_context.entry_point = entry_point;
+
+	// Trace formation: either generate exit profiling code, or build
+	// a superblock from the profile of TRACE_HEAD. The latter may be
+	// released on cache invalidation, so work on a copy
+#if PPC_ENABLE_JIT_TRACES
+	// A profile saved from a previous run also makes a superblock
+	block_info::trace_info head_ti;
+	bool use_head_ti = false;
+	if (trace_head) {
+		head_ti = trace_head->ti;
+		use_head_ti = true;
+	}
+	else if (use_jit_traces && !trace_profiles.empty())
+		use_head_ti = find_trace_profile(entry_point, head_ti);
+	const bool profiling = use_jit_traces && !use_head_ti;
+#else
+	const bool profiling = false;
+#endif
   again:
 	block_info *bi = my_block_cache.new_blockinfo();
 	bi->init(entry_point);
@@ -175,6 +444,14 @@ powerpc_cpu::compile_block(uint32 entry_point)
 	min_pc = max_pc = entry_point;
 	uint32 sync_pc = dpc;
 	uint32 sync_pc_offset = 0;
+#if PPC_ENABLE_JIT_TRACES
+	// Profile of the current trace segment
+	bool use_trace = use_head_ti;
+	block_info::trace_info seg_ti;
+	if (use_trace)
+		seg_ti = head_ti;
+	int trace_blocks = 1;
+#endif
 	bool done_compile = false;
 	while (!done_compile) {
 		uint32 opcode = vm_read_memory_4(dpc += 4);
@@ -527,9 +804,23 @@ powerpc_cpu::compile_block(uint32 entry_point)
 #endif
 			const uint32 tpc = ((AA_field::test(opcode) ? 0 : dpc) + operand_BD::get(this, opcode)) & -4;
 			const uint32 npc = dpc + 4;
+#if PPC_ENABLE_JIT_TRACES
+			// Follow the hot direction, leave the block on the other one
+			if (use_trace && dpc == seg_ti.end_pc && trace_blocks < TRACE_MAX_BLOCKS &&
+				(BO_CONDITIONAL_BRANCH(bo) || BO_DECREMENT_CTR(bo))) {
+				const uint32 hpc = trace_successor(seg_ti, bi->pc);
+				if (hpc == tpc || hpc == npc) {
+					if (LK_field::test(opcode))
+						dg.gen_store_im_LR(npc);
+					dg.gen_bc_side_exit(bo, BI_field::extract(opcode), hpc == tpc, hpc == tpc ? npc : tpc, (uintptr)bi);
+					op.jmp.target = hpc;
+					goto do_trace_jump;
+				}
+			}
+#endif
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 			// Use direct block chaining for in-page jumps or jumps to ROM area
-			if (direct_chaining_possible(bi->pc, tpc)) {
+			if (!profiling && direct_chaining_possible(bi->pc, tpc)) {
 				use_direct_block_chaining = true;
 				bi->li[0].jmp_pc = tpc;
 				// Make sure it's a conditional branch
@@ -565,6 +856,31 @@ powerpc_cpu::compile_block(uint32 entry_point)
 		case PPC_I(B):			// Branch
 			goto do_call;
 		{
+#if PPC_ENABLE_JIT_TRACES
+		  do_trace_jump:
+			// Continue translation into the next trace segment
+			{
+				block_info *tbi = my_block_cache.find(op.jmp.target);
+				use_trace = tbi != NULL && tbi->ti.end_pc != block_info::INVALID_PC;
+				if (use_trace) {
+					seg_ti = tbi->ti;
+					record_trace_profile(tbi);
+				}
+				else if (!trace_profiles.empty())
+					use_trace = find_trace_profile(op.jmp.target, seg_ti);
+			}
+			trace_blocks++;
+			if (dpc > max_pc)
+				max_pc = dpc;
+			sync_pc = dpc = op.jmp.target - 4;
+			sync_pc_offset = 0;
+			if (dpc < min_pc)
+				min_pc = dpc;
+			else if (dpc > max_pc)
+				max_pc = dpc;
+			done_compile = false;
+			break;
+#endif
 #if FOLLOW_CONST_JUMPS
 		  do_const_jump:
 			sync_pc = dpc = op.jmp.target - 4;
@@ -590,9 +906,18 @@ powerpc_cpu::compile_block(uint32 entry_point)
 			}
 #endif
 
+#if PPC_ENABLE_JIT_TRACES
+			// Inline hot subroutine calls into the trace
+			if (use_trace && dpc == seg_ti.end_pc && trace_blocks < TRACE_MAX_BLOCKS &&
+				trace_successor(seg_ti, bi->pc) == tpc) {
+				op.jmp.target = tpc;
+				goto do_trace_jump;
+			}
+#endif
+
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 			// Use direct block chaining, addresses will be resolved at execution
-			if (direct_chaining_possible(bi->pc, tpc)) {
+			if (!profiling && direct_chaining_possible(bi->pc, tpc)) {
 				use_direct_block_chaining = true;
 				bi->li[0].jmp_pc = tpc;
 			}
@@ -1568,10 +1893,24 @@ powerpc_cpu::compile_block(uint32 entry_point)
 		if (!use_direct_block_chaining) {
 			// TODO: optimize this to a direct jump to pregenerated code?
 			dg.gen_mov_ad_A0_im((uintptr)bi);
+#if PPC_ENABLE_JIT_TRACES
+			if (profiling) {
+				typedef void *(*func_t)(dyngen_cpu_base);
+				func_t func = (func_t)&powerpc_cpu::call_profile_block;
+				dg.gen_invoke_CPU_A0_ret_A0(func);
+				bi->trace_state = block_info::TRACE_PROFILE;
+				bi->ti.end_pc = dpc;
+			}
+#endif
 			dg.gen_jump_next_A0();
 		}
 		dg.gen_exec_return();
 	}
+#if PPC_ENABLE_JIT_TRACES
+	// Superblocks inherit the profile of their head
+	if (use_head_ti)
+		bi->ti = head_ti;
+#endif
 	bi->end_pc = dpc;
 	if (dpc < min_pc)
 		min_pc = dpc;
@@ -22,6 +22,7 @@
 
 #include <vector>
 #include <limits>
+#include <climits>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -30,6 +31,7 @@
 #include <signal.h>
 #include <ctype.h>
 #include <math.h>
+#include <time.h>
 
 #if defined(__powerpc__) || defined(__ppc__)
 #define NATIVE_POWERPC
@@ -709,6 +711,7 @@ public:
 	~powerpc_test_cpu();
 
 	bool test(void);
+	bool bench(void);
 
 	void set_results_file(FILE *fp)
 		{ results_file = fp; }
@@ -2178,6 +2181,54 @@ bool powerpc_test_cpu::test(void)
 	return errors == 0;
 }
 
+// Measure execution throughput of a loop made of common instructions
+bool powerpc_test_cpu::bench(void)
+{
+	const uint32 n_iterations = 20000000;
+	const uint32 n_loop_insns = 14;
+
+	static uint32 data[2];
+	data[0] = 0;
+	data[1] = htonl(0x5a000000);
+	assert((uintptr)data <= UINT_MAX);
+
+	static const uint32 code[] = {
+		POWERPC_MTSPR(3, 9),					// mtctr	r3
+		_D(32,8,4,0),							// lwz		r8,0(r4)
+		_D(14,8,8,1),							// addi		r8,r8,1
+		_D(36,8,4,0),							// stw		r8,0(r4)
+		_XO(31,5,5,8,0,266,0),					// add		r5,r5,r8
+		_M(21,5,9,3,0,28,0),					// rlwinm	r9,r5,3,0,28
+		_X(31,6,6,9,316,0),						// xor		r6,r6,r9
+		_D(34,10,4,4),							// lbz		r10,4(r4)
+		_X(31,10,11,7,444,0),					// or		r11,r10,r7
+		_XO(31,12,11,5,0,40,0),					// subf		r12,r11,r5
+		_X(31,12,12,2,824,0),					// srawi	r12,r12,2
+		_X(31,0,5,12,32,0),						// cmplw	r5,r12
+		_I((16<<26)|(4<<21)|(0<<16)|8),			// bge		1f
+		_D(14,7,7,1),							// addi		r7,r7,1
+		_I((16<<26)|(16<<21)|((-13*4)&0xfffc)),	// 1: bdnz	0b
+		POWERPC_BLR
+	};
+
+	set_gpr(3, n_iterations);
+	set_gpr(4, (uintptr)data);
+	set_gpr(5, 0);
+	set_gpr(6, 0);
+	set_gpr(7, 1);
+
+	clock_t start_time = clock();
+	execute((uint32 *)code);
+	clock_t end_time = clock();
+
+	const double secs = double(end_time - start_time) / CLOCKS_PER_SEC;
+	const double insns = double(n_iterations) * n_loop_insns;
+	printf("Executed %u iterations in %.3f s, %.1f MIPS (checksum %08x %08x)\n",
+		   n_iterations, secs, secs > 0 ? insns / secs / 1.0e6 : 0.0,
+		   get_gpr(6), get_gpr(7));
+	return get_gpr(5) != 0 && ntohl(data[0]) == n_iterations;
+}
+
 int main(int argc, char *argv[])
 {
 #ifdef EMU_KHEPERIX
@@ -2188,14 +2239,25 @@ int main(int argc, char *argv[])
 	FILE *fp = NULL;
 	powerpc_test_cpu *ppc = new powerpc_test_cpu;
 
-	if (argc > 1) {
+	bool run_bench = false;
+	while (argc > 1) {
 		const char *arg = argv[1];
-		if (strcmp(arg, "--jit") == 0) {
-			--argc;
-			argv[1] = argv[0];
-			++argv;
+		if (strcmp(arg, "--jit") == 0)
 			ppc->enable_jit();
-		}
+		else if (strcmp(arg, "--bench") == 0)
+			run_bench = true;
+		else
+			break;
+		--argc;
+		argv[1] = argv[0];
+		++argv;
+	}
+
+	// Benchmark mode does not need any results file
+	if (run_bench) {
+		bool ok = ppc->bench();
+		delete ppc;
+		return !ok;
 	}
 
 	if (argc > 1) {
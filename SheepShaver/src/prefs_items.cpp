@@ -48,6 +48,7 @@ prefs_desc common_prefs_items[] = {
 	{"ramsize", TYPE_INT32, false,      "size of Mac RAM in bytes"},
 	{"frameskip", TYPE_INT32, false,    "number of frames to skip in refreshed video modes"},
 	{"gfxaccel", TYPE_BOOLEAN, false,   "turn on QuickDraw acceleration"},
+	{"diskasync", TYPE_BOOLEAN, false,  "perform asynchronous disk I/O in a host thread"},
 	{"nocdrom", TYPE_BOOLEAN, false,    "don't install CD-ROM driver"},
 	{"nonet", TYPE_BOOLEAN, false,      "don't use Ethernet"},
 	{"nosound", TYPE_BOOLEAN, false,    "don't enable sound output"},
@@ -57,6 +58,8 @@ prefs_desc common_prefs_items[] = {
 	{"ignoreillegal", TYPE_BOOLEAN, false, "ignore illegal instructions"},
 	{"jit", TYPE_BOOLEAN, false,        "enable JIT compiler"},
 	{"jit68k", TYPE_BOOLEAN, false,     "enable 68k DR emulator"},
+	{"jittraces", TYPE_BOOLEAN, false,  "enable JIT trace formation"},
+	{"jitcache", TYPE_STRING, false,    "path of persistent JIT trace profiles, enables jittraces"},
 	{"keyboardtype", TYPE_INT32, false, "hardware keyboard type"},
 	{"hardcursor", TYPE_BOOLEAN, false, "hardware mouse cursor"},
 	{"hotkey", TYPE_INT32, false,       "hotkey modifier"},
@@ -72,6 +75,7 @@ prefs_desc common_prefs_items[] = {
 	{"redir", TYPE_STRING, true,		"port forwarding for slirp"},
 	{"title", TYPE_STRING, false,	"window title"},
 	{"sound_buffer", TYPE_INT32, false,	"sound buffer length"},
+	{"sound_blocks", TYPE_INT32, false,	"number of sound buffers queued ahead (SDL audio)"},
 	{"name_encoding", TYPE_INT32, false,	"file name encoding"},
 	{"init_grab", TYPE_BOOLEAN, false,	"initially grabbing mouse"},
 	{NULL, TYPE_END, false, NULL} // End of list
@@ -91,9 +95,11 @@ void AddPrefsDefaults(void)
 	PrefsAddInt32("ramsize", 16 * 1024 * 1024);
 	PrefsAddInt32("frameskip", 8);
 	PrefsAddBool("gfxaccel", true);
+	PrefsAddBool("diskasync", false);
 	PrefsAddBool("nocdrom", false);
 	PrefsAddBool("nonet", false);
 	PrefsAddBool("nosound", false);
+	PrefsAddInt32("sound_blocks", 2);
 	PrefsAddBool("nogui", false);
 	PrefsAddBool("noclipconversion", false);
 	PrefsAddBool("ignoresegv", true);
@@ -106,6 +112,7 @@ void AddPrefsDefaults(void)
 	PrefsAddBool("jit", false);
 #endif
 	PrefsAddBool("jit68k", false);
+	PrefsAddBool("jittraces", false);
 
 	PrefsAddInt32("keyboardtype", 5);
 